@@ -30,10 +30,13 @@
 typedef struct _ConsecutiveAckRecord
 {
   AckRecord super;
+  /* written before the acked flag is set */
+  AckType ack_type;
   gboolean acked;
 } ConsecutiveAckRecord;
 
 typedef struct _ConsecutiveAckRecordContainer ConsecutiveAckRecordContainer;
+typedef void (*ConsecutiveAckRecordFunc)(ConsecutiveAckRecord *ack_record, gpointer user_data);
 
 struct _ConsecutiveAckRecordContainer
 {
@@ -42,6 +45,7 @@ struct _ConsecutiveAckRecordContainer
   void (*store_pending)(ConsecutiveAckRecordContainer *s);
   void (*drop)(ConsecutiveAckRecordContainer *s, gsize n);
   ConsecutiveAckRecord *(*at)(const ConsecutiveAckRecordContainer *s, gsize idx);
+  void (*foreach)(const ConsecutiveAckRecordContainer *s, gsize n, ConsecutiveAckRecordFunc func, gpointer user_data);
   void (*free_fn)(ConsecutiveAckRecordContainer *s);
   gsize (*size)(const ConsecutiveAckRecordContainer *s);
   gsize (*get_continual_range_length)(const ConsecutiveAckRecordContainer *s);
@@ -93,6 +97,15 @@ consecutive_ack_record_container_at(const ConsecutiveAckRecordContainer *s, gsiz
   return s->at(s, idx);
 }
 
+/* calls @func for the first @n records, oldest first */
+static inline void
+consecutive_ack_record_container_foreach(const ConsecutiveAckRecordContainer *s, gsize n,
+                                         ConsecutiveAckRecordFunc func, gpointer user_data)
+{
+  g_assert(n <= consecutive_ack_record_container_size(s));
+  s->foreach(s, n, func, user_data);
+}
+
 static inline void
 consecutive_ack_record_container_free(ConsecutiveAckRecordContainer *s)
 {
@@ -113,6 +113,16 @@ _at(const ConsecutiveAckRecordContainer *s, gsize idx)
   return (ConsecutiveAckRecord *) g_list_nth(self->head, idx)->data;
 }
 
+static void
+_foreach(const ConsecutiveAckRecordContainer *s, gsize n, ConsecutiveAckRecordFunc func, gpointer user_data)
+{
+  DynamicConsecutiveAckRecordContainer *self = (DynamicConsecutiveAckRecordContainer *) s;
+  GList *it = self->head;
+
+  for (gsize i = 0; i < n; i++, it = it->next)
+    func((ConsecutiveAckRecord *) it->data, user_data);
+}
+
 static void
 _free(ConsecutiveAckRecordContainer *s)
 {
@@ -173,6 +183,7 @@ consecutive_ack_record_container_dynamic_new(void)
   self->super.store_pending = _store_pending;
   self->super.drop = _drop;
   self->super.at = _at;
+  self->super.foreach = _foreach;
   self->super.free_fn = _free;
   self->super.size = _size;
   self->super.get_continual_range_length = _get_continual_range_length;
@@ -89,6 +89,15 @@ _at(const ConsecutiveAckRecordContainer *s, gsize idx)
   return ring_buffer_element_at(&self->ack_records, idx);
 }
 
+static void
+_foreach(const ConsecutiveAckRecordContainer *s, gsize n, ConsecutiveAckRecordFunc func, gpointer user_data)
+{
+  StaticConsecutiveAckRecordContainer *self = (StaticConsecutiveAckRecordContainer *)s;
+
+  for (gsize i = 0; i < n; i++)
+    func((ConsecutiveAckRecord *) ring_buffer_element_at(&self->ack_records, i), user_data);
+}
+
 static void
 _free(ConsecutiveAckRecordContainer *s)
 {
@@ -114,7 +123,7 @@ _ack_range_is_continuous(void *data)
 {
   ConsecutiveAckRecord *ack_rec = (ConsecutiveAckRecord *)data;
 
-  return ack_rec->acked;
+  return g_atomic_int_get(&ack_rec->acked);
 }
 
 static gsize
@@ -135,6 +144,7 @@ consecutive_ack_record_container_static_new(gsize size)
   self->super.store_pending = _store_pending;
   self->super.drop = _drop;
   self->super.at = _at;
+  self->super.foreach = _foreach;
   self->super.free_fn = _free;
   self->super.size = _size;
   self->super.get_continual_range_length = _get_continual_range_length;
@@ -32,6 +32,14 @@ typedef struct _ConsecutiveAckTracker
   AckTracker super;
   ConsecutiveAckRecord *pending_ack_record;
   ConsecutiveAckRecordContainer *ack_records;
+
+  /* With a static window the records are kept in a RingBuffer, which is
+   * written by the source thread and released by the acking threads
+   * without the mutex.  Acks only set the flag of their record, the
+   * thread that wins the draining flag releases the acked range for
+   * everyone. */
+  gboolean lockless;
+  gint draining;
   GStaticMutex mutex;
   AckTrackerOnAllAcked on_all_acked;
   gboolean bookmark_saving_disabled;
@@ -99,6 +107,12 @@ consecutive_ack_tracker_track_msg(AckTracker *s, LogMessage *msg)
 
   log_pipe_ref((LogPipe *)source);
 
+  if (self->lockless)
+    {
+      _ack_records_track_msg(self, msg);
+      return;
+    }
+
   consecutive_ack_tracker_lock(s);
   {
     _ack_records_track_msg(self, msg);
@@ -109,7 +123,7 @@ consecutive_ack_tracker_track_msg(AckTracker *s, LogMessage *msg)
 static gboolean
 _is_bookmark_saving_enabled(ConsecutiveAckTracker *self)
 {
-  return self->bookmark_saving_disabled == FALSE;
+  return g_atomic_int_get(&self->bookmark_saving_disabled) == FALSE;
 }
 
 static void
@@ -120,20 +134,73 @@ _ack_record_save_bookmark(ConsecutiveAckRecord *ack_record)
   bookmark_save(bookmark);
 }
 
-static guint32
-_ack_records_untrack_msg(ConsecutiveAckTracker *self, LogMessage *msg, AckType ack_type)
+typedef struct _AckRangeTypes
+{
+  gboolean aborted;
+  gboolean suspended;
+} AckRangeTypes;
+
+static void
+_collect_ack_type(ConsecutiveAckRecord *ack_record, gpointer user_data)
+{
+  AckRangeTypes *types = (AckRangeTypes *) user_data;
+
+  types->aborted |= (ack_record->ack_type == AT_ABORTED);
+  types->suspended |= (ack_record->ack_type == AT_SUSPENDED);
+}
+
+/* The released range may contain records acked earlier by other acks
+ * (and in lockless mode by other threads), so the ack types are taken
+ * from the records: a single aborted record prevents saving the bookmark,
+ * a single suspended one keeps the source suspended. */
+static void
+_release_acked_records(ConsecutiveAckTracker *self)
 {
   guint32 ack_range_length = consecutive_ack_record_container_get_continual_range_length(self->ack_records);
-  if (ack_range_length > 0)
+  if (ack_range_length == 0)
+    return;
+
+  AckRangeTypes types = { FALSE, FALSE };
+  consecutive_ack_record_container_foreach(self->ack_records, ack_range_length, _collect_ack_type, &types);
+
+  if (!types.aborted && _is_bookmark_saving_enabled(self))
     {
-      if (ack_type != AT_ABORTED && _is_bookmark_saving_enabled(self))
-        {
-          _ack_record_save_bookmark(consecutive_ack_record_container_at(self->ack_records, ack_range_length - 1));
-        }
-      consecutive_ack_record_container_drop(self->ack_records, ack_range_length);
+      _ack_record_save_bookmark(consecutive_ack_record_container_at(self->ack_records, ack_range_length - 1));
     }
+  consecutive_ack_record_container_drop(self->ack_records, ack_range_length);
+
+  if (types.suspended)
+    log_source_flow_control_adjust_when_suspended(self->super.source, ack_range_length);
+  else
+    log_source_flow_control_adjust(self->super.source, ack_range_length);
 
-  return ack_range_length;
+  if (consecutive_ack_tracker_is_empty(&self->super))
+    consecutive_ack_tracker_on_all_acked_call(&self->super);
+}
+
+static gboolean
+_first_record_is_acked(ConsecutiveAckTracker *self)
+{
+  if (consecutive_ack_record_container_is_empty(self->ack_records))
+    return FALSE;
+
+  return g_atomic_int_get(&consecutive_ack_record_container_at(self->ack_records, 0)->acked);
+}
+
+static void
+_release_acked_records_lockless(ConsecutiveAckTracker *self)
+{
+  do
+    {
+      /* somebody else is releasing records, it will see our ack flag when
+       * it rechecks the first record after clearing the draining flag */
+      if (!g_atomic_int_compare_and_exchange(&self->draining, FALSE, TRUE))
+        return;
+
+      _release_acked_records(self);
+      g_atomic_int_set(&self->draining, FALSE);
+    }
+  while (_first_record_is_acked(self));
 }
 
 static void
@@ -141,26 +208,22 @@ consecutive_ack_tracker_manage_msg_ack(AckTracker *s, LogMessage *msg, AckType a
 {
   ConsecutiveAckTracker *self = (ConsecutiveAckTracker *)s;
   ConsecutiveAckRecord *ack_rec = (ConsecutiveAckRecord *)msg->ack_record;
-  ack_rec->acked = TRUE;
+  ack_rec->ack_type = ack_type;
+  g_atomic_int_set(&ack_rec->acked, TRUE);
 
   if (ack_type == AT_SUSPENDED)
     log_source_flow_control_suspend(self->super.source);
 
-  consecutive_ack_tracker_lock(s);
-  {
-    guint32 ack_range_length = _ack_records_untrack_msg(self, msg, ack_type);
-    if (ack_range_length > 0)
-      {
-        if (ack_type == AT_SUSPENDED)
-          log_source_flow_control_adjust_when_suspended(self->super.source, ack_range_length);
-        else
-          log_source_flow_control_adjust(self->super.source, ack_range_length);
-
-        if (consecutive_ack_tracker_is_empty(s))
-          consecutive_ack_tracker_on_all_acked_call(s);
-      }
-  }
-  consecutive_ack_tracker_unlock(s);
+  if (self->lockless)
+    {
+      _release_acked_records_lockless(self);
+    }
+  else
+    {
+      consecutive_ack_tracker_lock(s);
+      _release_acked_records(self);
+      consecutive_ack_tracker_unlock(s);
+    }
 
   log_msg_unref(msg);
   log_pipe_unref((LogPipe *)self->super.source);
@@ -179,12 +242,9 @@ consecutive_ack_tracker_request_bookmark(AckTracker *s)
 {
   ConsecutiveAckTracker *self = (ConsecutiveAckTracker *)s;
 
+  /* the pending record is only accessed by the source thread */
   if (!self->pending_ack_record)
-    {
-      consecutive_ack_tracker_lock(s);
-      self->pending_ack_record = consecutive_ack_record_container_request_pending(self->ack_records);
-      consecutive_ack_tracker_unlock(s);
-    }
+    self->pending_ack_record = consecutive_ack_record_container_request_pending(self->ack_records);
 
   if (self->pending_ack_record)
     {
@@ -221,11 +281,7 @@ consecutive_ack_tracker_disable_bookmark_saving(AckTracker *s)
 {
   ConsecutiveAckTracker *self = (ConsecutiveAckTracker *)s;
 
-  consecutive_ack_tracker_lock(s);
-  {
-    self->bookmark_saving_disabled = TRUE;
-  }
-  consecutive_ack_tracker_unlock(s);
+  g_atomic_int_set(&self->bookmark_saving_disabled, TRUE);
 }
 
 static void
@@ -240,11 +296,12 @@ _setup_callbacks(ConsecutiveAckTracker *self)
 
 static void
 consecutive_ack_tracker_init_instance(ConsecutiveAckTracker *self, LogSource *source,
-                                      ConsecutiveAckRecordContainer *ack_records)
+                                      ConsecutiveAckRecordContainer *ack_records, gboolean lockless)
 {
   self->super.source = source;
   source->ack_tracker = (AckTracker *)self;
   self->ack_records = ack_records;
+  self->lockless = lockless;
   g_static_mutex_init(&self->mutex);
   _setup_callbacks(self);
 }
@@ -264,7 +321,8 @@ consecutive_ack_tracker_new(LogSource *source)
   ConsecutiveAckTracker *self = g_new0(ConsecutiveAckTracker, 1);
   ConsecutiveAckRecordContainer *ack_records = _create_ack_record_container(source);
 
-  consecutive_ack_tracker_init_instance(self, source, ack_records);
+  /* the GList based dynamic container cannot be shared without the mutex */
+  consecutive_ack_tracker_init_instance(self, source, ack_records, !log_source_is_dynamic_window_enabled(source));
 
   return (AckTracker *)self;
 }
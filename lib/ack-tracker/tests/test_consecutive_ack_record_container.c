@@ -86,6 +86,26 @@ _assert_indexes(ConsecutiveAckRecordContainer *ack_records, gsize n, gsize idx_s
     }
 }
 
+static void
+_collect_idx(ConsecutiveAckRecord *rec, gpointer user_data)
+{
+  GArray *indexes = (GArray *) user_data;
+
+  g_array_append_val(indexes, _ack_record_extract_bookmark(rec)->idx);
+}
+
+static void
+_assert_foreach_indexes(ConsecutiveAckRecordContainer *ack_records, gsize n, gsize idx_shift)
+{
+  GArray *indexes = g_array_new(FALSE, FALSE, sizeof(gsize));
+
+  consecutive_ack_record_container_foreach(ack_records, n, _collect_idx, indexes);
+  cr_assert_eq(indexes->len, n);
+  for (gsize i = 0; i < n; i++)
+    cr_assert_eq(g_array_index(indexes, gsize, i), i + idx_shift);
+  g_array_free(indexes, TRUE);
+}
+
 Test(consecutive_ack_record_container_static, is_empty)
 {
   static const gsize capacity = 32;
@@ -209,6 +229,21 @@ Test(consecutive_ack_record_container_static, get_continual_range_length)
   consecutive_ack_record_container_free(ack_records);
 }
 
+Test(consecutive_ack_record_container_static, foreach_visits_the_oldest_records_first)
+{
+  static const gsize capacity = 32;
+  ConsecutiveAckRecordContainer *ack_records = consecutive_ack_record_container_static_new(capacity);
+  {
+    _fill_container(ack_records, capacity, 0);
+    _assert_foreach_indexes(ack_records, 10, 0);
+    // wrap around the end of the ring buffer
+    consecutive_ack_record_container_drop(ack_records, 16);
+    _fill_container(ack_records, 16, 32);
+    _assert_foreach_indexes(ack_records, capacity, 16);
+  }
+  consecutive_ack_record_container_free(ack_records);
+}
+
 Test(consecutive_ack_record_container_dynamic, is_empty)
 {
   ConsecutiveAckRecordContainer *ack_records = consecutive_ack_record_container_dynamic_new();
@@ -301,3 +336,14 @@ Test(consecutive_ack_record_container_dynamic, store_pending_after_drop_all)
   consecutive_ack_record_container_free(ack_records);
 }
 
+Test(consecutive_ack_record_container_dynamic, foreach_visits_the_oldest_records_first)
+{
+  ConsecutiveAckRecordContainer *ack_records = consecutive_ack_record_container_dynamic_new();
+  {
+    _fill_container(ack_records, 32, 0);
+    _assert_foreach_indexes(ack_records, 10, 0);
+    consecutive_ack_record_container_drop(ack_records, 16);
+    _assert_foreach_indexes(ack_records, 16, 16);
+  }
+  consecutive_ack_record_container_free(ack_records);
+}
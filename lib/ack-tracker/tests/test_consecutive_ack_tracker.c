@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+#include "ack-tracker/consecutive_ack_tracker.h"
+#include "ack-tracker/ack_tracker_factory.h"
+#include "logsource.h"
+#include "dynamic-window-pool.h"
+#include "apphook.h"
+
+#define ACKER_THREADS 4
+#define NUM_MESSAGES 100000
+
+GlobalConfig *cfg;
+
+typedef struct _TestBookmarkData
+{
+  gint id;
+  gint *last_saved_id;
+} TestBookmarkData;
+
+static void
+_save_bookmark(Bookmark *bookmark)
+{
+  TestBookmarkData *bookmark_data = (TestBookmarkData *) &bookmark->container;
+
+  /* saved from the acking threads, a bookmark older than the last saved one
+   * is recorded as -1 and checked by the test itself */
+  if (bookmark_data->id <= g_atomic_int_get(bookmark_data->last_saved_id))
+    g_atomic_int_set(bookmark_data->last_saved_id, -1);
+  else if (g_atomic_int_get(bookmark_data->last_saved_id) >= 0)
+    g_atomic_int_set(bookmark_data->last_saved_id, bookmark_data->id);
+}
+
+static void
+_fill_bookmark(Bookmark *bookmark, gint id, gint *last_saved_id)
+{
+  TestBookmarkData *bookmark_data = (TestBookmarkData *) &bookmark->container;
+
+  bookmark_data->id = id;
+  bookmark_data->last_saved_id = last_saved_id;
+  bookmark->save = _save_bookmark;
+}
+
+/* with a window pool the tracker uses the dynamic (locked) container */
+static LogSource *
+_init_log_source_with_window_pool(gint init_window_size, DynamicWindowPool *window_pool)
+{
+  LogSource *src = g_new0(LogSource, 1);
+  LogSourceOptions *options = g_new0(LogSourceOptions, 1);
+
+  log_source_options_defaults(options);
+  options->init_window_size = init_window_size;
+  log_source_init_instance(src, cfg);
+  log_source_options_init(options, cfg, "testgroup");
+  log_source_set_options(src, options, "test_stats_id", "test_stats_instance", TRUE, NULL);
+  log_source_set_ack_tracker_factory(src, consecutive_ack_tracker_factory_new());
+  if (window_pool)
+    log_source_enable_dynamic_window(src, window_pool);
+
+  cr_assert(log_pipe_init(&src->super));
+
+  return src;
+}
+
+static LogSource *
+_init_log_source(gint init_window_size)
+{
+  return _init_log_source_with_window_pool(init_window_size, NULL);
+}
+
+static DynamicWindowPool *
+_dynamic_window_pool_new(gsize pool_size)
+{
+  DynamicWindowPool *window_pool = dynamic_window_pool_new(pool_size);
+
+  window_pool->balanced_window = pool_size;
+  dynamic_window_pool_init(window_pool);
+  return window_pool;
+}
+
+static void
+_deinit_log_source(LogSource *src)
+{
+  log_pipe_deinit(&src->super);
+  g_free(src->options);
+  log_pipe_unref(&src->super);
+}
+
+static LogMessage *
+_track_msg(AckTracker *ack_tracker, gint id, gint *last_saved_id)
+{
+  Bookmark *bookmark = ack_tracker_request_bookmark(ack_tracker);
+
+  if (!bookmark)
+    return NULL;
+
+  _fill_bookmark(bookmark, id, last_saved_id);
+
+  LogMessage *msg = log_msg_new_empty();
+  ack_tracker_track_msg(ack_tracker, msg);
+  return msg;
+}
+
+static void
+_setup(void)
+{
+  cfg = cfg_new_snippet();
+  app_startup();
+}
+
+static void
+_teardown(void)
+{
+  app_shutdown();
+  cfg_free(cfg);
+}
+
+TestSuite(consecutive_ack_tracker, .init = _setup, .fini = _teardown);
+
+Test(consecutive_ack_tracker, bookmark_of_the_last_consecutively_acked_message_is_saved)
+{
+  LogSource *src = _init_log_source(10);
+  AckTracker *ack_tracker = src->ack_tracker;
+  gint last_saved_id = 0;
+
+  LogMessage *msg1 = _track_msg(ack_tracker, 1, &last_saved_id);
+  LogMessage *msg2 = _track_msg(ack_tracker, 2, &last_saved_id);
+  LogMessage *msg3 = _track_msg(ack_tracker, 3, &last_saved_id);
+
+  ack_tracker_manage_msg_ack(ack_tracker, msg2, AT_PROCESSED);
+  cr_expect_eq(last_saved_id, 0);
+
+  ack_tracker_manage_msg_ack(ack_tracker, msg1, AT_PROCESSED);
+  cr_expect_eq(last_saved_id, 2);
+  cr_expect_not(consecutive_ack_tracker_is_empty(ack_tracker));
+
+  ack_tracker_manage_msg_ack(ack_tracker, msg3, AT_PROCESSED);
+  cr_expect_eq(last_saved_id, 3);
+  cr_expect(consecutive_ack_tracker_is_empty(ack_tracker));
+
+  _deinit_log_source(src);
+}
+
+Test(consecutive_ack_tracker, request_bookmark_fails_when_the_window_is_full)
+{
+  LogSource *src = _init_log_source(2);
+  AckTracker *ack_tracker = src->ack_tracker;
+  gint last_saved_id = 0;
+
+  LogMessage *msg1 = _track_msg(ack_tracker, 1, &last_saved_id);
+  LogMessage *msg2 = _track_msg(ack_tracker, 2, &last_saved_id);
+  cr_assert_null(ack_tracker_request_bookmark(ack_tracker));
+
+  ack_tracker_manage_msg_ack(ack_tracker, msg1, AT_PROCESSED);
+  LogMessage *msg3 = _track_msg(ack_tracker, 3, &last_saved_id);
+  cr_assert_not_null(msg3);
+
+  ack_tracker_manage_msg_ack(ack_tracker, msg2, AT_PROCESSED);
+  ack_tracker_manage_msg_ack(ack_tracker, msg3, AT_PROCESSED);
+  cr_expect_eq(last_saved_id, 3);
+
+  _deinit_log_source(src);
+}
+
+static void
+_test_suspended_ack_keeps_the_source_suspended_when_released_by_another_ack(LogSource *src)
+{
+  AckTracker *ack_tracker = src->ack_tracker;
+  gint last_saved_id = 0;
+
+  LogMessage *msg1 = _track_msg(ack_tracker, 1, &last_saved_id);
+  LogMessage *msg2 = _track_msg(ack_tracker, 2, &last_saved_id);
+  LogMessage *msg3 = _track_msg(ack_tracker, 3, &last_saved_id);
+
+  ack_tracker_manage_msg_ack(ack_tracker, msg2, AT_SUSPENDED);
+  cr_expect(window_size_counter_suspended(&src->window_size));
+
+  /* releases the suspended record too */
+  ack_tracker_manage_msg_ack(ack_tracker, msg1, AT_PROCESSED);
+  cr_expect_eq(last_saved_id, 2);
+  cr_expect(window_size_counter_suspended(&src->window_size));
+
+  ack_tracker_manage_msg_ack(ack_tracker, msg3, AT_PROCESSED);
+  cr_expect_eq(last_saved_id, 3);
+  cr_expect_not(window_size_counter_suspended(&src->window_size));
+}
+
+static void
+_test_bookmark_is_not_saved_for_a_range_with_an_aborted_ack(LogSource *src)
+{
+  AckTracker *ack_tracker = src->ack_tracker;
+  gint last_saved_id = 0;
+
+  LogMessage *msg1 = _track_msg(ack_tracker, 1, &last_saved_id);
+  LogMessage *msg2 = _track_msg(ack_tracker, 2, &last_saved_id);
+
+  ack_tracker_manage_msg_ack(ack_tracker, msg2, AT_ABORTED);
+  ack_tracker_manage_msg_ack(ack_tracker, msg1, AT_PROCESSED);
+  cr_expect_eq(last_saved_id, 0);
+  cr_expect(consecutive_ack_tracker_is_empty(ack_tracker));
+
+  LogMessage *msg3 = _track_msg(ack_tracker, 3, &last_saved_id);
+  ack_tracker_manage_msg_ack(ack_tracker, msg3, AT_PROCESSED);
+  cr_expect_eq(last_saved_id, 3);
+}
+
+Test(consecutive_ack_tracker, suspended_ack_keeps_the_source_suspended_when_released_by_another_ack)
+{
+  LogSource *src = _init_log_source(10);
+
+  _test_suspended_ack_keeps_the_source_suspended_when_released_by_another_ack(src);
+  _deinit_log_source(src);
+}
+
+Test(consecutive_ack_tracker, suspended_ack_keeps_the_source_suspended_with_dynamic_window)
+{
+  DynamicWindowPool *window_pool = _dynamic_window_pool_new(100);
+  LogSource *src = _init_log_source_with_window_pool(10, window_pool);
+
+  cr_assert(log_source_is_dynamic_window_enabled(src));
+  _test_suspended_ack_keeps_the_source_suspended_when_released_by_another_ack(src);
+  _deinit_log_source(src);
+  dynamic_window_pool_unref(window_pool);
+}
+
+Test(consecutive_ack_tracker, bookmark_is_not_saved_for_a_range_with_an_aborted_ack)
+{
+  LogSource *src = _init_log_source(10);
+
+  _test_bookmark_is_not_saved_for_a_range_with_an_aborted_ack(src);
+  _deinit_log_source(src);
+}
+
+Test(consecutive_ack_tracker, bookmark_is_not_saved_for_a_range_with_an_aborted_ack_with_dynamic_window)
+{
+  DynamicWindowPool *window_pool = _dynamic_window_pool_new(100);
+  LogSource *src = _init_log_source_with_window_pool(10, window_pool);
+
+  cr_assert(log_source_is_dynamic_window_enabled(src));
+  _test_bookmark_is_not_saved_for_a_range_with_an_aborted_ack(src);
+  _deinit_log_source(src);
+  dynamic_window_pool_unref(window_pool);
+}
+
+static gpointer
+_ack_messages(gpointer user_data)
+{
+  GAsyncQueue *queue = (GAsyncQueue *) user_data;
+  LogMessage *msg;
+
+  while ((msg = g_async_queue_pop(queue)) != GINT_TO_POINTER(-1))
+    ack_tracker_manage_msg_ack(msg->ack_record->tracker, msg, AT_PROCESSED);
+
+  return NULL;
+}
+
+Test(consecutive_ack_tracker, acks_from_multiple_threads_save_bookmarks_in_order)
+{
+  LogSource *src = _init_log_source(1000);
+  AckTracker *ack_tracker = src->ack_tracker;
+  gint last_saved_id = 0;
+  GAsyncQueue *queues[ACKER_THREADS];
+  GThread *threads[ACKER_THREADS];
+
+  for (gint i = 0; i < ACKER_THREADS; i++)
+    {
+      queues[i] = g_async_queue_new();
+      threads[i] = g_thread_create(_ack_messages, queues[i], TRUE, NULL);
+    }
+
+  for (gint id = 1; id <= NUM_MESSAGES; id++)
+    {
+      LogMessage *msg;
+
+      while (!(msg = _track_msg(ack_tracker, id, &last_saved_id)))
+        g_thread_yield();
+
+      /* spread the messages, so that acks arrive out of order */
+      g_async_queue_push(queues[g_random_int_range(0, ACKER_THREADS)], msg);
+    }
+
+  for (gint i = 0; i < ACKER_THREADS; i++)
+    {
+      g_async_queue_push(queues[i], GINT_TO_POINTER(-1));
+      g_thread_join(threads[i]);
+      g_async_queue_unref(queues[i]);
+    }
+
+  cr_expect(consecutive_ack_tracker_is_empty(ack_tracker));
+  cr_expect_eq(last_saved_id, NUM_MESSAGES);
+
+  _deinit_log_source(src);
+}
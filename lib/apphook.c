@@ -26,6 +26,8 @@
 #include "messages.h"
 #include "children.h"
 #include "dnscache.h"
+#include "dns-resolver.h"
+#include "formatter-pool.h"
 #include "alarms.h"
 #include "stats/stats-registry.h"
 #include "logmsg/logmsg.h"
@@ -166,14 +168,15 @@ app_startup(void)
   iv_init();
   crypto_init();
   hostname_global_init();
-  dns_caching_global_init();
-  dns_caching_thread_init();
   afinter_global_init();
   child_manager_init();
   alarm_init();
   g_thread_init(NULL);
   main_loop_thread_resource_init();
   stats_init();
+  dns_caching_global_init();
+  dns_resolver_global_init();
+  formatter_pool_global_init();
   tzset();
   log_msg_global_init();
   log_tags_global_init();
@@ -214,6 +217,8 @@ app_shutdown(void)
 {
   msg_stats_deinit();
   run_application_hook(AH_SHUTDOWN);
+  /* formatter threads call app_thread_stop() when exiting */
+  formatter_pool_global_deinit();
   main_loop_thread_resource_deinit();
   secret_storage_deinit();
   scratch_buffers_allocator_deinit();
@@ -224,12 +229,12 @@ app_shutdown(void)
   log_msg_global_deinit();
 
   afinter_global_deinit();
+  dns_resolver_global_deinit();
+  dns_caching_global_deinit();
   stats_destroy();
   child_manager_deinit();
   g_list_foreach(application_hooks, (GFunc) g_free, NULL);
   g_list_free(application_hooks);
-  dns_caching_thread_deinit();
-  dns_caching_global_deinit();
   hostname_global_deinit();
   crypto_deinit();
   msg_deinit();
@@ -271,7 +276,6 @@ void
 app_thread_start(void)
 {
   scratch_buffers_allocator_init();
-  dns_caching_thread_init();
   main_loop_call_thread_init();
 }
 
@@ -279,6 +283,5 @@ void
 app_thread_stop(void)
 {
   main_loop_call_thread_deinit();
-  dns_caching_thread_deinit();
   scratch_buffers_allocator_deinit();
 }
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "cfg-fingerprint.h"
+#include "cfg-tree.h"
+
+#include <string.h>
+
+gchar *
+cfg_fingerprint_format_object_key(gint content, const gchar *name)
+{
+  return g_strdup_printf("%s:%s", log_expr_node_get_content_name(content), name);
+}
+
+const gchar *
+cfg_fingerprint_get_object_digest(CfgFingerprint *self, gint content, const gchar *name)
+{
+  gchar *key = cfg_fingerprint_format_object_key(content, name);
+  const gchar *digest = g_hash_table_lookup(self->objects, key);
+
+  g_free(key);
+  return digest;
+}
+
+static gboolean
+_named_objects_contained(CfgFingerprint *self, CfgFingerprint *other, const gchar *prefix)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init(&iter, self->objects);
+  while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+      if (!g_str_has_prefix(key, prefix))
+        continue;
+
+      const gchar *other_digest = g_hash_table_lookup(other->objects, key);
+      if (!other_digest || strcmp(other_digest, value) != 0)
+        return FALSE;
+    }
+  return TRUE;
+}
+
+/* whether the named objects of the @content type are the same in both */
+gboolean
+cfg_fingerprint_named_objects_equal(CfgFingerprint *self, CfgFingerprint *other, gint content)
+{
+  gchar *prefix = g_strdup_printf("%s:", log_expr_node_get_content_name(content));
+  gboolean result = _named_objects_contained(self, other, prefix) && _named_objects_contained(other, self, prefix);
+
+  g_free(prefix);
+  return result;
+}
+
+static gint
+_lookup_object_content(const gchar *keyword, gsize keyword_len)
+{
+  static const struct
+  {
+    const gchar *keyword;
+    gint content;
+  } object_keywords[] =
+  {
+    { "source", ENC_SOURCE },
+    { "destination", ENC_DESTINATION },
+    { "filter", ENC_FILTER },
+    { "parser", ENC_PARSER },
+    { "rewrite", ENC_REWRITE },
+  };
+
+  for (gsize i = 0; i < G_N_ELEMENTS(object_keywords); i++)
+    {
+      if (strlen(object_keywords[i].keyword) == keyword_len &&
+          strncmp(object_keywords[i].keyword, keyword, keyword_len) == 0)
+        return object_keywords[i].content;
+    }
+  return -1;
+}
+
+static gboolean
+_is_word_char(gchar c)
+{
+  return g_ascii_isalnum(c) || c == '_' || c == '-' || c == '.';
+}
+
+static gboolean
+_is_separator_char(gchar c)
+{
+  return strchr("{}();,", c) != NULL;
+}
+
+static gchar *
+_extract_object_name(const gchar *p)
+{
+  while (*p == ' ')
+    p++;
+
+  if (*p == '"' || *p == '\'')
+    {
+      const gchar *end = strchr(p + 1, *p);
+
+      return end ? g_strndup(p + 1, end - p - 1) : NULL;
+    }
+
+  const gchar *start = p;
+  while (_is_word_char(*p))
+    p++;
+  return p > start ? g_strndup(start, p - start) : NULL;
+}
+
+static void
+_add_statement(CfgFingerprint *self, const gchar *statement, GString *global)
+{
+  const gchar *p = statement;
+
+  while (_is_word_char(*p))
+    p++;
+
+  gsize keyword_len = p - statement;
+  gint content = _lookup_object_content(statement, keyword_len);
+
+  if (content >= 0)
+    {
+      gchar *name = _extract_object_name(p);
+
+      if (name)
+        {
+          g_hash_table_replace(self->objects, cfg_fingerprint_format_object_key(content, name),
+                               g_compute_checksum_for_string(G_CHECKSUM_SHA1, statement, -1));
+          g_free(name);
+          return;
+        }
+    }
+  else if (keyword_len == 3 && strncmp(statement, "log", 3) == 0)
+    {
+      g_ptr_array_add(self->log_paths, g_compute_checksum_for_string(G_CHECKSUM_SHA1, statement, -1));
+      return;
+    }
+  else if (keyword_len == 5 && strncmp(statement, "block", 5) == 0)
+    {
+      /* block definitions only matter where they are referenced, and
+       * those places contain the expanded block */
+      return;
+    }
+
+  g_string_append(global, statement);
+  g_string_append(global, ";\n");
+}
+
+static const gchar *
+_skip_to_eol(const gchar *p)
+{
+  while (*p && *p != '\n')
+    p++;
+  return p;
+}
+
+static const gchar *
+_copy_string_literal(GString *dst, const gchar *p)
+{
+  gchar quote = *p;
+
+  g_string_append_c(dst, *p++);
+  while (*p && *p != quote)
+    {
+      if (*p == '\\' && quote == '"' && *(p + 1))
+        g_string_append_c(dst, *p++);
+      g_string_append_c(dst, *p++);
+    }
+  if (*p)
+    g_string_append_c(dst, *p++);
+  return p;
+}
+
+/* split the configuration into top-level statements, collapsing
+ * whitespace and dropping comments on the way */
+static void
+_split_statements(CfgFingerprint *self, const gchar *config_text, GString *global)
+{
+  GString *statement = g_string_sized_new(1024);
+  const gchar *p = config_text;
+  gboolean pending_space = FALSE;
+  gint depth = 0;
+
+  while (*p)
+    {
+      if (*p == '#')
+        {
+          p = _skip_to_eol(p);
+          pending_space = TRUE;
+          continue;
+        }
+      if (g_ascii_isspace(*p))
+        {
+          pending_space = TRUE;
+          p++;
+          continue;
+        }
+      if (*p == '@' && depth == 0 && statement->len == 0)
+        {
+          /* pragma, up to the end of the line */
+          const gchar *eol = _skip_to_eol(p);
+
+          g_string_append_len(global, p, eol - p);
+          g_string_append_c(global, '\n');
+          p = eol;
+          continue;
+        }
+
+      if (pending_space && statement->len > 0 &&
+          !_is_separator_char(statement->str[statement->len - 1]) && !_is_separator_char(*p))
+        g_string_append_c(statement, ' ');
+      pending_space = FALSE;
+
+      if (*p == '"' || *p == '\'')
+        {
+          p = _copy_string_literal(statement, p);
+          continue;
+        }
+
+      if (*p == '{' || *p == '(')
+        {
+          depth++;
+        }
+      else if ((*p == '}' || *p == ')') && depth > 0)
+        {
+          depth--;
+        }
+      else if (*p == ';' && depth == 0)
+        {
+          if (statement->len > 0)
+            _add_statement(self, statement->str, global);
+          g_string_truncate(statement, 0);
+          p++;
+          continue;
+        }
+      g_string_append_c(statement, *p++);
+    }
+
+  if (statement->len > 0)
+    _add_statement(self, statement->str, global);
+  g_string_free(statement, TRUE);
+}
+
+CfgFingerprint *
+cfg_fingerprint_new(const gchar *config_text)
+{
+  CfgFingerprint *self = g_new0(CfgFingerprint, 1);
+  GString *global = g_string_sized_new(1024);
+
+  self->objects = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  self->log_paths = g_ptr_array_new_with_free_func(g_free);
+
+  _split_statements(self, config_text, global);
+  self->global_digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, global->str, global->len);
+
+  g_string_free(global, TRUE);
+  return self;
+}
+
+void
+cfg_fingerprint_free(CfgFingerprint *self)
+{
+  g_free(self->global_digest);
+  g_hash_table_destroy(self->objects);
+  g_ptr_array_free(self->log_paths, TRUE);
+  g_free(self);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef CFG_FINGERPRINT_H_INCLUDED
+#define CFG_FINGERPRINT_H_INCLUDED
+
+#include "syslog-ng.h"
+
+/*
+ * Digests of the top-level statements of a preprocessed configuration
+ * (see GlobalConfig->preprocess_config), used to find out which parts of
+ * the configuration changed during a reload.  Whitespace and comments
+ * are not significant.
+ */
+typedef struct _CfgFingerprint
+{
+  /* everything that is neither a log path nor a named object: pragmas,
+   * global options, templates, module specific global blocks */
+  gchar *global_digest;
+  /* "<content>:<name>" -> digest of named source, destination, filter,
+   * parser and rewrite objects */
+  GHashTable *objects;
+  /* digests of the top-level log paths, in the order of appearance */
+  GPtrArray *log_paths;
+} CfgFingerprint;
+
+gchar *cfg_fingerprint_format_object_key(gint content, const gchar *name);
+const gchar *cfg_fingerprint_get_object_digest(CfgFingerprint *self, gint content, const gchar *name);
+gboolean cfg_fingerprint_named_objects_equal(CfgFingerprint *self, CfgFingerprint *other, gint content);
+
+CfgFingerprint *cfg_fingerprint_new(const gchar *config_text);
+void cfg_fingerprint_free(CfgFingerprint *self);
+
+#endif
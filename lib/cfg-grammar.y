@@ -182,6 +182,7 @@
 %token KW_TYPE                        10083
 %token KW_STATS_MAX_DYNAMIC           10084
 %token KW_MIN_IW_SIZE_PER_READER      10085
+%token KW_MIRRORED_BUFFER             10086
 %token KW_BATCH_LINES                 10087
 %token KW_BATCH_TIMEOUT               10088
 %token KW_TRIM_LARGE_MESSAGES         10089
@@ -204,6 +205,8 @@
 %token KW_DNS_CACHE_EXPIRE            10130
 %token KW_DNS_CACHE_EXPIRE_FAILED     10131
 %token KW_DNS_CACHE_HOSTS             10132
+%token KW_DNS_RESOLVER_THREADS        10133
+%token KW_DNS_RESOLVE_TIMEOUT         10134
 
 %token KW_PERSIST_ONLY                10140
 %token KW_USE_RCPTID                  10141
@@ -222,6 +225,8 @@
 
 %token KW_THROTTLE                    10170
 %token KW_THREADED                    10171
+%token KW_INCREMENTAL_RELOAD          10172
+%token KW_IO_URING                    10173
 %token KW_PASS_UNIX_CREDENTIALS       10231
 
 %token KW_PERSIST_NAME                10302
@@ -239,9 +244,12 @@
 %token KW_SEND_TIME_ZONE              10203
 %token KW_LOCAL_TIME_ZONE             10204
 %token KW_FORMAT                      10205
+%token KW_PARSE_THREADS               10208
+%token KW_PARSE_ORDERED               10209
 
 /* destination writer options */
 %token KW_TRUNCATE_SIZE               10206
+%token KW_FORMAT_THREADS              10207
 
 /* timers */
 %token KW_TIME_REOPEN                 10210
@@ -925,6 +933,8 @@ options_item
 	| KW_TIME_SLEEP '(' nonnegative_integer ')'	{}
 	| KW_SUPPRESS '(' nonnegative_integer ')'		{ configuration->suppress = $3; }
 	| KW_THREADED '(' yesno ')'		{ configuration->threaded = $3; }
+	| KW_INCREMENTAL_RELOAD '(' yesno ')'	{ configuration->incremental_reload = $3; }
+	| KW_IO_URING '(' yesno ')'		{ configuration->use_io_uring = $3; }
 	| KW_PASS_UNIX_CREDENTIALS '(' yesno ')' { configuration->pass_unix_credentials = $3; }
 	| KW_USE_RCPTID '(' yesno ')'		{ cfg_set_use_uniqid($3); }
 	| KW_USE_UNIQID '(' yesno ')'		{ cfg_set_use_uniqid($3); }
@@ -971,6 +981,10 @@ dns_cache_option
 	| KW_DNS_CACHE_EXPIRE_FAILED '(' positive_integer ')'
 	                                        { last_dns_cache_options->expire_failed = $3; }
 	| KW_DNS_CACHE_HOSTS '(' string ')'     { last_dns_cache_options->hosts = g_strdup($3); free($3); }
+	| KW_DNS_RESOLVER_THREADS '(' nonnegative_integer ')'
+	                                        { configuration->dns_resolver_options.threads = $3; }
+	| KW_DNS_RESOLVE_TIMEOUT '(' nonnegative_integer ')'
+	                                        { configuration->dns_resolver_options.timeout = $3; }
         ;
 
 
@@ -1252,6 +1266,8 @@ source_reader_option
 	: KW_CHECK_HOSTNAME '(' yesno ')'	{ last_reader_options->check_hostname = $3; }
 	| KW_FLAGS '(' source_reader_option_flags ')'
 	| KW_LOG_FETCH_LIMIT '(' positive_integer ')'	{ last_reader_options->fetch_limit = $3; }
+	| KW_PARSE_THREADS '(' nonnegative_integer ')'	{ last_reader_options->parse_threads = $3; }
+	| KW_PARSE_ORDERED '(' yesno ')'	{ last_reader_options->parse_ordered = $3; }
         | KW_FORMAT '(' string ')'              { last_reader_options->parse_options.format = g_strdup($3); free($3); }
         | { last_source_options = &last_reader_options->super; } source_option
         | { last_proto_server_options = &last_reader_options->proto_options.super; } source_proto_option
@@ -1275,6 +1291,7 @@ source_proto_option
           }
         | KW_LOG_MSG_SIZE '(' positive_integer ')'      { last_proto_server_options->max_msg_size = $3; }
         | KW_TRIM_LARGE_MESSAGES '(' yesno ')'          { last_proto_server_options->trim_large_messages = $3; }
+        | KW_MIRRORED_BUFFER '(' yesno ')'              { last_proto_server_options->mirrored_buffer = $3; }
         ;
 
 host_resolve_option
@@ -1322,6 +1339,7 @@ dest_writer_option
 	| KW_TEMPLATE_ESCAPE '(' yesno ')'	{ log_writer_options_set_template_escape(last_writer_options, $3); }
 	| KW_PAD_SIZE '(' nonnegative_integer ')'         { last_writer_options->padding = $3; }
 	| KW_TRUNCATE_SIZE '(' nonnegative_integer ')'         { last_writer_options->truncate_size = $3; }
+	| KW_FORMAT_THREADS '(' nonnegative_integer ')'        { last_writer_options->format_threads = $3; }
 	| KW_MARK_FREQ '(' nonnegative_integer ')'        { last_writer_options->mark_freq = $3; }
         | KW_MARK_MODE '(' KW_INTERNAL ')'      { log_writer_options_set_mark_mode(last_writer_options, "internal"); }
 	| KW_MARK_MODE '(' string ')'
@@ -84,6 +84,7 @@ static CfgLexerKeyword main_keywords[] =
   { "flags",              KW_FLAGS },
   { "pad_size",           KW_PAD_SIZE },
   { "truncate_size",      KW_TRUNCATE_SIZE },
+  { "format_threads",     KW_FORMAT_THREADS },
   { "mark_freq",          KW_MARK_FREQ },
   { "mark",               KW_MARK_FREQ, KWS_OBSOLETE, "mark_freq" },
   { "mark_mode",          KW_MARK_MODE },
@@ -127,14 +128,19 @@ static CfgLexerKeyword main_keywords[] =
   { "default_severity",   KW_DEFAULT_SEVERITY },
   { "default_facility",   KW_DEFAULT_FACILITY },
   { "threaded",           KW_THREADED },
+  { "incremental_reload", KW_INCREMENTAL_RELOAD },
+  { "io_uring",           KW_IO_URING },
   { "use_rcptid",         KW_USE_RCPTID, KWS_OBSOLETE, "This has been deprecated, try use_uniqid() instead" },
   { "use_uniqid",         KW_USE_UNIQID },
 
   { "log_fifo_size",      KW_LOG_FIFO_SIZE },
   { "log_fetch_limit",    KW_LOG_FETCH_LIMIT },
+  { "parse_threads",      KW_PARSE_THREADS },
+  { "parse_ordered",      KW_PARSE_ORDERED },
   { "log_iw_size",        KW_LOG_IW_SIZE },
   { "log_msg_size",       KW_LOG_MSG_SIZE },
   { "trim_large_messages", KW_TRIM_LARGE_MESSAGES },
+  { "mirrored_buffer",    KW_MIRRORED_BUFFER },
   { "log_prefix",         KW_LOG_PREFIX, KWS_OBSOLETE, "program_override" },
   { "program_override",   KW_PROGRAM_OVERRIDE },
   { "host_override",      KW_HOST_OVERRIDE },
@@ -159,6 +165,8 @@ static CfgLexerKeyword main_keywords[] =
   { "dns_cache_size",     KW_DNS_CACHE_SIZE },
   { "dns_cache_expire",   KW_DNS_CACHE_EXPIRE },
   { "dns_cache_expire_failed", KW_DNS_CACHE_EXPIRE_FAILED },
+  { "dns_resolver_threads", KW_DNS_RESOLVER_THREADS },
+  { "dns_resolve_timeout", KW_DNS_RESOLVE_TIMEOUT },
   { "pass_unix_credentials",   KW_PASS_UNIX_CREDENTIALS },
   { "persist_name",            KW_PERSIST_NAME, VERSION_VALUE_3_8 },
 
@@ -1363,6 +1363,422 @@ cfg_tree_compile(CfgTree *self)
   return TRUE;
 }
 
+CfgTreeComponent *
+cfg_tree_component_ref(CfgTreeComponent *self)
+{
+  self->ref_cnt++;
+  return self;
+}
+
+void
+cfg_tree_component_unref(CfgTreeComponent *self)
+{
+  g_assert(self->ref_cnt > 0);
+
+  if (--self->ref_cnt == 0)
+    {
+      g_free(self->digest);
+      g_ptr_array_free(self->rules, TRUE);
+      g_ptr_array_free(self->pipes, TRUE);
+      g_string_free(self->objects, TRUE);
+      g_free(self);
+    }
+}
+
+static CfgTreeComponent *
+cfg_tree_component_new(void)
+{
+  CfgTreeComponent *self = g_new0(CfgTreeComponent, 1);
+
+  self->ref_cnt = 1;
+  self->rules = g_ptr_array_new_with_free_func((GDestroyNotify) log_expr_node_unref);
+  self->pipes = g_ptr_array_new_with_free_func((GDestroyNotify) log_pipe_unref);
+  self->objects = g_string_sized_new(64);
+  return self;
+}
+
+typedef void (*CfgTreeNodeFunc)(LogExprNode *node, gpointer user_data);
+
+/*
+ * Visit @node and its subtree, following references into the named
+ * objects.  Named objects are only visited once, they are collected in
+ * @visited_objects.
+ */
+static gboolean
+cfg_tree_walk_node(CfgTree *self, LogExprNode *node, GHashTable *visited_objects,
+                   CfgTreeNodeFunc func, gpointer user_data)
+{
+  if (func)
+    func(node, user_data);
+
+  if (node->layout == ENL_REFERENCE)
+    {
+      LogExprNode *referenced_node = node->object ? node->object : cfg_tree_get_object(self, node->content, node->name);
+
+      if (!referenced_node)
+        return FALSE;
+      if (g_hash_table_contains(visited_objects, referenced_node))
+        return TRUE;
+
+      g_hash_table_insert(visited_objects, referenced_node, referenced_node);
+      return cfg_tree_walk_node(self, referenced_node, visited_objects, func, user_data);
+    }
+
+  for (LogExprNode *child = node->children; child; child = child->next)
+    {
+      if (!cfg_tree_walk_node(self, child, visited_objects, func, user_data))
+        return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+cfg_tree_walk_rule(CfgTree *self, LogExprNode *rule, GHashTable *visited_objects,
+                   CfgTreeNodeFunc func, gpointer user_data)
+{
+  if (!cfg_tree_walk_node(self, rule, visited_objects, func, user_data))
+    return FALSE;
+
+  if ((rule->flags & LC_CATCHALL) == 0)
+    return TRUE;
+
+  /* not compiled yet, the catch-all rule implicitly references all sources */
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init(&iter, self->objects);
+  while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+      LogExprNode *object = (LogExprNode *) key;
+
+      if (object->content != ENC_SOURCE || g_hash_table_contains(visited_objects, object))
+        continue;
+
+      g_hash_table_insert(visited_objects, object, object);
+      if (!cfg_tree_walk_node(self, object, visited_objects, func, user_data))
+        return FALSE;
+    }
+  return TRUE;
+}
+
+static gint
+_find_component_root(gint *parents, gint i)
+{
+  while (parents[i] != i)
+    {
+      parents[i] = parents[parents[i]];
+      i = parents[i];
+    }
+  return i;
+}
+
+static void
+_merge_components(gint *parents, gint a, gint b)
+{
+  a = _find_component_root(parents, a);
+  b = _find_component_root(parents, b);
+
+  parents[MAX(a, b)] = MIN(a, b);
+}
+
+static gint
+_compare_strings(gconstpointer a, gconstpointer b)
+{
+  return strcmp(*(const gchar **) a, *(const gchar **) b);
+}
+
+static gboolean
+cfg_tree_component_calculate_digest(CfgTreeComponent *self, GHashTable *objects, CfgFingerprint *fingerprint,
+                                    GPtrArray *rule_digests)
+{
+  GPtrArray *object_members = g_ptr_array_new_with_free_func(g_free);
+  GString *members = g_string_sized_new(1024);
+  gboolean success = TRUE;
+  GHashTableIter iter;
+  gpointer key;
+
+  /* log paths are order dependent (e.g. flags(final)), objects are not */
+  for (gint i = 0; i < rule_digests->len; i++)
+    g_string_append_printf(members, "log:%s\n", (const gchar *) g_ptr_array_index(rule_digests, i));
+
+  g_hash_table_iter_init(&iter, objects);
+  while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+      LogExprNode *object = (LogExprNode *) key;
+      const gchar *digest = cfg_fingerprint_get_object_digest(fingerprint, object->content, object->name);
+
+      if (!digest)
+        {
+          success = FALSE;
+          goto exit;
+        }
+      g_ptr_array_add(object_members, g_strdup_printf("%s:%s:%s", log_expr_node_get_content_name(object->content),
+                                                      object->name, digest));
+    }
+  g_ptr_array_sort(object_members, _compare_strings);
+
+  for (gint i = 0; i < object_members->len; i++)
+    {
+      const gchar *member = g_ptr_array_index(object_members, i);
+
+      g_string_append_printf(members, "%s\n", member);
+      if (self->objects->len > 0)
+        g_string_append(self->objects, ", ");
+      /* drop the digest from the human readable form */
+      g_string_append_len(self->objects, member, strrchr(member, ':') - member);
+    }
+  self->digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, members->str, members->len);
+
+exit:
+  g_string_free(members, TRUE);
+  g_ptr_array_free(object_members, TRUE);
+  return success;
+}
+
+/*
+ * Split the (not yet compiled or fully started) tree into independent
+ * components: top-level rules are in the same component if they
+ * reference the same named objects.  The digests of the components come
+ * from the fingerprint of the configuration the tree was parsed from.
+ */
+gboolean
+cfg_tree_split_components(CfgTree *self, CfgFingerprint *fingerprint)
+{
+  gint num_rules = self->rules->len;
+  gint *parents = g_new(gint, num_rules);
+  GHashTable **rule_objects = g_new0(GHashTable *, num_rules);
+  GHashTable *object_owners = g_hash_table_new(g_direct_hash, g_direct_equal);
+  gboolean success = FALSE;
+
+  g_assert(self->components == NULL);
+
+  if (fingerprint->log_paths->len != num_rules)
+    goto exit;
+
+  for (gint i = 0; i < num_rules; i++)
+    {
+      LogExprNode *rule = g_ptr_array_index(self->rules, i);
+      GHashTableIter iter;
+      gpointer object;
+
+      parents[i] = i;
+      rule_objects[i] = g_hash_table_new(g_direct_hash, g_direct_equal);
+      if (!cfg_tree_walk_rule(self, rule, rule_objects[i], NULL, NULL))
+        goto exit;
+
+      g_hash_table_iter_init(&iter, rule_objects[i]);
+      while (g_hash_table_iter_next(&iter, &object, NULL))
+        {
+          gpointer owner;
+
+          if (g_hash_table_lookup_extended(object_owners, object, NULL, &owner))
+            _merge_components(parents, i, GPOINTER_TO_INT(owner));
+          else
+            g_hash_table_insert(object_owners, object, GINT_TO_POINTER(i));
+        }
+    }
+
+  self->components = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                           (GDestroyNotify) cfg_tree_component_unref);
+  success = TRUE;
+  for (gint root = 0; root < num_rules && success; root++)
+    {
+      if (_find_component_root(parents, root) != root)
+        continue;
+
+      CfgTreeComponent *component = cfg_tree_component_new();
+      GHashTable *objects = g_hash_table_new(g_direct_hash, g_direct_equal);
+      GPtrArray *rule_digests = g_ptr_array_new();
+
+      for (gint i = root; i < num_rules; i++)
+        {
+          if (_find_component_root(parents, i) != root)
+            continue;
+
+          GHashTableIter iter;
+          gpointer object;
+
+          g_ptr_array_add(component->rules, log_expr_node_ref(g_ptr_array_index(self->rules, i)));
+          g_ptr_array_add(rule_digests, g_ptr_array_index(fingerprint->log_paths, i));
+          g_hash_table_iter_init(&iter, rule_objects[i]);
+          while (g_hash_table_iter_next(&iter, &object, NULL))
+            g_hash_table_insert(objects, object, object);
+        }
+
+      success = cfg_tree_component_calculate_digest(component, objects, fingerprint, rule_digests) &&
+                !g_hash_table_contains(self->components, component->digest);
+      if (success)
+        g_hash_table_insert(self->components, component->digest, component);
+      else
+        cfg_tree_component_unref(component);
+
+      g_ptr_array_free(rule_digests, TRUE);
+      g_hash_table_destroy(objects);
+    }
+
+  if (!success)
+    {
+      g_hash_table_destroy(self->components);
+      self->components = NULL;
+    }
+
+exit:
+  for (gint i = 0; i < num_rules; i++)
+    {
+      if (rule_objects[i])
+        g_hash_table_destroy(rule_objects[i]);
+    }
+  g_free(rule_objects);
+  g_free(parents);
+  g_hash_table_destroy(object_owners);
+  return success;
+}
+
+static void
+_map_node_to_component(LogExprNode *node, gpointer user_data)
+{
+  gpointer *args = (gpointer *) user_data;
+  GHashTable *node_components = args[0];
+
+  g_hash_table_insert(node_components, node, args[1]);
+}
+
+/*
+ * Once the tree is started, collect the pipes of the components that were
+ * compiled by this tree.  If a pipe can not be attributed to a component,
+ * the components are dropped, so the next reload restarts everything.
+ */
+gboolean
+cfg_tree_assign_pipes_to_components(CfgTree *self)
+{
+  GHashTable *node_components = g_hash_table_new(g_direct_hash, g_direct_equal);
+  gboolean success = TRUE;
+  GHashTableIter iter;
+  gpointer value;
+
+  if (!self->components)
+    return FALSE;
+
+  g_hash_table_iter_init(&iter, self->components);
+  while (g_hash_table_iter_next(&iter, NULL, &value) && success)
+    {
+      CfgTreeComponent *component = (CfgTreeComponent *) value;
+      GHashTable *visited_objects;
+
+      /* adopted components come with their pipes */
+      if (component->pipes->len > 0)
+        continue;
+
+      gpointer args[] = { node_components, component };
+      visited_objects = g_hash_table_new(g_direct_hash, g_direct_equal);
+      for (gint i = 0; i < component->rules->len && success; i++)
+        success = cfg_tree_walk_rule(self, g_ptr_array_index(component->rules, i), visited_objects,
+                                     _map_node_to_component, args);
+      g_hash_table_destroy(visited_objects);
+    }
+
+  for (gint i = 0; i < self->initialized_pipes->len && success; i++)
+    {
+      LogPipe *pipe = g_ptr_array_index(self->initialized_pipes, i);
+
+      if (g_hash_table_contains(self->adopted_pipes, pipe))
+        continue;
+
+      CfgTreeComponent *component = pipe->expr_node ? g_hash_table_lookup(node_components, pipe->expr_node) : NULL;
+      if (!component)
+        {
+          success = FALSE;
+          break;
+        }
+      g_ptr_array_add(component->pipes, log_pipe_ref(pipe));
+    }
+
+  if (!success)
+    {
+      g_hash_table_destroy(self->components);
+      self->components = NULL;
+    }
+
+  g_hash_table_destroy(node_components);
+  return success;
+}
+
+/*
+ * Replace the freshly parsed version of @component with the running one
+ * from @previous: its rules are not compiled by this tree, its pipes are
+ * taken over as they are, and @previous will not stop them.
+ */
+void
+cfg_tree_adopt_component(CfgTree *self, CfgTree *previous, CfgTreeComponent *component)
+{
+  CfgTreeComponent *own_component = g_hash_table_lookup(self->components, component->digest);
+
+  g_assert(own_component);
+
+  for (gint i = 0; i < own_component->rules->len; i++)
+    {
+      LogExprNode *rule = g_ptr_array_index(own_component->rules, i);
+
+      if (g_ptr_array_remove(self->rules, rule))
+        log_expr_node_unref(rule);
+    }
+
+  for (gint i = 0; i < component->pipes->len; i++)
+    {
+      LogPipe *pipe = g_ptr_array_index(component->pipes, i);
+
+      g_ptr_array_add(self->initialized_pipes, log_pipe_ref(pipe));
+      g_hash_table_insert(self->adopted_pipes, pipe, pipe);
+      g_hash_table_insert(previous->preserved_pipes, pipe, pipe);
+    }
+
+  g_hash_table_replace(self->components, component->digest, cfg_tree_component_ref(component));
+}
+
+/* the new configuration failed to start, give back the adopted pipes */
+void
+cfg_tree_release_adopted_pipes(CfgTree *self)
+{
+  for (gint i = self->initialized_pipes->len - 1; i >= 0; i--)
+    {
+      LogPipe *pipe = g_ptr_array_index(self->initialized_pipes, i);
+
+      if (g_hash_table_remove(self->adopted_pipes, pipe))
+        {
+          g_ptr_array_remove_index(self->initialized_pipes, i);
+          log_pipe_unref(pipe);
+        }
+    }
+}
+
+/* the preserved pipes are still running when reverting to this tree */
+void
+cfg_tree_restore_preserved_pipes(CfgTree *self)
+{
+  GHashTableIter iter;
+  gpointer pipe;
+
+  g_hash_table_iter_init(&iter, self->preserved_pipes);
+  while (g_hash_table_iter_next(&iter, &pipe, NULL))
+    g_hash_table_insert(self->adopted_pipes, pipe, pipe);
+  g_hash_table_remove_all(self->preserved_pipes);
+}
+
+gboolean
+cfg_tree_has_adopted_pipes_of(CfgTree *self, GlobalConfig *cfg)
+{
+  GHashTableIter iter;
+  gpointer pipe;
+
+  g_hash_table_iter_init(&iter, self->adopted_pipes);
+  while (g_hash_table_iter_next(&iter, &pipe, NULL))
+    {
+      if (((LogPipe *) pipe)->cfg == cfg)
+        return TRUE;
+    }
+  return FALSE;
+}
+
 static gboolean
 _verify_unique_persist_names_among_pipes(const GPtrArray *initialized_pipes)
 {
@@ -1436,7 +1852,12 @@ cfg_tree_stop(CfgTree *self)
 
   for (i = 0; i < self->initialized_pipes->len; i++)
     {
-      if (!log_pipe_deinit(g_ptr_array_index(self->initialized_pipes, i)))
+      LogPipe *pipe = g_ptr_array_index(self->initialized_pipes, i);
+
+      if (g_hash_table_contains(self->preserved_pipes, pipe))
+        continue;
+
+      if (!log_pipe_deinit(pipe))
         success = FALSE;
     }
 
@@ -1452,6 +1873,10 @@ cfg_tree_on_inited(CfgTree *self)
     {
       LogPipe *pipe = g_ptr_array_index(self->initialized_pipes, i);
 
+      /* adopted pipes have been running for a while */
+      if (g_hash_table_contains(self->adopted_pipes, pipe))
+        continue;
+
       if (!log_pipe_on_config_inited(pipe))
         {
           msg_error("Error executing on_config_inited hook",
@@ -1473,6 +1898,8 @@ cfg_tree_init_instance(CfgTree *self, GlobalConfig *cfg)
                                         (GDestroyNotify) log_expr_node_unref);
   self->templates = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) log_template_unref);
   self->rules = g_ptr_array_new();
+  self->adopted_pipes = g_hash_table_new(g_direct_hash, g_direct_equal);
+  self->preserved_pipes = g_hash_table_new(g_direct_hash, g_direct_equal);
   self->cfg = cfg;
 }
 
@@ -1487,5 +1914,9 @@ cfg_tree_free_instance(CfgTree *self)
 
   g_hash_table_destroy(self->objects);
   g_hash_table_destroy(self->templates);
+  if (self->components)
+    g_hash_table_destroy(self->components);
+  g_hash_table_destroy(self->adopted_pipes);
+  g_hash_table_destroy(self->preserved_pipes);
   self->cfg = NULL;
 }
@@ -28,6 +28,7 @@
 #include "syslog-ng.h"
 #include "template/templates.h"
 #include "cfg-lexer.h"
+#include "cfg-fingerprint.h"
 #include "messages.h"
 #include "atomic.h"
 
@@ -157,6 +158,28 @@ LogExprNode *log_expr_node_new_conditional_with_filter(LogExprNode *filter_pipe,
                                                        CFG_LTYPE *yylloc);
 LogExprNode *log_expr_node_new_conditional_with_block(LogExprNode *block, CFG_LTYPE *yylloc);
 
+/*
+ * A connected part of the pipeline: a set of top-level log paths that
+ * share sources or destinations, along with the named objects they
+ * reference.  Components are independent of each other, so an unchanged
+ * component can be kept running when the configuration is reloaded.
+ */
+typedef struct _CfgTreeComponent
+{
+  gint ref_cnt;
+  /* digest of the log paths and the named objects in the component */
+  gchar *digest;
+  /* the top-level rules belonging to the component */
+  GPtrArray *rules;
+  /* the pipes the component was compiled into, once the tree is started */
+  GPtrArray *pipes;
+  /* human readable list of the named objects, for logging */
+  GString *objects;
+} CfgTreeComponent;
+
+CfgTreeComponent *cfg_tree_component_ref(CfgTreeComponent *self);
+void cfg_tree_component_unref(CfgTreeComponent *self);
+
 typedef struct _CfgTree
 {
   GlobalConfig *cfg;
@@ -168,6 +191,13 @@ typedef struct _CfgTree
   GPtrArray *rules;
   GHashTable *templates;
   gboolean compiled;
+
+  /* digest -> CfgTreeComponent, NULL if the tree can not be split up */
+  GHashTable *components;
+  /* pipes taken over, already running, from the previous configuration */
+  GHashTable *adopted_pipes;
+  /* pipes left running for the next configuration, not stopped by cfg_tree_stop() */
+  GHashTable *preserved_pipes;
 } CfgTree;
 
 gboolean cfg_tree_add_object(CfgTree *self, LogExprNode *rule);
@@ -181,6 +211,13 @@ LogTemplate *cfg_tree_check_inline_template(CfgTree *self, const gchar *template
 gchar *cfg_tree_get_rule_name(CfgTree *self, gint content, LogExprNode *node);
 gchar *cfg_tree_get_child_id(CfgTree *self, gint content, LogExprNode *node);
 
+gboolean cfg_tree_split_components(CfgTree *self, CfgFingerprint *fingerprint);
+gboolean cfg_tree_assign_pipes_to_components(CfgTree *self);
+void cfg_tree_adopt_component(CfgTree *self, CfgTree *previous, CfgTreeComponent *component);
+void cfg_tree_release_adopted_pipes(CfgTree *self);
+void cfg_tree_restore_preserved_pipes(CfgTree *self);
+gboolean cfg_tree_has_adopted_pipes_of(CfgTree *self, GlobalConfig *cfg);
+
 gboolean cfg_tree_start(CfgTree *self);
 gboolean cfg_tree_stop(CfgTree *self);
 gboolean cfg_tree_on_inited(CfgTree *self);
@@ -27,6 +27,7 @@
 #include "cfg-grammar.h"
 #include "module-config.h"
 #include "cfg-tree.h"
+#include "cfg-fingerprint.h"
 #include "messages.h"
 #include "template/templates.h"
 #include "userdb.h"
@@ -360,6 +361,7 @@ cfg_init(GlobalConfig *cfg)
   stats_reinit(&cfg->stats_options);
 
   dns_caching_update_options(&cfg->dns_cache_options);
+  dns_resolver_update_options(&cfg->dns_resolver_options);
   hostname_reinit(cfg->custom_domain);
   host_resolve_options_init_globals(&cfg->host_resolve_options);
   log_template_options_init(&cfg->template_options, cfg);
@@ -496,6 +498,7 @@ cfg_new(gint version)
   file_perm_options_global_defaults(&self->file_perm_options);
 
   dns_cache_options_defaults(&self->dns_cache_options);
+  dns_resolver_options_defaults(&self->dns_resolver_options);
   self->threaded = TRUE;
   self->pass_unix_credentials = TRUE;
 
@@ -720,10 +723,128 @@ cfg_free(GlobalConfig *self)
     g_string_free(self->original_config, TRUE);
 
   g_list_free_full(self->file_list, _cfg_file_path_free);
+  g_list_free_full(self->retained_configs, (GDestroyNotify) cfg_free);
 
   g_free(self);
 }
 
+static gint
+_adopt_unchanged_components(GlobalConfig *self, GlobalConfig *previous)
+{
+  GList *components = g_hash_table_get_values(self->tree.components);
+  gint adopted_log_paths = 0;
+
+  for (GList *l = components; l; l = l->next)
+    {
+      CfgTreeComponent *component = (CfgTreeComponent *) l->data;
+      CfgTreeComponent *running_component = g_hash_table_lookup(previous->tree.components, component->digest);
+
+      if (!running_component)
+        continue;
+
+      msg_verbose("Keeping unchanged log path running",
+                  evt_tag_str("objects", running_component->objects->str),
+                  log_expr_node_location_tag(g_ptr_array_index(component->rules, 0)));
+
+      adopted_log_paths += running_component->rules->len;
+      cfg_tree_adopt_component(&self->tree, &previous->tree, running_component);
+    }
+  g_list_free(components);
+  return adopted_log_paths;
+}
+
+/*
+ * Incremental reload: find the parts of the pipeline that did not change
+ * compared to the running @previous configuration and take them over, so
+ * that they keep running instead of being stopped and restarted.  Must be
+ * called before @self is initialized, returns the number of top-level
+ * log paths taken over.
+ *
+ * Only the configuration text is compared, files referenced from the
+ * configuration (e.g. patterndb files or certificates) are not reloaded
+ * for unchanged log paths.
+ */
+gint
+cfg_adopt_unchanged_log_paths(GlobalConfig *self, GlobalConfig *previous)
+{
+  CfgFingerprint *fingerprint, *previous_fingerprint;
+  gint adopted_log_paths = 0;
+
+  if (!self->incremental_reload || !self->preprocess_config || !previous->preprocess_config)
+    return 0;
+
+  fingerprint = cfg_fingerprint_new(self->preprocess_config->str);
+  previous_fingerprint = cfg_fingerprint_new(previous->preprocess_config->str);
+
+  if (strcmp(fingerprint->global_digest, previous_fingerprint->global_digest) != 0)
+    {
+      msg_info("Global configuration changed, restarting all log paths");
+      goto exit;
+    }
+
+  /* filters can refer to each other by name from filter expressions,
+   * these references are not visible in the tree */
+  if (!cfg_fingerprint_named_objects_equal(fingerprint, previous_fingerprint, ENC_FILTER))
+    {
+      msg_info("Named filters changed, restarting all log paths");
+      goto exit;
+    }
+
+  if (!previous->tree.components && g_hash_table_size(previous->tree.adopted_pipes) == 0 &&
+      cfg_tree_split_components(&previous->tree, previous_fingerprint))
+    cfg_tree_assign_pipes_to_components(&previous->tree);
+
+  if (!previous->tree.components || !cfg_tree_split_components(&self->tree, fingerprint))
+    {
+      msg_info("Unable to split the configuration into independent log paths, restarting all of them");
+      goto exit;
+    }
+
+  adopted_log_paths = _adopt_unchanged_components(self, previous);
+
+exit:
+  cfg_fingerprint_free(fingerprint);
+  cfg_fingerprint_free(previous_fingerprint);
+  return adopted_log_paths;
+}
+
+/*
+ * Free @replaced once @self is up and running in its place.  The
+ * configurations that still own pipes running as part of @self are kept
+ * until @self is freed, newest first.
+ */
+void
+cfg_free_replaced(GlobalConfig *self, GlobalConfig *replaced)
+{
+  GList *candidates = replaced->retained_configs;
+
+  replaced->retained_configs = NULL;
+
+  /* the pipes of @self are known by now, for the next incremental reload */
+  if (self->tree.components)
+    cfg_tree_assign_pipes_to_components(&self->tree);
+
+  if (cfg_tree_has_adopted_pipes_of(&self->tree, replaced))
+    {
+      /* @replaced still refers to the pipes of the older ones */
+      self->retained_configs = g_list_concat(g_list_append(self->retained_configs, replaced), candidates);
+      return;
+    }
+
+  /* free @replaced before the older ones, it holds references to their pipes */
+  cfg_free(replaced);
+  for (GList *l = candidates; l; l = l->next)
+    {
+      GlobalConfig *candidate = (GlobalConfig *) l->data;
+
+      if (cfg_tree_has_adopted_pipes_of(&self->tree, candidate))
+        self->retained_configs = g_list_append(self->retained_configs, candidate);
+      else
+        cfg_free(candidate);
+    }
+  g_list_free(candidates);
+}
+
 void
 cfg_persist_config_move(GlobalConfig *src, GlobalConfig *dest)
 {
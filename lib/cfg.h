@@ -36,6 +36,7 @@
 #include "type-hinting.h"
 #include "stats/stats.h"
 #include "dnscache.h"
+#include "dns-resolver.h"
 #include "file-perms.h"
 
 #include <sys/types.h>
@@ -74,6 +75,8 @@ struct _GlobalConfig
   gint flush_lines;
   gint mark_mode;
   gboolean threaded;
+  gboolean incremental_reload;
+  gboolean use_io_uring;
   gboolean pass_unix_credentials;
   gboolean chain_hostnames;
   gboolean keep_hostname;
@@ -83,6 +86,7 @@ struct _GlobalConfig
   gchar *bad_hostname_re;
   gchar *custom_domain;
   DNSCacheOptions dns_cache_options;
+  DNSResolverOptions dns_resolver_options;
   gint time_reopen;
   gint time_reap;
   gint suppress;
@@ -121,6 +125,9 @@ struct _GlobalConfig
   GString *original_config;
 
   GList *file_list;
+
+  /* previous configurations whose pipes are still running as part of this one */
+  GList *retained_configs;
 };
 
 gboolean cfg_load_module_with_args(GlobalConfig *cfg, const gchar *module_name, CfgArgs *args);
@@ -159,6 +166,8 @@ gboolean cfg_is_shutting_down(GlobalConfig *cfg);
 void cfg_free(GlobalConfig *self);
 gboolean cfg_init(GlobalConfig *cfg);
 gboolean cfg_deinit(GlobalConfig *cfg);
+gint cfg_adopt_unchanged_log_paths(GlobalConfig *self, GlobalConfig *previous);
+void cfg_free_replaced(GlobalConfig *self, GlobalConfig *replaced);
 
 PersistConfig *persist_config_new(void);
 void persist_config_free(PersistConfig *self);
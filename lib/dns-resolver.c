@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "dns-resolver.h"
+#include "dnscache.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-cluster-single.h"
+#include "stats/stats-histogram.h"
+
+#define DNS_RESOLVER_HOSTNAME_MAX 256
+
+typedef struct _DNSResolveRequest
+{
+  /* all fields are protected by dns_resolver_lock */
+  gint ref_cnt;
+  gchar *key;
+  GSockAddr *saddr;
+  DNSResolverLookupFunc lookup_func;
+  gboolean cache_result;
+  gboolean done;
+  gboolean positive;
+  gchar hostname[DNS_RESOLVER_HOSTNAME_MAX];
+} DNSResolveRequest;
+
+static GMutex dns_resolver_lock;
+static GCond dns_resolver_request_done;
+/* address -> DNSResolveRequest, requests that have not finished yet */
+static GHashTable *dns_resolver_pending;
+static GThreadPool *dns_resolver_pool;
+static DNSResolverOptions dns_resolver_options;
+
+static StatsHistogram *dns_resolver_lookup_latency;
+static StatsCounterItem *dns_resolver_failures;
+static StatsCounterItem *dns_resolver_deadline_expired;
+
+static DNSResolveRequest *
+dns_resolve_request_new(const gchar *key, GSockAddr *saddr, DNSResolverLookupFunc lookup_func)
+{
+  DNSResolveRequest *self = g_new0(DNSResolveRequest, 1);
+
+  self->ref_cnt = 1;
+  self->key = g_strdup(key);
+  self->saddr = g_sockaddr_ref(saddr);
+  self->lookup_func = lookup_func;
+  return self;
+}
+
+static void
+dns_resolve_request_unref(DNSResolveRequest *self)
+{
+  if (--self->ref_cnt > 0)
+    return;
+
+  g_sockaddr_unref(self->saddr);
+  g_free(self->key);
+  g_free(self);
+}
+
+static void
+dns_resolver_store_result(GSockAddr *saddr, const gchar *hostname, gboolean positive)
+{
+  gchar buf[DNS_RESOLVER_HOSTNAME_MAX];
+  void *dnscache_key = dns_caching_sockaddr_to_key(saddr);
+
+  if (!dnscache_key)
+    return;
+
+  /* failures are cached as the textual address, just like the callers
+   * would use it in place of the name */
+  if (!positive)
+    hostname = g_sockaddr_format(saddr, buf, sizeof(buf), GSA_ADDRESS_ONLY);
+  dns_caching_store(saddr->sa.sa_family, dnscache_key, hostname, positive);
+}
+
+static gboolean
+dns_resolver_lookup(GSockAddr *saddr, DNSResolverLookupFunc lookup_func, gchar *hostname, gsize hostname_size)
+{
+  gint64 start = g_get_monotonic_time();
+  gboolean positive = lookup_func(saddr, hostname, hostname_size);
+
+  stats_histogram_record(dns_resolver_lookup_latency, g_get_monotonic_time() - start);
+  if (!positive)
+    stats_counter_inc(dns_resolver_failures);
+  return positive;
+}
+
+static void
+dns_resolver_run_request(gpointer data, gpointer user_data)
+{
+  DNSResolveRequest *request = data;
+  gchar hostname[DNS_RESOLVER_HOSTNAME_MAX];
+
+  /* the request is kept alive by dns_resolver_pending until we remove it */
+  gboolean positive = dns_resolver_lookup(request->saddr, request->lookup_func, hostname, sizeof(hostname));
+
+  g_mutex_lock(&dns_resolver_lock);
+  if (request->cache_result)
+    dns_resolver_store_result(request->saddr, hostname, positive);
+
+  request->positive = positive;
+  if (positive)
+    g_strlcpy(request->hostname, hostname, sizeof(request->hostname));
+  request->done = TRUE;
+  g_hash_table_remove(dns_resolver_pending, request->key);
+  g_cond_broadcast(&dns_resolver_request_done);
+  g_mutex_unlock(&dns_resolver_lock);
+}
+
+/* must be called with dns_resolver_lock held */
+static DNSResolveRequest *
+dns_resolver_submit(GSockAddr *saddr, DNSResolverLookupFunc lookup_func, gboolean cache_result)
+{
+  gchar key[DNS_RESOLVER_HOSTNAME_MAX];
+  DNSResolveRequest *request;
+
+  g_sockaddr_format(saddr, key, sizeof(key), GSA_ADDRESS_ONLY);
+  request = g_hash_table_lookup(dns_resolver_pending, key);
+  if (!request)
+    {
+      request = dns_resolve_request_new(key, saddr, lookup_func);
+      g_hash_table_insert(dns_resolver_pending, request->key, request);
+      g_thread_pool_push(dns_resolver_pool, request, NULL);
+    }
+
+  /* merged requests want the result cached if any of them does */
+  request->cache_result |= cache_result;
+  return request;
+}
+
+/* must be called with dns_resolver_lock held */
+static DNSResolveResult
+dns_resolver_wait_for_request(DNSResolveRequest *request, gchar *hostname, gsize hostname_size)
+{
+  gint64 deadline = g_get_monotonic_time() + dns_resolver_options.timeout * G_TIME_SPAN_MILLISECOND;
+
+  while (!request->done)
+    {
+      if (!g_cond_wait_until(&dns_resolver_request_done, &dns_resolver_lock, deadline))
+        break;
+    }
+
+  if (!request->done)
+    return DNS_RESOLVE_PENDING;
+
+  if (!request->positive)
+    return DNS_RESOLVE_FAILED;
+
+  g_strlcpy(hostname, request->hostname, hostname_size);
+  return DNS_RESOLVE_SUCCESS;
+}
+
+/*
+ * Resolve @saddr to a name using @lookup_func, either in the current
+ * thread or in the resolver pool, as configured.  If @cache_result is
+ * TRUE the outcome is stored in the DNS cache, even if the answer arrives
+ * after the deadline.
+ */
+DNSResolveResult
+dns_resolver_resolve(GSockAddr *saddr, DNSResolverLookupFunc lookup_func, gboolean cache_result,
+                     gchar *hostname, gsize hostname_size)
+{
+  DNSResolveResult result = DNS_RESOLVE_PENDING;
+  DNSResolveRequest *request;
+
+  g_mutex_lock(&dns_resolver_lock);
+  if (dns_resolver_options.threads == 0)
+    {
+      g_mutex_unlock(&dns_resolver_lock);
+
+      gboolean positive = dns_resolver_lookup(saddr, lookup_func, hostname, hostname_size);
+
+      if (cache_result)
+        dns_resolver_store_result(saddr, hostname, positive);
+      return positive ? DNS_RESOLVE_SUCCESS : DNS_RESOLVE_FAILED;
+    }
+
+  request = dns_resolver_submit(saddr, lookup_func, cache_result);
+  gboolean waited = dns_resolver_options.timeout > 0;
+  if (waited)
+    {
+      request->ref_cnt++;
+      result = dns_resolver_wait_for_request(request, hostname, hostname_size);
+      dns_resolve_request_unref(request);
+    }
+  g_mutex_unlock(&dns_resolver_lock);
+
+  /* with timeout(0) the lookup is not waited for, so no deadline expires */
+  if (waited && result == DNS_RESOLVE_PENDING)
+    stats_counter_inc(dns_resolver_deadline_expired);
+  return result;
+}
+
+void
+dns_resolver_options_defaults(DNSResolverOptions *options)
+{
+  options->threads = 0;
+  options->timeout = 0;
+}
+
+void
+dns_resolver_update_options(const DNSResolverOptions *options)
+{
+  g_mutex_lock(&dns_resolver_lock);
+  dns_resolver_options = *options;
+
+  if (options->threads > 0)
+    {
+      if (!dns_resolver_pool)
+        dns_resolver_pool = g_thread_pool_new(dns_resolver_run_request, NULL, options->threads, FALSE, NULL);
+      else
+        g_thread_pool_set_max_threads(dns_resolver_pool, options->threads, NULL);
+    }
+  /* with threads(0) an existing pool is kept to finish what is queued */
+  g_mutex_unlock(&dns_resolver_lock);
+}
+
+static void
+dns_resolver_register_stats(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_histogram_key_set(&sc_key, SCS_GLOBAL, "dns_resolver", NULL, "lookup_usec");
+  stats_register_histogram(0, &sc_key, &dns_resolver_lookup_latency);
+
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "dns_resolver_failures", NULL);
+  stats_register_counter(0, &sc_key, SC_TYPE_SINGLE_VALUE, &dns_resolver_failures);
+
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "dns_resolver_deadline_expired", NULL);
+  stats_register_counter(0, &sc_key, SC_TYPE_SINGLE_VALUE, &dns_resolver_deadline_expired);
+  stats_unlock();
+}
+
+static void
+dns_resolver_unregister_stats(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_histogram_key_set(&sc_key, SCS_GLOBAL, "dns_resolver", NULL, "lookup_usec");
+  stats_unregister_histogram(&sc_key, &dns_resolver_lookup_latency);
+
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "dns_resolver_failures", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &dns_resolver_failures);
+
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "dns_resolver_deadline_expired", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &dns_resolver_deadline_expired);
+  stats_unlock();
+}
+
+/* must be called after stats_init() and dns_caching_global_init() */
+void
+dns_resolver_global_init(void)
+{
+  g_mutex_init(&dns_resolver_lock);
+  g_cond_init(&dns_resolver_request_done);
+  dns_resolver_pending = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                               (GDestroyNotify) dns_resolve_request_unref);
+  dns_resolver_options_defaults(&dns_resolver_options);
+  dns_resolver_register_stats();
+}
+
+void
+dns_resolver_global_deinit(void)
+{
+  /* running lookups are finished, queued ones are dropped */
+  if (dns_resolver_pool)
+    g_thread_pool_free(dns_resolver_pool, TRUE, TRUE);
+  dns_resolver_pool = NULL;
+
+  g_hash_table_destroy(dns_resolver_pending);
+  dns_resolver_pending = NULL;
+  dns_resolver_unregister_stats();
+  g_cond_clear(&dns_resolver_request_done);
+  g_mutex_clear(&dns_resolver_lock);
+}
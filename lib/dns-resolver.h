@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef DNS_RESOLVER_H_INCLUDED
+#define DNS_RESOLVER_H_INCLUDED 1
+
+#include "syslog-ng.h"
+#include "gsockaddr.h"
+
+/*
+ * Reverse DNS resolver shared by the whole process.
+ *
+ * With dns-resolver-threads(0) (the default), names are resolved in the
+ * calling thread.  Otherwise the lookups run in a pool of resolver
+ * threads and the caller waits for the answer at most
+ * dns-resolve-timeout() milliseconds.  Concurrent requests for the same
+ * address are merged into a single lookup.  A lookup that misses the
+ * deadline still completes in the background and its result is put into
+ * the DNS cache, so later messages from the same host get the name.
+ */
+typedef struct _DNSResolverOptions
+{
+  gint threads;
+  gint timeout;
+} DNSResolverOptions;
+
+typedef enum
+{
+  DNS_RESOLVE_SUCCESS,
+  DNS_RESOLVE_FAILED,
+  /* the lookup did not finish before the deadline */
+  DNS_RESOLVE_PENDING,
+} DNSResolveResult;
+
+/* blocking reverse lookup of @saddr, returns TRUE and the name in @hostname on success */
+typedef gboolean (*DNSResolverLookupFunc)(GSockAddr *saddr, gchar *hostname, gsize hostname_size);
+
+DNSResolveResult dns_resolver_resolve(GSockAddr *saddr, DNSResolverLookupFunc lookup_func, gboolean cache_result,
+                                      gchar *hostname, gsize hostname_size);
+
+void dns_resolver_options_defaults(DNSResolverOptions *options);
+void dns_resolver_update_options(const DNSResolverOptions *options);
+
+void dns_resolver_global_init(void);
+void dns_resolver_global_deinit(void);
+
+#endif
@@ -25,7 +25,8 @@
 #include "dnscache.h"
 #include "messages.h"
 #include "timeutils/cache.h"
-#include "tls-support.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-cluster-single.h"
 
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -74,6 +75,10 @@ struct _DNSCache
   gint persistent_count;
   time_t hosts_mtime;
   time_t hosts_checktime;
+  /* the subset of the address space this cache is responsible for, see
+   * the sharded global cache below */
+  guint shard_index;
+  guint shard_count;
 };
 
 
@@ -143,6 +148,24 @@ dns_cache_fill_key(DNSCacheKey *key, gint family, void *addr)
     }
 }
 
+static gboolean
+dns_cache_owns_address(DNSCache *self, gint family, void *addr)
+{
+  DNSCacheKey key;
+
+  if (self->shard_count <= 1)
+    return TRUE;
+
+  dns_cache_fill_key(&key, family, addr);
+  return dns_cache_key_hash(&key) % self->shard_count == self->shard_index;
+}
+
+static gint
+dns_cache_get_capacity(DNSCache *self)
+{
+  return MAX(self->options->cache_size / (gint) self->shard_count, 1);
+}
+
 static void
 dns_cache_store(DNSCache *self, gboolean persistent, gint family, void *addr, const gchar *hostname, gboolean positive)
 {
@@ -173,7 +196,7 @@ dns_cache_store(DNSCache *self, gboolean persistent, gint family, void *addr, co
     self->persistent_count++;
 
   /* persistent elements are not counted */
-  if ((gint) (g_hash_table_size(self->cache) - self->persistent_count) > self->options->cache_size)
+  if ((gint) (g_hash_table_size(self->cache) - self->persistent_count) > dns_cache_get_capacity(self))
     {
       DNSCacheEntry *entry_to_remove = iv_list_entry(self->cache_list.next, DNSCacheEntry, list);
 
@@ -272,7 +295,8 @@ dns_cache_check_hosts(DNSCache *self, glong t)
               if (!p)
                 continue;
               inet_pton(family, ip, &ia);
-              dns_cache_store_persistent(self, family, &ia, p);
+              if (dns_cache_owns_address(self, family, &ia))
+                dns_cache_store_persistent(self, family, &ia, p);
             }
           fclose(hosts);
         }
@@ -339,6 +363,8 @@ dns_cache_new(const DNSCacheOptions *options)
   self->hosts_mtime = -1;
   self->hosts_checktime = 0;
   self->persistent_count = 0;
+  self->shard_index = 0;
+  self->shard_count = 1;
   self->options = options;
   return self;
 }
@@ -366,22 +392,26 @@ dns_cache_options_destroy(DNSCacheOptions *options)
   options->hosts = NULL;
 }
 
+
 /**************************************************************************
  * The global API that manages DNSCache instances on its own. Callers need
  * not be aware of underlying data structures and locking, they can simply
  * call these functions to lookup/query the DNS cache.
  *
- * I would prefer these to be moved into a higher level implementation
- * detail.
+ * The cache is shared by all threads of the process: it is split into
+ * DNS_CACHE_SHARDS independent DNSCache instances, each protected by its
+ * own lock, and addresses are assigned to shards by their hash.  This way
+ * a name resolved by one worker is available to all the others, while
+ * threads looking up different addresses rarely contend on the same lock.
  **************************************************************************/
 
-TLS_BLOCK_START
-{
-  DNSCache *dns_cache;
-}
-TLS_BLOCK_END;
+#define DNS_CACHE_SHARDS 16
 
-#define dns_cache __tls_deref(dns_cache)
+typedef struct _DNSCacheShard
+{
+  GMutex lock;
+  DNSCache *cache;
+} DNSCacheShard;
 
 /* DNS cache related options are global, independent of the configuration
  * (e.g.  GlobalConfig instance), and they are stored in the
@@ -391,7 +421,7 @@ TLS_BLOCK_END;
  *
  * Some notes:
  *   1) DNS cache contents are better retained between configuration reloads
- *   2) There are multiple DNSCache instances as they are per-thread data structs.
+ *   2) There are multiple DNSCache instances, one for each shard.
  *
  * The usual pattern would be:
  *    DNSCache->options -> DNSCacheOptions
@@ -401,35 +431,80 @@ TLS_BLOCK_END;
  *
  * The problem with this approach is that we don't want to recreate DNSCache
  * instances when reloading the configuration (as we want to keep their
- * config), and this would mean that we'd have to update the "options"
- * pointers in each of the existing instances.  And those instances are
- * per-thread variables, making it a bit more difficult to track them.
+ * contents), and this would mean that we'd have to update the "options"
+ * pointers in each of the existing instances.
  *
  * For this reason, it was a lot simpler to use a global variable to hold
  * configuration options, one that can be updated as the configuration is
  * reloaded.  Then DNSCache instances transparently take the options changes
  * into account as they continue to resolve names.
- *
- * I could come up with even better solutions to this problem (like using a
- * layer above GlobalConfig, a state that encapsulates per-execution state
- * of syslog-ng), however, right now that would be an overkill and I want to
- * get the DNSCache refactors into the master tree.
  */
 
 static DNSCacheOptions effective_dns_cache_options;
-G_LOCK_DEFINE_STATIC(unused_dns_caches);
-static GList *unused_dns_caches;
+static DNSCacheShard dns_cache_shards[DNS_CACHE_SHARDS];
+static StatsCounterItem *dns_cache_hits;
+static StatsCounterItem *dns_cache_misses;
 
+static DNSCacheShard *
+dns_caching_get_shard(gint family, void *addr)
+{
+  DNSCacheKey key;
+
+  dns_cache_fill_key(&key, family, addr);
+  return &dns_cache_shards[dns_cache_key_hash(&key) % DNS_CACHE_SHARDS];
+}
+
+void *
+dns_caching_sockaddr_to_key(GSockAddr *saddr)
+{
+  if (saddr->sa.sa_family == AF_INET)
+    return &((struct sockaddr_in *) &saddr->sa)->sin_addr;
+#if SYSLOG_NG_ENABLE_IPV6
+  else if (saddr->sa.sa_family == AF_INET6)
+    return &((struct sockaddr_in6 *) &saddr->sa)->sin6_addr;
+#endif
+  else
+    {
+      msg_warning("Socket address is neither IPv4 nor IPv6",
+                  evt_tag_int("sa_family", saddr->sa.sa_family));
+      return NULL;
+    }
+}
+
+/*
+ * As the cache is shared between threads, the cached name is copied to
+ * @hostname (of @hostname_size bytes) while the shard is locked.
+ */
 gboolean
-dns_caching_lookup(gint family, void *addr, const gchar **hostname, gsize *hostname_len, gboolean *positive)
+dns_caching_lookup(gint family, void *addr, gchar *hostname, gsize hostname_size, gsize *hostname_len,
+                   gboolean *positive)
 {
-  return dns_cache_lookup(dns_cache, family, addr, hostname, hostname_len, positive);
+  DNSCacheShard *shard = dns_caching_get_shard(family, addr);
+  const gchar *cached_hostname;
+  gsize cached_hostname_len;
+  gboolean found;
+
+  g_mutex_lock(&shard->lock);
+  found = dns_cache_lookup(shard->cache, family, addr, &cached_hostname, &cached_hostname_len, positive);
+  if (found)
+    {
+      g_strlcpy(hostname, cached_hostname, hostname_size);
+      *hostname_len = MIN(cached_hostname_len, hostname_size - 1);
+    }
+  g_mutex_unlock(&shard->lock);
+
+  stats_counter_inc(found ? dns_cache_hits : dns_cache_misses);
+  return found;
 }
 
 void
 dns_caching_store(gint family, void *addr, const gchar *hostname, gboolean positive)
 {
-  dns_cache_store_dynamic(dns_cache, family, addr, hostname, positive);
+  DNSCacheShard *shard = dns_caching_get_shard(family, addr);
+
+  g_mutex_lock(&shard->lock);
+  dns_cache_store_dynamic(shard->cache, family, addr, hostname, positive);
+  g_mutex_unlock(&shard->lock);
 }
 
 void
@@ -437,6 +512,10 @@ dns_caching_update_options(const DNSCacheOptions *new_options)
 {
   DNSCacheOptions *options = &effective_dns_cache_options;
 
+  /* the shards read the options while looking up names */
+  for (gint i = 0; i < DNS_CACHE_SHARDS; i++)
+    g_mutex_lock(&dns_cache_shards[i].lock);
+
   if (options->hosts)
     g_free(options->hosts);
 
@@ -444,49 +523,70 @@ dns_caching_update_options(const DNSCacheOptions *new_options)
   options->expire = new_options->expire;
   options->expire_failed = new_options->expire_failed;
   options->hosts = g_strdup(new_options->hosts);
+
+  for (gint i = DNS_CACHE_SHARDS - 1; i >= 0; i--)
+    g_mutex_unlock(&dns_cache_shards[i].lock);
 }
 
-void
-dns_caching_thread_init(void)
+static void
+dns_caching_register_stats(void)
 {
-  g_assert(dns_cache == NULL);
+  StatsClusterKey sc_key;
 
-  G_LOCK(unused_dns_caches);
-  if (unused_dns_caches)
-    {
-      dns_cache = unused_dns_caches->data;
-      unused_dns_caches = g_list_delete_link(unused_dns_caches, unused_dns_caches);
-    }
-  G_UNLOCK(unused_dns_caches);
+  stats_lock();
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "dns_cache_hits", NULL);
+  stats_register_counter(0, &sc_key, SC_TYPE_SINGLE_VALUE, &dns_cache_hits);
 
-  if (!dns_cache)
-    dns_cache = dns_cache_new(&effective_dns_cache_options);
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "dns_cache_misses", NULL);
+  stats_register_counter(0, &sc_key, SC_TYPE_SINGLE_VALUE, &dns_cache_misses);
+  stats_unlock();
 }
 
-void
-dns_caching_thread_deinit(void)
+static void
+dns_caching_unregister_stats(void)
 {
-  g_assert(dns_cache != NULL);
+  StatsClusterKey sc_key;
 
-  G_LOCK(unused_dns_caches);
-  unused_dns_caches = g_list_prepend(unused_dns_caches, dns_cache);
-  G_UNLOCK(unused_dns_caches);
-  dns_cache = NULL;
+  stats_lock();
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "dns_cache_hits", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &dns_cache_hits);
+
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "dns_cache_misses", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &dns_cache_misses);
+  stats_unlock();
 }
 
+/* must be called after stats_init() */
 void
 dns_caching_global_init(void)
 {
   dns_cache_options_defaults(&effective_dns_cache_options);
+
+  for (gint i = 0; i < DNS_CACHE_SHARDS; i++)
+    {
+      DNSCacheShard *shard = &dns_cache_shards[i];
+
+      g_mutex_init(&shard->lock);
+      shard->cache = dns_cache_new(&effective_dns_cache_options);
+      shard->cache->shard_index = i;
+      shard->cache->shard_count = DNS_CACHE_SHARDS;
+    }
+  dns_caching_register_stats();
 }
 
+/* must be called before stats_destroy() */
 void
 dns_caching_global_deinit(void)
 {
-  G_LOCK(unused_dns_caches);
-  g_list_foreach(unused_dns_caches, (GFunc) dns_cache_free, NULL);
-  g_list_free(unused_dns_caches);
-  unused_dns_caches = NULL;
-  G_UNLOCK(unused_dns_caches);
+  dns_caching_unregister_stats();
+
+  for (gint i = 0; i < DNS_CACHE_SHARDS; i++)
+    {
+      DNSCacheShard *shard = &dns_cache_shards[i];
+
+      dns_cache_free(shard->cache);
+      shard->cache = NULL;
+      g_mutex_clear(&shard->lock);
+    }
   dns_cache_options_destroy(&effective_dns_cache_options);
 }
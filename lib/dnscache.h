@@ -27,6 +27,7 @@
 #define DNSCACHE_H_INCLUDED
 
 #include "syslog-ng.h"
+#include "gsockaddr.h"
 
 typedef struct
 {
@@ -48,12 +49,12 @@ void dns_cache_free(DNSCache *self);
 void dns_cache_options_defaults(DNSCacheOptions *options);
 void dns_cache_options_destroy(DNSCacheOptions *options);
 
-gboolean dns_caching_lookup(gint family, void *addr, const gchar **hostname, gsize *hostname_len, gboolean *positive);
+void *dns_caching_sockaddr_to_key(GSockAddr *saddr);
+gboolean dns_caching_lookup(gint family, void *addr, gchar *hostname, gsize hostname_size, gsize *hostname_len,
+                            gboolean *positive);
 void dns_caching_store(gint family, void *addr, const gchar *hostname, gboolean positive);
 void dns_caching_update_options(const DNSCacheOptions *dns_cache_options);
 
-void dns_caching_thread_init(void);
-void dns_caching_thread_deinit(void);
 void dns_caching_global_init(void);
 void dns_caching_global_deinit(void);
 
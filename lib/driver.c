@@ -222,6 +222,26 @@ log_src_driver_queue_method(LogPipe *s, LogMessage *msg, const LogPathOptions *p
   log_pipe_forward_msg(s, msg, path_options);
 }
 
+static void
+log_src_driver_queue_batch_method(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options, gint len)
+{
+  LogSrcDriver *self = (LogSrcDriver *) s;
+  GlobalConfig *cfg = log_pipe_get_config(s);
+
+  /* $SOURCE */
+
+  for (gint i = 0; i < len; i++)
+    {
+      if (msgs[i]->flags & LF_LOCAL)
+        afinter_postpone_mark(cfg->mark_freq);
+
+      log_msg_set_value(msgs[i], LM_V_SOURCE, self->super.group, self->group_len);
+    }
+  stats_counter_add(self->super.processed_group_messages, len);
+  stats_counter_add(self->received_global_messages, len);
+  log_pipe_forward_msg_batch(s, msgs, path_options, len);
+}
+
 void
 log_src_driver_init_instance(LogSrcDriver *self, GlobalConfig *cfg)
 {
@@ -230,6 +250,7 @@ log_src_driver_init_instance(LogSrcDriver *self, GlobalConfig *cfg)
   self->super.super.init = log_src_driver_init_method;
   self->super.super.deinit = log_src_driver_deinit_method;
   self->super.super.queue = log_src_driver_queue_method;
+  self->super.super.queue_batch = log_src_driver_queue_batch_method;
   self->super.super.flags |= PIF_SOURCE;
 }
 
@@ -307,6 +328,20 @@ log_dest_driver_queue_method(LogPipe *s, LogMessage *msg, const LogPathOptions *
   log_pipe_forward_msg(s, msg, path_options);
 }
 
+/*
+ * Not set by default, as most destination drivers override queue(), it is
+ * meant to be chained up from queue_batch() implementations.
+ */
+void
+log_dest_driver_queue_batch_method(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options, gint len)
+{
+  LogDestDriver *self = (LogDestDriver *) s;
+
+  stats_counter_add(self->super.processed_group_messages, len);
+  stats_counter_add(self->queued_global_messages, len);
+  log_pipe_forward_msg_batch(s, msgs, path_options, len);
+}
+
 static gboolean
 log_dest_driver_pre_init_method(LogPipe *s)
 {
@@ -202,6 +202,8 @@ log_dest_driver_release_queue(LogDestDriver *self, LogQueue *q)
 gboolean log_dest_driver_init_method(LogPipe *s);
 gboolean log_dest_driver_deinit_method(LogPipe *s);
 void log_dest_driver_queue_method(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options);
+void log_dest_driver_queue_batch_method(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options,
+                                        gint len);
 
 void log_dest_driver_init_instance(LogDestDriver *self, GlobalConfig *cfg);
 void log_dest_driver_free(LogPipe *s);
@@ -89,6 +89,7 @@ filter_call_init(FilterExprNode *s, GlobalConfig *cfg)
       if (!filter_expr_init(self->filter_expr, cfg))
         return FALSE;
       self->super.modify = self->filter_expr->modify;
+      self->super.cost = self->filter_expr->cost;
 
       stats_lock();
       StatsClusterKey sc_key;
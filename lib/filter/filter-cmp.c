@@ -184,6 +184,9 @@ fop_cmp_new(LogTemplate *left, LogTemplate *right, gint token)
   self->super.free_fn = fop_cmp_free;
   self->left = left;
   self->right = right;
+  self->super.cost = FILTER_EXPR_COST_MEDIUM;
+  /* e.g. comparing `backtick` substitutions in SCL blocks */
+  self->super.constant = log_template_is_literal_string(left) && log_template_is_literal_string(right);
 
   return &self->super;
 }
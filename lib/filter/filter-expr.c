@@ -33,6 +33,7 @@ void
 filter_expr_node_init_instance(FilterExprNode *self)
 {
   self->ref_cnt = 1;
+  self->cost = FILTER_EXPR_COST_EXPENSIVE;
 }
 
 /*
@@ -77,6 +78,101 @@ filter_expr_eval_root(FilterExprNode *self, LogMessage **msg, const LogPathOptio
   return filter_expr_eval_root_with_context(self, msg, 1, &DEFAULT_TEMPLATE_EVAL_OPTIONS, path_options);
 }
 
+/*
+ * The ratio of messages matched by this node as measured by its counters
+ * (e.g. filter() references with stats-level(1) or higher), 0.5 if
+ * unknown.  The counters are kept across reloads, so a new configuration
+ * is optimized using the ratio measured with the previous one.
+ *
+ * NOTE: once the operands are reordered, the matched/not_matched counters
+ * of a filter() reference only count the messages that got past the
+ * operands in front of it, not every message reaching the expression.
+ * The ratio is biased by that, and the bias carries over to the ordering
+ * chosen on the next reload.
+ */
+gdouble
+filter_expr_get_match_ratio(FilterExprNode *self)
+{
+  gsize matched = stats_counter_get(self->matched);
+  gsize not_matched = stats_counter_get(self->not_matched);
+  gdouble ratio;
+
+  if (matched + not_matched < FILTER_EXPR_MIN_SAMPLES)
+    return 0.5;
+
+  /* the counters are updated before applying negation */
+  ratio = (gdouble) matched / (matched + not_matched);
+  return self->comp ? 1.0 - ratio : ratio;
+}
+
+/****************************************************************
+ * Constants, the result of folding
+ ****************************************************************/
+
+typedef struct _FilterConstant
+{
+  FilterExprNode super;
+  gboolean value;
+} FilterConstant;
+
+static gboolean
+filter_constant_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg, LogTemplateEvalOptions *options)
+{
+  FilterConstant *self = (FilterConstant *) s;
+
+  return self->value ^ s->comp;
+}
+
+gboolean
+filter_expr_is_constant_value(FilterExprNode *self, gboolean value)
+{
+  if (self->eval != filter_constant_eval)
+    return FALSE;
+  return filter_constant_eval(self, NULL, 0, NULL) == value;
+}
+
+FilterExprNode *
+filter_expr_constant_new(gboolean value)
+{
+  FilterConstant *self = g_new0(FilterConstant, 1);
+
+  filter_expr_node_init_instance(&self->super);
+  self->super.eval = filter_constant_eval;
+  self->super.constant = TRUE;
+  self->super.cost = 0;
+  self->super.type = value ? "TRUE" : "FALSE";
+  self->value = value;
+  return &self->super;
+}
+
+static gboolean
+_eval_constant(FilterExprNode *self)
+{
+  LogMessage *msg = log_msg_new_empty();
+  gboolean result = filter_expr_eval(self, msg);
+
+  log_msg_unref(msg);
+  return result;
+}
+
+/*
+ * Config time optimization pass over an initialized expression: nodes
+ * not depending on the message are replaced by their value and the
+ * operands of and/or are reordered by their cost (see fop_optimize()).
+ * Returns the expression to be evaluated instead of self.
+ */
+FilterExprNode *
+filter_expr_optimize(FilterExprNode *self)
+{
+  if (self->constant && self->eval != filter_constant_eval)
+    return filter_expr_constant_new(_eval_constant(self));
+
+  if (self->optimize)
+    return self->optimize(self);
+
+  return filter_expr_ref(self);
+}
+
 FilterExprNode *
 filter_expr_ref(FilterExprNode *self)
 {
@@ -33,13 +33,25 @@
 struct _GlobalConfig;
 typedef struct _FilterExprNode FilterExprNode;
 
+/* relative evaluation costs, used to order the operands of and/or */
+#define FILTER_EXPR_COST_CHEAP      1   /* facility(), level(), tags() */
+#define FILTER_EXPR_COST_MEDIUM     4   /* netmask(), in-list(), comparisons */
+#define FILTER_EXPR_COST_EXPENSIVE  16  /* regexps, plugins */
+
+/* below this many evaluations the counters of a node are not representative */
+#define FILTER_EXPR_MIN_SAMPLES 1000
+
 struct _FilterExprNode
 {
   guint32 ref_cnt;
   guint32 comp:1,   /* this not is negated */
-          modify:1; /* this filter changes the log message */
+          modify:1, /* this filter changes the log message */
+          constant:1; /* the result does not depend on the message */
+  guint32 cost;
   const gchar *type;
   gboolean (*init)(FilterExprNode *self, GlobalConfig *cfg);
+  /* returns the node to be used instead of self, with a new reference */
+  FilterExprNode *(*optimize)(FilterExprNode *self);
   gboolean (*eval)(FilterExprNode *self, LogMessage **msg, gint num_msg, LogTemplateEvalOptions *options);
   void (*free_fn)(FilterExprNode *self);
   StatsCounterItem *matched;
@@ -62,6 +74,10 @@ gboolean filter_expr_eval_root(FilterExprNode *self, LogMessage **msg, const Log
 gboolean filter_expr_eval_root_with_context(FilterExprNode *self, LogMessage **msgs, gint num_msg,
                                             LogTemplateEvalOptions *options,
                                             const LogPathOptions *path_options);
+FilterExprNode *filter_expr_optimize(FilterExprNode *self);
+gdouble filter_expr_get_match_ratio(FilterExprNode *self);
+gboolean filter_expr_is_constant_value(FilterExprNode *self, gboolean value);
+FilterExprNode *filter_expr_constant_new(gboolean value);
 void filter_expr_node_init_instance(FilterExprNode *self);
 FilterExprNode *filter_expr_ref(FilterExprNode *self);
 void filter_expr_unref(FilterExprNode *self);
@@ -96,5 +96,8 @@ filter_in_list_new(const gchar *list_file, const gchar *property)
 
   self->super.eval = filter_in_list_eval;
   self->super.free_fn = filter_in_list_free;
+  self->super.cost = FILTER_EXPR_COST_MEDIUM;
+  /* nothing is in an empty list */
+  self->super.constant = g_tree_nnodes(self->tree) == 0;
   return &self->super;
 }
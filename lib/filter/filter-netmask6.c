@@ -167,6 +167,7 @@ filter_netmask6_new(const gchar *cidr)
     self->address = in6addr_loopback;
 
   self->super.eval = _eval;
+  self->super.cost = FILTER_EXPR_COST_MEDIUM;
   return &self->super;
 }
 #endif
@@ -44,6 +44,7 @@ fop_init(FilterExprNode *s, GlobalConfig *cfg)
     return FALSE;
 
   self->super.modify = self->left->modify || self->right->modify;
+  self->super.cost = self->left->cost + self->right->cost;
 
   return TRUE;
 }
@@ -57,11 +58,14 @@ fop_free(FilterExprNode *s)
   filter_expr_unref(self->right);
 }
 
+static FilterExprNode *fop_optimize(FilterExprNode *s);
+
 static void
 fop_init_instance(FilterOp *self)
 {
   filter_expr_node_init_instance(&self->super);
   self->super.init = fop_init;
+  self->super.optimize = fop_optimize;
   self->super.free_fn = fop_free;
 }
 
@@ -108,3 +112,167 @@ fop_and_new(FilterExprNode *e1, FilterExprNode *e2)
   self->super.type = "AND";
   return &self->super;
 }
+
+/****************************************************************
+ * Optimization, see filter_expr_optimize()
+ ****************************************************************/
+
+static inline gboolean
+fop_is_and(FilterOp *self)
+{
+  return self->super.eval == fop_and_eval;
+}
+
+static void
+fop_replace_operand(FilterExprNode **operand, FilterExprNode *new_operand)
+{
+  filter_expr_unref(*operand);
+  *operand = new_operand;
+}
+
+/*
+ * AND is short-circuited by a FALSE operand, OR by a TRUE one.  Operands
+ * are only left out if they do not modify the message, otherwise the
+ * message would look different for the rest of the pipeline.
+ */
+static FilterExprNode *
+fop_fold_constants(FilterOp *self)
+{
+  gboolean short_circuit = !fop_is_and(self);
+
+  if (filter_expr_is_constant_value(self->left, short_circuit)
+      || (filter_expr_is_constant_value(self->right, short_circuit) && !self->left->modify))
+    return filter_expr_constant_new(short_circuit ^ self->super.comp);
+
+  if (self->super.comp)
+    return NULL;
+
+  if (filter_expr_is_constant_value(self->left, !short_circuit))
+    return filter_expr_ref(self->right);
+  if (filter_expr_is_constant_value(self->right, !short_circuit))
+    return filter_expr_ref(self->left);
+  return NULL;
+}
+
+/* the nodes of a chain like "a and b and c" share the same operator */
+static gboolean
+fop_is_chain_link(FilterOp *self, FilterExprNode *node)
+{
+  return node->eval == self->super.eval && !node->comp && node->ref_cnt == 1;
+}
+
+static void
+fop_collect_chain(FilterOp *self, FilterExprNode *node, GPtrArray *operands, GPtrArray *links)
+{
+  if (!fop_is_chain_link(self, node))
+    {
+      g_ptr_array_add(operands, node);
+      return;
+    }
+
+  g_ptr_array_add(links, node);
+  fop_collect_chain(self, ((FilterOp *) node)->left, operands, links);
+  fop_collect_chain(self, ((FilterOp *) node)->right, operands, links);
+}
+
+/*
+ * The expected cost of an operand is its own cost, divided by the
+ * probability of short-circuiting the rest of the chain.
+ */
+static gdouble
+fop_get_operand_rank(FilterOp *self, FilterExprNode *operand)
+{
+  gdouble match_ratio = filter_expr_get_match_ratio(operand);
+  gdouble short_circuit_ratio = fop_is_and(self) ? 1.0 - match_ratio : match_ratio;
+
+  return operand->cost / MAX(short_circuit_ratio, 0.01);
+}
+
+static void
+fop_sort_operands(FilterOp *self, GPtrArray *operands)
+{
+  gdouble *ranks = g_new(gdouble, operands->len);
+
+  for (gint i = 0; i < operands->len; i++)
+    ranks[i] = fop_get_operand_rank(self, g_ptr_array_index(operands, i));
+
+  /* insertion sort, keeping the written order of operands with equal rank */
+  for (gint i = 1; i < operands->len; i++)
+    {
+      gpointer operand = g_ptr_array_index(operands, i);
+      gdouble rank = ranks[i];
+      gint j;
+
+      for (j = i; j > 0 && ranks[j - 1] > rank; j--)
+        {
+          g_ptr_array_index(operands, j) = g_ptr_array_index(operands, j - 1);
+          ranks[j] = ranks[j - 1];
+        }
+      g_ptr_array_index(operands, j) = operand;
+      ranks[j] = rank;
+    }
+  g_free(ranks);
+}
+
+/*
+ * Reorders the operands of a chain of the same commutative operator, so
+ * that the cheapest and most selective ones are evaluated first.  The
+ * chain is rebuilt from the same nodes, left-deep, which is the
+ * evaluation order.  Operands modifying the message may be depended on by
+ * the ones following them, so those chains are left alone.
+ */
+static void
+fop_reorder_operands(FilterOp *self)
+{
+  GPtrArray *operands, *links;
+
+  if (self->super.modify)
+    return;
+
+  operands = g_ptr_array_new();
+  links = g_ptr_array_new();
+  fop_collect_chain(self, self->left, operands, links);
+  fop_collect_chain(self, self->right, operands, links);
+  fop_sort_operands(self, operands);
+
+  /* the links are reused as the left spine below self, deepest last */
+  FilterOp *link = self;
+  for (gint i = operands->len - 1; i > 1; i--)
+    {
+      FilterOp *next_link = (FilterOp *) g_ptr_array_index(links, operands->len - 1 - i);
+
+      link->right = g_ptr_array_index(operands, i);
+      link->left = &next_link->super;
+      link = next_link;
+    }
+  link->left = g_ptr_array_index(operands, 0);
+  link->right = g_ptr_array_index(operands, 1);
+
+  /* update the costs bottom-up */
+  for (gint i = links->len - 1; i >= 0; i--)
+    {
+      link = (FilterOp *) g_ptr_array_index(links, i);
+      link->super.cost = link->left->cost + link->right->cost;
+    }
+  self->super.cost = self->left->cost + self->right->cost;
+
+  g_ptr_array_free(operands, TRUE);
+  g_ptr_array_free(links, TRUE);
+}
+
+static FilterExprNode *
+fop_optimize(FilterExprNode *s)
+{
+  FilterOp *self = (FilterOp *) s;
+  FilterExprNode *folded;
+
+  fop_replace_operand(&self->left, filter_expr_optimize(self->left));
+  fop_replace_operand(&self->right, filter_expr_optimize(self->right));
+
+  folded = fop_fold_constants(self);
+  if (folded)
+    return folded;
+
+  fop_reorder_operands(self);
+  return filter_expr_ref(s);
+}
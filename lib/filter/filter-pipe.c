@@ -38,6 +38,10 @@ log_filter_pipe_init(LogPipe *s)
   if (!filter_expr_init(self->expr, cfg))
     return FALSE;
 
+  FilterExprNode *optimized_expr = filter_expr_optimize(self->expr);
+  filter_expr_unref(self->expr);
+  self->expr = optimized_expr;
+
   if (!self->name)
     self->name = cfg_tree_get_rule_name(&cfg->tree, ENC_FILTER, s->expr_node);
 
@@ -64,6 +68,7 @@ log_filter_pipe_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_op
             evt_tag_printf("msg", "%p", msg));
 
   res = filter_expr_eval_root(self->expr, &msg, path_options);
+  TRACEPOINT(filter_verdict, self->name, s, msg, res);
 
   if (res)
     {
@@ -86,6 +91,55 @@ log_filter_pipe_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_op
             evt_tag_printf("msg", "%p", msg));
 }
 
+/*
+ * The messages are evaluated first, then the matching ones are forwarded
+ * as a single batch, the counters are updated once for the batch.
+ */
+static void
+log_filter_pipe_queue_batch(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options, gint len)
+{
+  LogFilterPipe *self = (LogFilterPipe *) s;
+  LogMessage *matched_msgs[LOG_PIPE_MAX_BATCH_SIZE];
+  const LogPathOptions *matched_path_options[LOG_PIPE_MAX_BATCH_SIZE];
+  gint num_matched = 0;
+
+  msg_trace(">>>>>> filter rule evaluation begin",
+            evt_tag_str("rule", self->name),
+            log_pipe_location_tag(s),
+            evt_tag_int("batch_size", len));
+
+  for (gint i = 0; i < len; i++)
+    {
+      LogMessage *msg = msgs[i];
+      gboolean res = filter_expr_eval_root(self->expr, &msg, path_options[i]);
+
+      TRACEPOINT(filter_verdict, self->name, s, msg, res);
+      if (res)
+        {
+          matched_msgs[num_matched] = msg;
+          matched_path_options[num_matched] = path_options[i];
+          num_matched++;
+        }
+      else
+        {
+          if (path_options[i]->matched)
+            (*path_options[i]->matched) = FALSE;
+          log_msg_drop(msg, path_options[i], AT_PROCESSED);
+        }
+    }
+
+  msg_trace("<<<<<< filter rule evaluation result",
+            evt_tag_str("rule", self->name),
+            log_pipe_location_tag(s),
+            evt_tag_int("matched", num_matched),
+            evt_tag_int("not_matched", len - num_matched));
+
+  if (num_matched > 0)
+    log_pipe_forward_msg_batch(s, matched_msgs, matched_path_options, num_matched);
+  stats_counter_add(self->matched, num_matched);
+  stats_counter_add(self->not_matched, len - num_matched);
+}
+
 static LogPipe *
 log_filter_pipe_clone(LogPipe *s)
 {
@@ -120,6 +174,7 @@ log_filter_pipe_new(FilterExprNode *expr, GlobalConfig *cfg)
   log_pipe_init_instance(&self->super, cfg);
   self->super.init = log_filter_pipe_init;
   self->super.queue = log_filter_pipe_queue;
+  self->super.queue_batch = log_filter_pipe_queue_batch;
   self->super.free_fn = log_filter_pipe_free;
   self->super.clone = log_filter_pipe_clone;
   self->expr = expr;
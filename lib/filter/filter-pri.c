@@ -26,6 +26,9 @@
 #include "syslog-names.h"
 #include "logmsg/logmsg.h"
 
+/* a bit for each of the 8 severities */
+#define FILTER_SEVERITY_ALL 0xff
+
 typedef struct _FilterPri
 {
   FilterExprNode super;
@@ -66,6 +69,7 @@ filter_facility_new(guint32 facilities)
   self->super.eval = filter_facility_eval;
   self->valid = facilities;
   self->super.type = "facility";
+  self->super.cost = FILTER_EXPR_COST_CHEAP;
   return &self->super;
 }
 
@@ -96,5 +100,7 @@ filter_severity_new(guint32 levels)
   self->super.eval = filter_severity_eval;
   self->valid = levels;
   self->super.type = "severity";
+  self->super.cost = FILTER_EXPR_COST_CHEAP;
+  self->super.constant = (levels & FILTER_SEVERITY_ALL) == FILTER_SEVERITY_ALL;
   return &self->super;
 }
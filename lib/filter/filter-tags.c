@@ -95,5 +95,6 @@ filter_tags_new(GList *tags)
   self->super.eval = filter_tags_eval;
   self->super.free_fn = filter_tags_free;
   self->super.type = "tags";
+  self->super.cost = FILTER_EXPR_COST_CHEAP;
   return &self->super;
 }
@@ -21,10 +21,11 @@
  * COPYING for details.
  *
  */
-#include "filter/filter-op.h"
+#include "filter/filter-op.c"
 #include "filter/filter-expr.h"
 #include "filter/filter-pri.h"
 #include "filter/filter-expr-parser.h"
+#include "filter/filter-pipe.h"
 #include "test_filters_common.h"
 #include "cfg-lexer.h"
 #include "apphook.h"
@@ -94,4 +95,173 @@ ParameterizedTest(FilterParams *params, filter_op, test_or_evaluation)
   testcase(msg, filter, params->expected_result);
 }
 
+static FilterExprNode *
+_compile_optimized_filter(gchar *config_snippet)
+{
+  FilterExprNode *filter = _compile_standalone_filter(config_snippet);
+  FilterExprNode *optimized;
+
+  cr_assert(filter_expr_init(filter, configuration));
+  optimized = filter_expr_optimize(filter);
+  filter_expr_unref(filter);
+
+  return optimized;
+}
+
+ParameterizedTestParameters(filter_op, test_optimized_evaluation)
+{
+  static FilterParams test_data_list[] =
+  {
+    {.config_snippet = "not facility(2) or not facility(2)", .expected_result = FALSE },
+    {.config_snippet = "(not facility(2)) or (not facility(3))", .expected_result = TRUE },
+    {.config_snippet = "message(\"PTHREAD\") and facility(2) and not facility(3)", .expected_result = TRUE },
+    {.config_snippet = "message(\"PTHREAD\") and (facility(3) or program(\"openvpn\"))", .expected_result = TRUE },
+    {.config_snippet = "message(\"nomatch\") or facility(3) or not tags(\"foo\")", .expected_result = TRUE },
+    {.config_snippet = "message(\"PTHREAD\") and facility(2) and \"1\" == \"1\"", .expected_result = TRUE },
+
+    // constants
+    {.config_snippet = "level(emerg..debug) and facility(2)", .expected_result = TRUE },
+    {.config_snippet = "level(emerg..debug) and facility(3)", .expected_result = FALSE },
+    {.config_snippet = "message(\"nomatch\") or not level(emerg..debug)", .expected_result = FALSE },
+    {.config_snippet = "\"no\" == \"yes\" and message(\"PTHREAD\")", .expected_result = FALSE },
+  };
+
+  return cr_make_param_array(FilterParams, test_data_list, G_N_ELEMENTS(test_data_list));
+}
+
+ParameterizedTest(FilterParams *params, filter_op, test_optimized_evaluation)
+{
+  const gchar *msg = "<16> openvpn[2499]: PTHREAD support initialized";
+  FilterExprNode *filter = _compile_optimized_filter(params->config_snippet);
+  testcase(msg, filter, params->expected_result);
+}
+
+Test(filter_op, test_constant_folding)
+{
+  FilterExprNode *filter;
+
+  filter = _compile_optimized_filter("level(emerg..debug) and facility(2)");
+  cr_expect_str_eq(filter->type, "facility");
+  filter_expr_unref(filter);
+
+  filter = _compile_optimized_filter("message(\"foo\") or level(emerg..debug)");
+  cr_expect(filter_expr_is_constant_value(filter, TRUE));
+  filter_expr_unref(filter);
+
+  filter = _compile_optimized_filter("\"a\" == \"b\" and message(\"foo\")");
+  cr_expect(filter_expr_is_constant_value(filter, FALSE));
+  filter_expr_unref(filter);
+
+  /* the regexp would set $1 for the rest of the pipeline */
+  filter = _compile_optimized_filter("message(\"(foo)\" flags(store-matches)) and \"a\" == \"b\"");
+  cr_expect_str_eq(filter->type, "AND");
+  filter_expr_unref(filter);
+}
+
+static void
+_assert_fop(FilterExprNode *node, const gchar *type, const gchar *left_type, const gchar *right_type)
+{
+  FilterOp *op = (FilterOp *) node;
+
+  cr_assert_str_eq(node->type, type);
+  if (left_type)
+    cr_assert_str_eq(op->left->type, left_type);
+  cr_assert_str_eq(op->right->type, right_type);
+}
+
+Test(filter_op, test_chain_is_rebuilt_left_deep_with_cheap_operands_first)
+{
+  FilterExprNode *filter;
+
+  filter = _compile_optimized_filter("message(\"x\") and facility(2) and tags(\"t\")");
+  _assert_fop(filter, "AND", "AND", "regexp");
+  _assert_fop(((FilterOp *) filter)->left, "AND", "facility", "tags");
+  cr_expect_eq(filter->cost, FILTER_EXPR_COST_EXPENSIVE + 2 * FILTER_EXPR_COST_CHEAP);
+  cr_expect_eq(((FilterOp *) filter)->left->cost, 2 * FILTER_EXPR_COST_CHEAP);
+  filter_expr_unref(filter);
+
+  filter = _compile_optimized_filter("message(\"x\") or (tags(\"t\") or facility(2))");
+  _assert_fop(filter, "OR", "OR", "regexp");
+  _assert_fop(((FilterOp *) filter)->left, "OR", "tags", "facility");
+  filter_expr_unref(filter);
+
+  /* the negated subexpression is a single operand of the chain */
+  filter = _compile_optimized_filter("message(\"x\") and not (facility(2) and tags(\"t\"))");
+  _assert_fop(filter, "AND", "AND", "regexp");
+  filter_expr_unref(filter);
+}
+
+static void
+_define_filter(const gchar *name, gchar *config_snippet)
+{
+  FilterExprNode *expr = _compile_standalone_filter(config_snippet);
+  LogExprNode *rule = log_expr_node_new_filter(name,
+                                               log_expr_node_new_pipe(log_filter_pipe_new(expr, configuration), NULL),
+                                               NULL);
+
+  cr_assert(cfg_tree_add_object(&configuration->tree, rule));
+}
+
+/* the counters of filter() references are kept across reloads, emulate a previous configuration */
+static void
+_seed_filter_counters(const gchar *name, gsize matched, gsize not_matched, StatsCounterItem **counters)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_logpipe_key_set(&sc_key, SCS_FILTER, name, NULL);
+  stats_register_counter(1, &sc_key, SC_TYPE_MATCHED, &counters[0]);
+  stats_register_counter(1, &sc_key, SC_TYPE_NOT_MATCHED, &counters[1]);
+  stats_counter_set(counters[0], matched);
+  stats_counter_set(counters[1], not_matched);
+  stats_unlock();
+}
+
+static void
+_release_filter_counters(const gchar *name, StatsCounterItem **counters)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_logpipe_key_set(&sc_key, SCS_FILTER, name, NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_MATCHED, &counters[0]);
+  stats_unregister_counter(&sc_key, SC_TYPE_NOT_MATCHED, &counters[1]);
+  stats_unlock();
+}
+
+static void
+_test_filter_call_order(gsize matched, gsize not_matched, const gchar *expected_first)
+{
+  StatsCounterItem *counters[2] = { NULL, NULL };
+  FilterExprNode *filter;
+
+  configuration->stats_options.level = 1;
+  stats_reinit(&configuration->stats_options);
+
+  _define_filter("f_first", "program(\"first\")");
+  _define_filter("f_second", "program(\"second\")");
+  _seed_filter_counters("f_second", matched, not_matched, counters);
+
+  filter = _compile_optimized_filter("filter(f_first) and filter(f_second)");
+  cr_assert_str_eq(((FilterOp *) filter)->left->type, expected_first);
+  filter_expr_unref(filter);
+
+  _release_filter_counters("f_second", counters);
+}
+
+Test(filter_op, test_filter_call_order_is_kept_without_enough_samples)
+{
+  _test_filter_call_order(1, FILTER_EXPR_MIN_SAMPLES - 2, "filter(f_first)");
+}
+
+Test(filter_op, test_rarely_matching_filter_call_is_moved_first_in_and)
+{
+  _test_filter_call_order(10, 10 * FILTER_EXPR_MIN_SAMPLES, "filter(f_second)");
+}
+
+Test(filter_op, test_mostly_matching_filter_call_is_kept_last_in_and)
+{
+  _test_filter_call_order(10 * FILTER_EXPR_MIN_SAMPLES, 10, "filter(f_first)");
+}
+
 TestSuite(filter_op, .init = setup, .fini = teardown);
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "formatter-pool.h"
+#include "apphook.h"
+#include "scratch-buffers.h"
+#include "messages.h"
+
+/* upper limit, the same as the number of main loop worker threads */
+#define FORMATTER_POOL_MAX_THREADS 64
+
+static GMutex formatter_pool_lock;
+static GAsyncQueue *formatter_pool_jobs;
+static GThread *formatter_pool_threads[FORMATTER_POOL_MAX_THREADS];
+static gint formatter_pool_num_threads;
+
+/* pushed once for every thread to make it exit */
+static FormatterPoolJob formatter_pool_stop_job = { NULL, NULL };
+
+static gpointer
+formatter_pool_thread_func(gpointer user_data)
+{
+  app_thread_start();
+
+  while (TRUE)
+    {
+      FormatterPoolJob *job = (FormatterPoolJob *) g_async_queue_pop(formatter_pool_jobs);
+
+      if (!job->func)
+        break;
+
+      job->func(job->user_data);
+      scratch_buffers_explicit_gc();
+    }
+
+  app_thread_stop();
+  return NULL;
+}
+
+void
+formatter_pool_ensure_threads(gint threads)
+{
+  if (threads > FORMATTER_POOL_MAX_THREADS)
+    threads = FORMATTER_POOL_MAX_THREADS;
+
+  g_mutex_lock(&formatter_pool_lock);
+  if (formatter_pool_num_threads < threads)
+    {
+      while (formatter_pool_num_threads < threads)
+        {
+          formatter_pool_threads[formatter_pool_num_threads] = g_thread_new("formatter", formatter_pool_thread_func, NULL);
+          formatter_pool_num_threads++;
+        }
+      msg_debug("Formatter threads started",
+                evt_tag_int("threads", formatter_pool_num_threads));
+    }
+  g_mutex_unlock(&formatter_pool_lock);
+}
+
+void
+formatter_pool_submit(FormatterPoolJob *job)
+{
+  g_assert(job->func);
+  g_async_queue_push(formatter_pool_jobs, job);
+}
+
+void
+formatter_pool_global_init(void)
+{
+  formatter_pool_jobs = g_async_queue_new();
+  formatter_pool_num_threads = 0;
+}
+
+void
+formatter_pool_global_deinit(void)
+{
+  g_mutex_lock(&formatter_pool_lock);
+  for (gint i = 0; i < formatter_pool_num_threads; i++)
+    g_async_queue_push(formatter_pool_jobs, &formatter_pool_stop_job);
+
+  for (gint i = 0; i < formatter_pool_num_threads; i++)
+    {
+      g_thread_join(formatter_pool_threads[i]);
+      formatter_pool_threads[i] = NULL;
+    }
+  formatter_pool_num_threads = 0;
+  g_mutex_unlock(&formatter_pool_lock);
+
+  g_async_queue_unref(formatter_pool_jobs);
+  formatter_pool_jobs = NULL;
+}
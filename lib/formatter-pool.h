@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef FORMATTER_POOL_H_INCLUDED
+#define FORMATTER_POOL_H_INCLUDED
+
+#include "syslog-ng.h"
+
+/*
+ * A process wide pool of helper threads that LogWriter instances use to
+ * format messages in parallel (see format-threads()) and LogReader
+ * instances use to parse them (see parse-threads()).  The threads are
+ * started lazily and are set up like other syslog-ng threads, so templates
+ * can use scratch buffers.
+ *
+ * Jobs are owned by the caller and must stay alive until their function
+ * returns, completion has to be tracked by the caller as well.
+ */
+
+typedef void (*FormatterPoolFunc)(gpointer user_data);
+
+typedef struct _FormatterPoolJob
+{
+  FormatterPoolFunc func;
+  gpointer user_data;
+} FormatterPoolJob;
+
+void formatter_pool_ensure_threads(gint threads);
+void formatter_pool_submit(FormatterPoolJob *job);
+
+void formatter_pool_global_init(void);
+void formatter_pool_global_deinit(void);
+
+#endif
@@ -23,6 +23,7 @@
 #include "host-resolve.h"
 #include "hostname.h"
 #include "dnscache.h"
+#include "dns-resolver.h"
 #include "messages.h"
 #include "cfg.h"
 #include "tls-support.h"
@@ -323,21 +324,14 @@ resolve_address_using_gethostbyaddr(GSockAddr *saddr, gchar *buf, gsize buf_len)
 
 #endif
 
-static void *
-sockaddr_to_dnscache_key(GSockAddr *saddr)
+static gboolean
+resolve_address(GSockAddr *saddr, gchar *buf, gsize buf_len)
 {
-  if (saddr->sa.sa_family == AF_INET)
-    return &((struct sockaddr_in *) &saddr->sa)->sin_addr;
-#if SYSLOG_NG_ENABLE_IPV6
-  else if (saddr->sa.sa_family == AF_INET6)
-    return &((struct sockaddr_in6 *) &saddr->sa)->sin6_addr;
+#ifdef SYSLOG_NG_HAVE_GETNAMEINFO
+  return resolve_address_using_getnameinfo(saddr, buf, buf_len) != NULL;
+#else
+  return resolve_address_using_gethostbyaddr(saddr, buf, buf_len) != NULL;
 #endif
-  else
-    {
-      msg_warning("Socket address is neither IPv4 nor IPv6",
-                  evt_tag_int("sa_family", saddr->sa.sa_family));
-      return NULL;
-    }
 }
 
 static const gchar *
@@ -347,27 +341,32 @@ resolve_sockaddr_to_inet_or_inet6_hostname(gsize *result_len, GSockAddr *saddr,
   const gchar *hname;
   gsize hname_len;
   gboolean positive;
+  gboolean cached;
   void *dnscache_key;
 
-  dnscache_key = sockaddr_to_dnscache_key(saddr);
+  dnscache_key = dns_caching_sockaddr_to_key(saddr);
 
   hname = NULL;
   positive = FALSE;
+  cached = FALSE;
 
   if (host_resolve_options->use_dns_cache)
     {
-      if (dns_caching_lookup(saddr->sa.sa_family, dnscache_key, (const gchar **) &hname, &hname_len, &positive))
-        return hostname_apply_options_fqdn(hname_len, result_len, hname, positive, host_resolve_options);
+      if (dns_caching_lookup(saddr->sa.sa_family, dnscache_key, hostname_buffer, sizeof(hostname_buffer), &hname_len,
+                             &positive))
+        return hostname_apply_options_fqdn(hname_len, result_len, hostname_buffer, positive, host_resolve_options);
     }
 
-  if (!hname && host_resolve_options->use_dns && host_resolve_options->use_dns != 2)
+  if (host_resolve_options->use_dns && host_resolve_options->use_dns != 2)
     {
-#ifdef SYSLOG_NG_HAVE_GETNAMEINFO
-      hname = resolve_address_using_getnameinfo(saddr, hostname_buffer, sizeof(hostname_buffer));
-#else
-      hname = resolve_address_using_gethostbyaddr(saddr, hostname_buffer, sizeof(hostname_buffer));
-#endif
-      positive = (hname != NULL);
+      /* the resolver takes care of caching, even if the answer arrives late */
+      if (dns_resolver_resolve(saddr, resolve_address, host_resolve_options->use_dns_cache,
+                               hostname_buffer, sizeof(hostname_buffer)) == DNS_RESOLVE_SUCCESS)
+        {
+          hname = hostname_buffer;
+          positive = TRUE;
+        }
+      cached = TRUE;
     }
 
   if (!hname)
@@ -375,7 +374,7 @@ resolve_sockaddr_to_inet_or_inet6_hostname(gsize *result_len, GSockAddr *saddr,
       hname = g_sockaddr_format(saddr, hostname_buffer, sizeof(hostname_buffer), GSA_ADDRESS_ONLY);
       positive = FALSE;
     }
-  if (host_resolve_options->use_dns_cache)
+  if (host_resolve_options->use_dns_cache && !cached)
     dns_caching_store(saddr->sa.sa_family, dnscache_key, hname, positive);
 
   return hostname_apply_options_fqdn(-1, result_len, hname, positive, host_resolve_options);
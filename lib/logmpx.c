@@ -130,6 +130,103 @@ log_multiplexer_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_op
   log_pipe_forward_msg(s, msg, path_options);
 }
 
+static inline gboolean
+_is_next_hop_in_pass(LogPipe *next_hop, gint fallback)
+{
+  if (fallback == 0)
+    return (next_hop->flags & PIF_BRANCH_FALLBACK) == 0;
+  return (next_hop->flags & PIF_BRANCH_FALLBACK) != 0;
+}
+
+/*
+ * Same as log_multiplexer_queue(), except that each branch receives the
+ * messages as a single batch, instead of each message visiting every
+ * branch before the next one is processed.  The order of messages within
+ * a branch is the same.
+ */
+static void
+log_multiplexer_queue_batch(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options, gint len)
+{
+  LogMultiplexer *self = (LogMultiplexer *) s;
+  LogPathOptions local_options[LOG_PIPE_MAX_BATCH_SIZE];
+  gboolean matched[LOG_PIPE_MAX_BATCH_SIZE];
+  gboolean delivered[LOG_PIPE_MAX_BATCH_SIZE];
+  gboolean finished[LOG_PIPE_MAX_BATCH_SIZE];
+  LogMessage *hop_msgs[LOG_PIPE_MAX_BATCH_SIZE];
+  const LogPathOptions *hop_path_options[LOG_PIPE_MAX_BATCH_SIZE];
+  gint hop_indexes[LOG_PIPE_MAX_BATCH_SIZE];
+  gint num_undelivered = len;
+  gint fallback, i, j;
+
+  for (j = 0; j < len; j++)
+    {
+      local_options[j] = *path_options[j];
+      local_options[j].matched = &matched[j];
+      delivered[j] = FALSE;
+      finished[j] = FALSE;
+      if (self->next_hops->len > 1)
+        log_msg_write_protect(msgs[j]);
+    }
+
+  for (fallback = 0; (fallback == 0) || (fallback == 1 && self->fallback_exists && num_undelivered > 0); fallback++)
+    {
+      /* the fallback branches only get the messages not delivered so far */
+      for (j = 0; fallback && j < len; j++)
+        finished[j] = delivered[j];
+
+      for (i = 0; i < self->next_hops->len; i++)
+        {
+          LogPipe *next_hop = g_ptr_array_index(self->next_hops, i);
+          gint hop_len = 0;
+
+          if (!_is_next_hop_in_pass(next_hop, fallback))
+            continue;
+
+          for (j = 0; j < len; j++)
+            {
+              if (finished[j])
+                continue;
+
+              matched[j] = TRUE;
+              log_msg_add_ack(msgs[j], &local_options[j]);
+              hop_msgs[hop_len] = log_msg_ref(msgs[j]);
+              hop_path_options[hop_len] = &local_options[j];
+              hop_indexes[hop_len] = j;
+              hop_len++;
+            }
+          if (hop_len == 0)
+            break;
+
+          log_pipe_queue_batch(next_hop, hop_msgs, hop_path_options, hop_len);
+
+          for (gint k = 0; k < hop_len; k++)
+            {
+              j = hop_indexes[k];
+              if (!matched[j])
+                continue;
+
+              if (!delivered[j])
+                num_undelivered--;
+              delivered[j] = TRUE;
+              if (G_UNLIKELY(next_hop->flags & PIF_BRANCH_FINAL))
+                finished[j] = TRUE;
+            }
+        }
+    }
+
+  for (j = 0; j < len; j++)
+    {
+      if (self->next_hops->len > 1)
+        log_msg_write_unprotect(msgs[j]);
+
+      /* see log_multiplexer_queue() */
+      if (!s->pipe_next && !delivered[j] && path_options[j]->matched)
+        *path_options[j]->matched = FALSE;
+    }
+
+  log_pipe_forward_msg_batch(s, msgs, path_options, len);
+}
+
 static void
 log_multiplexer_free(LogPipe *s)
 {
@@ -172,6 +269,7 @@ log_multiplexer_new(GlobalConfig *cfg)
   self->super.init = log_multiplexer_init;
   self->super.deinit = log_multiplexer_deinit;
   self->super.queue = log_multiplexer_queue;
+  self->super.queue_batch = log_multiplexer_queue_batch;
   self->super.free_fn = log_multiplexer_free;
   self->next_hops = g_ptr_array_new();
   self->super.arcs = _arcs;
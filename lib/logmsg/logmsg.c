@@ -439,6 +439,7 @@ log_msg_init_queue_node(LogMessage *msg, LogMessageQueueNode *node, const LogPat
   INIT_IV_LIST_HEAD(&node->list);
   node->ack_needed = path_options->ack_needed;
   node->flow_control_requested = path_options->flow_control_requested;
+  node->enqueued_usec = 0;
   node->msg = log_msg_ref(msg);
   log_msg_write_protect(msg);
 }
@@ -1341,6 +1342,8 @@ log_msg_new(const gchar *msg, gint length,
 
   msg_trace("Initial message parsing follows");
   msg_format_parse(parse_options, self, (guchar *) msg, length);
+
+  TRACEPOINT(log_msg_new, self, length);
   return self;
 }
 
@@ -1350,6 +1353,8 @@ log_msg_new_empty(void)
   LogMessage *self = log_msg_alloc(256);
 
   log_msg_init(self);
+
+  TRACEPOINT(log_msg_new, self, 0);
   return self;
 }
 
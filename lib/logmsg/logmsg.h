@@ -147,6 +147,9 @@ typedef struct _LogMessageQueueNode
   struct iv_list_head list;
   LogMessage *msg;
   gboolean ack_needed:1, embedded:1, flow_control_requested:1;
+  /* low 32 bits of the monotonic time when the node was queued, only set if
+   * the queue measures residency, 0 otherwise */
+  guint32 enqueued_usec;
 } LogMessageQueueNode;
 
 
@@ -73,6 +73,7 @@ log_pipe_init_instance(LogPipe *self, GlobalConfig *cfg)
    * inlined (than to use an indirect call) for performance. */
 
   self->queue = NULL;
+  self->queue_batch = NULL;
   self->free_fn = log_pipe_free_method;
   self->arcs = _arcs;
 }
@@ -136,6 +137,77 @@ log_pipe_forward_notify(LogPipe *self, gint notify_code, gpointer user_data)
   log_pipe_notify(self->pipe_next, notify_code, user_data);
 }
 
+void
+log_pipe_forward_msg_batch(LogPipe *self, LogMessage **msgs, const LogPathOptions **path_options, gint len)
+{
+  if (self->pipe_next)
+    {
+      log_pipe_queue_batch(self->pipe_next, msgs, path_options, len);
+      return;
+    }
+
+  for (gint i = 0; i < len; i++)
+    log_msg_drop(msgs[i], path_options[i], AT_PROCESSED);
+}
+
+static void
+_queue_batch_one_by_one(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options, gint len)
+{
+  for (gint i = 0; i < len; i++)
+    log_pipe_queue(s, msgs[i], path_options[i]);
+}
+
+/*
+ * Same as log_pipe_queue() for an array of messages: the per-message
+ * checks and the indirect call are done once for the whole batch, if the
+ * pipe implements queue_batch().
+ */
+void
+log_pipe_queue_batch(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options, gint len)
+{
+  LogPathOptions local_path_options[LOG_PIPE_MAX_BATCH_SIZE];
+  const LogPathOptions *local_path_options_refs[LOG_PIPE_MAX_BATCH_SIZE];
+
+  g_assert((s->flags & PIF_INITIALIZED) != 0);
+  g_assert(len <= LOG_PIPE_MAX_BATCH_SIZE);
+
+  if (G_UNLIKELY(pipe_single_step_hook) || (s->queue && !s->queue_batch))
+    {
+      _queue_batch_one_by_one(s, msgs, path_options, len);
+      return;
+    }
+
+  for (gint i = 0; i < len; i++)
+    TRACEPOINT(pipe_queue, LOG_PIPE_TRACE_ID(s), msgs[i]);
+
+  if (G_UNLIKELY(s->flags & (PIF_HARD_FLOW_CONTROL)))
+    {
+      for (gint i = 0; i < len; i++)
+        {
+          local_path_options[i] = *path_options[i];
+          local_path_options[i].flow_control_requested = 1;
+          local_path_options_refs[i] = &local_path_options[i];
+        }
+      path_options = local_path_options_refs;
+
+      msg_trace("Requesting flow control", log_pipe_location_tag(s));
+    }
+
+  if (s->queue_batch)
+    s->queue_batch(s, msgs, path_options, len);
+  else
+    log_pipe_forward_msg_batch(s, msgs, path_options, len);
+
+  if (!(s->flags & PIF_DROP_UNMATCHED))
+    return;
+
+  for (gint i = 0; i < len; i++)
+    {
+      if (path_options[i]->matched && !(*path_options[i]->matched))
+        (*path_options[i]->matched) = TRUE;
+    }
+}
+
 void
 log_pipe_set_persist_name(LogPipe *self, const gchar *persist_name)
 {
@@ -31,6 +31,7 @@
 #include "atomic.h"
 #include "messages.h"
 #include "signal-slot-connector/signal-slot-connector.h"
+#include "tracepoint.h"
 
 /* notify code values */
 #define NC_CLOSE       1
@@ -212,6 +213,9 @@ struct _LogPathOptions
 #define LOG_PATH_OPTIONS_INIT { TRUE, FALSE, NULL }
 #define LOG_PATH_OPTIONS_INIT_NOACK { FALSE, FALSE, NULL }
 
+/* the maximum number of messages passed to log_pipe_queue_batch() at once */
+#define LOG_PIPE_MAX_BATCH_SIZE 64
+
 struct _LogPipe
 {
   GAtomicCounter ref_cnt;
@@ -219,6 +223,12 @@ struct _LogPipe
 
   void (*queue)(LogPipe *self, LogMessage *msg, const LogPathOptions *path_options);
 
+  /* Optional batch variant of queue(), pipes without it get the messages
+   * one-by-one.  The arrays are owned by the caller, the references of the
+   * messages are passed on just like with queue().  A class overriding
+   * queue() of its parent has to override (or clear) queue_batch() too.
+   */
+  void (*queue_batch)(LogPipe *self, LogMessage **msgs, const LogPathOptions **path_options, gint len);
   GlobalConfig *cfg;
   LogExprNode *expr_node;
   LogPipe *pipe_next;
@@ -269,7 +279,15 @@ gboolean log_pipe_unref(LogPipe *self);
 LogPipe *log_pipe_new(GlobalConfig *cfg);
 void log_pipe_init_instance(LogPipe *self, GlobalConfig *cfg);
 void log_pipe_forward_notify(LogPipe *self, gint notify_code, gpointer user_data);
+void log_pipe_queue_batch(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options, gint len);
+void log_pipe_forward_msg_batch(LogPipe *self, LogMessage **msgs, const LogPathOptions **path_options, gint len);
 EVTTAG *log_pipe_location_tag(LogPipe *pipe);
+
+/* tracepoint arguments identifying the config object of a pipe */
+#define LOG_PIPE_TRACE_ID(pipe) \
+  (pipe), \
+  ((pipe)->expr_node ? (pipe)->expr_node->filename : NULL), \
+  ((pipe)->expr_node ? (pipe)->expr_node->line : 0)
 void log_pipe_attach_expr_node(LogPipe *self, LogExprNode *expr_node);
 void log_pipe_detach_expr_node(LogPipe *self);
 
@@ -357,6 +375,8 @@ log_pipe_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
   LogPathOptions local_path_options;
   g_assert((s->flags & PIF_INITIALIZED) != 0);
 
+  TRACEPOINT(pipe_queue, LOG_PIPE_TRACE_ID(s), msg);
+
   if (G_UNLIKELY(pipe_single_step_hook))
     {
       if (!pipe_single_step_hook(s, msg, path_options))
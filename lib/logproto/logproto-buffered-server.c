@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <stdlib.h>
 
 typedef struct _BufferedServerBookmarkData
@@ -67,6 +68,145 @@ _log_proto_buffered_server_fallback_non_persistent(LogProtoBufferedServer *self)
   return self->persist_state == NULL;
 }
 
+#ifdef SYSLOG_NG_HAVE_MEMFD_CREATE
+
+static gboolean
+_map_mirrored_buffer(LogProtoBufferedServer *self, gsize size)
+{
+  gsize page_size = sysconf(_SC_PAGESIZE);
+  gsize ring_size = (size + page_size - 1) & ~(page_size - 1);
+  guchar *ring = MAP_FAILED;
+
+  gint fd = memfd_create("syslog-ng-input-buffer", MFD_CLOEXEC);
+  if (fd < 0)
+    goto error;
+
+  if (ftruncate(fd, ring_size) < 0)
+    goto error;
+
+  /* reserve the address range for both halves first, then map the
+   * memfd over it twice */
+  ring = mmap(NULL, 2 * ring_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED)
+    goto error;
+
+  if (mmap(ring, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+      mmap(ring + ring_size, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    goto error;
+
+  close(fd);
+  self->ring = ring;
+  self->ring_size = ring_size;
+  self->buffer = ring;
+  return TRUE;
+
+error:
+  msg_warning("Error allocating mirrored input buffer, falling back to a linear buffer",
+              evt_tag_int("size", size),
+              evt_tag_error("error"));
+  if (ring != MAP_FAILED)
+    munmap(ring, 2 * ring_size);
+  if (fd >= 0)
+    close(fd);
+  return FALSE;
+}
+
+#else
+
+static gboolean
+_map_mirrored_buffer(LogProtoBufferedServer *self, gsize size)
+{
+  msg_warning("mirrored-buffer() is not supported on this platform, falling back to a linear buffer");
+  return FALSE;
+}
+
+#endif
+
+/* let the transport know where reads go, so that it can register the
+ * memory with the kernel (e.g. io_uring fixed buffers) */
+static void
+log_proto_buffered_server_register_buffer(LogProtoBufferedServer *self, gsize size)
+{
+  if (!self->super.transport)
+    return;
+
+  if (self->ring)
+    log_transport_register_buffer(self->super.transport, self->ring, 2 * self->ring_size);
+  else
+    log_transport_register_buffer(self->super.transport, self->buffer, self->buffer ? size : 0);
+}
+
+static void
+log_proto_buffered_server_alloc_buffer(LogProtoBufferedServer *self, gsize size)
+{
+  g_assert(!self->buffer);
+
+  if (!self->super.options->mirrored_buffer || !_map_mirrored_buffer(self, size))
+    self->buffer = g_malloc(size);
+
+  log_proto_buffered_server_register_buffer(self, size);
+}
+
+static void
+log_proto_buffered_server_free_buffer(LogProtoBufferedServer *self)
+{
+  if (self->buffer && self->super.transport)
+    log_transport_register_buffer(self->super.transport, NULL, 0);
+
+  if (self->ring)
+    munmap(self->ring, 2 * self->ring_size);
+  else
+    g_free(self->buffer);
+
+  self->ring = NULL;
+  self->ring_size = 0;
+  self->buffer = NULL;
+}
+
+/* the first @used bytes of the buffer are preserved */
+static void
+log_proto_buffered_server_resize_buffer(LogProtoBufferedServer *self, gsize size, gsize used)
+{
+  if (!self->ring)
+    {
+      self->buffer = g_realloc(self->buffer, size);
+      log_proto_buffered_server_register_buffer(self, size);
+      return;
+    }
+
+  if (size <= self->ring_size)
+    return;
+
+  guchar *old_ring = self->ring;
+  gsize old_ring_size = self->ring_size;
+  guchar *old_buffer = self->buffer;
+
+  self->ring = NULL;
+  self->buffer = NULL;
+  log_proto_buffered_server_alloc_buffer(self, size);
+  memcpy(self->buffer, old_buffer, used);
+  munmap(old_ring, 2 * old_ring_size);
+}
+
+/* Drop the first @start bytes of the pending buffer, making space for new
+ * data after the remaining partial message.  In mirrored mode this only
+ * moves the start of the buffer forward within the ring, the positions
+ * stored in the state remain relative to self->buffer either way. */
+void
+log_proto_buffered_server_compact_buffer(LogProtoBufferedServer *self, LogProtoBufferedServerState *state,
+                                         gsize start)
+{
+  gsize remaining = state->pending_buffer_end - start;
+
+  if (self->ring)
+    self->buffer = self->ring + (self->buffer - self->ring + start) % self->ring_size;
+  else
+    memmove(self->buffer, self->buffer + start, remaining);
+
+  state->pending_buffer_pos = 0;
+  state->pending_buffer_end = remaining;
+}
+
 static gboolean
 log_proto_buffered_server_convert_from_raw(LogProtoBufferedServer *self, const guchar *raw_buffer, gsize raw_buffer_len)
 {
@@ -130,7 +270,7 @@ log_proto_buffered_server_convert_from_raw(LogProtoBufferedServer *self, const g
                   if (state->buffer_size > self->super.options->max_buffer_size)
                     state->buffer_size = self->super.options->max_buffer_size;
 
-                  self->buffer = g_realloc(self->buffer, state->buffer_size);
+                  log_proto_buffered_server_resize_buffer(self, state->buffer_size, state->pending_buffer_end);
                 }
               else
                 {
@@ -182,7 +322,7 @@ log_proto_buffered_server_apply_state(LogProtoBufferedServer *self, PersistEntry
   if (!self->buffer)
     {
       gssize buffer_size = MAX(state->buffer_size, self->super.options->init_buffer_size);
-      self->buffer = g_malloc(buffer_size);
+      log_proto_buffered_server_alloc_buffer(self, buffer_size);
       state->buffer_size = buffer_size;
     }
   state->pending_buffer_end = 0;
@@ -403,7 +543,9 @@ log_proto_buffered_server_convert_state(LogProtoBufferedServer *self, guint8 per
       if (!self->buffer || state->buffer_size < buffer_len)
         {
           gsize buffer_size = MAX(self->super.options->init_buffer_size, buffer_len);
-          self->buffer = g_realloc(self->buffer, buffer_size);
+
+          log_proto_buffered_server_free_buffer(self);
+          log_proto_buffered_server_alloc_buffer(self, buffer_size);
         }
       serialize_archive_free(archive);
 
@@ -636,7 +778,7 @@ static inline void
 log_proto_buffered_server_allocate_buffer(LogProtoBufferedServer *self, LogProtoBufferedServerState *state)
 {
   state->buffer_size = self->super.options->init_buffer_size;
-  self->buffer = g_malloc(state->buffer_size);
+  log_proto_buffered_server_alloc_buffer(self, state->buffer_size);
 }
 
 static inline gint
@@ -933,7 +1075,7 @@ log_proto_buffered_server_free_method(LogProtoServer *s)
 
   log_transport_aux_data_destroy(&self->buffer_aux);
 
-  g_free(self->buffer);
+  log_proto_buffered_server_free_buffer(self);
   if (self->state1)
     {
       g_free(self->state1);
@@ -92,6 +92,12 @@ struct _LogProtoBufferedServer
   GIConv convert;
   guchar *buffer;
 
+  /* with mirrored_buffer(yes), buffer points into ring, which maps the
+   * same ring_size bytes twice back-to-back: any buffer_size long window
+   * starting in the first half is contiguous */
+  guchar *ring;
+  gsize ring_size;
+
   /* auxiliary data (e.g. GSockAddr, other transport related meta
    * data) associated with the already buffered data */
   LogTransportAuxData buffer_aux;
@@ -113,6 +119,8 @@ LogProtoPrepareAction log_proto_buffered_server_prepare(LogProtoServer *s, GIOCo
                                                         gint *timeout G_GNUC_UNUSED);
 LogProtoBufferedServerState *log_proto_buffered_server_get_state(LogProtoBufferedServer *self);
 void log_proto_buffered_server_put_state(LogProtoBufferedServer *self);
+void log_proto_buffered_server_compact_buffer(LogProtoBufferedServer *self, LogProtoBufferedServerState *state,
+                                              gsize start);
 
 /* LogProtoBufferedServer */
 gboolean log_proto_buffered_server_validate_options_method(LogProtoServer *s);
@@ -27,6 +27,7 @@
 
 #include "logproto.h"
 #include "persist-state.h"
+#include "tracepoint.h"
 
 typedef struct _LogProtoClient LogProtoClient;
 
@@ -168,7 +169,10 @@ log_proto_client_process_in(LogProtoClient *s)
 static inline LogProtoStatus
 log_proto_client_post(LogProtoClient *s, LogMessage *logmsg, guchar *msg, gsize msg_len, gboolean *consumed)
 {
-  return s->post(s, logmsg, msg, msg_len, consumed);
+  LogProtoStatus status = s->post(s, logmsg, msg, msg_len, consumed);
+
+  TRACEPOINT(proto_client_post, s, s->transport->fd, status, msg_len);
+  return status;
 }
 
 static inline gint
@@ -29,6 +29,7 @@
 #include "persist-state.h"
 #include "transport/transport-aux-data.h"
 #include "ack-tracker/bookmark.h"
+#include "tracepoint.h"
 
 typedef struct _LogProtoServer LogProtoServer;
 typedef struct _LogProtoServerOptions LogProtoServerOptions;
@@ -52,6 +53,9 @@ struct _LogProtoServerOptions
   gboolean trim_large_messages;
   gint max_buffer_size;
   gint init_buffer_size;
+  /* map the input buffer twice back-to-back, so that partial lines never
+   * need to be moved to the front of the buffer */
+  gboolean mirrored_buffer;
   AckTrackerFactory *ack_tracker_factory;
 };
 
@@ -144,9 +148,14 @@ static inline LogProtoStatus
 log_proto_server_fetch(LogProtoServer *s, const guchar **msg, gsize *msg_len, gboolean *may_read,
                        LogTransportAuxData *aux, Bookmark *bookmark)
 {
-  if (s->status == LPS_SUCCESS)
-    return s->fetch(s, msg, msg_len, may_read, aux, bookmark);
-  return s->status;
+  if (s->status != LPS_SUCCESS)
+    return s->status;
+
+  LogProtoStatus status = s->fetch(s, msg, msg_len, may_read, aux, bookmark);
+
+  /* *msg is only set by fetch() on success */
+  TRACEPOINT(proto_server_fetch, s, s->transport->fd, status, (status == LPS_SUCCESS && *msg) ? *msg_len : 0);
+  return status;
 }
 
 static inline gint
@@ -186,9 +186,8 @@ log_proto_text_server_split_buffer(LogProtoTextServer *self, LogProtoBufferedSer
    * to the beginning of the buffer to make space for new data.
    */
 
-  memmove(self->super.buffer, buffer_start, buffer_bytes);
-  state->pending_buffer_pos = 0;
-  state->pending_buffer_end = buffer_bytes;
+  log_proto_buffered_server_compact_buffer(&self->super, state, buffer_start - self->super.buffer);
+  buffer_start = self->super.buffer;
 
   if (G_UNLIKELY(self->super.pos_tracking))
     {
@@ -565,3 +565,44 @@ Test(log_proto, test_log_proto_text_server_rewinding_the_initial_line_results_in
   test_log_proto_text_server_rewinding_the_initial_line_results_in_an_empty_message(log_transport_mock_stream_new);
   test_log_proto_text_server_rewinding_the_initial_line_results_in_an_empty_message(log_transport_mock_records_new);
 }
+
+static void
+test_log_proto_text_server_mirrored_buffer(const gchar *encoding)
+{
+  LogProtoServer *proto;
+  GString *input = g_string_new("");
+  gchar expected[32];
+
+  /* lines are split at random positions by the 32 byte reads, and the
+   * total size is larger than a page, so the buffer wraps around the ring
+   * several times */
+  for (gint i = 0; i < 500; i++)
+    g_string_append_printf(input, "line %03d: 0123456789\n", i);
+
+  proto_server_options.mirrored_buffer = TRUE;
+  if (encoding)
+    log_proto_server_options_set_encoding(&proto_server_options, encoding);
+  proto = construct_test_proto(log_transport_mock_stream_new(input->str, input->len, LTM_EOF));
+
+  for (gint i = 0; i < 500; i++)
+    {
+      g_snprintf(expected, sizeof(expected), "line %03d: 0123456789", i);
+      assert_proto_server_fetch(proto, expected, -1);
+    }
+#ifdef SYSLOG_NG_HAVE_MEMFD_CREATE
+  cr_assert_not_null(((LogProtoBufferedServer *) proto)->ring, "mirrored buffer was not allocated");
+#endif
+  assert_proto_server_fetch_failure(proto, LPS_EOF, NULL);
+  log_proto_server_free(proto);
+  g_string_free(input, TRUE);
+}
+
+Test(log_proto, test_log_proto_text_server_mirrored_buffer)
+{
+  test_log_proto_text_server_mirrored_buffer(NULL);
+}
+
+Test(log_proto, test_log_proto_text_server_mirrored_buffer_with_encoding)
+{
+  test_log_proto_text_server_mirrored_buffer("iso-8859-2");
+}
@@ -43,27 +43,30 @@ QueueType log_queue_fifo_type = "FIFO";
  *
  *   - has a per-thread, unlocked input queue where threads can put their items
  *
- *   - has a locked wait-queue where items go once the per-thread input
+ *   - has a lock-free wait-queue where items go once the per-thread input
  *     would be overflown or if the input thread goes to sleep (e.g.  one
- *     lock acquisition per a longer period)
+ *     atomic exchange per a longer period)
  *
  *   - has an unlocked output queue where items from the wait queue go, once
  *     it becomes depleted.
  *
  * This means that items flow in this sequence from one list to the next:
  *
- *    input queue (per-thread) -> wait queue (locked) -> output queue (single-threaded)
+ *    input queue (per-thread) -> wait queue (lock-free) -> output queue (single-threaded)
  *
  * Fastpath is:
  *   - input threads putting elements on their per-thread queue (lockless)
  *   - output threads removing elements from the output queue (lockless)
  *
  * Slowpath:
- *   - input queue is overflown (or the input thread goes to sleep), wait
- *     queue mutex is grabbed, all elements are put to the wait queue.
+ *   - input queue is overflown (or the input thread goes to sleep), all
+ *     elements are appended to the wait queue as a single segment.
  *
- *   - output queue is depleted, wait queue mutex is grabbed, all elements
- *     on the wait queue is put to the output queue
+ *   - output queue is depleted, all elements on the wait queue is put to
+ *     the output queue
+ *
+ *   - LogQueue->lock is only grabbed by input threads if the output thread
+ *     is waiting for a push notification.
  *
  * Threading assumptions:
  *   - the head of the queue is only manipulated from the output thread
@@ -87,13 +90,38 @@ typedef struct _OverflowQueue
   gint non_flow_controlled_len;
 } OverflowQueue;
 
+/*
+ * Intrusive multi-producer, single-consumer list of LogMessageQueueNodes
+ * (the non-blocking MPSC queue by Dmitry Vyukov).  Producers append a
+ * pre-linked segment with a single atomic exchange of the tail, the output
+ * thread detaches the nodes that are completely linked in.
+ *
+ * While a node is on the wait queue, only node->list.next is used, as a
+ * singly linked list, list.prev is fixed up when it is moved to the output
+ * queue.
+ *
+ * len and non_flow_controlled_len are increased before a segment is linked
+ * in, so they are never smaller than the number of nodes available to the
+ * consumer.
+ */
+typedef struct _WaitQueue
+{
+  struct iv_list_head *tail;
+  gint len;
+  gint non_flow_controlled_len;
+
+  /* only touched by the output thread */
+  struct iv_list_head *head;
+  struct iv_list_head stub;
+} WaitQueue;
+
 typedef struct _LogQueueFifo
 {
   LogQueue super;
 
   /* scalable qoverflow implementation */
   OverflowQueue output_queue;
-  OverflowQueue wait_queue;
+  WaitQueue wait_queue;
   OverflowQueue backlog_queue; /* entries that were sent but not acked yet */
 
   gint log_fifo_size;
@@ -104,6 +132,99 @@ typedef struct _LogQueueFifo
   InputQueue input_queues[0];
 } LogQueueFifo;
 
+static void
+_wait_queue_init(WaitQueue *self)
+{
+  self->stub.next = NULL;
+  self->head = self->tail = &self->stub;
+  self->len = 0;
+  self->non_flow_controlled_len = 0;
+}
+
+static struct iv_list_head *
+_wait_queue_exchange_tail(WaitQueue *self, struct iv_list_head *new_tail)
+{
+  struct iv_list_head *old_tail;
+
+  do
+    old_tail = g_atomic_pointer_get(&self->tail);
+  while (!g_atomic_pointer_compare_and_exchange(&self->tail, old_tail, new_tail));
+
+  return old_tail;
+}
+
+/* first ... last must already be linked together through their next pointers */
+static void
+_wait_queue_link_segment(WaitQueue *self, struct iv_list_head *first, struct iv_list_head *last)
+{
+  last->next = NULL;
+
+  /* the consumer cannot go beyond prev until its next pointer is set */
+  struct iv_list_head *prev = _wait_queue_exchange_tail(self, last);
+  g_atomic_pointer_set(&prev->next, first);
+}
+
+/* can be called from any thread */
+static void
+_wait_queue_push_segment(WaitQueue *self, struct iv_list_head *first, struct iv_list_head *last,
+                         gint len, gint non_flow_controlled_len)
+{
+  g_atomic_int_add(&self->len, len);
+  g_atomic_int_add(&self->non_flow_controlled_len, non_flow_controlled_len);
+  _wait_queue_link_segment(self, first, last);
+}
+
+/* can only be called from the output thread */
+static void
+_wait_queue_move_to(WaitQueue *self, OverflowQueue *q)
+{
+  struct iv_list_head *head = self->head;
+  gint len = 0, non_flow_controlled_len = 0;
+
+  while (TRUE)
+    {
+      struct iv_list_head *next = g_atomic_pointer_get(&head->next);
+
+      if (!next)
+        {
+          /* either empty, or a producer has not finished linking its
+           * segment yet, the rest is picked up next time */
+          if (head == &self->stub || head != g_atomic_pointer_get(&self->tail))
+            break;
+
+          /* head is the last node, put the stub behind it so it can be
+           * detached without racing with the producers */
+          _wait_queue_link_segment(self, &self->stub, &self->stub);
+          next = g_atomic_pointer_get(&head->next);
+          if (!next)
+            break;
+        }
+
+      if (head != &self->stub)
+        {
+          LogMessageQueueNode *node = iv_list_entry(head, LogMessageQueueNode, list);
+
+          iv_list_add_tail(head, &q->items);
+          len++;
+          if (!node->flow_control_requested)
+            non_flow_controlled_len++;
+        }
+      head = next;
+    }
+  self->head = head;
+
+  q->len += len;
+  q->non_flow_controlled_len += non_flow_controlled_len;
+  g_atomic_int_add(&self->len, -len);
+  g_atomic_int_add(&self->non_flow_controlled_len, -non_flow_controlled_len);
+}
+
+static inline gint
+_wait_queue_get_length(WaitQueue *self)
+{
+  return g_atomic_int_get(&self->len);
+}
+
 /* NOTE: this is inherently racy. If the LogQueue->lock is taken, then the
  * race is limited to the changes in output_queue queue changes.
  *
@@ -130,13 +251,7 @@ log_queue_fifo_get_length(LogQueue *s)
 {
   LogQueueFifo *self = (LogQueueFifo *) s;
 
-  return self->wait_queue.len + self->output_queue.len;
-}
-
-static gint64
-log_queue_fifo_get_non_flow_controlled_length(LogQueueFifo *self)
-{
-  return self->wait_queue.non_flow_controlled_len + self->output_queue.non_flow_controlled_len;
+  return _wait_queue_get_length(&self->wait_queue) + self->output_queue.len;
 }
 
 gboolean
@@ -144,7 +259,7 @@ log_queue_fifo_is_empty_racy(LogQueue *s)
 {
   LogQueueFifo *self = (LogQueueFifo *) s;
   gboolean has_message_in_queue = FALSE;
-  g_static_mutex_lock(&self->super.lock);
+
   if (log_queue_fifo_get_length(s) > 0)
     {
       has_message_in_queue = TRUE;
@@ -157,7 +272,6 @@ log_queue_fifo_is_empty_racy(LogQueue *s)
           has_message_in_queue |= self->input_queues[i].finish_cb_registered;
         }
     }
-  g_static_mutex_unlock(&self->super.lock);
   return !has_message_in_queue;
 }
 
@@ -210,76 +324,112 @@ log_queue_fifo_drop_messages_from_input_queue(LogQueueFifo *self, InputQueue *in
             evt_tag_str("persist_name", self->super.persist_name));
 }
 
-static inline gboolean
-log_queue_fifo_calculate_num_of_messages_to_drop(LogQueueFifo *self, InputQueue *input_queue,
-                                                 gint *num_of_messages_to_drop)
+/* The wait queue counter the log_fifo_size limit applies to: all items in
+ * legacy mode, non-flow-controlled ones otherwise. */
+static inline gint *
+log_queue_fifo_get_limited_counter(LogQueueFifo *self)
 {
-  /* since we're in the input thread, queue_len will be racy.
-   * It can increase due to log_queue_fifo_push_head() and can also decrease as
-   * items are removed from the output queue using log_queue_pop_head().
-   *
-   * The only reason we're using it here is to check for qoverflow
-   * overflows, however the only side-effect of the race (if lost) is that
-   * we would lose a couple of message too many or add some more messages to
-   * qoverflow than permitted by the user.  Since if flow-control is used,
-   * the fifo size should be sized larger than the potential window sizes,
-   * otherwise we can lose messages anyway, this is not deemed a cost to
-   * justify proper locking in this case.
-   */
-
-  guint16 input_queue_len;
-  gint queue_len;
+  if (G_UNLIKELY(self->use_legacy_fifo_size))
+    return &self->wait_queue.len;
+  return &self->wait_queue.non_flow_controlled_len;
+}
 
+static inline gint
+log_queue_fifo_get_limited_output_length(LogQueueFifo *self)
+{
   if (G_UNLIKELY(self->use_legacy_fifo_size))
+    return self->output_queue.len;
+  return self->output_queue.non_flow_controlled_len;
+}
+
+/*
+ * Reserves room for up to @n items in the wait queue, returns the number of
+ * items that fit in log_fifo_size.
+ *
+ * The limited counter is only increased with a compare-and-exchange against
+ * the value the decision was based on, so concurrent input threads cannot
+ * push the queue beyond log_fifo_size together.  The output queue length is
+ * read without synchronization, but the output thread can only decrease it
+ * (or move items over from the wait queue, increasing the output queue
+ * first), so the race is on the safe side: we may drop a message that
+ * would have just fit, but never exceed the limit.
+ */
+static gint
+log_queue_fifo_reserve(LogQueueFifo *self, gint n)
+{
+  gint *counter = log_queue_fifo_get_limited_counter(self);
+  gint old_value, reserved;
+
+  do
     {
-      queue_len = log_queue_fifo_get_length(&self->super);
-      input_queue_len = input_queue->len;
-    }
-  else
-    {
-      queue_len = log_queue_fifo_get_non_flow_controlled_length(self);
-      input_queue_len = input_queue->non_flow_controlled_len;
+      old_value = g_atomic_int_get(counter);
+      reserved = CLAMP(self->log_fifo_size - old_value - log_queue_fifo_get_limited_output_length(self), 0, n);
     }
+  while (reserved > 0 && !g_atomic_int_compare_and_exchange(counter, old_value, old_value + reserved));
 
-  gboolean drop_messages = queue_len + input_queue_len > self->log_fifo_size;
-  if (!drop_messages)
-    return FALSE;
+  return reserved;
+}
+
+/* link items to the wait queue, the limited counter has already been
+ * increased by log_queue_fifo_reserve() */
+static void
+log_queue_fifo_push_reserved(LogQueueFifo *self, struct iv_list_head *first, struct iv_list_head *last,
+                             gint len, gint non_flow_controlled_len)
+{
+  if (G_UNLIKELY(self->use_legacy_fifo_size))
+    _wait_queue_push_segment(&self->wait_queue, first, last, 0, non_flow_controlled_len);
+  else
+    _wait_queue_push_segment(&self->wait_queue, first, last, len, 0);
+}
 
-  /* NOTE: MAX is needed here to ensure that the lost race on queue_len
-   * doesn't result in n < 0 */
-  *num_of_messages_to_drop = input_queue_len - MAX(0, (self->log_fifo_size - queue_len));
+/* wake up the output thread if it is waiting for items, the exchange of the
+ * wait queue tail is a full barrier: either the output thread sees our items
+ * in log_queue_check_items(), or we see its callback here */
+static void
+log_queue_fifo_push_notify(LogQueueFifo *self)
+{
+  if (!g_atomic_pointer_get(&self->super.parallel_push_notify))
+    return;
 
-  return TRUE;
+  g_static_mutex_lock(&self->super.lock);
+  log_queue_push_notify(&self->super);
+  g_static_mutex_unlock(&self->super.lock);
 }
 
-/* move items from the per-thread input queue to the lock-protected "wait" queue */
+/* move items from the per-thread input queue to the lock-free "wait" queue */
 static void
 log_queue_fifo_move_input_unlocked(LogQueueFifo *self, gint thread_id)
 {
-  gint num_of_messages_to_drop;
-  gboolean drop_messages = log_queue_fifo_calculate_num_of_messages_to_drop(self, &self->input_queues[thread_id],
-                           &num_of_messages_to_drop);
+  InputQueue *input_queue = &self->input_queues[thread_id];
 
-  if (drop_messages)
+  if (input_queue->len == 0)
+    return;
+
+  gint limited_len = G_UNLIKELY(self->use_legacy_fifo_size) ? input_queue->len : input_queue->non_flow_controlled_len;
+  gint num_of_messages_to_drop = limited_len - log_queue_fifo_reserve(self, limited_len);
+
+  if (num_of_messages_to_drop > 0)
     {
       /* slow path, the input thread's queue would overflow the queue, let's drop some messages */
-      log_queue_fifo_drop_messages_from_input_queue(self, &self->input_queues[thread_id], num_of_messages_to_drop);
+      log_queue_fifo_drop_messages_from_input_queue(self, input_queue, num_of_messages_to_drop);
     }
 
-  log_queue_queued_messages_add(&self->super, self->input_queues[thread_id].len);
-  iv_list_update_msg_size(self, &self->input_queues[thread_id].items);
+  log_queue_queued_messages_add(&self->super, input_queue->len);
+  iv_list_update_msg_size(self, &input_queue->items);
 
-  iv_list_splice_tail_init(&self->input_queues[thread_id].items, &self->wait_queue.items);
-  self->wait_queue.len += self->input_queues[thread_id].len;
-  self->wait_queue.non_flow_controlled_len += self->input_queues[thread_id].non_flow_controlled_len;
-  self->input_queues[thread_id].len = 0;
-  self->input_queues[thread_id].non_flow_controlled_len = 0;
+  if (!iv_list_empty(&input_queue->items))
+    {
+      log_queue_fifo_push_reserved(self, input_queue->items.next, input_queue->items.prev,
+                                   input_queue->len, input_queue->non_flow_controlled_len);
+      INIT_IV_LIST_HEAD(&input_queue->items);
+    }
+  input_queue->len = 0;
+  input_queue->non_flow_controlled_len = 0;
 }
 
-/* move items from the per-thread input queue to the lock-protected
- * "wait" queue, but grabbing locks first. This is registered as a
- * callback to be called when the input worker thread finishes its
- * job.
+/* move items from the per-thread input queue to the "wait" queue and
+ * notify the output thread. This is registered as a callback to be called
+ * when the input worker thread finishes its job.
  */
 static gpointer
 log_queue_fifo_move_input(gpointer user_data)
@@ -291,24 +441,41 @@ log_queue_fifo_move_input(gpointer user_data)
 
   g_assert(thread_id >= 0);
 
-  g_static_mutex_lock(&self->super.lock);
   log_queue_fifo_move_input_unlocked(self, thread_id);
-  log_queue_push_notify(&self->super);
-  g_static_mutex_unlock(&self->super.lock);
+  log_queue_fifo_push_notify(self);
   self->input_queues[thread_id].finish_cb_registered = FALSE;
   log_queue_unref(&self->super);
   return NULL;
 }
 
-/* lock must be held */
+/* reserves a slot in the wait queue, see log_queue_fifo_reserve() */
 static inline gboolean
 _message_has_to_be_dropped(LogQueueFifo *self, const LogPathOptions *path_options)
 {
-  if (G_UNLIKELY(self->use_legacy_fifo_size))
-    return log_queue_fifo_get_length(&self->super) >= self->log_fifo_size;
+  if (!self->use_legacy_fifo_size && path_options->flow_control_requested)
+    return FALSE;
 
-  return !path_options->flow_control_requested
-         && log_queue_fifo_get_non_flow_controlled_length(self) >= self->log_fifo_size;
+  return log_queue_fifo_reserve(self, 1) == 0;
+}
+
+/* queue residency is measured on the low 32 bits of the monotonic clock,
+ * which wraps in about 71 minutes, the upper limit of StatsHistogram anyway */
+static inline void
+_stamp_node(LogQueueFifo *self, LogMessageQueueNode *node)
+{
+  if (self->super.residency)
+    node->enqueued_usec = (guint32) g_get_monotonic_time() | 1;
+}
+
+static inline void
+_record_residency(LogQueueFifo *self, LogMessageQueueNode *node)
+{
+  if (!self->super.residency || !node->enqueued_usec)
+    return;
+
+  stats_histogram_record(self->super.residency, (guint32) g_get_monotonic_time() - node->enqueued_usec);
+  /* rewound messages are not accounted twice */
+  node->enqueued_usec = 0;
 }
 
 static inline void
@@ -374,6 +541,7 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
         }
 
       node = log_msg_alloc_queue_node(msg, path_options);
+      _stamp_node(self, node);
       iv_list_add_tail(&node->list, &self->input_queues[thread_id].items);
       self->input_queues[thread_id].len++;
 
@@ -384,14 +552,11 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
       return;
     }
 
-  /* slow path, put the pending item and the whole input queue to the wait_queue */
-
-  g_static_mutex_lock(&self->super.lock);
+  /* slow path, put the pending item directly to the wait_queue */
 
   if (_message_has_to_be_dropped(self, path_options))
     {
       stats_counter_inc(self->super.dropped_messages);
-      g_static_mutex_unlock(&self->super.lock);
 
       _drop_message(msg, path_options);
 
@@ -403,18 +568,14 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
     }
 
   node = log_msg_alloc_queue_node(msg, path_options);
+  _stamp_node(self, node);
 
-  iv_list_add_tail(&node->list, &self->wait_queue.items);
-  self->wait_queue.len++;
-
-  if (!path_options->flow_control_requested)
-    self->wait_queue.non_flow_controlled_len++;
-
-  log_queue_push_notify(&self->super);
   log_queue_queued_messages_inc(&self->super);
-
   log_queue_memory_usage_add(&self->super, log_msg_get_size(msg));
-  g_static_mutex_unlock(&self->super.lock);
+
+  log_queue_fifo_push_reserved(self, &node->list, &node->list, 1,
+                               path_options->flow_control_requested ? 0 : 1);
+  log_queue_fifo_push_notify(self);
 
   log_msg_unref(msg);
 }
@@ -464,13 +625,7 @@ log_queue_fifo_pop_head(LogQueue *s, LogPathOptions *path_options)
   if (self->output_queue.len == 0)
     {
       /* slow path, output queue is empty, get some elements from the wait queue */
-      g_static_mutex_lock(&self->super.lock);
-      iv_list_splice_tail_init(&self->wait_queue.items, &self->output_queue.items);
-      self->output_queue.len = self->wait_queue.len;
-      self->output_queue.non_flow_controlled_len = self->wait_queue.non_flow_controlled_len;
-      self->wait_queue.len = 0;
-      self->wait_queue.non_flow_controlled_len = 0;
-      g_static_mutex_unlock(&self->super.lock);
+      _wait_queue_move_to(&self->wait_queue, &self->output_queue);
     }
 
   if (self->output_queue.len > 0)
@@ -479,6 +634,7 @@ log_queue_fifo_pop_head(LogQueue *s, LogPathOptions *path_options)
 
       msg = node->msg;
       path_options->ack_needed = node->ack_needed;
+      _record_residency(self, node);
       self->output_queue.len--;
 
       if (!node->flow_control_requested)
@@ -644,7 +800,7 @@ log_queue_fifo_free(LogQueue *s)
       log_queue_fifo_free_queue(&self->input_queues[i].items);
     }
 
-  log_queue_fifo_free_queue(&self->wait_queue.items);
+  _wait_queue_move_to(&self->wait_queue, &self->output_queue);
   log_queue_fifo_free_queue(&self->output_queue.items);
   log_queue_fifo_free_queue(&self->backlog_queue.items);
   log_queue_free_method(s);
@@ -680,7 +836,7 @@ log_queue_fifo_new(gint log_fifo_size, const gchar *persist_name)
       self->input_queues[i].cb.func = log_queue_fifo_move_input;
       self->input_queues[i].cb.user_data = self;
     }
-  INIT_IV_LIST_HEAD(&self->wait_queue.items);
+  _wait_queue_init(&self->wait_queue);
   INIT_IV_LIST_HEAD(&self->output_queue.items);
   INIT_IV_LIST_HEAD(&self->backlog_queue.items);
 
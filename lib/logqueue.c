@@ -147,11 +147,19 @@ log_queue_check_items(LogQueue *self, gint *timeout, LogQueuePushNotifyFunc para
   num_elements = log_queue_get_length(self);
   if (num_elements == 0)
     {
-      self->parallel_push_notify = parallel_push_notify;
       self->parallel_push_data = user_data;
       self->parallel_push_data_destroy = user_data_destroy;
-      g_static_mutex_unlock(&self->lock);
-      return FALSE;
+      g_atomic_pointer_set(&self->parallel_push_notify, parallel_push_notify);
+
+      /* queue implementations may add items without holding self->lock,
+       * checking parallel_push_notify only afterwards: recheck the length
+       * once the callback is visible so that such items are not missed */
+      num_elements = log_queue_get_length(self);
+      if (num_elements == 0)
+        {
+          g_static_mutex_unlock(&self->lock);
+          return FALSE;
+        }
     }
 
   /* consume the user_data reference as we won't use the callback */
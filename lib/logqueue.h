@@ -27,6 +27,8 @@
 
 #include "logmsg/logmsg.h"
 #include "stats/stats-registry.h"
+#include "stats/stats-histogram.h"
+#include "tracepoint.h"
 
 extern gint log_queue_max_threads;
 
@@ -50,6 +52,8 @@ struct _LogQueue
   StatsCounterItem *queued_messages;
   StatsCounterItem *dropped_messages;
   StatsCounterItem *memory_usage;
+  /* owned by the consumer, see log_queue_set_residency_histogram() */
+  StatsHistogram *residency;
 
   struct
   {
@@ -86,6 +90,16 @@ log_queue_keep_on_reload(LogQueue *self)
   return TRUE;
 }
 
+/* The time messages spend in the queue is recorded into @residency while
+ * it is set.  Only the FIFO queue measures it, by stamping its queue nodes
+ * on push and recording the difference when they are popped.  Can only be
+ * called while no messages are flowing (init/deinit). */
+static inline void
+log_queue_set_residency_histogram(LogQueue *self, StatsHistogram *residency)
+{
+  self->residency = residency;
+}
+
 static inline gint64
 log_queue_get_length(LogQueue *self)
 {
@@ -104,6 +118,7 @@ log_queue_is_empty_racy(LogQueue *self)
 static inline void
 log_queue_push_tail(LogQueue *self, LogMessage *msg, const LogPathOptions *path_options)
 {
+  TRACEPOINT(queue_push_tail, self, self->persist_name, msg);
   self->push_tail(self, msg, path_options);
 }
 
@@ -122,6 +137,7 @@ log_queue_pop_head(LogQueue *self, LogPathOptions *path_options)
     return NULL;
 
   msg = self->pop_head(self, path_options);
+  TRACEPOINT(queue_pop_head, self, self->persist_name, msg);
 
   if (msg && self->throttle_buckets > 0)
     self->throttle_buckets--;
@@ -132,7 +148,10 @@ log_queue_pop_head(LogQueue *self, LogPathOptions *path_options)
 static inline LogMessage *
 log_queue_pop_head_ignore_throttle(LogQueue *self, LogPathOptions *path_options)
 {
-  return self->pop_head(self, path_options);
+  LogMessage *msg = self->pop_head(self, path_options);
+
+  TRACEPOINT(queue_pop_head, self, self->persist_name, msg);
+  return msg;
 }
 
 static inline void
@@ -24,9 +24,54 @@
 
 #include "logreader.h"
 #include "mainloop-call.h"
+#include "formatter-pool.h"
 #include "ack-tracker/ack_tracker.h"
 #include "ack-tracker/ack_tracker_factory.h"
 
+/* number of lines parsed by a single parser job */
+#define LOG_READER_PARSE_CHUNK_SIZE 64
+/* batches smaller than this are not worth to be split among threads */
+#define LOG_READER_PARSE_MIN_CHUNK_SIZE 16
+
+/* a framed line, copied out of the LogProtoServer buffer */
+typedef struct _LogReaderParseItem
+{
+  gsize offset;
+  gsize length;
+  gint proto;
+  /* only allocated if the transport passed addresses or name-value pairs */
+  LogTransportAuxData *aux;
+  gboolean aux_set;
+  LogMessage *msg;
+} LogReaderParseItem;
+
+typedef struct _LogReaderParseChunk
+{
+  FormatterPoolJob job;
+  LogReaderParseBatch *batch;
+  gint start, end;
+} LogReaderParseChunk;
+
+/*
+ * Lines framed in one fetch when parse-threads() is set.  They are parsed
+ * in parallel, then posted either in their original order by the thread
+ * fetching the input, or by the parser threads as they finish.
+ */
+struct _LogReaderParseBatch
+{
+  LogReader *reader;
+  GString *lines;
+  LogReaderParseItem *items;
+  gint num_items, max_items;
+  LogReaderParseChunk *chunks;
+  gint num_chunks;
+  gboolean ordered;
+
+  GMutex lock;
+  GCond chunks_done;
+  gint pending_chunks;
+};
+
 static void log_reader_io_handle_in(gpointer s);
 static gboolean log_reader_fetch_log(LogReader *self);
 static void log_reader_update_watches(LogReader *self);
@@ -436,8 +481,8 @@ log_reader_process_handshake(LogReader *self)
   return 0;
 }
 
-static gboolean
-log_reader_handle_line(LogReader *self, const guchar *line, gint length, LogTransportAuxData *aux)
+static LogMessage *
+log_reader_parse_line(LogReader *self, const guchar *line, gint length, LogTransportAuxData *aux)
 {
   LogMessage *m;
 
@@ -450,34 +495,310 @@ log_reader_handle_line(LogReader *self, const guchar *line, gint length, LogTran
   log_msg_set_saddr(m, aux->peer_addr ? : self->peer_addr);
   log_msg_set_daddr(m, aux->local_addr ? : self->local_addr);
   m->proto = aux->proto;
-  log_msg_refcache_start_producer(m);
 
   log_transport_aux_data_foreach(aux, _add_aux_nvpair, m);
+  return m;
+}
 
+static void
+log_reader_post_msg(LogReader *self, LogMessage *m)
+{
+  log_msg_refcache_start_producer(m);
   log_source_post(&self->super, m);
   log_msg_refcache_stop();
+}
+
+static gboolean
+log_reader_handle_line(LogReader *self, const guchar *line, gint length, LogTransportAuxData *aux)
+{
+  log_reader_post_msg(self, log_reader_parse_line(self, line, length, aux));
   return log_source_free_to_send(&self->super);
 }
 
+/*****************************************************************************
+ * Parallel parsing (parse-threads())
+ *****************************************************************************/
+
+static LogReaderParseBatch *
+log_reader_parse_batch_new(LogReader *reader, gint threads)
+{
+  LogReaderParseBatch *self = g_new0(LogReaderParseBatch, 1);
+
+  self->reader = reader;
+  self->lines = g_string_sized_new(4096);
+  self->num_chunks = threads;
+  self->max_items = threads * LOG_READER_PARSE_CHUNK_SIZE;
+  self->items = g_new0(LogReaderParseItem, self->max_items);
+  self->chunks = g_new0(LogReaderParseChunk, self->num_chunks);
+  g_mutex_init(&self->lock);
+  g_cond_init(&self->chunks_done);
+  return self;
+}
+
+static void
+log_reader_parse_batch_free(LogReaderParseBatch *self)
+{
+  g_assert(self->num_items == 0);
+
+  for (gint i = 0; i < self->max_items; i++)
+    g_free(self->items[i].aux);
+  g_free(self->items);
+  g_free(self->chunks);
+  g_string_free(self->lines, TRUE);
+  g_mutex_clear(&self->lock);
+  g_cond_clear(&self->chunks_done);
+  g_free(self);
+}
+
+/* the line is only valid until the next fetch, so it is copied */
+static void
+log_reader_parse_batch_add(LogReaderParseBatch *self, const guchar *line, gsize length, LogTransportAuxData *aux)
+{
+  LogReaderParseItem *item = &self->items[self->num_items++];
+
+  item->offset = self->lines->len;
+  item->length = length;
+  item->proto = aux->proto;
+  g_string_append_len(self->lines, (const gchar *) line, length);
+
+  item->aux_set = aux->peer_addr || aux->local_addr || aux->end_ptr > 0;
+  if (item->aux_set)
+    {
+      if (!item->aux)
+        item->aux = g_new(LogTransportAuxData, 1);
+      log_transport_aux_data_copy(item->aux, aux);
+    }
+}
+
+static void
+log_reader_parse_batch_reset(LogReaderParseBatch *self)
+{
+  for (gint i = 0; i < self->num_items; i++)
+    {
+      LogReaderParseItem *item = &self->items[i];
+
+      if (item->aux_set)
+        log_transport_aux_data_destroy(item->aux);
+      item->aux_set = FALSE;
+      item->msg = NULL;
+    }
+  self->num_items = 0;
+  g_string_truncate(self->lines, 0);
+}
+
+static void
+log_reader_parse_chunk(gpointer user_data)
+{
+  LogReaderParseChunk *chunk = (LogReaderParseChunk *) user_data;
+  LogReaderParseBatch *batch = chunk->batch;
+  LogReader *reader = batch->reader;
+
+  for (gint i = chunk->start; i < chunk->end; i++)
+    {
+      LogReaderParseItem *item = &batch->items[i];
+      LogTransportAuxData no_aux, *aux = item->aux;
+
+      if (!item->aux_set)
+        {
+          log_transport_aux_data_init(&no_aux);
+          no_aux.proto = item->proto;
+          aux = &no_aux;
+        }
+
+      item->msg = log_reader_parse_line(reader, (const guchar *) batch->lines->str + item->offset, item->length, aux);
+      if (!batch->ordered)
+        {
+          log_reader_post_msg(reader, item->msg);
+          item->msg = NULL;
+        }
+    }
+
+  g_mutex_lock(&batch->lock);
+  batch->pending_chunks--;
+  if (batch->pending_chunks == 0)
+    g_cond_signal(&batch->chunks_done);
+  g_mutex_unlock(&batch->lock);
+}
+
+static void
+log_reader_parse_batch_post(LogReaderParseBatch *batch)
+{
+  LogMessage *msgs[LOG_PIPE_MAX_BATCH_SIZE];
+  gint len = 0;
+
+  for (gint i = 0; i < batch->num_items; i++)
+    {
+      msgs[len++] = batch->items[i].msg;
+      if (len == LOG_PIPE_MAX_BATCH_SIZE)
+        {
+          log_source_post_batch(&batch->reader->super, msgs, len);
+          len = 0;
+        }
+    }
+  if (len > 0)
+    log_source_post_batch(&batch->reader->super, msgs, len);
+}
+
+/* splits the batch among the parser threads and waits for all of them */
+static void
+log_reader_parse_batch_process(LogReaderParseBatch *batch)
+{
+  gint chunk_size = (batch->num_items + batch->num_chunks - 1) / batch->num_chunks;
+  gint num_chunks = 0;
+
+  if (chunk_size < LOG_READER_PARSE_MIN_CHUNK_SIZE)
+    chunk_size = LOG_READER_PARSE_MIN_CHUNK_SIZE;
+
+  batch->ordered = batch->reader->options->parse_ordered;
+  for (gint start = 0; start < batch->num_items; start += chunk_size)
+    {
+      LogReaderParseChunk *chunk = &batch->chunks[num_chunks++];
+
+      chunk->job.func = log_reader_parse_chunk;
+      chunk->job.user_data = chunk;
+      chunk->batch = batch;
+      chunk->start = start;
+      chunk->end = MIN(start + chunk_size, batch->num_items);
+    }
+
+  batch->pending_chunks = num_chunks;
+
+  /* the first chunk is parsed by the current thread */
+  for (gint i = 1; i < num_chunks; i++)
+    formatter_pool_submit(&batch->chunks[i].job);
+  log_reader_parse_chunk(&batch->chunks[0]);
+
+  g_mutex_lock(&batch->lock);
+  while (batch->pending_chunks > 0)
+    g_cond_wait(&batch->chunks_done, &batch->lock);
+  g_mutex_unlock(&batch->lock);
+
+  if (batch->ordered)
+    log_reader_parse_batch_post(batch);
+  log_reader_parse_batch_reset(batch);
+}
+
+/*
+ * The messages of a batch are posted without checking the window in
+ * between, so the batch is limited to the window available when the
+ * fetch starts.  Only the poster decreases the window, so it cannot
+ * shrink below the size of the batch meanwhile.
+ */
+static gint
+log_reader_get_batch_limit(LogReader *self)
+{
+  gsize window = window_size_counter_get(&self->super.window_size, NULL);
+  gint limit = MIN(self->options->fetch_limit, self->parse_batch->max_items);
+
+  return MIN((gsize) limit, window);
+}
+
 /* returns: notify_code (NC_XXXX) or 0 for success */
 static gint
-log_reader_fetch_log(LogReader *self)
+log_reader_fetch_log_batch(LogReader *self)
 {
+  LogReaderParseBatch *batch = self->parse_batch;
+  gint limit = log_reader_get_batch_limit(self);
+  gint notify_code = 0;
   gint msg_count = 0;
   gboolean may_read = TRUE;
   LogTransportAuxData aux;
 
   log_transport_aux_data_init(&aux);
+  while (msg_count < limit && !main_loop_worker_job_quit())
+    {
+      Bookmark *bookmark;
+      const guchar *msg = NULL;
+      gsize msg_len;
+      LogProtoStatus status;
+
+      log_transport_aux_data_reinit(&aux);
+      bookmark = ack_tracker_request_bookmark(self->super.ack_tracker);
+      status = log_proto_server_fetch(self->proto, &msg, &msg_len, &may_read, &aux, bookmark);
+      if (status == LPS_EOF || status == LPS_ERROR)
+        {
+          /* the lines framed so far are still processed */
+          notify_code = (status == LPS_ERROR) ? NC_READ_ERROR : NC_CLOSE;
+          break;
+        }
+
+      if (!msg)
+        {
+          /* no more messages for now */
+          break;
+        }
+      if (msg_len > 0 || (self->options->flags & LR_EMPTY_LINES))
+        {
+          msg_count++;
+          log_reader_parse_batch_add(batch, msg, msg_len, &aux);
+        }
+    }
+  log_transport_aux_data_destroy(&aux);
+
+  if (batch->num_items > 0)
+    log_reader_parse_batch_process(batch);
+
+  if (!notify_code && msg_count == self->options->fetch_limit)
+    self->immediate_check = TRUE;
+  return notify_code;
+}
+
+/*
+ * Lines of a connection can only be processed out of band if they are not
+ * tracked by position (bookmarks are acknowledged in the order of the
+ * lines), which is the case for network sources.
+ */
+static gboolean
+log_reader_parses_in_parallel(LogReader *self)
+{
+  return self->parse_batch && !log_proto_server_is_position_tracked(self->proto);
+}
+
+/*
+ * Lines not tracked by position are posted in batches of up to fetch_limit
+ * lines.  Position tracked lines are posted one-by-one, as a line has to be
+ * tracked before the bookmark of the next one is requested.
+ */
+static gboolean
+log_reader_posts_in_batches(LogReader *self)
+{
+  return !log_proto_server_is_position_tracked(self->proto);
+}
+
+/* returns: notify_code (NC_XXXX) or 0 for success */
+static gint
+log_reader_fetch_log(LogReader *self)
+{
+  LogMessage *batch[LOG_PIPE_MAX_BATCH_SIZE];
+  gint batch_len = 0;
+  gboolean post_in_batches;
+  gint limit = self->options->fetch_limit;
+  gint notify_code = 0;
+  gint msg_count = 0;
+  gboolean may_read = TRUE;
+  LogTransportAuxData aux;
+
   if (log_proto_server_handshake_in_progress(self->proto))
     {
       return log_reader_process_handshake(self);
     }
 
+  if (log_reader_parses_in_parallel(self))
+    return log_reader_fetch_log_batch(self);
+
+  /* the window is not checked between the lines of a batch, see
+   * log_reader_get_batch_limit() */
+  post_in_batches = log_reader_posts_in_batches(self);
+  if (post_in_batches)
+    limit = MIN((gsize) limit, window_size_counter_get(&self->super.window_size, NULL));
+
+  log_transport_aux_data_init(&aux);
+
   /* NOTE: this loop is here to decrease the load on the main loop, we try
    * to fetch a couple of messages in a single run (but only up to
    * fetch_limit).
    */
-  while (msg_count < self->options->fetch_limit && !main_loop_worker_job_quit())
+  while (msg_count < limit && !main_loop_worker_job_quit())
     {
       Bookmark *bookmark;
       const guchar *msg;
@@ -498,11 +819,11 @@ log_reader_fetch_log(LogReader *self)
       switch (status)
         {
         case LPS_EOF:
-          g_sockaddr_unref(aux.peer_addr);
-          return NC_CLOSE;
+          notify_code = NC_CLOSE;
+          break;
         case LPS_ERROR:
-          g_sockaddr_unref(aux.peer_addr);
-          return NC_READ_ERROR;
+          notify_code = NC_READ_ERROR;
+          break;
         case LPS_SUCCESS:
           break;
         case LPS_AGAIN:
@@ -512,7 +833,7 @@ log_reader_fetch_log(LogReader *self)
           break;
         }
 
-      if (!msg)
+      if (notify_code || !msg)
         {
           /* no more messages for now */
           break;
@@ -521,7 +842,16 @@ log_reader_fetch_log(LogReader *self)
         {
           msg_count++;
 
-          if (!log_reader_handle_line(self, msg, msg_len, &aux))
+          if (post_in_batches)
+            {
+              batch[batch_len++] = log_reader_parse_line(self, msg, msg_len, &aux);
+              if (batch_len == LOG_PIPE_MAX_BATCH_SIZE)
+                {
+                  log_source_post_batch(&self->super, batch, batch_len);
+                  batch_len = 0;
+                }
+            }
+          else if (!log_reader_handle_line(self, msg, msg_len, &aux))
             {
               /* window is full, don't generate further messages */
               break;
@@ -530,9 +860,13 @@ log_reader_fetch_log(LogReader *self)
     }
   log_transport_aux_data_destroy(&aux);
 
-  if (msg_count == self->options->fetch_limit)
+  /* the lines framed before an EOF or an error are still posted */
+  if (batch_len > 0)
+    log_source_post_batch(&self->super, batch, batch_len);
+
+  if (!notify_code && msg_count == self->options->fetch_limit)
     self->immediate_check = TRUE;
-  return 0;
+  return notify_code;
 }
 
 static void
@@ -567,6 +901,40 @@ log_reader_io_handle_in(gpointer s)
  * LogReader->LogPipe interface implementation
  *****************************************************************************/
 
+static void
+log_reader_setup_parse_batch(LogReader *self)
+{
+  gint threads = self->options->parse_threads;
+
+  if (self->parse_batch && self->parse_batch->num_chunks != threads)
+    {
+      log_reader_parse_batch_free(self->parse_batch);
+      self->parse_batch = NULL;
+    }
+
+  if (threads <= 1)
+    return;
+
+  if (log_proto_server_is_position_tracked(self->proto))
+    {
+      msg_warning("WARNING: parse-threads() is ignored for sources that track their position, lines are parsed sequentially",
+                  log_pipe_location_tag(&self->super.super));
+      return;
+    }
+
+  /* a batch never exceeds fetch_limit, see log_reader_get_batch_limit() */
+  if (self->options->fetch_limit <= LOG_READER_PARSE_MIN_CHUNK_SIZE)
+    msg_warning("WARNING: parse-threads() has no effect unless log-fetch-limit() is raised, lines are parsed sequentially",
+                evt_tag_int("log_fetch_limit", self->options->fetch_limit),
+                evt_tag_int("min_log_fetch_limit", LOG_READER_PARSE_MIN_CHUNK_SIZE + 1),
+                log_pipe_location_tag(&self->super.super));
+
+  if (!self->parse_batch)
+    self->parse_batch = log_reader_parse_batch_new(self, threads);
+  /* the thread fetching the input parses one chunk itself */
+  formatter_pool_ensure_threads(threads - 1);
+}
+
 static gboolean
 log_reader_init(LogPipe *s)
 {
@@ -588,6 +956,7 @@ log_reader_init(LogPipe *s)
       return FALSE;
     }
 
+  log_reader_setup_parse_batch(self);
   iv_event_register(&self->schedule_wakeup);
 
   log_reader_start_watches(self);
@@ -656,6 +1025,8 @@ log_reader_free(LogPipe *s)
   g_sockaddr_unref(self->local_addr);
   g_static_mutex_free(&self->pending_close_lock);
   g_cond_free(self->pending_close_cond);
+  if (self->parse_batch)
+    log_reader_parse_batch_free(self->parse_batch);
   log_source_free(s);
 }
 
@@ -705,6 +1076,8 @@ log_reader_options_defaults(LogReaderOptions *options)
   log_proto_server_options_defaults(&options->proto_options.super);
   msg_format_options_defaults(&options->parse_options);
   options->fetch_limit = 10;
+  options->parse_threads = 0;
+  options->parse_ordered = TRUE;
 }
 
 /*
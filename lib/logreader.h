@@ -48,9 +48,17 @@ typedef struct _LogReaderOptions
   gint fetch_limit;
   const gchar *group_name;
   gboolean check_hostname;
+  /* number of threads parsing messages in parallel, 0 or 1 disables it.
+   * A batch holds at most fetch_limit lines and batches of up to 16 lines
+   * are not split, so fetch_limit has to be raised well above its default
+   * of 10 for this to have any effect. */
+  gint parse_threads;
+  /* post parsed messages in their original order */
+  gboolean parse_ordered;
 } LogReaderOptions;
 
 typedef struct _LogReader LogReader;
+typedef struct _LogReaderParseBatch LogReaderParseBatch;
 
 struct _LogReader
 {
@@ -82,6 +90,7 @@ struct _LogReader
   GStaticMutex pending_close_lock;
 
   struct iv_timer idle_timer;
+  LogReaderParseBatch *parse_batch;
 };
 
 void log_reader_set_options(LogReader *s, LogPipe *control, LogReaderOptions *options, const gchar *stats_id,
@@ -504,24 +504,15 @@ log_source_deinit(LogPipe *s)
   return TRUE;
 }
 
-void
-log_source_post(LogSource *self, LogMessage *msg)
+static void
+_take_window(LogSource *self, gsize len)
 {
-  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
-  gint old_window_size;
-
-  ack_tracker_track_msg(self->ack_tracker, msg);
+  gsize old_window_size;
 
-  /* NOTE: we start by enabling flow-control, thus we need an acknowledgement */
-  path_options.ack_needed = TRUE;
-  log_msg_ref(msg);
-  log_msg_add_ack(msg, &path_options);
-  msg->ack_func = log_source_msg_ack;
+  old_window_size = window_size_counter_sub(&self->window_size, len, NULL);
+  stats_counter_sub(self->stat_window_size, len);
 
-  old_window_size = window_size_counter_sub(&self->window_size, 1, NULL);
-  stats_counter_sub(self->stat_window_size, 1);
-
-  if (G_UNLIKELY(old_window_size == 1))
+  if (G_UNLIKELY(old_window_size == len))
     {
       msg_debug("Source has been suspended",
                 log_pipe_location_tag(&self->super),
@@ -532,11 +523,32 @@ log_source_post(LogSource *self, LogMessage *msg)
    * NOTE: this assertion validates that the source is not overflowing its
    * own flow-control window size, decreased above, by the atomic statement.
    *
-   * If the _old_ value is zero, that means that the decrement operation
-   * above has decreased the value to -1.
+   * If the _old_ value is smaller than the decrement, the operation above
+   * has decreased the value below zero.
    */
 
-  g_assert(old_window_size > 0);
+  g_assert(old_window_size >= len);
+}
+
+static void
+_prepare_post(LogSource *self, LogMessage *msg, LogPathOptions *path_options)
+{
+  ack_tracker_track_msg(self->ack_tracker, msg);
+
+  /* NOTE: we start by enabling flow-control, thus we need an acknowledgement */
+  path_options->ack_needed = TRUE;
+  log_msg_ref(msg);
+  log_msg_add_ack(msg, path_options);
+  msg->ack_func = log_source_msg_ack;
+}
+
+void
+log_source_post(LogSource *self, LogMessage *msg)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+
+  _prepare_post(self, msg, &path_options);
+  _take_window(self, 1);
 
   ScratchBuffersMarker mark;
   scratch_buffers_mark(&mark);
@@ -544,6 +556,39 @@ log_source_post(LogSource *self, LogMessage *msg)
   scratch_buffers_reclaim_marked(mark);
 }
 
+/*
+ * Posts up to LOG_PIPE_MAX_BATCH_SIZE messages at once.  The caller has to
+ * make sure that the window is large enough for all of them, and as the
+ * messages are tracked here, that no bookmark of a later message has been
+ * requested meanwhile (see log_proto_server_is_position_tracked()).
+ */
+void
+log_source_post_batch(LogSource *self, LogMessage **msgs, gint len)
+{
+  LogPathOptions path_options[LOG_PIPE_MAX_BATCH_SIZE];
+  const LogPathOptions *path_options_refs[LOG_PIPE_MAX_BATCH_SIZE];
+
+  g_assert(len > 0 && len <= LOG_PIPE_MAX_BATCH_SIZE);
+
+  /* the refcache holds a single message per thread: the ref/ack changes of
+   * the first message are cached, the rest of the batch uses atomic
+   * reference counting */
+  log_msg_refcache_start_producer(msgs[0]);
+  for (gint i = 0; i < len; i++)
+    {
+      path_options[i] = (LogPathOptions) LOG_PATH_OPTIONS_INIT;
+      _prepare_post(self, msgs[i], &path_options[i]);
+      path_options_refs[i] = &path_options[i];
+    }
+  _take_window(self, len);
+
+  ScratchBuffersMarker mark;
+  scratch_buffers_mark(&mark);
+  log_pipe_queue_batch(&self->super, msgs, path_options_refs, len);
+  scratch_buffers_reclaim_marked(mark);
+  log_msg_refcache_stop();
+}
+
 static gboolean
 _invoke_mangle_callbacks(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
 {
@@ -600,19 +645,12 @@ _get_pid_string(void)
   return pid_string;
 }
 
-static void
-log_source_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
+/* returns FALSE if the message was dropped */
+static gboolean
+log_source_prepare_msg(LogSource *self, LogMessage *msg, const LogPathOptions *path_options)
 {
-  LogSource *self = (LogSource *) s;
   gint i;
 
-  msg_set_context(msg);
-
-  msg_diagnostics(">>>>>> Source side message processing begin",
-                  evt_tag_str("instance", self->stats_instance ? self->stats_instance : "internal"),
-                  log_pipe_location_tag(s),
-                  evt_tag_printf("msg", "%p", msg));
-
   /* $HOST setup */
   log_source_mangle_hostname(self, msg);
 
@@ -631,8 +669,8 @@ log_source_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options
   log_msg_set_tag_by_id(msg, self->options->source_group_tag);
 
 
-  if (!_invoke_mangle_callbacks(s, msg, path_options))
-    return;
+  if (!_invoke_mangle_callbacks(&self->super, msg, path_options))
+    return FALSE;
 
   if (self->options->host_override)
     log_source_override_host(self, msg);
@@ -646,8 +684,12 @@ log_source_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options
 
   stats_counter_inc(self->recvd_messages);
   stats_counter_set(self->last_message_seen, msg->timestamps[LM_TS_RECVD].ut_sec);
-  log_pipe_forward_msg(s, msg, path_options);
+  return TRUE;
+}
 
+static void
+log_source_sleep_if_window_full(LogSource *self)
+{
   if (accurate_nanosleep && self->threaded && self->window_full_sleep_nsec > 0 && !log_source_free_to_send(self))
     {
       struct timespec ts;
@@ -657,6 +699,26 @@ log_source_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options
       ts.tv_nsec = self->window_full_sleep_nsec;
       nanosleep(&ts, NULL);
     }
+}
+
+static void
+log_source_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  LogSource *self = (LogSource *) s;
+
+  msg_set_context(msg);
+
+  msg_diagnostics(">>>>>> Source side message processing begin",
+                  evt_tag_str("instance", self->stats_instance ? self->stats_instance : "internal"),
+                  log_pipe_location_tag(s),
+                  evt_tag_printf("msg", "%p", msg));
+
+  if (!log_source_prepare_msg(self, msg, path_options))
+    return;
+
+  log_pipe_forward_msg(s, msg, path_options);
+
+  log_source_sleep_if_window_full(self);
   msg_diagnostics("<<<<<< Source side message processing finish",
                   evt_tag_str("instance", self->stats_instance ? self->stats_instance : "internal"),
                   log_pipe_location_tag(s),
@@ -665,6 +727,41 @@ log_source_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options
   msg_set_context(NULL);
 }
 
+static void
+log_source_queue_batch(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options, gint len)
+{
+  LogSource *self = (LogSource *) s;
+  LogMessage *prepared_msgs[LOG_PIPE_MAX_BATCH_SIZE];
+  const LogPathOptions *prepared_path_options[LOG_PIPE_MAX_BATCH_SIZE];
+  gint num_prepared = 0;
+
+  msg_diagnostics(">>>>>> Source side message processing begin",
+                  evt_tag_str("instance", self->stats_instance ? self->stats_instance : "internal"),
+                  log_pipe_location_tag(s),
+                  evt_tag_int("batch_size", len));
+
+  for (gint i = 0; i < len; i++)
+    {
+      msg_set_context(msgs[i]);
+      if (!log_source_prepare_msg(self, msgs[i], path_options[i]))
+        continue;
+
+      prepared_msgs[num_prepared] = msgs[i];
+      prepared_path_options[num_prepared] = path_options[i];
+      num_prepared++;
+    }
+  msg_set_context(NULL);
+
+  if (num_prepared > 0)
+    log_pipe_forward_msg_batch(s, prepared_msgs, prepared_path_options, num_prepared);
+
+  log_source_sleep_if_window_full(self);
+  msg_diagnostics("<<<<<< Source side message processing finish",
+                  evt_tag_str("instance", self->stats_instance ? self->stats_instance : "internal"),
+                  log_pipe_location_tag(s),
+                  evt_tag_int("batch_size", len));
+}
+
 static void
 _initialize_window(LogSource *self, gint init_window_size)
 {
@@ -725,6 +822,7 @@ log_source_init_instance(LogSource *self, GlobalConfig *cfg)
 {
   log_pipe_init_instance(&self->super, cfg);
   self->super.queue = log_source_queue;
+  self->super.queue_batch = log_source_queue_batch;
   self->super.free_fn = log_source_free;
   self->super.init = log_source_init;
   self->super.deinit = log_source_deinit;
@@ -119,6 +119,7 @@ gboolean log_source_init(LogPipe *s);
 gboolean log_source_deinit(LogPipe *s);
 
 void log_source_post(LogSource *self, LogMessage *msg);
+void log_source_post_batch(LogSource *self, LogMessage **msgs, gint len);
 
 void log_source_set_options(LogSource *self, LogSourceOptions *options, const gchar *stats_id,
                             const gchar *stats_instance, gboolean threaded, LogExprNode *expr_node);
@@ -384,7 +384,10 @@ _perform_flush(LogThreadedDestWorker *self)
                 evt_tag_int("worker_index", self->worker_index),
                 evt_tag_int("batch_size", self->batch_size));
 
+      gint batch_size = self->batch_size;
       LogThreadedResult result = log_threaded_dest_worker_flush(self, LTF_FLUSH_NORMAL);
+
+      TRACEPOINT(threaded_dest_flush, self->owner->super.super.id, self->worker_index, batch_size, result);
       _process_result(self, result);
     }
 
@@ -990,6 +993,31 @@ log_threaded_dest_driver_queue(LogPipe *s, LogMessage *msg,
   log_dest_driver_queue_method(s, msg, path_options);
 }
 
+static void
+log_threaded_dest_driver_queue_batch(LogPipe *s, LogMessage **msgs, const LogPathOptions **path_options, gint len)
+{
+  LogThreadedDestDriver *self = (LogThreadedDestDriver *)s;
+  LogPathOptions local_options[LOG_PIPE_MAX_BATCH_SIZE];
+  const LogPathOptions *queued_path_options[LOG_PIPE_MAX_BATCH_SIZE];
+
+  for (gint i = 0; i < len; i++)
+    {
+      LogThreadedDestWorker *dw = _lookup_worker(self, msgs[i]);
+      const LogPathOptions *msg_path_options = path_options[i];
+
+      if (!msg_path_options->flow_control_requested)
+        msg_path_options = log_msg_break_ack(msgs[i], msg_path_options, &local_options[i]);
+
+      log_msg_add_ack(msgs[i], msg_path_options);
+      log_queue_push_tail(dw->queue, log_msg_ref(msgs[i]), msg_path_options);
+      queued_path_options[i] = msg_path_options;
+    }
+
+  stats_counter_add(self->processed_messages, len);
+
+  log_dest_driver_queue_batch_method(s, msgs, queued_path_options, len);
+}
+
 static void
 _init_stats_key(LogThreadedDestDriver *self, StatsClusterKey *sc_key)
 {
@@ -1147,6 +1175,7 @@ log_threaded_dest_driver_init_instance(LogThreadedDestDriver *self, GlobalConfig
   self->super.super.super.init = log_threaded_dest_driver_init_method;
   self->super.super.super.deinit = log_threaded_dest_driver_deinit_method;
   self->super.super.super.queue = log_threaded_dest_driver_queue;
+  self->super.super.super.queue_batch = log_threaded_dest_driver_queue_batch;
   self->super.super.super.free_fn = log_threaded_dest_driver_free;
   self->super.super.super.on_config_inited = log_threaded_dest_driver_start_workers;
   self->time_reopen = -1;
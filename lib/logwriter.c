@@ -26,6 +26,7 @@
 #include "messages.h"
 #include "stats/stats-registry.h"
 #include "stats/stats-cluster-single.h"
+#include "stats/stats-histogram.h"
 #include "hostname.h"
 #include "host-resolve.h"
 #include "seqnum.h"
@@ -37,6 +38,7 @@
 #include "ml-batched-timer.h"
 #include "str-format.h"
 #include "scratch-buffers.h"
+#include "formatter-pool.h"
 #include "timeutils/format.h"
 #include "timeutils/misc.h"
 
@@ -59,6 +61,46 @@ typedef enum
   LW_FLUSH_FORCE,
 } LogWriterFlushMode;
 
+/* number of messages formatted by a single formatter job */
+#define LOG_WRITER_FORMAT_CHUNK_SIZE 64
+/* batches smaller than this are not worth to be split among threads */
+#define LOG_WRITER_FORMAT_MIN_CHUNK_SIZE 16
+
+typedef struct _LogWriterFormatBatch LogWriterFormatBatch;
+
+typedef struct _LogWriterFormatItem
+{
+  LogMessage *msg;
+  LogPathOptions path_options;
+  gint32 seq_num;
+  GString *line;
+} LogWriterFormatItem;
+
+typedef struct _LogWriterFormatChunk
+{
+  FormatterPoolJob job;
+  LogWriterFormatBatch *batch;
+  gint start, end;
+} LogWriterFormatChunk;
+
+/*
+ * Messages popped from the queue in one go when format-threads() is set.
+ * They are formatted in parallel, then posted in their original order by
+ * the thread running log_writer_flush().
+ */
+struct _LogWriterFormatBatch
+{
+  LogWriter *writer;
+  LogWriterFormatItem *items;
+  gint num_items, max_items;
+  LogWriterFormatChunk *chunks;
+  gint num_chunks;
+
+  GMutex lock;
+  GCond chunks_done;
+  gint pending_chunks;
+};
+
 struct _LogWriter
 {
   LogPipe super;
@@ -70,16 +112,25 @@ struct _LogWriter
   StatsCounterItem *suppressed_messages;
   StatsCounterItem *processed_messages;
   StatsCounterItem *written_messages;
+  StatsCounterItem *written_bytes;
   struct
   {
     StatsCounterItem *count;
     StatsCounterItem *bytes;
   } truncated;
+  /* in microseconds, registered from stats-level(1) */
+  struct
+  {
+    StatsHistogram *source_to_queue;
+    StatsHistogram *queue_residency;
+    StatsHistogram *write;
+  } latency;
   LogPipe *control;
   LogWriterOptions *options;
   LogMessage *last_msg;
   guint32 last_msg_count;
   GString *line_buffer;
+  LogWriterFormatBatch *format_batch;
 
   gchar *stats_id;
   gchar *stats_instance;
@@ -859,6 +910,7 @@ log_writer_queue(LogPipe *s, LogMessage *lm, const LogPathOptions *path_options)
     }
 
   stats_counter_inc(self->processed_messages);
+  stats_histogram_record_since(self->latency.source_to_queue, &lm->timestamps[LM_TS_RECVD]);
   log_queue_push_tail(self->queue, lm, path_options);
 }
 
@@ -908,8 +960,13 @@ log_writer_do_padding(LogWriter *self, GString *result)
   memset(result->str + len - 1, '\0', padd_bytes);
 }
 
-void
-log_writer_format_log(LogWriter *self, LogMessage *lm, GString *result)
+/*
+ * @local_seq_num is the sequence number to be used for locally generated
+ * messages, it is passed explicitly as messages may be formatted ahead of
+ * writing them out when format-threads() is used.
+ */
+static void
+log_writer_format_log_with_seq_num(LogWriter *self, LogMessage *lm, gint32 local_seq_num, GString *result)
 {
   LogTemplate *template = NULL;
   UnixTime *stamp;
@@ -921,7 +978,7 @@ log_writer_format_log(LogWriter *self, LogMessage *lm, GString *result)
 
   if (lm->flags & LF_LOCAL)
     {
-      seq_num = self->seq_num;
+      seq_num = local_seq_num;
     }
   else
     {
@@ -1111,6 +1168,12 @@ log_writer_format_log(LogWriter *self, LogMessage *lm, GString *result)
     }
 }
 
+void
+log_writer_format_log(LogWriter *self, LogMessage *lm, GString *result)
+{
+  log_writer_format_log_with_seq_num(self, lm, self->seq_num, result);
+}
+
 static void
 log_writer_broken(LogWriter *self, gint notify_code)
 {
@@ -1119,11 +1182,11 @@ log_writer_broken(LogWriter *self, gint notify_code)
 }
 
 static void
-log_writer_realloc_line_buffer(LogWriter *self)
+log_writer_realloc_line_buffer(GString *line_buffer)
 {
-  self->line_buffer->str = g_malloc(self->line_buffer->allocated_len);
-  self->line_buffer->str[0] = 0;
-  self->line_buffer->len = 0;
+  line_buffer->str = g_malloc(line_buffer->allocated_len);
+  line_buffer->str[0] = 0;
+  line_buffer->len = 0;
 }
 
 /*
@@ -1150,34 +1213,39 @@ log_writer_flush_finalize(LogWriter *self)
   return FALSE;
 }
 
+/*
+ * Posts the already formatted @line of @msg to the LogProtoClient.  If the
+ * message was consumed, the ownership of line->str is passed to the
+ * LogProtoClient and @line is reallocated.  Rewinding the backlog in case
+ * the message was not consumed is up to the caller.
+ */
 static gboolean
-log_writer_write_message(LogWriter *self, LogMessage *msg, LogPathOptions *path_options, gboolean *write_error)
+log_writer_post_line(LogWriter *self, LogMessage *msg, GString *line, gboolean *write_error)
 {
   gboolean consumed = FALSE;
 
   *write_error = FALSE;
 
-  log_msg_refcache_start_consumer(msg, path_options);
-  msg_set_context(msg);
-
-  log_writer_format_log(self, msg, self->line_buffer);
-
   if (!(msg->flags & LF_INTERNAL))
     {
       msg_debug("Outgoing message",
-                evt_tag_printf("message", "%s", self->line_buffer->str));
+                evt_tag_printf("message", "%s", line->str));
     }
 
-  if (self->line_buffer->len)
+  if (line->len)
     {
-      LogProtoStatus status = log_proto_client_post(self->proto, msg, (guchar *)self->line_buffer->str,
-                                                    self->line_buffer->len,
+      gsize len = line->len;
+      LogProtoStatus status = log_proto_client_post(self->proto, msg, (guchar *)line->str,
+                                                    len,
                                                     &consumed);
 
       self->partial_write = (status == LPS_PARTIAL);
 
       if (consumed)
-        log_writer_realloc_line_buffer(self);
+        {
+          stats_counter_add(self->written_bytes, len);
+          log_writer_realloc_line_buffer(line);
+        }
 
       if (status == LPS_ERROR)
         {
@@ -1185,8 +1253,8 @@ log_writer_write_message(LogWriter *self, LogMessage *msg, LogPathOptions *path_
             {
               if (!consumed)
                 {
-                  g_free(self->line_buffer->str);
-                  log_writer_realloc_line_buffer(self);
+                  g_free(line->str);
+                  log_writer_realloc_line_buffer(line);
                   consumed = TRUE;
                 }
             }
@@ -1207,26 +1275,34 @@ log_writer_write_message(LogWriter *self, LogMessage *msg, LogPathOptions *path_
     {
       if (msg->flags & LF_LOCAL)
         step_sequence_number(&self->seq_num);
-
-      log_msg_unref(msg);
-      msg_set_context(NULL);
-      log_msg_refcache_stop();
-
-      return TRUE;
     }
   else
     {
       msg_debug("Can't send the message rewind backlog",
-                evt_tag_printf("message", "%s", self->line_buffer->str));
+                evt_tag_printf("message", "%s", line->str));
+    }
+  return consumed;
+}
 
-      log_queue_rewind_backlog(self->queue, 1);
+static gboolean
+log_writer_write_message(LogWriter *self, LogMessage *msg, LogPathOptions *path_options, gboolean *write_error)
+{
+  gboolean consumed;
 
-      log_msg_unref(msg);
-      msg_set_context(NULL);
-      log_msg_refcache_stop();
+  log_msg_refcache_start_consumer(msg, path_options);
+  msg_set_context(msg);
 
-      return FALSE;
-    }
+  log_writer_format_log(self, msg, self->line_buffer);
+
+  consumed = log_writer_post_line(self, msg, self->line_buffer, write_error);
+  if (!consumed)
+    log_queue_rewind_backlog(self->queue, 1);
+
+  log_msg_unref(msg);
+  msg_set_context(NULL);
+  log_msg_refcache_stop();
+
+  return consumed;
 }
 
 static inline LogMessage *
@@ -1249,6 +1325,216 @@ log_writer_process_handshake(LogWriter *self)
   return TRUE;
 }
 
+static LogWriterFormatBatch *
+log_writer_format_batch_new(LogWriter *writer, gint threads)
+{
+  LogWriterFormatBatch *self = g_new0(LogWriterFormatBatch, 1);
+
+  self->writer = writer;
+  self->num_chunks = threads;
+  self->max_items = threads * LOG_WRITER_FORMAT_CHUNK_SIZE;
+  self->items = g_new0(LogWriterFormatItem, self->max_items);
+  for (gint i = 0; i < self->max_items; i++)
+    self->items[i].line = g_string_sized_new(128);
+
+  self->chunks = g_new0(LogWriterFormatChunk, self->num_chunks);
+  g_mutex_init(&self->lock);
+  g_cond_init(&self->chunks_done);
+  return self;
+}
+
+static void
+log_writer_format_batch_free(LogWriterFormatBatch *self)
+{
+  g_assert(self->num_items == 0);
+
+  for (gint i = 0; i < self->max_items; i++)
+    g_string_free(self->items[i].line, TRUE);
+  g_free(self->items);
+  g_free(self->chunks);
+  g_mutex_clear(&self->lock);
+  g_cond_clear(&self->chunks_done);
+  g_free(self);
+}
+
+/*
+ * Pops as many messages as the batch can hold.  Sequence numbers are
+ * assigned here, in queue order, assuming that every message is going to
+ * be written.  self->seq_num is only stepped once a message is consumed, so
+ * the rewound part of a batch gets the same numbers when it is retried.
+ */
+static gboolean
+log_writer_format_batch_fill(LogWriter *self, LogWriterFormatBatch *batch, gboolean force_flush)
+{
+  gint32 seq_num = self->seq_num;
+
+  g_assert(batch->num_items == 0);
+
+  while (batch->num_items < batch->max_items)
+    {
+      LogWriterFormatItem *item = &batch->items[batch->num_items];
+
+      item->path_options = (LogPathOptions) LOG_PATH_OPTIONS_INIT;
+      item->msg = log_writer_queue_pop_message(self, &item->path_options, force_flush);
+      if (!item->msg)
+        break;
+
+      item->seq_num = (item->msg->flags & LF_LOCAL) ? step_sequence_number(&seq_num) : 0;
+      batch->num_items++;
+    }
+
+  return batch->num_items > 0;
+}
+
+static void
+log_writer_format_chunk(gpointer user_data)
+{
+  LogWriterFormatChunk *chunk = (LogWriterFormatChunk *) user_data;
+  LogWriterFormatBatch *batch = chunk->batch;
+
+  for (gint i = chunk->start; i < chunk->end; i++)
+    {
+      LogWriterFormatItem *item = &batch->items[i];
+      ScratchBuffersMarker mark;
+
+      scratch_buffers_mark(&mark);
+      log_writer_format_log_with_seq_num(batch->writer, item->msg, item->seq_num, item->line);
+      scratch_buffers_reclaim_marked(mark);
+    }
+
+  g_mutex_lock(&batch->lock);
+  batch->pending_chunks--;
+  if (batch->pending_chunks == 0)
+    g_cond_signal(&batch->chunks_done);
+  g_mutex_unlock(&batch->lock);
+}
+
+/* splits the batch among the formatter threads and waits for all of them */
+static void
+log_writer_format_batch_format(LogWriterFormatBatch *batch)
+{
+  gint chunk_size = (batch->num_items + batch->num_chunks - 1) / batch->num_chunks;
+  gint num_chunks = 0;
+
+  if (chunk_size < LOG_WRITER_FORMAT_MIN_CHUNK_SIZE)
+    chunk_size = LOG_WRITER_FORMAT_MIN_CHUNK_SIZE;
+
+  for (gint start = 0; start < batch->num_items; start += chunk_size)
+    {
+      LogWriterFormatChunk *chunk = &batch->chunks[num_chunks++];
+
+      chunk->job.func = log_writer_format_chunk;
+      chunk->job.user_data = chunk;
+      chunk->batch = batch;
+      chunk->start = start;
+      chunk->end = MIN(start + chunk_size, batch->num_items);
+    }
+
+  batch->pending_chunks = num_chunks;
+
+  /* the first chunk is formatted by the current thread */
+  for (gint i = 1; i < num_chunks; i++)
+    formatter_pool_submit(&batch->chunks[i].job);
+  log_writer_format_chunk(&batch->chunks[0]);
+
+  g_mutex_lock(&batch->lock);
+  while (batch->pending_chunks > 0)
+    g_cond_wait(&batch->chunks_done, &batch->lock);
+  g_mutex_unlock(&batch->lock);
+}
+
+/*
+ * Posts the formatted messages in their original order.  If a message is
+ * not consumed, it is rewound to the queue together with the rest of the
+ * batch, as those were popped after it.
+ */
+static gboolean
+log_writer_format_batch_post(LogWriter *self, LogWriterFormatBatch *batch, gboolean *write_error)
+{
+  gboolean consumed = TRUE;
+  gint i;
+
+  for (i = 0; i < batch->num_items; i++)
+    {
+      LogWriterFormatItem *item = &batch->items[i];
+      gint64 write_start = self->latency.write ? g_get_monotonic_time() : 0;
+
+      log_msg_refcache_start_consumer(item->msg, &item->path_options);
+      msg_set_context(item->msg);
+
+      consumed = log_writer_post_line(self, item->msg, item->line, write_error);
+      if (!consumed)
+        log_queue_rewind_backlog(self->queue, batch->num_items - i);
+
+      log_msg_unref(item->msg);
+      item->msg = NULL;
+      msg_set_context(NULL);
+      log_msg_refcache_stop();
+
+      if (!consumed)
+        break;
+
+      stats_counter_inc(self->written_messages);
+      stats_histogram_record(self->latency.write, g_get_monotonic_time() - write_start);
+    }
+
+  for (i++; i < batch->num_items; i++)
+    {
+      log_msg_unref(batch->items[i].msg);
+      batch->items[i].msg = NULL;
+    }
+  batch->num_items = 0;
+
+  return consumed;
+}
+
+static void
+log_writer_flush_messages(LogWriter *self, LogWriterFlushMode flush_mode, gboolean *write_error)
+{
+  while ((!main_loop_worker_job_quit() || flush_mode == LW_FLUSH_FORCE) && !*write_error)
+    {
+      LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+      LogMessage *msg = log_writer_queue_pop_message(self, &path_options, flush_mode == LW_FLUSH_FORCE);
+
+      if (!msg)
+        break;
+
+      gint64 write_start = self->latency.write ? g_get_monotonic_time() : 0;
+
+      ScratchBuffersMarker mark;
+      scratch_buffers_mark(&mark);
+      if (!log_writer_write_message(self, msg, &path_options, write_error))
+        {
+          scratch_buffers_reclaim_marked(mark);
+          break;
+        }
+      scratch_buffers_reclaim_marked(mark);
+
+      if (!*write_error)
+        {
+          stats_counter_inc(self->written_messages);
+          stats_histogram_record(self->latency.write, g_get_monotonic_time() - write_start);
+        }
+    }
+}
+
+static void
+log_writer_flush_format_batches(LogWriter *self, LogWriterFlushMode flush_mode, gboolean *write_error)
+{
+  LogWriterFormatBatch *batch = self->format_batch;
+
+  while ((!main_loop_worker_job_quit() || flush_mode == LW_FLUSH_FORCE) && !*write_error)
+    {
+      if (!log_writer_format_batch_fill(self, batch, flush_mode == LW_FLUSH_FORCE))
+        break;
+
+      log_writer_format_batch_format(batch);
+
+      if (!log_writer_format_batch_post(self, batch, write_error))
+        break;
+    }
+}
+
 /*
  * @flush_mode specifies how hard LogWriter is trying to send messages to
  * the actual destination:
@@ -1276,26 +1562,10 @@ log_writer_flush(LogWriter *self, LogWriterFlushMode flush_mode)
    * infinite loop, since the reader will cease to produce new messages when
    * main_loop_io_worker_job_quit() is set. */
 
-  while ((!main_loop_worker_job_quit() || flush_mode == LW_FLUSH_FORCE) && !write_error)
-    {
-      LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
-      LogMessage *msg = log_writer_queue_pop_message(self, &path_options, flush_mode == LW_FLUSH_FORCE);
-
-      if (!msg)
-        break;
-
-      ScratchBuffersMarker mark;
-      scratch_buffers_mark(&mark);
-      if (!log_writer_write_message(self, msg, &path_options, &write_error))
-        {
-          scratch_buffers_reclaim_marked(mark);
-          break;
-        }
-      scratch_buffers_reclaim_marked(mark);
-
-      if (!write_error)
-        stats_counter_inc(self->written_messages);
-    }
+  if (self->format_batch)
+    log_writer_flush_format_batches(self, flush_mode, &write_error);
+  else
+    log_writer_flush_messages(self, flush_mode, &write_error);
 
   if (write_error)
     return FALSE;
@@ -1417,10 +1687,50 @@ _register_counters(LogWriter *self)
     stats_register_counter(self->options->stats_level, &sc_key_truncated_bytes, SC_TYPE_SINGLE_VALUE,
                            &self->truncated.bytes);
 
+    StatsClusterKey sc_key_written_bytes;
+    stats_cluster_single_key_set_with_name(&sc_key_written_bytes, self->options->stats_source | SCS_DESTINATION,
+                                           self->stats_id, self->stats_instance, "written_bytes");
+    stats_register_counter(self->options->stats_level, &sc_key_written_bytes, SC_TYPE_SINGLE_VALUE,
+                           &self->written_bytes);
+
+    gint latency_stats_level = MAX(self->options->stats_level, STATS_LEVEL1);
+    StatsClusterKey sc_key_latency;
+    stats_cluster_histogram_key_set(&sc_key_latency, self->options->stats_source | SCS_DESTINATION,
+                                    self->stats_id, self->stats_instance, "source_to_queue_usec");
+    stats_register_histogram(latency_stats_level, &sc_key_latency, &self->latency.source_to_queue);
+
+    stats_cluster_histogram_key_set(&sc_key_latency, self->options->stats_source | SCS_DESTINATION,
+                                    self->stats_id, self->stats_instance, "queue_residency_usec");
+    stats_register_histogram(latency_stats_level, &sc_key_latency, &self->latency.queue_residency);
+    log_queue_set_residency_histogram(self->queue, self->latency.queue_residency);
+
+    stats_cluster_histogram_key_set(&sc_key_latency, self->options->stats_source | SCS_DESTINATION,
+                                    self->stats_id, self->stats_instance, "write_usec");
+    stats_register_histogram(latency_stats_level, &sc_key_latency, &self->latency.write);
   }
   stats_unlock();
 }
 
+static void
+log_writer_setup_format_batch(LogWriter *self)
+{
+  gint threads = self->options->format_threads;
+
+  if (self->format_batch && self->format_batch->num_chunks != threads)
+    {
+      log_writer_format_batch_free(self->format_batch);
+      self->format_batch = NULL;
+    }
+
+  if (threads > 1)
+    {
+      if (!self->format_batch)
+        self->format_batch = log_writer_format_batch_new(self, threads);
+      /* the thread flushing the writer formats one chunk itself */
+      formatter_pool_ensure_threads(threads - 1);
+    }
+}
+
 static gboolean
 log_writer_init(LogPipe *s)
 {
@@ -1432,6 +1742,8 @@ log_writer_init(LogPipe *s)
     }
   iv_event_register(&self->queue_filled);
 
+  log_writer_setup_format_batch(self);
+
   if ((self->options->options & LWO_NO_STATS) == 0 && !self->dropped_messages)
     _register_counters(self);
 
@@ -1479,6 +1791,25 @@ _unregister_counters(LogWriter *self)
                                            self->stats_id, self->stats_instance, "truncated_bytes");
     stats_unregister_counter(&sc_key_truncated_bytes, SC_TYPE_SINGLE_VALUE, &self->truncated.bytes);
 
+    StatsClusterKey sc_key_written_bytes;
+    stats_cluster_single_key_set_with_name(&sc_key_written_bytes, self->options->stats_source | SCS_DESTINATION,
+                                           self->stats_id, self->stats_instance, "written_bytes");
+    stats_unregister_counter(&sc_key_written_bytes, SC_TYPE_SINGLE_VALUE, &self->written_bytes);
+
+    StatsClusterKey sc_key_latency;
+    stats_cluster_histogram_key_set(&sc_key_latency, self->options->stats_source | SCS_DESTINATION,
+                                    self->stats_id, self->stats_instance, "source_to_queue_usec");
+    stats_unregister_histogram(&sc_key_latency, &self->latency.source_to_queue);
+
+    stats_cluster_histogram_key_set(&sc_key_latency, self->options->stats_source | SCS_DESTINATION,
+                                    self->stats_id, self->stats_instance, "queue_residency_usec");
+    log_queue_set_residency_histogram(self->queue, NULL);
+    stats_unregister_histogram(&sc_key_latency, &self->latency.queue_residency);
+
+    stats_cluster_histogram_key_set(&sc_key_latency, self->options->stats_source | SCS_DESTINATION,
+                                    self->stats_id, self->stats_instance, "write_usec");
+    stats_unregister_histogram(&sc_key_latency, &self->latency.write);
+
     log_queue_unregister_stats_counters(self->queue, &sc_key);
   }
   stats_unlock();
@@ -1522,6 +1853,8 @@ log_writer_free(LogPipe *s)
 
   if (self->line_buffer)
     g_string_free(self->line_buffer, TRUE);
+  if (self->format_batch)
+    log_writer_format_batch_free(self->format_batch);
 
   log_queue_unref(self->queue);
   if (self->last_msg)
@@ -1731,6 +2064,7 @@ log_writer_options_defaults(LogWriterOptions *options)
   options->mark_mode = MM_GLOBAL;
   options->mark_freq = -1;
   options->truncate_size = -1;
+  options->format_threads = 0;
   host_resolve_options_defaults(&options->host_resolve_options);
 }
 
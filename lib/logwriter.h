@@ -70,6 +70,8 @@ typedef struct _LogWriterOptions
   gint stats_level;
   gint stats_source;
   gint truncate_size;
+  /* number of threads formatting messages in parallel, 0 or 1 disables it */
+  gint format_threads;
 } LogWriterOptions;
 
 typedef struct _LogWriter LogWriter;
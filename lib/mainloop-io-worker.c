@@ -25,6 +25,7 @@
 #include "mainloop-worker.h"
 #include "mainloop-call.h"
 #include "logqueue.h"
+#include "tracepoint.h"
 
 /************************************************************************************
  * I/O worker threads
@@ -66,9 +67,13 @@ main_loop_io_worker_job_submit(MainLoopIOWorkerJob *self, GIOCondition cond)
 static void
 _work(MainLoopIOWorkerJob *self)
 {
+  TRACEPOINT(worker_batch_start, self, self->cond);
+
   self->work(self->user_data, self->cond);
   main_loop_worker_invoke_batch_callbacks();
   main_loop_worker_run_gc();
+
+  TRACEPOINT(worker_batch_end, self);
 }
 
 /* NOTE: runs in the main thread */
@@ -29,6 +29,7 @@
 #include "apphook.h"
 #include "cfg.h"
 #include "stats/stats-registry.h"
+#include "stats/stats-cluster-single.h"
 #include "messages.h"
 #include "children.h"
 #include "control/control-main.h"
@@ -165,6 +166,35 @@ struct _MainLoop
 
 static MainLoop main_loop;
 
+static StatsCounterItem *config_reload_duration;
+static StatsCounterItem *config_reload_preserved_log_paths;
+static StatsCounterItem *config_reload_rebuilt_log_paths;
+
+static void
+main_loop_register_reload_stats(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "config_reload_duration_usec", NULL);
+  stats_register_counter(0, &sc_key, SC_TYPE_SINGLE_VALUE, &config_reload_duration);
+
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "config_reload_preserved_log_paths", NULL);
+  stats_register_counter(0, &sc_key, SC_TYPE_SINGLE_VALUE, &config_reload_preserved_log_paths);
+
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "config_reload_rebuilt_log_paths", NULL);
+  stats_register_counter(0, &sc_key, SC_TYPE_SINGLE_VALUE, &config_reload_rebuilt_log_paths);
+  stats_unlock();
+}
+
+static void
+main_loop_update_reload_stats(gint64 started, gint preserved_log_paths, gint rebuilt_log_paths)
+{
+  stats_counter_set(config_reload_duration, g_get_monotonic_time() - started);
+  stats_counter_set(config_reload_preserved_log_paths, preserved_log_paths);
+  stats_counter_set(config_reload_rebuilt_log_paths, rebuilt_log_paths);
+}
+
 
 MainLoop *
 main_loop_get_instance(void)
@@ -234,6 +264,10 @@ main_loop_reload_config_revert(gpointer user_data)
 {
   MainLoop *self = (MainLoop *) user_data;
 
+  /* log paths kept running by an incremental reload go back to the old config */
+  cfg_tree_release_adopted_pipes(&self->new_config->tree);
+  cfg_tree_restore_preserved_pipes(&self->old_config->tree);
+
   cfg_persist_config_move(self->new_config, self->old_config);
   cfg_deinit(self->new_config);
   if (!cfg_init(self->old_config))
@@ -270,6 +304,10 @@ main_loop_reload_config_apply(gpointer user_data)
       return;
     }
 
+  gint64 started = g_get_monotonic_time();
+  gint preserved_log_paths = cfg_adopt_unchanged_log_paths(self->new_config, self->old_config);
+  gint rebuilt_log_paths = self->new_config->tree.rules->len;
+
   self->old_config->persist = persist_config_new();
   cfg_deinit(self->old_config);
   cfg_persist_config_move(self->old_config, self->new_config);
@@ -288,16 +326,22 @@ main_loop_reload_config_apply(gpointer user_data)
       msg_error("Error initializing new configuration, reverting to old config");
       service_management_publish_status("Error initializing new configuration, using the old config");
       main_loop_reload_config_revert(self);
+      main_loop_update_reload_stats(started, 0, 0);
       return;
     }
 
   msg_verbose("New configuration initialized");
   persist_config_free(self->new_config->persist);
   self->new_config->persist = NULL;
-  cfg_free(self->old_config);
+  cfg_free_replaced(self->new_config, self->old_config);
   self->current_configuration = self->new_config;
   service_management_clear_status();
   msg_notice("Configuration reload request received, reloading configuration");
+  if (preserved_log_paths > 0)
+    msg_info("Incremental configuration reload finished",
+             evt_tag_int("preserved_log_paths", preserved_log_paths),
+             evt_tag_int("rebuilt_log_paths", rebuilt_log_paths));
+  main_loop_update_reload_stats(started, preserved_log_paths, rebuilt_log_paths);
 
   /* this is already running with the new config in place */
   main_loop_reload_config_finished(self);
@@ -596,6 +640,7 @@ main_loop_init(MainLoop *self, MainLoopOptions *options)
 
   main_loop_init_events(self);
   setup_signals(self);
+  register_application_hook(AH_RUNNING, (ApplicationHookFunc) main_loop_register_reload_stats, NULL, AHM_RUN_ONCE);
 
   self->current_configuration = cfg_new(0);
 }
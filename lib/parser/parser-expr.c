@@ -89,6 +89,7 @@ log_parser_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options
             evt_tag_printf("msg", "%p", msg));
 
   success = log_parser_process_message(self, &msg, path_options);
+  TRACEPOINT(parser_result, self->name, s, msg, success);
 
   if (success)
     {
@@ -26,6 +26,7 @@
 #include "serialize.h"
 #include "messages.h"
 #include "fdhelpers.h"
+#include "tls-support.h"
 
 #include <sys/types.h>
 #include <unistd.h>
@@ -118,12 +119,54 @@ typedef struct _PersistValueHeader
 
 /* lowest layer, "store" functions manage the file on disk */
 
+TLS_BLOCK_START
+{
+  /* 1 based, 0 means the thread has not been assigned a slot yet */
+  gint persist_state_reader_slot;
+}
+TLS_BLOCK_END;
+
+#define persist_state_reader_slot __tls_deref(persist_state_reader_slot)
+
+static gint next_reader_slot;
+
+static PersistStateReaderSlot *
+_get_reader_slot(PersistState *self)
+{
+  if (G_UNLIKELY(persist_state_reader_slot == 0))
+    persist_state_reader_slot = (g_atomic_int_add(&next_reader_slot, 1) % PERSIST_STATE_READER_SLOTS) + 1;
+
+  return &self->reader_slots[persist_state_reader_slot - 1];
+}
+
+static gint
+_count_readers(PersistState *self)
+{
+  gint readers = 0;
+
+  for (gint i = 0; i < PERSIST_STATE_READER_SLOTS; i++)
+    readers += g_atomic_int_get(&self->reader_slots[i].readers);
+  return readers;
+}
+
+/*
+ * Called after the new mapping has been published: a reader that
+ * increments its slot after we have seen that slot empty can only load
+ * the new mapping, so it is enough to see each slot drained once, they
+ * don't need to be empty at the same time.
+ */
 static void
 _wait_until_map_release(PersistState *self)
 {
   g_mutex_lock(self->mapped_lock);
-  while (self->mapped_counter)
-    g_cond_wait(self->mapped_release_cond, self->mapped_lock);
+  g_atomic_int_set(&self->remapping, TRUE);
+  for (gint i = 0; i < PERSIST_STATE_READER_SLOTS; i++)
+    {
+      while (g_atomic_int_get(&self->reader_slots[i].readers))
+        g_cond_wait(self->mapped_release_cond, self->mapped_lock);
+    }
+  g_atomic_int_set(&self->remapping, FALSE);
+  g_mutex_unlock(self->mapped_lock);
 }
 
 static gboolean
@@ -145,40 +188,46 @@ _increase_file_size(PersistState *self, guint32 new_size)
   return result;
 }
 
+/*
+ * Threading NOTE: only the main thread grows the store, readers may still
+ * be using the old mapping while the new one is set up.  Both are shared
+ * mappings of the same file, so writes through either of them are visible
+ * in the other one, the old mapping is unmapped once readers are drained.
+ */
 static gboolean
 _grow_store(PersistState *self, guint32 new_size)
 {
   int pgsize = getpagesize();
-  gboolean result = FALSE;
-
-  _wait_until_map_release(self);
 
   if ((new_size & (pgsize-1)) != 0)
     {
       new_size = ((new_size / pgsize) + 1) * pgsize;
     }
 
-  if (new_size > self->current_size)
+  if (new_size <= self->current_size)
+    return TRUE;
+
+  if (!_increase_file_size(self, new_size))
+    return FALSE;
+
+  gpointer new_map = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+  if (new_map == MAP_FAILED)
+    return FALSE;
+
+  gpointer old_map = self->current_map;
+  guint32 old_size = self->current_size;
+
+  g_atomic_pointer_set(&self->current_map, new_map);
+  self->current_size = new_size;
+  self->header = (PersistFileHeader *) self->current_map;
+  memcpy(&self->header->magic, "SLP4", 4);
+
+  if (old_map)
     {
-      if (!_increase_file_size(self, new_size))
-        goto exit;
-
-      if (self->current_map)
-        munmap(self->current_map, self->current_size);
-      self->current_size = new_size;
-      self->current_map = mmap(NULL, self->current_size, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
-      if (self->current_map == MAP_FAILED)
-        {
-          self->current_map = NULL;
-          goto exit;
-        }
-      self->header = (PersistFileHeader *) self->current_map;
-      memcpy(&self->header->magic, "SLP4", 4);
+      _wait_until_map_release(self);
+      munmap(old_map, old_size);
     }
-  result = TRUE;
-exit:
-  g_mutex_unlock(self->mapped_lock);
-  return result;
+  return TRUE;
 }
 
 static gboolean
@@ -718,7 +767,8 @@ close_and_exit:
  * save this pointer for longer terms as the underlying mapping may
  * change when the file grows.
  *
- * Threading NOTE: this can be called from any kind of threads.
+ * Threading NOTE: this can be called from any kind of threads, but the
+ * matching unmap_entry() must be called from the same thread.
  *
  * NOTE: it is not safe to keep an entry mapped while synchronizing with the
  * main thread (e.g.  mutexes, condvars, main_loop_call()), because
@@ -728,12 +778,11 @@ gpointer
 persist_state_map_entry(PersistState *self, PersistEntryHandle handle)
 {
   /* we count the number of mapped entries in order to know if we're
-   * safe to remap the file region */
+   * safe to unmap an old mapping of the file region, the counter must be
+   * incremented before the mapping is loaded, see _wait_until_map_release() */
   g_assert(handle);
-  g_mutex_lock(self->mapped_lock);
-  self->mapped_counter++;
-  g_mutex_unlock(self->mapped_lock);
-  return (gpointer) (((gchar *) self->current_map) + (guint32) handle);
+  g_atomic_int_inc(&_get_reader_slot(self)->readers);
+  return (gpointer) (((gchar *) g_atomic_pointer_get(&self->current_map)) + (guint32) handle);
 }
 
 /*
@@ -742,14 +791,15 @@ persist_state_map_entry(PersistState *self, PersistEntryHandle handle)
 void
 persist_state_unmap_entry(PersistState *self, PersistEntryHandle handle)
 {
-  g_mutex_lock(self->mapped_lock);
-  g_assert(self->mapped_counter >= 1);
-  self->mapped_counter--;
-  if (self->mapped_counter == 0)
+  PersistStateReaderSlot *slot = _get_reader_slot(self);
+
+  g_assert(g_atomic_int_get(&slot->readers) >= 1);
+  if (g_atomic_int_dec_and_test(&slot->readers) && g_atomic_int_get(&self->remapping))
     {
-      g_cond_signal(self->mapped_release_cond);
+      g_mutex_lock(self->mapped_lock);
+      g_cond_broadcast(self->mapped_release_cond);
+      g_mutex_unlock(self->mapped_lock);
     }
-  g_mutex_unlock(self->mapped_lock);
 }
 
 static PersistValueHeader *
@@ -965,9 +1015,7 @@ persist_state_commit(PersistState *self)
 static void
 _destroy(PersistState *self)
 {
-  g_mutex_lock(self->mapped_lock);
-  g_assert(self->mapped_counter == 0);
-  g_mutex_unlock(self->mapped_lock);
+  g_assert(_count_readers(self) == 0);
 
   if (self->fd >= 0)
     close(self->fd);
@@ -63,13 +63,26 @@ typedef struct _PersistEntry
   PersistEntryHandle ofs;
 } PersistEntry;
 
+#define PERSIST_STATE_READER_SLOTS 64
+
+/* padded to a cache line so that readers in different slots do not bounce
+ * the same line between CPUs */
+typedef struct _PersistStateReaderSlot
+{
+  gint readers;
+  gchar __padding[64 - sizeof(gint)];
+} PersistStateReaderSlot;
+
 struct _PersistState
 {
   gint version;
   gchar *committed_filename;
   gchar *temp_filename;
   gint fd;
-  gint mapped_counter;
+  /* threads count their mapped entries in a slot of their own, the
+   * shared lock is only taken while the store is being remapped */
+  PersistStateReaderSlot reader_slots[PERSIST_STATE_READER_SLOTS];
+  gint remapping;
   GMutex *mapped_lock;
   GCond *mapped_release_cond;
   guint32 current_size;
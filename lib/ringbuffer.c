@@ -68,13 +68,13 @@ ring_buffer_free(RingBuffer *self)
 gboolean
 ring_buffer_is_full(RingBuffer *self)
 {
-  return self->capacity == self->count ? TRUE : FALSE;
+  return self->capacity == ring_buffer_count(self) ? TRUE : FALSE;
 }
 
 gboolean
 ring_buffer_is_empty(RingBuffer *self)
 {
-  return (self->count == 0) ? TRUE : FALSE;
+  return (ring_buffer_count(self) == 0) ? TRUE : FALSE;
 }
 
 gpointer
@@ -85,8 +85,8 @@ ring_buffer_push(RingBuffer *self)
   if (!r)
     return NULL;
 
-  ++self->count;
   self->tail = (self->tail + 1) % self->capacity;
+  g_atomic_int_inc((gint *) &self->count);
 
   return r;
 }
@@ -114,8 +114,8 @@ ring_buffer_pop(RingBuffer *self)
 
   gpointer r = (guint8 *) (self->buffer) + self->head * self->element_size;
 
-  --self->count;
   self->head = (self->head + 1) % self->capacity;
+  g_atomic_int_add((gint *) &self->count, -1);
 
   return r;
 }
@@ -128,8 +128,8 @@ ring_buffer_drop(RingBuffer *self, guint32 n)
   if (ring_buffer_count(self) < n)
     return FALSE;
 
-  self->count -= n;
   self->head = (self->head + n) % self->capacity;
+  g_atomic_int_add((gint *) &self->count, -(gint) n);
 
   return TRUE;
 }
@@ -143,7 +143,7 @@ ring_buffer_capacity(RingBuffer *self)
 guint32
 ring_buffer_count(RingBuffer *self)
 {
-  return self->count;
+  return g_atomic_int_get((gint *) &self->count);
 }
 
 gpointer
@@ -151,7 +151,7 @@ ring_buffer_element_at(RingBuffer *self, guint32 idx)
 {
   g_assert(self->buffer != NULL);
 
-  if (idx >= self->count)
+  if (idx >= ring_buffer_count(self))
     return NULL;
 
   return (guint8 *) (self->buffer) + ((self->head + idx) % self->capacity) * self->element_size;
@@ -161,10 +161,11 @@ guint32
 ring_buffer_get_continual_range_length(RingBuffer *self, RingBufferIsContinuousPredicate pred)
 {
   guint32 r = 0, i;
+  guint32 count = ring_buffer_count(self);
 
   g_assert(self->buffer != NULL);
 
-  for (i = 0; i < ring_buffer_count(self); i++)
+  for (i = 0; i < count; i++)
     {
       if (!pred(ring_buffer_element_at(self, i)))
         {
@@ -27,6 +27,12 @@
 
 #include <glib.h>
 
+/*
+ * A single producer (push) and a single consumer (pop, drop, element_at)
+ * may use the ring concurrently: head is only written by the consumer,
+ * tail only by the producer, and the elements are published/released by
+ * the atomic update of count.
+ */
 typedef struct _RingBuffer
 {
   gpointer buffer;
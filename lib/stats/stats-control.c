@@ -26,6 +26,7 @@
 #include "stats/stats-csv.h"
 #include "stats/stats-counter.h"
 #include "stats/stats-registry.h"
+#include "stats/stats-histogram.h"
 #include "stats/stats-query-commands.h"
 #include "control/control-commands.h"
 #include "control/control-server.h"
@@ -56,6 +57,7 @@ static void
 _reset_counters(void)
 {
   stats_lock();
+  stats_reset_histograms();
   stats_foreach_counter(_reset_counter_if_needed, NULL);
   stats_unlock();
 }
@@ -23,6 +23,7 @@
  */
 #include "stats/stats-csv.h"
 #include "stats/stats-registry.h"
+#include "stats/stats-histogram.h"
 #include "utf8utils.h"
 
 #include <string.h>
@@ -93,6 +94,7 @@ stats_generate_csv(void)
   g_string_append_printf(csv, "%s;%s;%s;%s;%s;%s\n", "SourceName", "SourceId", "SourceInstance", "State", "Type",
                          "Number");
   stats_lock();
+  stats_update_histograms();
   stats_foreach_counter(stats_format_csv, csv);
   stats_unlock();
   return g_string_free(csv, FALSE);
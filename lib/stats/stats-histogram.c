@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "stats/stats-histogram.h"
+#include "stats/stats-registry.h"
+#include "tls-support.h"
+
+#define STATS_HISTOGRAM_SHARDS 8
+
+typedef struct _StatsHistogramShard
+{
+  atomic_gssize buckets[STATS_HISTOGRAM_BUCKETS];
+} StatsHistogramShard;
+
+struct _StatsHistogram
+{
+  StatsHistogramShard shards[STATS_HISTOGRAM_SHARDS];
+  StatsCounterItem *exported[SC_TYPE_HISTOGRAM_MAX];
+};
+
+static const gchar *tag_suffixes[SC_TYPE_HISTOGRAM_MAX] =
+{
+  /* [SC_TYPE_HISTOGRAM_P50]       = */ "p50",
+  /* [SC_TYPE_HISTOGRAM_P90]       = */ "p90",
+  /* [SC_TYPE_HISTOGRAM_P99]       = */ "p99",
+  /* [SC_TYPE_HISTOGRAM_P999]      = */ "p999",
+  /* [SC_TYPE_HISTOGRAM_MAX_VALUE] = */ "max",
+  /* [SC_TYPE_HISTOGRAM_COUNT]     = */ "count",
+};
+
+static const gdouble exported_percentiles[SC_TYPE_HISTOGRAM_MAX_VALUE] =
+{
+  /* [SC_TYPE_HISTOGRAM_P50]  = */ 50.0,
+  /* [SC_TYPE_HISTOGRAM_P90]  = */ 90.0,
+  /* [SC_TYPE_HISTOGRAM_P99]  = */ 99.0,
+  /* [SC_TYPE_HISTOGRAM_P999] = */ 99.9,
+};
+
+/* registered histograms, protected by stats_lock() */
+static GList *registered_histograms;
+
+TLS_BLOCK_START
+{
+  /* 1 based, 0 means the thread has not been assigned a shard yet */
+  gint stats_histogram_shard;
+}
+TLS_BLOCK_END;
+
+#define stats_histogram_shard __tls_deref(stats_histogram_shard)
+
+static gint next_shard;
+
+static StatsHistogramShard *
+_get_shard(StatsHistogram *self)
+{
+  if (G_UNLIKELY(stats_histogram_shard == 0))
+    stats_histogram_shard = (g_atomic_int_add(&next_shard, 1) % STATS_HISTOGRAM_SHARDS) + 1;
+
+  return &self->shards[stats_histogram_shard - 1];
+}
+
+static gint
+_value_to_bucket(guint64 value)
+{
+  if (value < STATS_HISTOGRAM_SUB_BUCKETS)
+    return value;
+
+  if (value >= G_GUINT64_CONSTANT(1) << STATS_HISTOGRAM_VALUE_BITS)
+    return STATS_HISTOGRAM_BUCKETS - 1;
+
+  gint msb = g_bit_nth_msf((gulong) value, -1);
+  gint shift = msb - STATS_HISTOGRAM_SUB_BUCKET_BITS;
+
+  return (shift + 1) * STATS_HISTOGRAM_SUB_BUCKETS + (gint)(value >> shift) - STATS_HISTOGRAM_SUB_BUCKETS;
+}
+
+/* the largest value accounted in the bucket */
+static gint64
+_bucket_upper_bound(gint bucket)
+{
+  if (bucket < STATS_HISTOGRAM_SUB_BUCKETS)
+    return bucket;
+
+  gint shift = bucket / STATS_HISTOGRAM_SUB_BUCKETS - 1;
+  gint64 sub_bucket = bucket % STATS_HISTOGRAM_SUB_BUCKETS + STATS_HISTOGRAM_SUB_BUCKETS;
+
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+static gsize
+_merge_shards(StatsHistogram *self, gsize *buckets)
+{
+  gsize total = 0;
+
+  for (gint bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++)
+    {
+      buckets[bucket] = 0;
+      for (gint shard = 0; shard < STATS_HISTOGRAM_SHARDS; shard++)
+        buckets[bucket] += atomic_gssize_get_unsigned(&self->shards[shard].buckets[bucket]);
+      total += buckets[bucket];
+    }
+
+  return total;
+}
+
+static gint64
+_find_percentile(const gsize *buckets, gsize total, gdouble percentile)
+{
+  if (total == 0)
+    return 0;
+
+  gdouble exact_rank = total * percentile / 100.0;
+  gsize rank = (gsize) exact_rank;
+  gsize seen = 0;
+
+  if (rank < exact_rank)
+    rank++;
+  rank = CLAMP(rank, 1, total);
+  for (gint bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++)
+    {
+      seen += buckets[bucket];
+      if (seen >= rank)
+        return _bucket_upper_bound(bucket);
+    }
+
+  return _bucket_upper_bound(STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+void
+stats_histogram_record(StatsHistogram *self, gint64 value)
+{
+  if (!self)
+    return;
+
+  StatsHistogramShard *shard = _get_shard(self);
+  atomic_gssize_inc(&shard->buckets[_value_to_bucket(MAX(value, 0))]);
+}
+
+void
+stats_histogram_record_since(StatsHistogram *self, const UnixTime *since)
+{
+  if (!self || !unix_time_is_set(since))
+    return;
+
+  GTimeVal now;
+  g_get_current_time(&now);
+
+  stats_histogram_record(self, ((gint64) now.tv_sec - since->ut_sec) * G_USEC_PER_SEC + now.tv_usec - since->ut_usec);
+}
+
+gsize
+stats_histogram_get_count(StatsHistogram *self)
+{
+  gsize buckets[STATS_HISTOGRAM_BUCKETS];
+
+  return _merge_shards(self, buckets);
+}
+
+gint64
+stats_histogram_get_percentile(StatsHistogram *self, gdouble percentile)
+{
+  gsize buckets[STATS_HISTOGRAM_BUCKETS];
+  gsize total = _merge_shards(self, buckets);
+
+  return _find_percentile(buckets, total, percentile);
+}
+
+void
+stats_histogram_reset(StatsHistogram *self)
+{
+  for (gint shard = 0; shard < STATS_HISTOGRAM_SHARDS; shard++)
+    for (gint bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++)
+      atomic_gssize_set(&self->shards[shard].buckets[bucket], 0);
+}
+
+StatsHistogram *
+stats_histogram_new(void)
+{
+  return g_new0(StatsHistogram, 1);
+}
+
+void
+stats_histogram_free(StatsHistogram *self)
+{
+  g_free(self);
+}
+
+static void
+_update_exported_counters(StatsHistogram *self)
+{
+  gsize buckets[STATS_HISTOGRAM_BUCKETS];
+  gsize total = _merge_shards(self, buckets);
+
+  for (gint type = 0; type < SC_TYPE_HISTOGRAM_MAX_VALUE; type++)
+    stats_counter_set(self->exported[type], _find_percentile(buckets, total, exported_percentiles[type]));
+
+  stats_counter_set(self->exported[SC_TYPE_HISTOGRAM_MAX_VALUE], _find_percentile(buckets, total, 100.0));
+  stats_counter_set(self->exported[SC_TYPE_HISTOGRAM_COUNT], total);
+}
+
+static void
+_counter_group_histogram_free(StatsCounterGroup *counter_group)
+{
+  for (gint type = 0; type < SC_TYPE_HISTOGRAM_MAX; type++)
+    g_free((gchar *) counter_group->counter_names[type]);
+  g_free(counter_group->counter_names);
+  g_free(counter_group->counters);
+}
+
+static void
+_counter_group_histogram_init(StatsCounterGroupInit *self, StatsCounterGroup *counter_group)
+{
+  const gchar **counter_names = g_new0(const gchar *, SC_TYPE_HISTOGRAM_MAX);
+
+  for (gint type = 0; type < SC_TYPE_HISTOGRAM_MAX; type++)
+    counter_names[type] = g_strdup_printf("%s_%s", self->counter.name, tag_suffixes[type]);
+
+  counter_group->counters = g_new0(StatsCounterItem, SC_TYPE_HISTOGRAM_MAX);
+  counter_group->capacity = SC_TYPE_HISTOGRAM_MAX;
+  counter_group->counter_names = counter_names;
+  counter_group->free_fn = _counter_group_histogram_free;
+}
+
+static gboolean
+_group_init_equals(const StatsCounterGroupInit *self, const StatsCounterGroupInit *other)
+{
+  g_assert(self != NULL && other != NULL && self->counter.name != NULL && other->counter.name != NULL);
+  return (self->init == other->init) && (g_strcmp0(self->counter.name, other->counter.name) == 0);
+}
+
+void
+stats_cluster_histogram_key_set(StatsClusterKey *key, guint16 component, const gchar *id, const gchar *instance,
+                                const gchar *name)
+{
+  stats_cluster_key_set(key, component, id, instance, (StatsCounterGroupInit)
+  {
+    .counter.name = name, .init = _counter_group_histogram_init, .equals = _group_init_equals
+  });
+}
+
+void
+stats_register_histogram(gint level, const StatsClusterKey *sc_key, StatsHistogram **histogram)
+{
+  *histogram = NULL;
+
+  if (!stats_check_level(level))
+    return;
+
+  StatsHistogram *self = stats_histogram_new();
+
+  for (gint type = 0; type < SC_TYPE_HISTOGRAM_MAX; type++)
+    stats_register_counter(level, sc_key, type, &self->exported[type]);
+
+  registered_histograms = g_list_prepend(registered_histograms, self);
+  *histogram = self;
+}
+
+void
+stats_unregister_histogram(const StatsClusterKey *sc_key, StatsHistogram **histogram)
+{
+  StatsHistogram *self = *histogram;
+
+  if (!self)
+    return;
+
+  /* publish the final values, the cluster is kept as orphaned */
+  _update_exported_counters(self);
+
+  for (gint type = 0; type < SC_TYPE_HISTOGRAM_MAX; type++)
+    stats_unregister_counter(sc_key, type, &self->exported[type]);
+
+  registered_histograms = g_list_remove(registered_histograms, self);
+  stats_histogram_free(self);
+  *histogram = NULL;
+}
+
+void
+stats_update_histograms(void)
+{
+  for (GList *l = registered_histograms; l; l = l->next)
+    _update_exported_counters((StatsHistogram *) l->data);
+}
+
+void
+stats_reset_histograms(void)
+{
+  for (GList *l = registered_histograms; l; l = l->next)
+    stats_histogram_reset((StatsHistogram *) l->data);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef STATS_HISTOGRAM_H_INCLUDED
+#define STATS_HISTOGRAM_H_INCLUDED
+
+#include "stats/stats-cluster.h"
+#include "timeutils/unixtime.h"
+
+/*
+ * Log-linear (HDR style) latency histogram.
+ *
+ * Values are recorded in microseconds.  Each power of two range is split
+ * into STATS_HISTOGRAM_SUB_BUCKETS linear buckets, which keeps the relative
+ * error of the reported percentiles below 1/STATS_HISTOGRAM_SUB_BUCKETS
+ * while covering everything from a microsecond to more than an hour with a
+ * few hundred buckets.  Larger values are accounted in the last bucket.
+ *
+ * Recording is lock-free: threads are spread over a small set of bucket
+ * shards, which are only merged when the histogram is read.
+ *
+ * A registered histogram publishes its percentiles as ordinary counters of
+ * a cluster (named <name>_p50, <name>_p99, <name>_max, etc.), these are
+ * refreshed by stats_update_histograms() right before the counters are
+ * read, so they are visible in "syslog-ng-ctl stats" and the query
+ * commands without any further change.
+ */
+
+#define STATS_HISTOGRAM_SUB_BUCKET_BITS 3
+#define STATS_HISTOGRAM_SUB_BUCKETS (1 << STATS_HISTOGRAM_SUB_BUCKET_BITS)
+#define STATS_HISTOGRAM_VALUE_BITS 32
+#define STATS_HISTOGRAM_BUCKETS \
+  ((STATS_HISTOGRAM_VALUE_BITS - STATS_HISTOGRAM_SUB_BUCKET_BITS + 1) * STATS_HISTOGRAM_SUB_BUCKETS)
+
+typedef enum
+{
+  SC_TYPE_HISTOGRAM_P50,
+  SC_TYPE_HISTOGRAM_P90,
+  SC_TYPE_HISTOGRAM_P99,
+  SC_TYPE_HISTOGRAM_P999,
+  SC_TYPE_HISTOGRAM_MAX_VALUE,
+  SC_TYPE_HISTOGRAM_COUNT,
+  SC_TYPE_HISTOGRAM_MAX
+} StatsCounterGroupHistogram;
+
+typedef struct _StatsHistogram StatsHistogram;
+
+StatsHistogram *stats_histogram_new(void);
+void stats_histogram_free(StatsHistogram *self);
+void stats_histogram_reset(StatsHistogram *self);
+
+void stats_histogram_record(StatsHistogram *self, gint64 value);
+void stats_histogram_record_since(StatsHistogram *self, const UnixTime *since);
+
+gsize stats_histogram_get_count(StatsHistogram *self);
+gint64 stats_histogram_get_percentile(StatsHistogram *self, gdouble percentile);
+
+void stats_cluster_histogram_key_set(StatsClusterKey *key, guint16 component, const gchar *id, const gchar *instance,
+                                     const gchar *name);
+
+/* the functions below must be called with stats_lock() held */
+void stats_register_histogram(gint level, const StatsClusterKey *sc_key, StatsHistogram **histogram);
+void stats_unregister_histogram(const StatsClusterKey *sc_key, StatsHistogram **histogram);
+
+void stats_update_histograms(void);
+void stats_reset_histograms(void);
+
+#endif
@@ -24,6 +24,8 @@
 #include "messages.h"
 #include "stats-query-commands.h"
 #include "stats/stats-query.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-histogram.h"
 #include "control/control-server.h"
 
 typedef enum _QueryCommand
@@ -190,6 +192,10 @@ _process_query_command(ControlConnection *cc, GString *command, gpointer user_da
 
   g_assert(g_str_equal(cmds[CMD_STR], "QUERY"));
 
+  stats_lock();
+  stats_update_histograms();
+  stats_unlock();
+
   _dispatch_query(_command_str_to_id(cmds[QUERY_CMD_STR]), cmds[QUERY_FILTER_STR], result);
 
   g_strfreev(cmds);
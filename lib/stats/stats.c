@@ -26,6 +26,7 @@
 #include "stats/stats-log.h"
 #include "stats/stats-query.h"
 #include "stats/stats-registry.h"
+#include "stats/stats-histogram.h"
 #include "stats/stats.h"
 #include "timeutils/cache.h"
 #include "timeutils/misc.h"
@@ -157,6 +158,8 @@ stats_publish_and_prune_counters(StatsOptions *options)
     st.stats_event = msg_event_create(EVT_PRI_INFO, "Log statistics", NULL);
 
   stats_lock();
+  if (publish)
+    stats_update_histograms();
   stats_foreach_cluster_remove(stats_format_and_prune_cluster, &st);
   stats_unlock();
 
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "stats/stats-histogram.h"
+#include "stats/stats-registry.h"
+#include "apphook.h"
+
+#define RECORDER_THREADS 4
+
+static void
+_expect_value_within_relative_error(gint64 value, gint64 expected)
+{
+  cr_expect(value >= expected && value <= expected + expected / STATS_HISTOGRAM_SUB_BUCKETS,
+            "value out of the expected range, value: %" G_GINT64_FORMAT ", expected: %" G_GINT64_FORMAT,
+            value, expected);
+}
+
+Test(stats_histogram, small_values_are_exact)
+{
+  StatsHistogram *histogram = stats_histogram_new();
+
+  for (gint i = 0; i < STATS_HISTOGRAM_SUB_BUCKETS; i++)
+    stats_histogram_record(histogram, i);
+
+  cr_expect_eq(stats_histogram_get_count(histogram), STATS_HISTOGRAM_SUB_BUCKETS);
+  cr_expect_eq(stats_histogram_get_percentile(histogram, 0.0), 0);
+  cr_expect_eq(stats_histogram_get_percentile(histogram, 100.0), STATS_HISTOGRAM_SUB_BUCKETS - 1);
+
+  stats_histogram_free(histogram);
+}
+
+Test(stats_histogram, percentiles_are_within_the_relative_error)
+{
+  StatsHistogram *histogram = stats_histogram_new();
+
+  for (gint i = 1; i <= 100000; i++)
+    stats_histogram_record(histogram, i);
+
+  _expect_value_within_relative_error(stats_histogram_get_percentile(histogram, 50.0), 50000);
+  _expect_value_within_relative_error(stats_histogram_get_percentile(histogram, 99.0), 99000);
+  _expect_value_within_relative_error(stats_histogram_get_percentile(histogram, 99.9), 99900);
+  _expect_value_within_relative_error(stats_histogram_get_percentile(histogram, 100.0), 100000);
+
+  stats_histogram_free(histogram);
+}
+
+Test(stats_histogram, out_of_range_values_are_clamped)
+{
+  StatsHistogram *histogram = stats_histogram_new();
+
+  stats_histogram_record(histogram, -1);
+  stats_histogram_record(histogram, G_MAXINT64);
+
+  cr_expect_eq(stats_histogram_get_count(histogram), 2);
+  cr_expect_eq(stats_histogram_get_percentile(histogram, 50.0), 0);
+  cr_expect_eq(stats_histogram_get_percentile(histogram, 100.0),
+               (G_GINT64_CONSTANT(1) << STATS_HISTOGRAM_VALUE_BITS) - 1);
+
+  stats_histogram_reset(histogram);
+  cr_expect_eq(stats_histogram_get_count(histogram), 0);
+  cr_expect_eq(stats_histogram_get_percentile(histogram, 100.0), 0);
+
+  stats_histogram_free(histogram);
+}
+
+static gpointer
+_record_values(gpointer user_data)
+{
+  StatsHistogram *histogram = (StatsHistogram *) user_data;
+
+  for (gint i = 0; i < 100000; i++)
+    stats_histogram_record(histogram, 1000);
+
+  return NULL;
+}
+
+Test(stats_histogram, records_from_multiple_threads_are_merged)
+{
+  StatsHistogram *histogram = stats_histogram_new();
+  GThread *threads[RECORDER_THREADS];
+
+  for (gint i = 0; i < RECORDER_THREADS; i++)
+    threads[i] = g_thread_create(_record_values, histogram, TRUE, NULL);
+
+  for (gint i = 0; i < RECORDER_THREADS; i++)
+    g_thread_join(threads[i]);
+
+  cr_expect_eq(stats_histogram_get_count(histogram), RECORDER_THREADS * 100000);
+  _expect_value_within_relative_error(stats_histogram_get_percentile(histogram, 50.0), 1000);
+
+  stats_histogram_free(histogram);
+}
+
+Test(stats_histogram, registered_histogram_is_exported_as_counters)
+{
+  StatsHistogram *histogram;
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_histogram_key_set(&sc_key, SCS_GLOBAL, "test_histogram", NULL, "latency");
+  stats_register_histogram(0, &sc_key, &histogram);
+  stats_unlock();
+  cr_assert_not_null(histogram);
+
+  for (gint i = 1; i <= 100; i++)
+    stats_histogram_record(histogram, i);
+
+  stats_lock();
+  stats_update_histograms();
+  StatsCounterItem *p50 = stats_get_counter(&sc_key, SC_TYPE_HISTOGRAM_P50);
+  StatsCounterItem *count = stats_get_counter(&sc_key, SC_TYPE_HISTOGRAM_COUNT);
+  _expect_value_within_relative_error(stats_counter_get(p50), 50);
+  cr_expect_eq(stats_counter_get(count), 100);
+
+  stats_reset_histograms();
+  stats_update_histograms();
+  cr_expect_eq(stats_counter_get(count), 0);
+
+  stats_unregister_histogram(&sc_key, &histogram);
+  stats_unlock();
+  cr_expect_null(histogram);
+}
+
+TestSuite(stats_histogram, .init = app_startup, .fini = app_shutdown);
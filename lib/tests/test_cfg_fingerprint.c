@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "cfg-fingerprint.h"
+#include "cfg-tree.h"
+
+#define BASE_CONFIG \
+  "@version: 3.35\n" \
+  "options { keep-hostname(yes); };\n" \
+  "source s_net { network(port(5514)); };\n" \
+  "filter f_error { level(err..emerg); };\n" \
+  "destination d_file { file(\"/var/log/messages\" template(\"$MSG # not a comment\\n\")); };\n" \
+  "log { source(s_net); filter(f_error); destination(d_file); };\n"
+
+static void
+assert_object_digests_equal(CfgFingerprint *a, CfgFingerprint *b, gint content, const gchar *name)
+{
+  const gchar *digest_a = cfg_fingerprint_get_object_digest(a, content, name);
+  const gchar *digest_b = cfg_fingerprint_get_object_digest(b, content, name);
+
+  cr_assert_not_null(digest_a);
+  cr_assert_not_null(digest_b);
+  cr_assert_str_eq(digest_a, digest_b, "digests of %s differ", name);
+}
+
+Test(cfg_fingerprint, statements_are_classified)
+{
+  CfgFingerprint *fingerprint = cfg_fingerprint_new(BASE_CONFIG);
+
+  cr_assert_eq(g_hash_table_size(fingerprint->objects), 3);
+  cr_assert_not_null(cfg_fingerprint_get_object_digest(fingerprint, ENC_SOURCE, "s_net"));
+  cr_assert_not_null(cfg_fingerprint_get_object_digest(fingerprint, ENC_FILTER, "f_error"));
+  cr_assert_not_null(cfg_fingerprint_get_object_digest(fingerprint, ENC_DESTINATION, "d_file"));
+  cr_assert_null(cfg_fingerprint_get_object_digest(fingerprint, ENC_SOURCE, "d_file"));
+  cr_assert_eq(fingerprint->log_paths->len, 1);
+
+  cfg_fingerprint_free(fingerprint);
+}
+
+Test(cfg_fingerprint, whitespace_and_comments_are_not_significant)
+{
+  CfgFingerprint *a = cfg_fingerprint_new(BASE_CONFIG);
+  CfgFingerprint *b = cfg_fingerprint_new("@version: 3.35\n"
+                                          "# global options\n"
+                                          "options {\n  keep-hostname(yes);\n};\n"
+                                          "source s_net {\n  network(port(5514)); # syslog\n};\n"
+                                          "filter f_error { level(err..emerg); };\n"
+                                          "destination d_file {\n"
+                                          "  file(\"/var/log/messages\"\n"
+                                          "       template(\"$MSG # not a comment\\n\"));\n"
+                                          "};\n"
+                                          "log {\n  source(s_net);\n  filter(f_error);\n  destination(d_file);\n};\n");
+
+  cr_assert_str_eq(a->global_digest, b->global_digest);
+  assert_object_digests_equal(a, b, ENC_SOURCE, "s_net");
+  assert_object_digests_equal(a, b, ENC_DESTINATION, "d_file");
+  cr_assert_str_eq(g_ptr_array_index(a->log_paths, 0), g_ptr_array_index(b->log_paths, 0));
+  cr_assert(cfg_fingerprint_named_objects_equal(a, b, ENC_FILTER));
+
+  cfg_fingerprint_free(a);
+  cfg_fingerprint_free(b);
+}
+
+Test(cfg_fingerprint, changes_are_detected_per_statement)
+{
+  CfgFingerprint *a = cfg_fingerprint_new(BASE_CONFIG);
+  CfgFingerprint *b = cfg_fingerprint_new("@version: 3.35\n"
+                                          "options { keep-hostname(yes); };\n"
+                                          "source s_net { network(port(5514)); };\n"
+                                          "filter f_error { level(err..emerg); };\n"
+                                          "destination d_file { file(\"/var/log/messages\" template(\"$MSG # a comment\\n\")); };\n"
+                                          "log { source(s_net); filter(f_error); destination(d_file); };\n");
+
+  cr_assert_str_eq(a->global_digest, b->global_digest);
+  assert_object_digests_equal(a, b, ENC_SOURCE, "s_net");
+  cr_assert_str_neq(cfg_fingerprint_get_object_digest(a, ENC_DESTINATION, "d_file"),
+                    cfg_fingerprint_get_object_digest(b, ENC_DESTINATION, "d_file"));
+
+  cfg_fingerprint_free(a);
+  cfg_fingerprint_free(b);
+}
+
+Test(cfg_fingerprint, global_options_and_filters)
+{
+  CfgFingerprint *a = cfg_fingerprint_new(BASE_CONFIG);
+  CfgFingerprint *b = cfg_fingerprint_new("@version: 3.35\n"
+                                          "options { keep-hostname(no); };\n"
+                                          "block source unused() { internal(); };\n"
+                                          "source s_net { network(port(5514)); };\n"
+                                          "filter f_error { level(err..emerg); };\n"
+                                          "filter f_new { program(\"sshd\"); };\n");
+
+  cr_assert_str_neq(a->global_digest, b->global_digest);
+  cr_assert_not(cfg_fingerprint_named_objects_equal(a, b, ENC_FILTER));
+  cr_assert(cfg_fingerprint_named_objects_equal(a, b, ENC_PARSER));
+  cr_assert_eq(b->log_paths->len, 0);
+
+  cfg_fingerprint_free(a);
+  cfg_fingerprint_free(b);
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "cfg.h"
+#include "cfg-tree.h"
+#include "apphook.h"
+#include "mainloop.h"
+#include "libtest/persist_lib.h"
+
+#include <unistd.h>
+
+#define TEST_CONFIG_FILE "test_cfg_incremental_reload.conf"
+
+#define OPTIONS "options { incremental-reload(yes); };\n"
+#define CHANGED_OPTIONS "options { incremental-reload(yes); flush-lines(10); };\n"
+
+#define FILTER "filter f_unused { level(err); };\n"
+#define CHANGED_FILTER "filter f_unused { level(warning); };\n"
+
+#define LOG_PATH(name, value) \
+  "rewrite " name " { set(\"" value "\" value(\"MSG\")); };\n" \
+  "log { rewrite(" name "); };\n"
+
+MainLoop *main_loop;
+MainLoopOptions main_loop_options = {0};
+
+static GlobalConfig *
+_load_config(const gchar *config_text)
+{
+  GlobalConfig *cfg = cfg_new_snippet();
+
+  cr_assert(g_file_set_contents(TEST_CONFIG_FILE, config_text, -1, NULL));
+  cr_assert(cfg_read_config(cfg, TEST_CONFIG_FILE, NULL), "error parsing configuration: %s", config_text);
+  unlink(TEST_CONFIG_FILE);
+  return cfg;
+}
+
+static GlobalConfig *
+_start_config(const gchar *config_text)
+{
+  GlobalConfig *cfg = _load_config(config_text);
+
+  cfg->state = clean_and_create_persist_state_for_test("test_cfg_incremental_reload.persist");
+  cr_assert(cfg_init(cfg));
+  return cfg;
+}
+
+static void
+_stop_config(GlobalConfig *cfg)
+{
+  cfg_deinit(cfg);
+  cancel_and_destroy_persist_state(cfg->state);
+  cfg->state = NULL;
+  cfg_free(cfg);
+}
+
+/* same steps as main_loop_reload_config_apply(), returns the number of log paths kept running */
+static gint
+_reload_config(GlobalConfig *old_config, GlobalConfig *new_config)
+{
+  gint adopted_log_paths = cfg_adopt_unchanged_log_paths(new_config, old_config);
+
+  old_config->persist = persist_config_new();
+  cfg_deinit(old_config);
+  cfg_persist_config_move(old_config, new_config);
+
+  cr_assert(cfg_init(new_config));
+  persist_config_free(new_config->persist);
+  new_config->persist = NULL;
+  cfg_free_replaced(new_config, old_config);
+  return adopted_log_paths;
+}
+
+static LogPipe *
+_find_rewrite(GlobalConfig *cfg, const gchar *name)
+{
+  for (gint i = 0; i < cfg->tree.initialized_pipes->len; i++)
+    {
+      LogPipe *pipe = g_ptr_array_index(cfg->tree.initialized_pipes, i);
+      LogExprNode *rule;
+
+      if (!pipe->expr_node)
+        continue;
+
+      rule = log_expr_node_get_container_rule(pipe->expr_node, ENC_REWRITE);
+      if (rule && g_strcmp0(rule->name, name) == 0)
+        return pipe;
+    }
+  return NULL;
+}
+
+static gboolean
+_failing_init(LogPipe *s)
+{
+  return FALSE;
+}
+
+Test(cfg_incremental_reload, unchanged_log_paths_are_kept_and_changed_ones_are_rebuilt)
+{
+  GlobalConfig *old_config = _start_config(OPTIONS LOG_PATH("r_a", "a") LOG_PATH("r_b", "b"));
+  GlobalConfig *new_config = _load_config(OPTIONS LOG_PATH("r_a", "a") LOG_PATH("r_b", "changed"));
+  LogPipe *rewrite_a = _find_rewrite(old_config, "r_a");
+  LogPipe *rewrite_b = _find_rewrite(old_config, "r_b");
+
+  cr_assert_not_null(rewrite_a);
+  cr_assert_not_null(rewrite_b);
+
+  cr_assert_eq(_reload_config(old_config, new_config), 1);
+  cr_assert_eq(new_config->tree.rules->len, 1, "only the changed log path is compiled again");
+
+  cr_assert_eq(_find_rewrite(new_config, "r_a"), rewrite_a);
+  cr_assert(rewrite_a->flags & PIF_INITIALIZED);
+  cr_assert_eq(rewrite_a->cfg, old_config);
+
+  cr_assert_neq(_find_rewrite(new_config, "r_b"), rewrite_b);
+  cr_assert_eq(_find_rewrite(new_config, "r_b")->cfg, new_config);
+
+  cr_assert_not_null(g_list_find(new_config->retained_configs, old_config),
+                     "the old config owns pipes that are still running");
+
+  _stop_config(new_config);
+}
+
+Test(cfg_incremental_reload, global_option_change_restarts_everything)
+{
+  GlobalConfig *old_config = _start_config(OPTIONS LOG_PATH("r_a", "a"));
+  GlobalConfig *new_config = _load_config(CHANGED_OPTIONS LOG_PATH("r_a", "a"));
+  LogPipe *rewrite_a = _find_rewrite(old_config, "r_a");
+
+  cr_assert_eq(_reload_config(old_config, new_config), 0);
+  cr_assert_eq(new_config->tree.rules->len, 1);
+  cr_assert_neq(_find_rewrite(new_config, "r_a"), rewrite_a);
+  cr_assert_null(new_config->retained_configs);
+
+  _stop_config(new_config);
+}
+
+Test(cfg_incremental_reload, named_filter_change_restarts_everything)
+{
+  GlobalConfig *old_config = _start_config(OPTIONS FILTER LOG_PATH("r_a", "a"));
+  GlobalConfig *new_config = _load_config(OPTIONS CHANGED_FILTER LOG_PATH("r_a", "a"));
+  LogPipe *rewrite_a = _find_rewrite(old_config, "r_a");
+
+  cr_assert_eq(_reload_config(old_config, new_config), 0);
+  cr_assert_neq(_find_rewrite(new_config, "r_a"), rewrite_a);
+  cr_assert_null(new_config->retained_configs);
+
+  _stop_config(new_config);
+}
+
+Test(cfg_incremental_reload, failed_init_gives_adopted_pipes_back_to_the_old_config)
+{
+  GlobalConfig *old_config = _start_config(OPTIONS LOG_PATH("r_a", "a") LOG_PATH("r_b", "b"));
+  GlobalConfig *new_config = _load_config(OPTIONS LOG_PATH("r_a", "a") LOG_PATH("r_b", "changed"));
+  LogPipe *rewrite_a = _find_rewrite(old_config, "r_a");
+  LogPipe *rewrite_b = _find_rewrite(old_config, "r_b");
+  LogPipe *failing_pipe = log_pipe_new(new_config);
+
+  failing_pipe->init = _failing_init;
+  g_ptr_array_add(new_config->tree.initialized_pipes, failing_pipe);
+
+  /* same steps as main_loop_reload_config_apply() and main_loop_reload_config_revert() */
+  cr_assert_eq(cfg_adopt_unchanged_log_paths(new_config, old_config), 1);
+  old_config->persist = persist_config_new();
+  cfg_deinit(old_config);
+  cfg_persist_config_move(old_config, new_config);
+
+  cr_assert(rewrite_a->flags & PIF_INITIALIZED);
+  cr_assert_not(rewrite_b->flags & PIF_INITIALIZED);
+  cr_assert_not(cfg_init(new_config));
+
+  cfg_tree_release_adopted_pipes(&new_config->tree);
+  cfg_tree_restore_preserved_pipes(&old_config->tree);
+  cfg_persist_config_move(new_config, old_config);
+  cfg_deinit(new_config);
+
+  cr_assert(rewrite_a->flags & PIF_INITIALIZED, "the failed config must not stop the adopted pipes");
+  cr_assert_null(_find_rewrite(new_config, "r_a"));
+
+  cr_assert(cfg_init(old_config));
+  persist_config_free(old_config->persist);
+  old_config->persist = NULL;
+  cfg_free(new_config);
+
+  cr_assert_eq(_find_rewrite(old_config, "r_a"), rewrite_a);
+  cr_assert_eq(_find_rewrite(old_config, "r_b"), rewrite_b);
+  cr_assert(rewrite_b->flags & PIF_INITIALIZED);
+
+  /* the restored pipes can be adopted again */
+  new_config = _load_config(OPTIONS LOG_PATH("r_a", "a") LOG_PATH("r_b", "changed"));
+  cr_assert_eq(_reload_config(old_config, new_config), 1);
+  cr_assert_eq(_find_rewrite(new_config, "r_a"), rewrite_a);
+
+  _stop_config(new_config);
+}
+
+Test(cfg_incremental_reload, retained_configs_are_freed_after_a_second_reload)
+{
+  GlobalConfig *first_config = _start_config(OPTIONS LOG_PATH("r_a", "a") LOG_PATH("r_b", "b1"));
+  GlobalConfig *second_config = _load_config(OPTIONS LOG_PATH("r_a", "a") LOG_PATH("r_b", "b2"));
+  GlobalConfig *third_config = _load_config(OPTIONS LOG_PATH("r_a", "a") LOG_PATH("r_b", "b3"));
+  GlobalConfig *fourth_config = _load_config(CHANGED_OPTIONS LOG_PATH("r_a", "a") LOG_PATH("r_b", "b3"));
+  LogPipe *rewrite_a = _find_rewrite(first_config, "r_a");
+
+  cr_assert_eq(_reload_config(first_config, second_config), 1);
+  cr_assert_eq(g_list_length(second_config->retained_configs), 1);
+  cr_assert_eq(second_config->retained_configs->data, first_config);
+
+  /* r_a is still owned by the first config, the second one is not needed anymore */
+  cr_assert_eq(_reload_config(second_config, third_config), 1);
+  cr_assert_eq(_find_rewrite(third_config, "r_a"), rewrite_a);
+  cr_assert_eq(g_list_length(third_config->retained_configs), 1);
+  cr_assert_eq(third_config->retained_configs->data, first_config);
+
+  cr_assert_eq(_reload_config(third_config, fourth_config), 0);
+  cr_assert_null(fourth_config->retained_configs);
+
+  _stop_config(fourth_config);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+
+  main_loop = main_loop_get_instance();
+  main_loop_init(main_loop, &main_loop_options);
+}
+
+static void
+teardown(void)
+{
+  main_loop_deinit(main_loop);
+  app_shutdown();
+}
+
+TestSuite(cfg_incremental_reload, .init = setup, .fini = teardown);
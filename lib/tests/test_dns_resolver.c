@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "dns-resolver.h"
+#include "dnscache.h"
+#include "apphook.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-cluster-single.h"
+
+/* a stand-in for the system resolver: addresses in 10.0.0.0/8 have no
+ * name, the others resolve to <address>.stub.  Lookups can be held up to
+ * simulate a slow DNS server. */
+static GMutex stub_lock;
+static GCond stub_released;
+static gboolean stub_blocked;
+static gint stub_lookups;
+
+static gboolean
+stub_lookup(GSockAddr *saddr, gchar *hostname, gsize hostname_size)
+{
+  gchar address[64];
+
+  g_sockaddr_format(saddr, address, sizeof(address), GSA_ADDRESS_ONLY);
+
+  g_mutex_lock(&stub_lock);
+  stub_lookups++;
+  while (stub_blocked)
+    g_cond_wait(&stub_released, &stub_lock);
+  g_mutex_unlock(&stub_lock);
+
+  if (g_str_has_prefix(address, "10."))
+    return FALSE;
+
+  g_snprintf(hostname, hostname_size, "%s.stub", address);
+  return TRUE;
+}
+
+static void
+stub_block(void)
+{
+  g_mutex_lock(&stub_lock);
+  stub_blocked = TRUE;
+  g_mutex_unlock(&stub_lock);
+}
+
+static void
+stub_release(void)
+{
+  g_mutex_lock(&stub_lock);
+  stub_blocked = FALSE;
+  g_cond_broadcast(&stub_released);
+  g_mutex_unlock(&stub_lock);
+}
+
+static gint
+stub_get_lookups(void)
+{
+  g_mutex_lock(&stub_lock);
+  gint lookups = stub_lookups;
+  g_mutex_unlock(&stub_lock);
+  return lookups;
+}
+
+static void
+set_resolver_options(gint threads, gint timeout)
+{
+  DNSResolverOptions options = { .threads = threads, .timeout = timeout };
+
+  dns_resolver_update_options(&options);
+}
+
+static DNSResolveResult
+resolve(const gchar *address, gchar *hostname, gsize hostname_size)
+{
+  GSockAddr *saddr = g_sockaddr_inet_new(address, 0);
+  DNSResolveResult result = dns_resolver_resolve(saddr, stub_lookup, TRUE, hostname, hostname_size);
+
+  g_sockaddr_unref(saddr);
+  return result;
+}
+
+static gsize
+get_deadline_expired(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "dns_resolver_deadline_expired", NULL);
+  StatsCounterItem *counter = stats_get_counter(&sc_key, SC_TYPE_SINGLE_VALUE);
+  stats_unlock();
+
+  return stats_counter_get(counter);
+}
+
+static gboolean
+lookup_cache(const gchar *address, gchar *hostname, gsize hostname_size, gboolean *positive)
+{
+  GSockAddr *saddr = g_sockaddr_inet_new(address, 0);
+  gsize hostname_len;
+  gboolean found = dns_caching_lookup(AF_INET, dns_caching_sockaddr_to_key(saddr), hostname, hostname_size,
+                                      &hostname_len, positive);
+
+  g_sockaddr_unref(saddr);
+  return found;
+}
+
+static gboolean
+wait_for_cache(const gchar *address, gchar *hostname, gsize hostname_size, gboolean *positive)
+{
+  for (gint i = 0; i < 5000; i++)
+    {
+      if (lookup_cache(address, hostname, hostname_size, positive))
+        return TRUE;
+      g_usleep(1000);
+    }
+  return FALSE;
+}
+
+Test(dns_resolver, inline_lookup_is_cached)
+{
+  gchar hostname[256];
+  gboolean positive;
+
+  set_resolver_options(0, 0);
+
+  cr_assert_eq(resolve("192.168.1.1", hostname, sizeof(hostname)), DNS_RESOLVE_SUCCESS);
+  cr_assert_str_eq(hostname, "192.168.1.1.stub");
+
+  cr_assert(lookup_cache("192.168.1.1", hostname, sizeof(hostname), &positive));
+  cr_assert(positive);
+  cr_assert_str_eq(hostname, "192.168.1.1.stub");
+}
+
+Test(dns_resolver, failures_are_cached_as_the_address)
+{
+  gchar hostname[256];
+  gboolean positive;
+
+  set_resolver_options(2, 1000);
+
+  cr_assert_eq(resolve("10.1.2.3", hostname, sizeof(hostname)), DNS_RESOLVE_FAILED);
+
+  cr_assert(lookup_cache("10.1.2.3", hostname, sizeof(hostname), &positive));
+  cr_assert_not(positive);
+  cr_assert_str_eq(hostname, "10.1.2.3");
+}
+
+Test(dns_resolver, pool_lookup_within_the_deadline)
+{
+  gchar hostname[256];
+
+  set_resolver_options(2, 5000);
+
+  cr_assert_eq(resolve("192.168.1.2", hostname, sizeof(hostname)), DNS_RESOLVE_SUCCESS);
+  cr_assert_str_eq(hostname, "192.168.1.2.stub");
+}
+
+Test(dns_resolver, late_answers_end_up_in_the_cache)
+{
+  gchar hostname[256];
+  gboolean positive;
+
+  set_resolver_options(2, 10);
+  stub_block();
+
+  cr_assert_eq(resolve("192.168.1.3", hostname, sizeof(hostname)), DNS_RESOLVE_PENDING);
+  cr_assert_not(lookup_cache("192.168.1.3", hostname, sizeof(hostname), &positive));
+  cr_assert_eq(get_deadline_expired(), 1);
+
+  stub_release();
+  cr_assert(wait_for_cache("192.168.1.3", hostname, sizeof(hostname), &positive));
+  cr_assert(positive);
+  cr_assert_str_eq(hostname, "192.168.1.3.stub");
+}
+
+Test(dns_resolver, concurrent_requests_are_merged)
+{
+  gchar hostname[256];
+  gboolean positive;
+
+  set_resolver_options(4, 0);
+  stub_block();
+
+  for (gint i = 0; i < 10; i++)
+    cr_assert_eq(resolve("192.168.1.4", hostname, sizeof(hostname)), DNS_RESOLVE_PENDING);
+
+  stub_release();
+  cr_assert(wait_for_cache("192.168.1.4", hostname, sizeof(hostname), &positive));
+  cr_assert_eq(stub_get_lookups(), 1);
+
+  /* nothing was waited for with timeout(0) */
+  cr_assert_eq(get_deadline_expired(), 0);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+  stub_blocked = FALSE;
+  stub_lookups = 0;
+}
+
+static void
+teardown(void)
+{
+  stub_release();
+  app_shutdown();
+}
+
+TestSuite(dns_resolver, .init = setup, .fini = teardown);
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "formatter-pool.h"
+#include "scratch-buffers.h"
+#include "apphook.h"
+
+#include <string.h>
+
+#define NUM_JOBS 64
+
+typedef struct _TestJobs
+{
+  FormatterPoolJob jobs[NUM_JOBS];
+  GThread *threads[NUM_JOBS];
+  gboolean scratch_buffer_usable[NUM_JOBS];
+  GMutex lock;
+  GCond done;
+  gint pending;
+} TestJobs;
+
+static TestJobs test_jobs;
+
+static void
+_run_job(gpointer user_data)
+{
+  FormatterPoolJob *job = (FormatterPoolJob *) user_data;
+  gint index = job - test_jobs.jobs;
+
+  GString *buffer = scratch_buffers_alloc();
+  g_string_assign(buffer, "formatted");
+
+  test_jobs.threads[index] = g_thread_self();
+  test_jobs.scratch_buffer_usable[index] = strcmp(buffer->str, "formatted") == 0;
+
+  g_mutex_lock(&test_jobs.lock);
+  test_jobs.pending--;
+  g_cond_signal(&test_jobs.done);
+  g_mutex_unlock(&test_jobs.lock);
+}
+
+static void
+_submit_all_jobs_and_wait(void)
+{
+  test_jobs.pending = NUM_JOBS;
+  for (gint i = 0; i < NUM_JOBS; i++)
+    {
+      test_jobs.jobs[i].func = _run_job;
+      test_jobs.jobs[i].user_data = &test_jobs.jobs[i];
+      formatter_pool_submit(&test_jobs.jobs[i]);
+    }
+
+  g_mutex_lock(&test_jobs.lock);
+  while (test_jobs.pending > 0)
+    g_cond_wait(&test_jobs.done, &test_jobs.lock);
+  g_mutex_unlock(&test_jobs.lock);
+}
+
+Test(formatter_pool, submitted_jobs_are_run_by_the_formatter_threads)
+{
+  formatter_pool_ensure_threads(4);
+  _submit_all_jobs_and_wait();
+
+  for (gint i = 0; i < NUM_JOBS; i++)
+    {
+      cr_assert_not_null(test_jobs.threads[i]);
+      cr_assert_neq(test_jobs.threads[i], g_thread_self());
+      cr_assert(test_jobs.scratch_buffer_usable[i]);
+    }
+}
+
+Test(formatter_pool, ensure_threads_can_be_called_repeatedly)
+{
+  formatter_pool_ensure_threads(2);
+  formatter_pool_ensure_threads(1);
+  formatter_pool_ensure_threads(3);
+  _submit_all_jobs_and_wait();
+
+  for (gint i = 0; i < NUM_JOBS; i++)
+    cr_assert_not_null(test_jobs.threads[i]);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+  memset(test_jobs.threads, 0, sizeof(test_jobs.threads));
+  memset(test_jobs.scratch_buffer_usable, 0, sizeof(test_jobs.scratch_buffer_usable));
+}
+
+static void
+teardown(void)
+{
+  app_shutdown();
+}
+
+TestSuite(formatter_pool, .init = setup, .fini = teardown);
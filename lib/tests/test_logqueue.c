@@ -283,27 +283,58 @@ Test(logqueue, test_with_threads)
   fprintf(stderr, "Feed speed: %.2lf\n", (double) TEST_RUNS * MESSAGES_SUM * 1000000 / sum_time);
 }
 
-Test(logqueue, log_queue_fifo_rewind_all_and_memory_usage)
+#define CONCURRENT_FEEDERS 8
+
+static gpointer
+_consume_concurrently_fed_messages(gpointer st)
 {
-  LogQueue *q = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
-  log_queue_set_use_backlog(q, TRUE);
+  LogQueue *q = (LogQueue *) st;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gint msg_count = 0;
+  gint idle_loops = 0;
 
-  StatsClusterKey sc_key;
-  stats_lock();
-  stats_cluster_logpipe_key_set(&sc_key, SCS_DESTINATION, q->persist_name, NULL );
-  stats_register_counter(1, &sc_key, SC_TYPE_MEMORY_USAGE, &q->memory_usage);
-  stats_unlock();
+  /* give up after 10 seconds without any messages */
+  while (msg_count < CONCURRENT_FEEDERS * MESSAGES_PER_FEEDER && idle_loops < 100000)
+    {
+      LogMessage *msg = log_queue_pop_head(q, &path_options);
 
-  feed_some_messages(q, 1);
-  gint size_when_single_msg = stats_counter_get(q->memory_usage);
+      if (!msg)
+        {
+          idle_loops++;
+          g_usleep(100);
+          continue;
+        }
+      idle_loops = 0;
+      log_msg_ack(msg, &path_options, AT_PROCESSED);
+      log_msg_unref(msg);
+      msg_count++;
+    }
+  return GINT_TO_POINTER(msg_count);
+}
 
-  feed_some_messages(q, 9);
-  cr_assert_eq(stats_counter_get(q->memory_usage), 10*size_when_single_msg);
+Test(logqueue, log_queue_fifo_multiple_feeders_with_concurrent_consumer)
+{
+  GThread *thread_feed[CONCURRENT_FEEDERS], *thread_consume;
+  GTimeVal start, end;
 
-  send_some_messages(q, 10);
-  cr_assert_eq(stats_counter_get(q->memory_usage), 0);
-  log_queue_rewind_backlog_all(q);
-  cr_assert_eq(stats_counter_get(q->memory_usage), 10*size_when_single_msg);
+  log_queue_set_max_threads(CONCURRENT_FEEDERS);
+  LogQueue *q = log_queue_fifo_new(CONCURRENT_FEEDERS * MESSAGES_PER_FEEDER, NULL);
+
+  g_get_current_time(&start);
+  thread_consume = g_thread_create(_consume_concurrently_fed_messages, q, TRUE, NULL);
+  for (gint i = 0; i < CONCURRENT_FEEDERS; i++)
+    thread_feed[i] = g_thread_create(_threaded_feed, q, TRUE, NULL);
+
+  for (gint i = 0; i < CONCURRENT_FEEDERS; i++)
+    g_thread_join(thread_feed[i]);
+  gint consumed = GPOINTER_TO_INT(g_thread_join(thread_consume));
+  g_get_current_time(&end);
+
+  cr_assert_eq(consumed, CONCURRENT_FEEDERS * MESSAGES_PER_FEEDER,
+               "messages were lost on the wait queue: consumed=%d", consumed);
+  cr_assert_eq(log_queue_get_length(q), 0);
+  fprintf(stderr, "Feed and consume speed with %d feeders: %.2lf\n", CONCURRENT_FEEDERS,
+          (double) CONCURRENT_FEEDERS * MESSAGES_PER_FEEDER * 1000000 / g_time_val_diff(&end, &start));
 
   log_queue_unref(q);
 }
@@ -330,6 +361,63 @@ _unregister_stats_counters(LogQueue *q)
   stats_unlock();
 }
 
+static gpointer
+_feed_without_worker_thread(gpointer st)
+{
+  LogQueue *q = (LogQueue *) st;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+
+  /* not a worker thread: every message goes to the wait queue directly */
+  feed_empty_messages(q, &path_options, MESSAGES_PER_FEEDER);
+  return NULL;
+}
+
+Test(logqueue, log_queue_fifo_concurrent_feeders_do_not_exceed_fifo_size)
+{
+  GThread *thread_feed[CONCURRENT_FEEDERS];
+  gint fifo_size = MESSAGES_PER_FEEDER;
+
+  log_queue_set_max_threads(CONCURRENT_FEEDERS);
+  LogQueue *q = log_queue_fifo_new(fifo_size, NULL);
+  _register_stats_counters(q);
+
+  for (gint i = 0; i < CONCURRENT_FEEDERS; i++)
+    thread_feed[i] = g_thread_create(_feed_without_worker_thread, q, TRUE, NULL);
+  for (gint i = 0; i < CONCURRENT_FEEDERS; i++)
+    g_thread_join(thread_feed[i]);
+
+  cr_assert_eq(log_queue_get_length(q), fifo_size);
+  cr_assert_eq(stats_counter_get(q->dropped_messages), (CONCURRENT_FEEDERS - 1) * MESSAGES_PER_FEEDER);
+
+  _unregister_stats_counters(q);
+  log_queue_unref(q);
+}
+
+Test(logqueue, log_queue_fifo_rewind_all_and_memory_usage)
+{
+  LogQueue *q = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  StatsClusterKey sc_key;
+  stats_lock();
+  stats_cluster_logpipe_key_set(&sc_key, SCS_DESTINATION, q->persist_name, NULL );
+  stats_register_counter(1, &sc_key, SC_TYPE_MEMORY_USAGE, &q->memory_usage);
+  stats_unlock();
+
+  feed_some_messages(q, 1);
+  gint size_when_single_msg = stats_counter_get(q->memory_usage);
+
+  feed_some_messages(q, 9);
+  cr_assert_eq(stats_counter_get(q->memory_usage), 10*size_when_single_msg);
+
+  send_some_messages(q, 10);
+  cr_assert_eq(stats_counter_get(q->memory_usage), 0);
+  log_queue_rewind_backlog_all(q);
+  cr_assert_eq(stats_counter_get(q->memory_usage), 10*size_when_single_msg);
+
+  log_queue_unref(q);
+}
+
 Test(logqueue, log_queue_fifo_should_drop_only_non_flow_controlled_messages,
      .description = "Flow-controlled messages should never be dropped")
 {
@@ -424,3 +512,28 @@ Test(logqueue, log_queue_fifo_should_drop_only_non_flow_controlled_messages_thre
   _unregister_stats_counters(q);
   log_queue_unref(q);
 }
+
+Test(logqueue, log_queue_fifo_records_residency_only_when_histogram_is_set)
+{
+  LogQueue *q = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+  StatsHistogram *residency = stats_histogram_new();
+
+  feed_some_messages(q, 2);
+  send_some_messages(q, 2);
+  cr_assert_eq(stats_histogram_get_count(residency), 0);
+
+  log_queue_set_residency_histogram(q, residency);
+  feed_some_messages(q, 3);
+  send_some_messages(q, 3);
+  cr_assert_eq(stats_histogram_get_count(residency), 3);
+
+  /* rewound messages are only accounted when they are first popped */
+  log_queue_rewind_backlog_all(q);
+  send_some_messages(q, 5);
+  cr_assert_eq(stats_histogram_get_count(residency), 3);
+
+  log_queue_set_residency_histogram(q, NULL);
+  log_queue_unref(q);
+  stats_histogram_free(residency);
+}
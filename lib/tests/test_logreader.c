@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "logreader.c"
+#include "apphook.h"
+#include "mainloop.h"
+#include "logproto/logproto-text-server.h"
+#include "libtest/mock-transport.h"
+
+#define NUM_LINES 200
+
+MainLoop *main_loop;
+MainLoopOptions main_loop_options = {0};
+GlobalConfig *cfg;
+LogReaderOptions reader_options;
+
+static GThread *fetching_thread;
+static gint lines_parsed_by_helper_threads;
+
+static gboolean
+_parse_into_message(const MsgFormatOptions *options, LogMessage *msg,
+                    const guchar *data, gsize length, gsize *problem_position)
+{
+  log_msg_set_value(msg, LM_V_MESSAGE, (const gchar *) data, length);
+  if (g_thread_self() != fetching_thread)
+    g_atomic_int_inc(&lines_parsed_by_helper_threads);
+  return TRUE;
+}
+
+static MsgFormatHandler test_format_handler =
+{
+  .parse = _parse_into_message,
+};
+
+/* messages may be posted by the parser threads with parse-ordered(no) */
+typedef struct _TestPipe
+{
+  LogPipe super;
+  GMutex lock;
+  GQueue messages;
+} TestPipe;
+
+static void
+_test_pipe_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  TestPipe *self = (TestPipe *) s;
+
+  g_mutex_lock(&self->lock);
+  g_queue_push_tail(&self->messages, msg);
+  g_mutex_unlock(&self->lock);
+}
+
+static void
+_test_pipe_ack_messages(TestPipe *self)
+{
+  LogMessage *msg;
+
+  while ((msg = g_queue_pop_head(&self->messages)))
+    {
+      LogPathOptions path_options = { .ack_needed = TRUE };
+      log_msg_drop(msg, &path_options, AT_PROCESSED);
+    }
+}
+
+static void
+_test_pipe_free(LogPipe *s)
+{
+  TestPipe *self = (TestPipe *) s;
+
+  _test_pipe_ack_messages(self);
+  g_mutex_clear(&self->lock);
+  log_pipe_free_method(s);
+}
+
+static TestPipe *
+_test_pipe_new(void)
+{
+  TestPipe *self = g_new0(TestPipe, 1);
+
+  log_pipe_init_instance(&self->super, cfg);
+  self->super.queue = _test_pipe_queue;
+  self->super.free_fn = _test_pipe_free;
+  g_mutex_init(&self->lock);
+  g_queue_init(&self->messages);
+  return self;
+}
+
+static gchar *
+_format_lines(gint num_lines)
+{
+  GString *lines = g_string_new("");
+
+  for (gint i = 0; i < num_lines; i++)
+    g_string_append_printf(lines, "message %03d\n", i);
+  return g_string_free(lines, FALSE);
+}
+
+static LogReader *
+_create_reader(TestPipe *pipe, const gchar *input, gint parse_threads, gboolean parse_ordered, gint fetch_limit,
+               gint window_size)
+{
+  LogReader *reader = log_reader_new(cfg);
+  LogTransport *transport = log_transport_mock_stream_new(input, -1, LTM_EOF);
+
+  reader_options.parse_threads = parse_threads;
+  reader_options.parse_ordered = parse_ordered;
+  reader_options.fetch_limit = fetch_limit;
+  reader_options.super.init_window_size = window_size;
+  log_reader_options_init(&reader_options, cfg, "test_logreader");
+  reader_options.parse_options.format_handler = &test_format_handler;
+
+  log_reader_apply_proto_and_poll_events(reader, log_proto_text_server_new(transport,
+                                         &reader_options.proto_options.super), NULL);
+  log_reader_set_options(reader, &pipe->super, &reader_options, "test_stats_id", "test_stats_instance");
+  log_pipe_append(&reader->super.super, &pipe->super);
+  cr_assert(log_pipe_init(&reader->super.super));
+  return reader;
+}
+
+static void
+_free_reader(LogReader *reader)
+{
+  log_pipe_deinit(&reader->super.super);
+  log_pipe_unref(&reader->super.super);
+}
+
+/* fetches until the window is exhausted or the input is closed */
+static gint
+_fetch_while_window_allows(LogReader *reader)
+{
+  gint notify_code = 0;
+
+  while (!notify_code && log_source_free_to_send(&reader->super))
+    notify_code = log_reader_fetch_log(reader);
+  return notify_code;
+}
+
+static void
+_assert_messages_in_original_order(TestPipe *pipe, gint first, gint count)
+{
+  cr_assert_eq(g_queue_get_length(&pipe->messages), count);
+  for (gint i = 0; i < count; i++)
+    {
+      LogMessage *msg = g_queue_peek_nth(&pipe->messages, i);
+      gchar *expected = g_strdup_printf("message %03d", first + i);
+
+      cr_assert_str_eq(log_msg_get_value(msg, LM_V_MESSAGE, NULL), expected);
+      g_free(expected);
+    }
+}
+
+Test(logreader, parse_threads_parse_lines_in_parallel_in_original_order)
+{
+  gchar *input = _format_lines(NUM_LINES);
+  TestPipe *pipe = _test_pipe_new();
+  LogReader *reader = _create_reader(pipe, input, 4, TRUE, NUM_LINES, NUM_LINES);
+
+  cr_assert_not_null(reader->parse_batch);
+  cr_assert_eq(_fetch_while_window_allows(reader), 0);
+
+  cr_assert_gt(g_atomic_int_get(&lines_parsed_by_helper_threads), 0);
+  _assert_messages_in_original_order(pipe, 0, NUM_LINES);
+
+  _free_reader(reader);
+  log_pipe_unref(&pipe->super);
+  g_free(input);
+}
+
+Test(logreader, parse_ordered_no_delivers_every_line)
+{
+  gchar *input = _format_lines(NUM_LINES);
+  TestPipe *pipe = _test_pipe_new();
+  LogReader *reader = _create_reader(pipe, input, 4, FALSE, NUM_LINES, NUM_LINES);
+  GHashTable *seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  cr_assert_eq(_fetch_while_window_allows(reader), 0);
+  cr_assert_gt(g_atomic_int_get(&lines_parsed_by_helper_threads), 0);
+
+  cr_assert_eq(g_queue_get_length(&pipe->messages), NUM_LINES);
+  for (GList *l = pipe->messages.head; l; l = l->next)
+    g_hash_table_add(seen, g_strdup(log_msg_get_value((LogMessage *) l->data, LM_V_MESSAGE, NULL)));
+  cr_assert_eq(g_hash_table_size(seen), NUM_LINES, "lines are lost or duplicated");
+
+  g_hash_table_destroy(seen);
+  _free_reader(reader);
+  log_pipe_unref(&pipe->super);
+  g_free(input);
+}
+
+Test(logreader, parse_threads_batches_are_limited_by_the_window)
+{
+  gchar *input = _format_lines(NUM_LINES);
+  TestPipe *pipe = _test_pipe_new();
+  LogReader *reader = _create_reader(pipe, input, 4, TRUE, NUM_LINES, NUM_LINES / 2);
+
+  cr_assert_eq(_fetch_while_window_allows(reader), 0);
+  cr_assert_eq(window_size_counter_get(&reader->super.window_size, NULL), 0);
+  _assert_messages_in_original_order(pipe, 0, NUM_LINES / 2);
+
+  _test_pipe_ack_messages(pipe);
+  cr_assert_eq(window_size_counter_get(&reader->super.window_size, NULL), NUM_LINES / 2);
+
+  cr_assert_eq(_fetch_while_window_allows(reader), 0);
+  _assert_messages_in_original_order(pipe, NUM_LINES / 2, NUM_LINES / 2);
+
+  _test_pipe_ack_messages(pipe);
+  cr_assert_eq(window_size_counter_get(&reader->super.window_size, NULL), NUM_LINES / 2);
+
+  _free_reader(reader);
+  log_pipe_unref(&pipe->super);
+  g_free(input);
+}
+
+Test(logreader, parse_threads_have_no_effect_with_the_default_fetch_limit)
+{
+  gchar *input = _format_lines(NUM_LINES);
+  TestPipe *pipe = _test_pipe_new();
+  LogReader *reader = _create_reader(pipe, input, 4, TRUE, 10, NUM_LINES);
+
+  cr_assert_eq(_fetch_while_window_allows(reader), 0);
+
+  cr_assert_eq(g_atomic_int_get(&lines_parsed_by_helper_threads), 0);
+  _assert_messages_in_original_order(pipe, 0, NUM_LINES);
+
+  _free_reader(reader);
+  log_pipe_unref(&pipe->super);
+  g_free(input);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+
+  main_loop = main_loop_get_instance();
+  main_loop_init(main_loop, &main_loop_options);
+
+  cfg = cfg_new_snippet();
+  log_reader_options_defaults(&reader_options);
+
+  fetching_thread = g_thread_self();
+  lines_parsed_by_helper_threads = 0;
+}
+
+static void
+teardown(void)
+{
+  log_reader_options_destroy(&reader_options);
+  cfg_free(cfg);
+  main_loop_deinit(main_loop);
+  app_shutdown();
+}
+
+TestSuite(logreader, .init = setup, .fini = teardown);
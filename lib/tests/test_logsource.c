@@ -418,6 +418,73 @@ Test(log_source, test_mangle_callback)
 }
 
 
+static void
+_post_message_batch(LogSource *source, LogMessage **msgs, gsize messages_to_send)
+{
+  for (gsize i = 0; i < messages_to_send; ++i)
+    {
+      if (!msgs[i])
+        msgs[i] = log_msg_new_empty();
+    }
+  log_source_post_batch(source, msgs, messages_to_send);
+}
+
+Test(log_source, test_post_batch)
+{
+  source_options.init_window_size = 3;
+
+  LogSource *source = test_source_init(&source_options);
+  TestPipe *next_pipe = test_pipe_init();
+  log_pipe_append(&source->super, &next_pipe->super);
+
+  LogMessage *msgs[3] = { NULL };
+  _post_message_batch(source, msgs, 2);
+  cr_assert_eq(next_pipe->messages_count, 2);
+  cr_assert(log_source_free_to_send(source));
+
+  _post_message_batch(source, msgs + 2, 1);
+  cr_assert_not(log_source_free_to_send(source));
+
+  for (gint i = 0; i < 3; i++)
+    cr_expect_eq(g_queue_peek_nth(next_pipe->messages, i), msgs[i], "Batch should be forwarded in order");
+
+  test_pipe_ack_messages(next_pipe, 3);
+  cr_assert(log_source_free_to_send(source));
+
+  test_pipe_destroy(next_pipe);
+  test_source_destroy(source);
+}
+
+Test(log_source, test_post_batch_mangle_callback)
+{
+  register_source_mangle_callback(cfg, test_mangle_callback_forbidden);
+  register_source_mangle_callback(cfg, test_mangle_callback_tag);
+
+  LogSource *source = test_source_init(&source_options);
+  TestPipe *next_pipe = test_pipe_init();
+  log_pipe_append(&source->super, &next_pipe->super);
+
+  LogMessage *msgs[3] =
+  {
+    log_msg_new_internal(LOG_INFO | LOG_SYSLOG, "Message"),
+    log_msg_new_internal(LOG_INFO | LOG_SYSLOG, "This is a forbidden message"),
+    log_msg_new_internal(LOG_INFO | LOG_SYSLOG, "Message"),
+  };
+  _post_message_batch(source, msgs, 3);
+
+  cr_assert_eq(next_pipe->messages_count, 2);
+  cr_expect_eq(g_queue_peek_nth(next_pipe->messages, 0), msgs[0]);
+  cr_expect_eq(g_queue_peek_nth(next_pipe->messages, 1), msgs[2]);
+  cr_expect(log_msg_is_tag_by_name(msgs[0], "tagged"));
+
+  test_pipe_ack_messages(next_pipe, 2);
+  cr_assert(log_source_free_to_send(source));
+
+  test_pipe_destroy(next_pipe);
+  test_source_destroy(source);
+}
+
+
 static DynamicWindowPool *
 test_dynamic_window_pool_init(gsize pool_size)
 {
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "logwriter.c"
+#include "apphook.h"
+#include "libtest/mock-transport.h"
+
+#define FORMAT_THREADS 2
+#define BATCH_SIZE (FORMAT_THREADS * LOG_WRITER_FORMAT_CHUNK_SIZE)
+
+GlobalConfig *cfg;
+LogWriterOptions writer_options;
+
+static gint acked_messages;
+
+/* records the lines it consumes, refuses the line posted as refuse_at-th once */
+typedef struct _TestProtoClient
+{
+  LogProtoClient super;
+  GPtrArray *lines;
+  gint num_posts;
+  gint refuse_at;
+} TestProtoClient;
+
+static LogProtoStatus
+_test_proto_post(LogProtoClient *s, LogMessage *logmsg, guchar *msg, gsize msg_len, gboolean *consumed)
+{
+  TestProtoClient *self = (TestProtoClient *) s;
+
+  if (self->num_posts++ == self->refuse_at)
+    {
+      *consumed = FALSE;
+      return LPS_SUCCESS;
+    }
+
+  g_ptr_array_add(self->lines, g_strndup((const gchar *) msg, msg_len));
+  g_free(msg);
+  *consumed = TRUE;
+  return LPS_SUCCESS;
+}
+
+static void
+_test_proto_free(LogProtoClient *s)
+{
+  TestProtoClient *self = (TestProtoClient *) s;
+
+  g_ptr_array_free(self->lines, TRUE);
+  log_proto_client_free_method(s);
+}
+
+static TestProtoClient *
+_test_proto_new(gint refuse_at)
+{
+  TestProtoClient *self = g_new0(TestProtoClient, 1);
+
+  log_proto_client_init(&self->super, log_transport_mock_stream_new(LTM_EOF),
+                        &writer_options.proto_options.super);
+  self->super.post = _test_proto_post;
+  self->super.free_fn = _test_proto_free;
+  self->lines = g_ptr_array_new_with_free_func(g_free);
+  self->refuse_at = refuse_at;
+  return self;
+}
+
+static void
+_test_ack(LogMessage *msg, AckType ack_type)
+{
+  acked_messages++;
+}
+
+static void
+_feed_local_messages(LogQueue *queue, gint num_messages)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+
+  path_options.ack_needed = TRUE;
+  for (gint i = 0; i < num_messages; i++)
+    {
+      LogMessage *msg = log_msg_new_local();
+      gchar *text = g_strdup_printf("message %03d", i);
+
+      log_msg_set_value(msg, LM_V_MESSAGE, text, -1);
+      log_msg_add_ack(msg, &path_options);
+      msg->ack_func = _test_ack;
+      log_queue_push_tail(queue, msg, &path_options);
+      g_free(text);
+    }
+}
+
+static LogWriter *
+_create_writer(TestProtoClient *proto)
+{
+  LogWriter *writer = log_writer_new(LW_FORMAT_FILE, cfg);
+  LogQueue *queue = log_queue_fifo_new(1000, NULL);
+  GError *error = NULL;
+
+  writer_options.format_threads = FORMAT_THREADS;
+  writer_options.template = log_template_new(cfg, NULL);
+  cr_assert(log_template_compile(writer_options.template, "$MSG $SEQNUM\n", &error));
+  log_writer_options_init(&writer_options, cfg, 0);
+  log_writer_set_options(writer, NULL, &writer_options, "test_stats_id", "test_stats_instance");
+
+  log_writer_set_queue(writer, queue);
+  log_queue_unref(queue);
+
+  log_writer_setup_format_batch(writer);
+  cr_assert_not_null(writer->format_batch);
+
+  /* the writer is not initialized, we only drive its flush path */
+  writer->proto = &proto->super;
+  return writer;
+}
+
+static gboolean
+_flush(LogWriter *writer)
+{
+  gboolean write_error = FALSE;
+
+  log_writer_flush_format_batches(writer, LW_FLUSH_FORCE, &write_error);
+  cr_assert_not(write_error);
+  return log_queue_get_length(writer->queue) == 0;
+}
+
+static void
+_assert_batch_holds_no_messages(LogWriterFormatBatch *batch)
+{
+  cr_assert_eq(batch->num_items, 0);
+  for (gint i = 0; i < batch->max_items; i++)
+    cr_assert_null(batch->items[i].msg, "message %d of the batch is still referenced", i);
+}
+
+static void
+_assert_lines_written_in_order(TestProtoClient *proto, gint count)
+{
+  cr_assert_eq(proto->lines->len, count);
+  for (gint i = 0; i < count; i++)
+    {
+      /* sequence numbers of local messages start at 1 */
+      gchar *expected = g_strdup_printf("message %03d %d\n", i, i + 1);
+
+      cr_assert_str_eq(g_ptr_array_index(proto->lines, i), expected);
+      g_free(expected);
+    }
+}
+
+static void
+_free_writer(LogWriter *writer, gint num_written)
+{
+  log_queue_ack_backlog(writer->queue, num_written);
+  log_pipe_unref(&writer->super);
+}
+
+static void
+_test_refused_line_is_rewound_with_the_rest_of_the_batch(gint num_messages, gint refuse_at)
+{
+  TestProtoClient *proto = _test_proto_new(refuse_at);
+  LogWriter *writer = _create_writer(proto);
+
+  _feed_local_messages(writer->queue, num_messages);
+
+  cr_assert_not(_flush(writer));
+  cr_assert_eq(log_queue_get_length(writer->queue), num_messages - refuse_at,
+               "the refused message and the ones popped after it should be back in the queue");
+  cr_assert_eq(writer->seq_num, refuse_at + 1);
+  _assert_batch_holds_no_messages(writer->format_batch);
+  _assert_lines_written_in_order(proto, refuse_at);
+
+  cr_assert(_flush(writer));
+  _assert_batch_holds_no_messages(writer->format_batch);
+  _assert_lines_written_in_order(proto, num_messages);
+  cr_assert_eq(writer->seq_num, num_messages + 1);
+
+  _free_writer(writer, num_messages);
+  cr_assert_eq(acked_messages, num_messages, "messages are lost or acked more than once");
+}
+
+Test(logwriter, refused_line_in_the_first_batch_is_retried_with_the_same_seq_num)
+{
+  _test_refused_line_is_rewound_with_the_rest_of_the_batch(BATCH_SIZE / 2, 10);
+}
+
+Test(logwriter, refused_line_in_a_later_batch_is_retried_with_the_same_seq_num)
+{
+  _test_refused_line_is_rewound_with_the_rest_of_the_batch(3 * BATCH_SIZE, BATCH_SIZE + 40);
+}
+
+Test(logwriter, refused_first_line_rewinds_the_whole_batch)
+{
+  _test_refused_line_is_rewound_with_the_rest_of_the_batch(BATCH_SIZE, 0);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+  cfg = cfg_new_snippet();
+  log_writer_options_defaults(&writer_options);
+  acked_messages = 0;
+}
+
+static void
+teardown(void)
+{
+  log_writer_options_destroy(&writer_options);
+  cfg_free(cfg);
+  app_shutdown();
+}
+
+TestSuite(logwriter, .init = setup, .fini = teardown);
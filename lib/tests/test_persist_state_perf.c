@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "persist-state.h"
+#include "apphook.h"
+#include "libtest/persist_lib.h"
+
+#include <stdio.h>
+
+#define MAP_ITERATIONS 1000000
+#define MAX_THREADS 16
+
+typedef struct _TestState
+{
+  guint64 value;
+} TestState;
+
+typedef struct _ReaderThreadData
+{
+  PersistState *state;
+  PersistEntryHandle handle;
+} ReaderThreadData;
+
+static gint readers_running;
+
+static gpointer
+_map_unmap_entry(gpointer user_data)
+{
+  ReaderThreadData *data = (ReaderThreadData *) user_data;
+
+  for (gint i = 0; i < MAP_ITERATIONS; i++)
+    {
+      TestState *test_state = (TestState *) persist_state_map_entry(data->state, data->handle);
+      test_state->value++;
+      persist_state_unmap_entry(data->state, data->handle);
+    }
+  g_atomic_int_dec_and_test(&readers_running);
+  return NULL;
+}
+
+static void
+_grow_store_while_readers_are_running(PersistState *state)
+{
+  gint grows = 0;
+
+  /* allocations crossing the watermark remap the store, while the readers
+   * keep mapping their entries */
+  while (g_atomic_int_get(&readers_running) && grows < 1000)
+    {
+      gchar name[32];
+
+      g_snprintf(name, sizeof(name), "filler_%d", grows++);
+      persist_state_alloc_entry(state, name, 1024);
+    }
+}
+
+static void
+_run_readers(gint num_threads, gboolean grow_store)
+{
+  PersistState *state = clean_and_create_persist_state_for_test("test_persist_state_perf.persist");
+  ReaderThreadData data[MAX_THREADS];
+  GThread *threads[MAX_THREADS];
+  GTimeVal start, end;
+
+  for (gint i = 0; i < num_threads; i++)
+    {
+      gchar name[32];
+
+      g_snprintf(name, sizeof(name), "reader_%d", i);
+      data[i].state = state;
+      data[i].handle = persist_state_alloc_entry(state, name, sizeof(TestState));
+    }
+
+  g_atomic_int_set(&readers_running, num_threads);
+  g_get_current_time(&start);
+  for (gint i = 0; i < num_threads; i++)
+    threads[i] = g_thread_create(_map_unmap_entry, &data[i], TRUE, NULL);
+
+  if (grow_store)
+    _grow_store_while_readers_are_running(state);
+
+  for (gint i = 0; i < num_threads; i++)
+    g_thread_join(threads[i]);
+  g_get_current_time(&end);
+
+  for (gint i = 0; i < num_threads; i++)
+    {
+      TestState *test_state = (TestState *) persist_state_map_entry(state, data[i].handle);
+      cr_assert_eq(test_state->value, MAP_ITERATIONS, "Updates through the mapping were lost");
+      persist_state_unmap_entry(state, data[i].handle);
+    }
+
+  printf("%2d threads%s: %12.3f map+unmap/sec\n", num_threads, grow_store ? ", growing store" : "",
+         ((gdouble) num_threads * MAP_ITERATIONS) * 1e6 / g_time_val_diff(&end, &start));
+  cancel_and_destroy_persist_state(state);
+}
+
+Test(persist_state_perf, test_map_unmap_entry_performance)
+{
+  for (gint num_threads = 1; num_threads <= MAX_THREADS; num_threads *= 2)
+    _run_readers(num_threads, FALSE);
+}
+
+Test(persist_state_perf, test_map_unmap_entry_performance_while_growing_the_store)
+{
+  for (gint num_threads = 1; num_threads <= MAX_THREADS; num_threads *= 2)
+    _run_readers(num_threads, TRUE);
+}
+
+TestSuite(persist_state_perf, .init = app_startup, .fini = app_shutdown);
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "tlscontext.h"
+#include "apphook.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-cluster-single.h"
+
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <glib/gstdio.h>
+
+#define TEST_STATS_ID "tls"
+#define TEST_STATS_INSTANCE "localhost"
+
+static gchar *test_dir;
+static gchar *key_file;
+static gchar *cert_file;
+
+/* a throwaway self-signed keypair for the server, peers are not verified */
+static void
+_generate_keypair(void)
+{
+  EVP_PKEY_CTX *pkey_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+  EVP_PKEY *pkey = NULL;
+
+  cr_assert(EVP_PKEY_keygen_init(pkey_ctx) > 0);
+  cr_assert(EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pkey_ctx, NID_X9_62_prime256v1) > 0);
+  cr_assert(EVP_PKEY_keygen(pkey_ctx, &pkey) > 0);
+  EVP_PKEY_CTX_free(pkey_ctx);
+
+  X509 *cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, pkey);
+  X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC,
+                             (const guchar *) "localhost", -1, -1, 0);
+  X509_set_issuer_name(cert, X509_get_subject_name(cert));
+  cr_assert(X509_sign(cert, pkey, EVP_sha256()) > 0);
+
+  FILE *f = fopen(key_file, "w");
+  cr_assert(PEM_write_PrivateKey(f, pkey, NULL, NULL, 0, NULL, NULL));
+  fclose(f);
+
+  f = fopen(cert_file, "w");
+  cr_assert(PEM_write_X509(f, cert));
+  fclose(f);
+
+  X509_free(cert);
+  EVP_PKEY_free(pkey);
+}
+
+static TLSContext *
+_create_context(TLSMode mode)
+{
+  TLSContext *self = tls_context_new(mode, "test");
+
+  tls_context_set_verify_mode(self, TVM_OPTIONAL | TVM_UNTRUSTED);
+  if (mode == TM_SERVER)
+    {
+      tls_context_set_key_file(self, key_file);
+      tls_context_set_cert_file(self, cert_file);
+    }
+  return self;
+}
+
+static void
+_disable_tls13(TLSContext *self)
+{
+  GList *options = g_list_append(NULL, "no-tlsv13");
+
+  cr_assert(tls_context_set_ssl_options_by_name(self, options));
+  g_list_free(options);
+}
+
+static void
+_setup_contexts(TLSContext *client, TLSContext *server)
+{
+  cr_assert_eq(tls_context_setup_context(client), TLS_CONTEXT_SETUP_OK);
+  cr_assert_eq(tls_context_setup_context(server), TLS_CONTEXT_SETUP_OK);
+
+  tls_context_register_stats(client, SCS_DESTINATION, TEST_STATS_ID, TEST_STATS_INSTANCE);
+  tls_context_register_stats(server, SCS_SOURCE, TEST_STATS_ID, TEST_STATS_INSTANCE);
+}
+
+static void
+_free_contexts(TLSContext *client, TLSContext *server)
+{
+  tls_context_unregister_stats(client, SCS_DESTINATION, TEST_STATS_ID, TEST_STATS_INSTANCE);
+  tls_context_unregister_stats(server, SCS_SOURCE, TEST_STATS_ID, TEST_STATS_INSTANCE);
+
+  tls_context_unref(client);
+  tls_context_unref(server);
+}
+
+static gsize
+_get_counter(gint component, const gchar *name)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_single_key_set_with_name(&sc_key, component, TEST_STATS_ID, TEST_STATS_INSTANCE, name);
+  StatsCounterItem *counter = stats_get_counter(&sc_key, SC_TYPE_SINGLE_VALUE);
+  stats_unlock();
+
+  cr_assert_not_null(counter, "counter is not registered: %s", name);
+  return stats_counter_get(counter);
+}
+
+static gboolean
+_handshake_step(SSL *ssl)
+{
+  gint ret = SSL_do_handshake(ssl);
+
+  if (ret == 1)
+    return TRUE;
+
+  gint error = SSL_get_error(ssl, ret);
+  cr_assert(error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE, "TLS handshake failed: %d", error);
+  return FALSE;
+}
+
+/* connects a new client session to a new server session in memory,
+ * returns whether the client resumed its previous session */
+static gboolean
+_connect(TLSContext *client, TLSContext *server)
+{
+  TLSSession *client_session = tls_context_setup_session(client);
+  TLSSession *server_session = tls_context_setup_session(server);
+  BIO *client_bio, *server_bio;
+
+  cr_assert(BIO_new_bio_pair(&client_bio, 0, &server_bio, 0));
+  SSL_set_bio(client_session->ssl, client_bio, client_bio);
+  SSL_set_bio(server_session->ssl, server_bio, server_bio);
+
+  gboolean client_done = FALSE, server_done = FALSE;
+  for (gint i = 0; i < 16 && !(client_done && server_done); i++)
+    {
+      if (!client_done)
+        client_done = _handshake_step(client_session->ssl);
+      if (!server_done)
+        server_done = _handshake_step(server_session->ssl);
+    }
+  cr_assert(client_done && server_done, "TLS handshake did not finish");
+
+  /* TLS 1.3 tickets arrive after the handshake, they are processed by the next read */
+  gchar buf[16];
+  cr_assert_eq(SSL_read(client_session->ssl, buf, sizeof(buf)), -1);
+  cr_assert_eq(SSL_get_error(client_session->ssl, -1), SSL_ERROR_WANT_READ);
+
+  gboolean resumed = SSL_session_reused(client_session->ssl);
+  cr_assert_eq(SSL_session_reused(server_session->ssl), resumed);
+
+  /* sessions of connections closed without a close_notify are not resumable */
+  SSL_shutdown(client_session->ssl);
+  SSL_shutdown(server_session->ssl);
+  tls_session_free(client_session);
+  tls_session_free(server_session);
+  return resumed;
+}
+
+static void
+_assert_handshake_counters(gsize handshakes, gsize resumed_handshakes)
+{
+  cr_assert_eq(_get_counter(SCS_DESTINATION, "tls_handshakes"), handshakes);
+  cr_assert_eq(_get_counter(SCS_DESTINATION, "tls_resumed_handshakes"), resumed_handshakes);
+  cr_assert_eq(_get_counter(SCS_SOURCE, "tls_handshakes"), handshakes);
+  cr_assert_eq(_get_counter(SCS_SOURCE, "tls_resumed_handshakes"), resumed_handshakes);
+}
+
+Test(tlscontext, client_resumes_tls12_session_by_session_id)
+{
+  TLSContext *client = _create_context(TM_CLIENT);
+  TLSContext *server = _create_context(TM_SERVER);
+
+  _disable_tls13(client);
+  tls_context_set_session_tickets(server, FALSE);
+  _setup_contexts(client, server);
+
+  cr_assert_not(_connect(client, server));
+  cr_assert(_connect(client, server));
+  cr_assert(_connect(client, server));
+  _assert_handshake_counters(3, 2);
+
+  _free_contexts(client, server);
+}
+
+Test(tlscontext, client_resumes_tls12_session_by_ticket)
+{
+  TLSContext *client = _create_context(TM_CLIENT);
+  TLSContext *server = _create_context(TM_SERVER);
+
+  _disable_tls13(client);
+  tls_context_set_session_cache_size(server, 0);
+  _setup_contexts(client, server);
+
+  cr_assert_not(_connect(client, server));
+  cr_assert(_connect(client, server));
+  _assert_handshake_counters(2, 1);
+
+  _free_contexts(client, server);
+}
+
+Test(tlscontext, tls12_session_is_not_resumed_without_cache_and_tickets)
+{
+  TLSContext *client = _create_context(TM_CLIENT);
+  TLSContext *server = _create_context(TM_SERVER);
+
+  _disable_tls13(client);
+  tls_context_set_session_cache_size(server, 0);
+  tls_context_set_session_tickets(server, FALSE);
+  _setup_contexts(client, server);
+
+  cr_assert_not(_connect(client, server));
+  cr_assert_not(_connect(client, server));
+  _assert_handshake_counters(2, 0);
+
+  _free_contexts(client, server);
+}
+
+Test(tlscontext, tls13_tickets_are_not_sent_by_default)
+{
+  TLSContext *client = _create_context(TM_CLIENT);
+  TLSContext *server = _create_context(TM_SERVER);
+
+  _setup_contexts(client, server);
+
+  cr_assert_not(_connect(client, server));
+  cr_assert_not(_connect(client, server));
+  _assert_handshake_counters(2, 0);
+
+  _free_contexts(client, server);
+}
+
+Test(tlscontext, client_resumes_tls13_session_when_server_sends_tickets)
+{
+  TLSContext *client = _create_context(TM_CLIENT);
+  TLSContext *server = _create_context(TM_SERVER);
+
+  tls_context_set_session_tickets(server, TRUE);
+  _setup_contexts(client, server);
+
+  /* the server sends more than one ticket, with OpenSSL 1.1.1 each of them
+   * triggers a HANDSHAKE_DONE callback on the client, still a single
+   * handshake is counted per connection */
+  cr_assert_not(_connect(client, server));
+  cr_assert(_connect(client, server));
+  _assert_handshake_counters(2, 1);
+
+  _free_contexts(client, server);
+}
+
+Test(tlscontext, handshake_succeeds_without_registered_stats)
+{
+  TLSContext *client = _create_context(TM_CLIENT);
+  TLSContext *server = _create_context(TM_SERVER);
+
+  cr_assert_eq(tls_context_setup_context(client), TLS_CONTEXT_SETUP_OK);
+  cr_assert_eq(tls_context_setup_context(server), TLS_CONTEXT_SETUP_OK);
+
+  cr_assert_not(_connect(client, server));
+
+  tls_context_unref(client);
+  tls_context_unref(server);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+
+  test_dir = g_dir_make_tmp("test_tlscontext_XXXXXX", NULL);
+  cr_assert_not_null(test_dir);
+  key_file = g_build_filename(test_dir, "server.key", NULL);
+  cert_file = g_build_filename(test_dir, "server.crt", NULL);
+  _generate_keypair();
+}
+
+static void
+teardown(void)
+{
+  g_unlink(key_file);
+  g_unlink(cert_file);
+  g_rmdir(test_dir);
+  g_free(key_file);
+  g_free(cert_file);
+  g_free(test_dir);
+
+  app_shutdown();
+}
+
+TestSuite(tlscontext, .init = setup, .fini = teardown);
@@ -26,6 +26,8 @@
 #include "messages.h"
 #include "compat/openssl_support.h"
 #include "secret-storage/secret-storage.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-cluster-single.h"
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -59,6 +61,19 @@ struct _TLSContext
   GList *trusted_dn_list;
   gint ssl_options;
   gchar *location;
+
+  gint session_cache_size;
+  glong session_timeout;
+  gint session_tickets;
+  gchar *session_ticket_key_file;
+
+  /* client side resumption: the last session handed out by the server,
+   * offered again on the next connection of the same destination */
+  GMutex cached_session_lock;
+  SSL_SESSION *cached_session;
+
+  StatsCounterItem *handshakes;
+  StatsCounterItem *resumed_handshakes;
 };
 
 typedef enum
@@ -294,10 +309,28 @@ tls_session_set_verifier(TLSSession *self, TLSVerifier *verifier)
   self->verifier = verifier ? tls_verifier_ref(verifier) : NULL;
 }
 
+static void
+_update_handshake_stats(TLSSession *self, const SSL *ssl)
+{
+  /* with TLS 1.3 post-handshake messages trigger further HANDSHAKE_DONE
+   * callbacks, only the first one is accounted */
+  if (self->handshake_done)
+    return;
+
+  self->handshake_done = TRUE;
+  stats_counter_inc(self->ctx->handshakes);
+  if (SSL_session_reused((SSL *) ssl))
+    stats_counter_inc(self->ctx->resumed_handshakes);
+}
+
 void
 tls_session_info_callback(const SSL *ssl, int where, int ret)
 {
   TLSSession *self = (TLSSession *)SSL_get_app_data(ssl);
+
+  if (where & SSL_CB_HANDSHAKE_DONE)
+    _update_handshake_stats(self, ssl);
+
   if( !self->peer_info.found && where == (SSL_ST_ACCEPT|SSL_CB_LOOP) )
     {
       X509 *cert = SSL_get_peer_certificate(ssl);
@@ -415,7 +448,102 @@ _print_and_clear_tls_session_error(TLSContext *self)
 static void
 tls_context_setup_session_tickets(TLSContext *self)
 {
-  openssl_ctx_setup_session_tickets(self->ssl_ctx);
+  if (self->session_tickets == FALSE)
+    {
+      SSL_CTX_set_options(self->ssl_ctx, SSL_OP_NO_TICKET);
+      return;
+    }
+
+  /* TLS 1.3 tickets are only sent by the server when explicitly asked for,
+   * see openssl_ctx_setup_session_tickets() for the reasons */
+  if (self->mode == TM_SERVER && self->session_tickets != TRUE)
+    openssl_ctx_setup_session_tickets(self->ssl_ctx);
+}
+
+static gboolean
+tls_context_load_session_ticket_keys(TLSContext *self)
+{
+  if (!self->session_ticket_key_file || self->mode != TM_SERVER)
+    return TRUE;
+
+  gchar *keys = NULL;
+  gsize keys_len = 0;
+  GError *error = NULL;
+  glong expected_len = SSL_CTX_get_tlsext_ticket_keys(self->ssl_ctx, NULL, 0);
+
+  if (!g_file_get_contents(self->session_ticket_key_file, &keys, &keys_len, &error))
+    {
+      msg_error("Error reading TLS session ticket key file",
+                evt_tag_str("filename", self->session_ticket_key_file),
+                evt_tag_str("error", error->message),
+                tls_context_format_location_tag(self));
+      g_clear_error(&error);
+      return FALSE;
+    }
+
+  gboolean result = FALSE;
+  if (keys_len != expected_len)
+    {
+      msg_error("Invalid TLS session ticket key file, it must contain exactly the specified number of random bytes",
+                evt_tag_str("filename", self->session_ticket_key_file),
+                evt_tag_long("expected_length", expected_len),
+                evt_tag_long("length", keys_len),
+                tls_context_format_location_tag(self));
+    }
+  else
+    {
+      result = SSL_CTX_set_tlsext_ticket_keys(self->ssl_ctx, keys, keys_len);
+    }
+
+  OPENSSL_cleanse(keys, keys_len);
+  g_free(keys);
+  return result;
+}
+
+static int
+_store_client_session(SSL *ssl, SSL_SESSION *session)
+{
+  TLSSession *tls_session = (TLSSession *) SSL_get_app_data(ssl);
+  TLSContext *self = tls_session->ctx;
+
+  g_mutex_lock(&self->cached_session_lock);
+  if (self->cached_session)
+    SSL_SESSION_free(self->cached_session);
+  self->cached_session = session;
+  g_mutex_unlock(&self->cached_session_lock);
+
+  /* we keep the reference passed by OpenSSL */
+  return 1;
+}
+
+static void
+tls_context_setup_session_cache(TLSContext *self)
+{
+  if (self->session_timeout > 0)
+    SSL_CTX_set_timeout(self->ssl_ctx, self->session_timeout);
+
+  if (self->mode == TM_CLIENT)
+    {
+      SSL_CTX_set_session_cache_mode(self->ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+      SSL_CTX_sess_set_new_cb(self->ssl_ctx, _store_client_session);
+      return;
+    }
+
+  if (self->session_cache_size == 0)
+    SSL_CTX_set_session_cache_mode(self->ssl_ctx, SSL_SESS_CACHE_OFF);
+  else if (self->session_cache_size > 0)
+    SSL_CTX_sess_set_cache_size(self->ssl_ctx, self->session_cache_size);
+}
+
+static void
+tls_session_resume_cached_session(TLSSession *self)
+{
+  TLSContext *ctx = self->ctx;
+
+  g_mutex_lock(&ctx->cached_session_lock);
+  if (ctx->cached_session)
+    SSL_set_session(self->ssl, ctx->cached_session);
+  g_mutex_unlock(&ctx->cached_session_lock);
 }
 
 static void
@@ -737,8 +865,10 @@ tls_context_setup_context(TLSContext *self)
 
   X509_VERIFY_PARAM_set_flags(SSL_CTX_get0_param(self->ssl_ctx), verify_flags);
 
-  if (self->mode == TM_SERVER)
-    tls_context_setup_session_tickets(self);
+  tls_context_setup_session_tickets(self);
+  tls_context_setup_session_cache(self);
+  if (!tls_context_load_session_ticket_keys(self))
+    goto error;
 
   tls_context_setup_verify_mode(self);
   tls_context_setup_ssl_options(self);
@@ -794,6 +924,10 @@ tls_context_setup_session(TLSContext *self)
     }
 
   SSL_set_app_data(ssl, session);
+
+  if (self->mode == TM_CLIENT)
+    tls_session_resume_cached_session(session);
+
   return session;
 }
 
@@ -808,6 +942,9 @@ tls_context_new(TLSMode mode, const gchar *location)
   self->verify_mode = TVM_REQUIRED | TVM_TRUSTED;
   self->ssl_options = TSO_NOSSLv2;
   self->location = g_strdup(location ? : "n/a");
+  self->session_cache_size = -1;
+  self->session_tickets = -1;
+  g_mutex_init(&self->cached_session_lock);
 
   if (self->mode == TM_CLIENT)
     self->ssl_ctx = SSL_CTX_new(SSLv23_client_method());
@@ -824,6 +961,9 @@ static void
 _tls_context_free(TLSContext *self)
 {
   g_free(self->location);
+  if (self->cached_session)
+    SSL_SESSION_free(self->cached_session);
+  g_mutex_clear(&self->cached_session_lock);
   SSL_CTX_free(self->ssl_ctx);
   g_list_foreach(self->trusted_fingerprint_list, (GFunc) g_free, NULL);
   g_list_foreach(self->trusted_dn_list, (GFunc) g_free, NULL);
@@ -837,6 +977,7 @@ _tls_context_free(TLSContext *self)
   g_free(self->cipher_suite);
   g_free(self->ecdh_curve_list);
   g_free(self->sni);
+  g_free(self->session_ticket_key_file);
   g_free(self);
 }
 
@@ -1062,6 +1203,57 @@ tls_context_set_sni(TLSContext *self, const gchar *sni)
   self->sni = g_strdup(sni);
 }
 
+void
+tls_context_set_session_cache_size(TLSContext *self, gint session_cache_size)
+{
+  self->session_cache_size = session_cache_size;
+}
+
+void
+tls_context_set_session_timeout(TLSContext *self, glong session_timeout)
+{
+  self->session_timeout = session_timeout;
+}
+
+void
+tls_context_set_session_tickets(TLSContext *self, gboolean session_tickets)
+{
+  self->session_tickets = session_tickets;
+}
+
+void
+tls_context_set_session_ticket_key_file(TLSContext *self, const gchar *session_ticket_key_file)
+{
+  g_free(self->session_ticket_key_file);
+  self->session_ticket_key_file = g_strdup(session_ticket_key_file);
+}
+
+void
+tls_context_register_stats(TLSContext *self, gint component, const gchar *id, const gchar *instance)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_single_key_set_with_name(&sc_key, component, id, instance, "tls_handshakes");
+  stats_register_counter(0, &sc_key, SC_TYPE_SINGLE_VALUE, &self->handshakes);
+  stats_cluster_single_key_set_with_name(&sc_key, component, id, instance, "tls_resumed_handshakes");
+  stats_register_counter(0, &sc_key, SC_TYPE_SINGLE_VALUE, &self->resumed_handshakes);
+  stats_unlock();
+}
+
+void
+tls_context_unregister_stats(TLSContext *self, gint component, const gchar *id, const gchar *instance)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_single_key_set_with_name(&sc_key, component, id, instance, "tls_handshakes");
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &self->handshakes);
+  stats_cluster_single_key_set_with_name(&sc_key, component, id, instance, "tls_resumed_handshakes");
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &self->resumed_handshakes);
+  stats_unlock();
+}
+
 void
 tls_log_certificate_validation_progress(int ok, X509_STORE_CTX *ctx)
 {
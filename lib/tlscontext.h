@@ -83,6 +83,7 @@ typedef struct _TLSSession
   SSL *ssl;
   TLSContext *ctx;
   TLSVerifier *verifier;
+  gboolean handshake_done;
   struct
   {
     int found;
@@ -126,6 +127,12 @@ void tls_context_set_cipher_suite(TLSContext *self, const gchar *cipher_suite);
 void tls_context_set_ecdh_curve_list(TLSContext *self, const gchar *ecdh_curve_list);
 void tls_context_set_dhparam_file(TLSContext *self, const gchar *dhparam_file);
 void tls_context_set_sni(TLSContext *self, const gchar *sni);
+void tls_context_set_session_cache_size(TLSContext *self, gint session_cache_size);
+void tls_context_set_session_timeout(TLSContext *self, glong session_timeout);
+void tls_context_set_session_tickets(TLSContext *self, gboolean session_tickets);
+void tls_context_set_session_ticket_key_file(TLSContext *self, const gchar *session_ticket_key_file);
+void tls_context_register_stats(TLSContext *self, gint component, const gchar *id, const gchar *instance);
+void tls_context_unregister_stats(TLSContext *self, gint component, const gchar *id, const gchar *instance);
 const gchar *tls_context_get_key_file(TLSContext *self);
 EVTTAG *tls_context_format_tls_error_tag(TLSContext *self);
 EVTTAG *tls_context_format_location_tag(TLSContext *self);
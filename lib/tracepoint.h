@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef TRACEPOINT_H_INCLUDED
+#define TRACEPOINT_H_INCLUDED 1
+
+#include "syslog-ng.h"
+
+/*
+ * USDT (user-level statically defined tracing) probes.
+ *
+ * When syslog-ng is built with sys/sdt.h available (--enable-usdt), each
+ * TRACEPOINT() compiles into a single nop and a note in the ELF binary,
+ * which perf, bpftrace or systemtap can attach to at runtime, e.g.:
+ *
+ *   bpftrace -e 'usdt:/usr/sbin/syslog-ng:syslog_ng:filter_verdict { @[str(arg0), arg3] = count(); }'
+ *
+ * Without a tracer attached, the only cost is evaluating the arguments,
+ * so these must be plain field loads, never function calls.  Without
+ * sys/sdt.h the probes are compiled out completely.
+ *
+ * Config objects are identified by their rule name or by the location of
+ * their definition in the configuration (see LOG_PIPE_TRACE_ID()), which
+ * remain stable across reloads and restarts, unlike pointers.
+ *
+ * The list of probes and their arguments:
+ *
+ *   log_msg_new(msg, length)
+ *   pipe_queue(pipe, config_file, config_line, msg)
+ *   filter_verdict(rule_name, pipe, msg, matched)
+ *   parser_result(rule_name, pipe, msg, success)
+ *   queue_push_tail(queue, persist_name, msg)
+ *   queue_pop_head(queue, persist_name, msg)
+ *   proto_server_fetch(proto, fd, status, length)
+ *   proto_client_post(proto, fd, status, length)
+ *   worker_batch_start(job, condition)
+ *   worker_batch_end(job)
+ *   threaded_dest_flush(driver_id, worker_index, batch_size, result)
+ */
+
+#if SYSLOG_NG_ENABLE_USDT
+
+#include <sys/sdt.h>
+
+#define TRACEPOINT(name, ...) STAP_PROBEV(syslog_ng, name, __VA_ARGS__)
+
+#else
+
+#define TRACEPOINT(name, ...) do { } while (0)
+
+#endif
+
+#endif
@@ -38,6 +38,8 @@ struct _LogTransport
   gssize (*read)(LogTransport *self, gpointer buf, gsize count, LogTransportAuxData *aux);
   gssize (*write)(LogTransport *self, const gpointer buf, gsize count);
   gssize (*writev)(LogTransport *self, struct iovec *iov, gint iov_count);
+  /* optional: tells the transport about the long-lived buffer reads are going to land in */
+  void (*register_buffer)(LogTransport *self, gpointer buf, gsize len);
   void (*free_fn)(LogTransport *self);
 };
 
@@ -59,6 +61,13 @@ log_transport_read(LogTransport *self, gpointer buf, gsize count, LogTransportAu
   return self->read(self, buf, count, aux);
 }
 
+static inline void
+log_transport_register_buffer(LogTransport *self, gpointer buf, gsize len)
+{
+  if (self->register_buffer)
+    self->register_buffer(self, buf, len);
+}
+
 void log_transport_init_instance(LogTransport *s, gint fd);
 void log_transport_free_method(LogTransport *s);
 void log_transport_free(LogTransport *s);
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include <criterion/criterion.h>
+#include "apphook.h"
+#include "transport/transport-uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* These pass both with and without io_uring, the transport falls back to
+ * plain file I/O if the ring cannot be used. */
+
+static gchar filename[] = "test_transport_uring.XXXXXX";
+static gint fd = -1;
+
+static LogTransport *
+_open_transport(gint flags, guint32 transport_flags)
+{
+  gint new_fd = open(filename, flags);
+
+  cr_assert(new_fd >= 0, "error opening %s: %s", filename, strerror(errno));
+  return log_transport_uring_new(new_fd, transport_flags);
+}
+
+Test(transport_uring, written_data_can_be_read_back)
+{
+  LogTransport *writer = _open_transport(O_WRONLY | O_APPEND, LTU_SYNC_AFTER_WRITE);
+  struct iovec iov[] =
+  {
+    { .iov_base = "foo", .iov_len = 3 },
+    { .iov_base = "bar\n", .iov_len = 4 },
+  };
+
+  cr_assert_eq(log_transport_write(writer, "first\n", 6), 6);
+  cr_assert_eq(log_transport_writev(writer, iov, 2), 7);
+  log_transport_free(writer);
+
+  LogTransport *reader = _open_transport(O_RDONLY, 0);
+  gchar buf[64] = { 0 };
+
+  cr_assert_eq(log_transport_read(reader, buf, sizeof(buf), NULL), 13);
+  cr_assert_str_eq(buf, "first\nfoobar\n");
+  cr_assert_eq(log_transport_read(reader, buf, sizeof(buf), NULL), 0);
+  log_transport_free(reader);
+}
+
+Test(transport_uring, reads_into_the_registered_buffer_continue_at_the_file_position)
+{
+  LogTransport *writer = _open_transport(O_WRONLY | O_APPEND, 0);
+  cr_assert_eq(log_transport_write(writer, "0123456789", 10), 10);
+  log_transport_free(writer);
+
+  LogTransport *reader = _open_transport(O_RDONLY, LTU_IGNORE_EOF);
+  gchar *buf = g_malloc0(4096);
+
+  log_transport_register_buffer(reader, buf, 4096);
+  cr_assert_eq(log_transport_read(reader, buf, 4, NULL), 4);
+  cr_assert_eq(log_transport_read(reader, buf + 4, 4096 - 4, NULL), 6);
+  cr_assert_str_eq(buf, "0123456789");
+
+  errno = 0;
+  cr_assert_eq(log_transport_read(reader, buf, 4096, NULL), -1);
+  cr_assert_eq(errno, EAGAIN);
+
+  log_transport_register_buffer(reader, NULL, 0);
+  log_transport_free(reader);
+  g_free(buf);
+}
+
+Test(transport_uring, writes_are_synced_by_the_transport_only_if_requested)
+{
+  LogTransport *transport = _open_transport(O_WRONLY | O_APPEND, 0);
+
+  cr_assert_not(log_transport_uring_syncs_writes(transport));
+  log_transport_free(transport);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+  fd = mkstemp(filename);
+  cr_assert(fd >= 0);
+}
+
+static void
+teardown(void)
+{
+  close(fd);
+  unlink(filename);
+  app_shutdown();
+}
+
+TestSuite(transport_uring, .init = setup, .fini = teardown);
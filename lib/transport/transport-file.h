@@ -38,6 +38,7 @@ gssize log_transport_file_read_method(LogTransport *self, gpointer buf, gsize bu
 gssize log_transport_file_read_and_ignore_eof_method(LogTransport *self, gpointer buf, gsize buflen,
                                                      LogTransportAuxData *aux);
 gssize log_transport_file_write_method(LogTransport *self, const gpointer buf, gsize buflen);
+gssize log_transport_file_writev_method(LogTransport *self, struct iovec *iov, gint iov_count);
 
 void log_transport_file_init_instance(LogTransportFile *self, gint fd);
 LogTransport *log_transport_file_new(gint fd);
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "transport/transport-uring.h"
+#include "transport/transport-file.h"
+#include "messages.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+static LogTransport *
+log_transport_uring_new_fallback(gint fd, guint32 flags)
+{
+  LogTransport *transport = log_transport_file_new(fd);
+
+  if (flags & LTU_IGNORE_EOF)
+    transport->read = log_transport_file_read_and_ignore_eof_method;
+  return transport;
+}
+
+#if SYSLOG_NG_ENABLE_IO_URING
+
+#include <liburing.h>
+
+/* at most a write and its linked fsync are in flight at a time */
+#define LOG_TRANSPORT_URING_QUEUE_DEPTH 4
+
+typedef struct _LogTransportUring
+{
+  LogTransportFile super;
+  struct io_uring ring;
+  guint32 flags;
+  /* set if the ring failed us, the plain syscalls are used from then on */
+  gboolean disabled;
+  guchar *fixed_buffer;
+  gsize fixed_buffer_len;
+} LogTransportUring;
+
+/* set once the kernel refused to create a ring, so that we don't retry for every file */
+static gint log_transport_uring_unsupported;
+
+static void
+log_transport_uring_disable(LogTransportUring *self, gint error)
+{
+  msg_warning("io_uring operation failed, falling back to regular I/O for this file",
+              evt_tag_int("fd", self->super.super.fd),
+              evt_tag_errno("error", error));
+  self->disabled = TRUE;
+}
+
+static gssize
+log_transport_uring_wait_result(LogTransportUring *self, gint count)
+{
+  struct io_uring_cqe *cqe;
+  gssize result = 0;
+  gint rc;
+
+  for (gint i = 0; i < count; i++)
+    {
+      do
+        {
+          rc = io_uring_wait_cqe(&self->ring, &cqe);
+        }
+      while (rc == -EINTR);
+
+      if (rc < 0)
+        {
+          log_transport_uring_disable(self, -rc);
+          errno = -rc;
+          return -1;
+        }
+
+      if (cqe->user_data == 0)
+        {
+          result = cqe->res;
+        }
+      else if (cqe->res < 0 && cqe->res != -ECANCELED)
+        {
+          msg_error("Error syncing file to disk",
+                    evt_tag_int("fd", self->super.super.fd),
+                    evt_tag_errno("error", -cqe->res));
+        }
+      io_uring_cqe_seen(&self->ring, cqe);
+    }
+
+  if (result < 0)
+    {
+      errno = -result;
+      return -1;
+    }
+  return result;
+}
+
+/*
+ * Submit everything prepared so far and wait for @count completions with a
+ * single io_uring_enter(), returns the result of the operation tagged with
+ * user_data 0.
+ *
+ * The file writer hands all lines pending at a flush to writev() at once,
+ * so a flush is a single SQE (plus the linked fsync, if any) and costs one
+ * system call.  If the wait is interrupted after the submission, the
+ * completions are collected by log_transport_uring_wait_result(), which
+ * only enters the kernel again for those that are still missing.
+ */
+static gssize
+log_transport_uring_submit(LogTransportUring *self, gint count)
+{
+  gint rc;
+
+  do
+    {
+      rc = io_uring_submit_and_wait(&self->ring, count);
+    }
+  while (rc == -EINTR);
+
+  if (rc < count)
+    {
+      /* the unsubmitted SQEs refer to buffers owned by our caller, the
+       * ring must never be entered again */
+      log_transport_uring_disable(self, rc < 0 ? -rc : EAGAIN);
+      errno = EAGAIN;
+      return -1;
+    }
+
+  return log_transport_uring_wait_result(self, count);
+}
+
+static gssize
+log_transport_uring_fallback_writev(LogTransportUring *self, struct iovec *iov, gint iov_count)
+{
+  gssize rc = log_transport_file_writev_method(&self->super.super, iov, iov_count);
+
+#ifdef SYSLOG_NG_HAVE_FDATASYNC
+  if (rc > 0 && (self->flags & LTU_SYNC_AFTER_WRITE))
+    fdatasync(self->super.super.fd);
+#else
+  if (rc > 0 && (self->flags & LTU_SYNC_AFTER_WRITE))
+    fsync(self->super.super.fd);
+#endif
+  return rc;
+}
+
+static gssize
+log_transport_uring_writev_method(LogTransport *s, struct iovec *iov, gint iov_count)
+{
+  LogTransportUring *self = (LogTransportUring *) s;
+  struct io_uring_sqe *sqe;
+  gint count = 1;
+
+  if (self->disabled)
+    return log_transport_uring_fallback_writev(self, iov, iov_count);
+
+  sqe = io_uring_get_sqe(&self->ring);
+  /* offset -1: write at the current file position, O_APPEND is honoured */
+  io_uring_prep_writev(sqe, s->fd, iov, iov_count, -1);
+  sqe->user_data = 0;
+
+  if (self->flags & LTU_SYNC_AFTER_WRITE)
+    {
+      io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+      sqe = io_uring_get_sqe(&self->ring);
+      io_uring_prep_fsync(sqe, s->fd, IORING_FSYNC_DATASYNC);
+      sqe->user_data = 1;
+      count++;
+    }
+
+  return log_transport_uring_submit(self, count);
+}
+
+static gssize
+log_transport_uring_write_method(LogTransport *s, const gpointer buf, gsize buflen)
+{
+  struct iovec iov = { .iov_base = buf, .iov_len = buflen };
+
+  return log_transport_uring_writev_method(s, &iov, 1);
+}
+
+static inline gboolean
+log_transport_uring_is_fixed_buffer(LogTransportUring *self, gpointer buf, gsize buflen)
+{
+  return self->fixed_buffer &&
+         (guchar *) buf >= self->fixed_buffer &&
+         (guchar *) buf + buflen <= self->fixed_buffer + self->fixed_buffer_len;
+}
+
+static gssize
+log_transport_uring_read_method(LogTransport *s, gpointer buf, gsize buflen, LogTransportAuxData *aux)
+{
+  LogTransportUring *self = (LogTransportUring *) s;
+  struct io_uring_sqe *sqe;
+  gssize rc;
+
+  if (self->disabled)
+    {
+      rc = log_transport_file_read_method(s, buf, buflen, aux);
+    }
+  else
+    {
+      sqe = io_uring_get_sqe(&self->ring);
+      if (log_transport_uring_is_fixed_buffer(self, buf, buflen))
+        io_uring_prep_read_fixed(sqe, s->fd, buf, buflen, -1, 0);
+      else
+        io_uring_prep_read(sqe, s->fd, buf, buflen, -1);
+      sqe->user_data = 0;
+
+      rc = log_transport_uring_submit(self, 1);
+    }
+
+  if (rc == 0 && (self->flags & LTU_IGNORE_EOF))
+    {
+      rc = -1;
+      errno = EAGAIN;
+    }
+  return rc;
+}
+
+static void
+log_transport_uring_register_buffer(LogTransport *s, gpointer buf, gsize len)
+{
+  LogTransportUring *self = (LogTransportUring *) s;
+  struct iovec iov = { .iov_base = buf, .iov_len = len };
+  gint rc;
+
+  if (self->fixed_buffer)
+    {
+      io_uring_unregister_buffers(&self->ring);
+      self->fixed_buffer = NULL;
+      self->fixed_buffer_len = 0;
+    }
+
+  if (!buf || self->disabled)
+    return;
+
+  /* this may fail e.g. because of RLIMIT_MEMLOCK, reads just don't use fixed buffers then */
+  rc = io_uring_register_buffers(&self->ring, &iov, 1);
+  if (rc < 0)
+    {
+      msg_debug("Error registering input buffer with io_uring, using regular reads",
+                evt_tag_int("fd", s->fd),
+                evt_tag_errno("error", -rc));
+      return;
+    }
+
+  self->fixed_buffer = buf;
+  self->fixed_buffer_len = len;
+}
+
+static void
+log_transport_uring_free_method(LogTransport *s)
+{
+  LogTransportUring *self = (LogTransportUring *) s;
+
+  io_uring_queue_exit(&self->ring);
+  log_transport_free_method(s);
+}
+
+gboolean
+log_transport_uring_syncs_writes(LogTransport *s)
+{
+  return s->writev == log_transport_uring_writev_method &&
+         (((LogTransportUring *) s)->flags & LTU_SYNC_AFTER_WRITE);
+}
+
+/* errors meaning that io_uring is missing or disabled, as opposed to
+ * running out of resources (EMFILE, ENOMEM, EAGAIN) */
+static gboolean
+_is_uring_unsupported_error(gint error)
+{
+  return error == ENOSYS || error == EPERM || error == EINVAL;
+}
+
+LogTransport *
+log_transport_uring_new(gint fd, guint32 flags)
+{
+  struct io_uring_params params = { 0 };
+  LogTransportUring *self;
+  gint rc;
+
+  if (g_atomic_int_get(&log_transport_uring_unsupported))
+    goto fallback;
+
+  self = g_new0(LogTransportUring, 1);
+  rc = io_uring_queue_init_params(LOG_TRANSPORT_URING_QUEUE_DEPTH, &self->ring, &params);
+  if (rc < 0 && !_is_uring_unsupported_error(-rc))
+    {
+      /* running out of fds or locked memory affects this ring only */
+      msg_warning("Error setting up io_uring for file, using regular file I/O for it",
+                  evt_tag_int("fd", fd),
+                  evt_tag_errno("error", -rc));
+      g_free(self);
+      goto fallback;
+    }
+
+  if (rc < 0 || !(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+      /* reads and writes at the current file position need 5.6 or later */
+      msg_warning("io_uring is not usable on this system, using regular file I/O",
+                  evt_tag_errno("error", rc < 0 ? -rc : ENOTSUP));
+      if (rc >= 0)
+        io_uring_queue_exit(&self->ring);
+      g_free(self);
+      g_atomic_int_set(&log_transport_uring_unsupported, TRUE);
+      goto fallback;
+    }
+
+  log_transport_file_init_instance(&self->super, fd);
+  self->super.super.read = log_transport_uring_read_method;
+  self->super.super.write = log_transport_uring_write_method;
+  self->super.super.writev = log_transport_uring_writev_method;
+  self->super.super.register_buffer = log_transport_uring_register_buffer;
+  self->super.super.free_fn = log_transport_uring_free_method;
+  self->flags = flags;
+  return &self->super.super;
+
+fallback:
+  return log_transport_uring_new_fallback(fd, flags);
+}
+
+#else
+
+gboolean
+log_transport_uring_syncs_writes(LogTransport *s)
+{
+  return FALSE;
+}
+
+LogTransport *
+log_transport_uring_new(gint fd, guint32 flags)
+{
+  return log_transport_uring_new_fallback(fd, flags);
+}
+
+#endif
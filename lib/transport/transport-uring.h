@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef TRANSPORT_TRANSPORT_URING_H_INCLUDED
+#define TRANSPORT_TRANSPORT_URING_H_INCLUDED 1
+
+#include "transport/logtransport.h"
+
+/*
+ * File transport doing its I/O through a small io_uring owned by the
+ * transport.  Operations are still completed before the read/write
+ * methods return, so LogReader and LogWriter see the same semantics as
+ * with LogTransportFile, but a write and the fdatasync() following it
+ * are submitted as a single linked batch, and reads into the buffer
+ * registered via log_transport_register_buffer() use fixed buffers.
+ *
+ * If syslog-ng was compiled without io_uring support, or the kernel
+ * refuses to set up the ring, log_transport_uring_new() returns a plain
+ * LogTransportFile instead.
+ */
+
+enum
+{
+  /* link an fdatasync() to every write */
+  LTU_SYNC_AFTER_WRITE = 0x0001,
+  /* report EOF as EAGAIN, see log_transport_file_read_and_ignore_eof_method() */
+  LTU_IGNORE_EOF = 0x0002,
+};
+
+gboolean log_transport_uring_syncs_writes(LogTransport *s);
+LogTransport *log_transport_uring_new(gint fd, guint32 flags);
+
+#endif
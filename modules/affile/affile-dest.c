@@ -38,6 +38,8 @@
 #include "apphook.h"
 #include "timeutils/cache.h"
 #include "timeutils/misc.h"
+#include "mainloop-worker.h"
+#include "tls-support.h"
 
 #include <iv.h>
 #include <sys/types.h>
@@ -58,11 +60,14 @@
  *
  *   - queue runs in the thread of the source thread that generated the message
  *   - if the message is to be written to a not-yet-opened file, a new gets
- *     opened and stored in the writer_hash hashtable (initiated from queue,
- *     but performed in the main thread, but more on that later)
+ *     opened and stored in one of the writer_shards hashtables (initiated
+ *     from queue, but performed in the main thread, but more on that later)
  *   - currently opened destination files are checked regularly and closed
  *     if they are idle for a given amount of time (time_reap) (this is done
  *     in the main thread)
+ *   - if max-open-files() is set and the limit is reached when a new file
+ *     is opened, the least recently used idle files are closed (this is
+ *     done in the main thread as well)
  *
  * Some of these operations have to be performed in the main thread, others
  * are done in the queue call.
@@ -75,17 +80,43 @@
  * syslog-ng is running.
  *
  * AFFileDestWriter instances are created dynamically when a new file is
- * opened. A reference is stored in the writer_hash hashtable. This is then:
+ * opened. A reference is stored in the writer_shards hashtables, the shard
+ * is selected by the hash of the filename. This is then:
  *    - looked up in _queue() (in the source thread)
  *    - cleaned up in reap callback (in the main thread)
  *
- * writer_hash is locked (currently a simple mutex) using
- * AFFileDestDriver->lock.  The "queue" method cannot hold the lock while
- * forwarding it to the next pipe, thus a reference is taken under the
- * protection of the lock, keeping a the next pipe alive, even if that would
- * go away in a parallel reaper process.
+ * Each shard is locked using its own mutex, so source threads writing to
+ * different files rarely contend on the same lock.  The "queue" method
+ * cannot hold the lock while forwarding it to the next pipe, thus a
+ * reference is taken and queue_pending is incremented under the protection
+ * of the lock, keeping the next pipe alive.  The reaper does not touch a
+ * writer while its queue_pending counter is non-zero.
+ *
+ * Worker threads additionally keep the writers they used in the current
+ * batch in a small per-thread cache, so consecutive messages to the same
+ * file don't need to take the shard lock at all.  A cached writer keeps its
+ * reference and queue_pending increment until the batch is finished, the
+ * cache is emptied from a batch callback.  The single_writer of a
+ * non-templated destination is protected by AFFileDestDriver->lock.
  */
 
+#define AFFILE_DW_CACHE_SIZE 8
+
+typedef struct _AFFileDestWriterCache
+{
+  WorkerBatchCallback batch_cb;
+  gboolean batch_cb_registered;
+  AFFileDestWriter *writers[AFFILE_DW_CACHE_SIZE];
+} AFFileDestWriterCache;
+
+TLS_BLOCK_START
+{
+  AFFileDestWriterCache writer_cache;
+}
+TLS_BLOCK_END;
+
+#define writer_cache __tls_deref(writer_cache)
+
 static GList *affile_dest_drivers = NULL;
 
 struct _AFFileDestWriter
@@ -94,12 +125,21 @@ struct _AFFileDestWriter
   GStaticMutex lock;
   AFFileDestDriver *owner;
   gchar *filename;
+  guint filename_hash;
   LogWriter *writer;
   time_t last_msg_stamp;
   time_t last_open_stamp;
-  gboolean reopen_pending, queue_pending;
+  gboolean reopen_pending;
+  /* number of references currently used by source threads, atomic */
+  gint queue_pending;
 };
 
+static inline AFFileDestWriterShard *
+affile_dd_get_shard(AFFileDestDriver *self, guint filename_hash)
+{
+  return &self->writer_shards[(filename_hash >> 8) % AFFILE_DD_WRITER_SHARDS];
+}
+
 static gchar *
 affile_dw_format_persist_name(AFFileDestWriter *self)
 {
@@ -113,22 +153,112 @@ affile_dw_format_persist_name(AFFileDestWriter *self)
 
 static void affile_dd_reap_writer(AFFileDestDriver *self, AFFileDestWriter *dw);
 
+/* the lock protecting the reference held by the owner */
+static GStaticMutex *
+affile_dw_get_owner_lock(AFFileDestWriter *self)
+{
+  if (self->owner->filename_is_a_template)
+    return &affile_dd_get_shard(self->owner, self->filename_hash)->lock;
+  return &self->owner->lock;
+}
+
+/* the lock returned by affile_dw_get_owner_lock() must be held */
+static gboolean
+affile_dw_is_idle(AFFileDestWriter *self)
+{
+  return !log_writer_has_pending_writes((LogWriter *) self->writer) &&
+         g_atomic_int_get(&self->queue_pending) == 0;
+}
+
 static void
 affile_dw_reap(AFFileDestWriter *self)
 {
-  AFFileDestDriver *owner = self->owner;
+  GStaticMutex *lock = affile_dw_get_owner_lock(self);
 
   main_loop_assert_main_thread();
 
-  g_static_mutex_lock(&owner->lock);
-  if (!log_writer_has_pending_writes((LogWriter *) self->writer) && !self->queue_pending)
+  g_static_mutex_lock(lock);
+  if (affile_dw_is_idle(self))
     {
       msg_verbose("Destination timed out, reaping",
                   evt_tag_str("template", self->owner->filename_template->template),
                   evt_tag_str("filename", self->filename));
       affile_dd_reap_writer(self->owner, self);
     }
-  g_static_mutex_unlock(&owner->lock);
+  g_static_mutex_unlock(lock);
+}
+
+/* the lock returned by affile_dw_get_owner_lock() must be held */
+static void
+affile_dw_pin(AFFileDestWriter *self)
+{
+  log_pipe_ref(&self->super);
+  g_atomic_int_inc(&self->queue_pending);
+}
+
+static void
+affile_dw_unpin(AFFileDestWriter *self)
+{
+  g_atomic_int_add(&self->queue_pending, -1);
+  log_pipe_unref(&self->super);
+}
+
+static gpointer
+affile_dw_cache_flush(gpointer user_data)
+{
+  AFFileDestWriterCache *cache = &writer_cache;
+
+  for (gint i = 0; i < AFFILE_DW_CACHE_SIZE; i++)
+    {
+      if (cache->writers[i])
+        {
+          affile_dw_unpin(cache->writers[i]);
+          cache->writers[i] = NULL;
+        }
+    }
+  cache->batch_cb_registered = FALSE;
+  return NULL;
+}
+
+static AFFileDestWriter *
+affile_dw_cache_lookup(AFFileDestDriver *owner, const gchar *filename, guint filename_hash)
+{
+  if (main_loop_worker_get_thread_id() < 0)
+    return NULL;
+
+  AFFileDestWriter *dw = writer_cache.writers[filename_hash % AFFILE_DW_CACHE_SIZE];
+
+  if (dw && dw->owner == owner && dw->filename_hash == filename_hash && strcmp(dw->filename, filename) == 0)
+    return dw;
+  return NULL;
+}
+
+/*
+ * Stores a pinned writer in the per-thread cache, which then keeps the pin
+ * until the current batch is finished. Returns FALSE if the writer was not
+ * cached, in which case the caller remains responsible for unpinning it.
+ */
+static gboolean
+affile_dw_cache_store(AFFileDestWriter *dw)
+{
+  if (main_loop_worker_get_thread_id() < 0)
+    return FALSE;
+
+  AFFileDestWriter **slot = &writer_cache.writers[dw->filename_hash % AFFILE_DW_CACHE_SIZE];
+
+  if (*slot)
+    return FALSE;
+
+  if (!writer_cache.batch_cb_registered)
+    {
+      worker_batch_callback_init(&writer_cache.batch_cb);
+      writer_cache.batch_cb.func = affile_dw_cache_flush;
+      writer_cache.batch_cb.user_data = NULL;
+      main_loop_worker_register_batch_callback(&writer_cache.batch_cb);
+      writer_cache.batch_cb_registered = TRUE;
+    }
+  *slot = dw;
+  return TRUE;
 }
 
 static gboolean
@@ -342,6 +472,7 @@ affile_dw_new(const gchar *filename, GlobalConfig *cfg)
   /* we have to take care about freeing filename later.
      This avoids a move of the filename. */
   self->filename = g_strdup(filename);
+  self->filename_hash = g_str_hash(self->filename);
   g_static_mutex_init(&self->lock);
   return self;
 }
@@ -359,8 +490,14 @@ affile_dd_reopen_all_writers(gpointer data, gpointer user_data)
   AFFileDestDriver *driver = (AFFileDestDriver *) data;
   if (driver->single_writer)
     affile_dw_reopen(driver->single_writer);
-  else if (driver->writer_hash)
-    g_hash_table_foreach(driver->writer_hash, affile_dw_reopen_writer, NULL);
+  else if (driver->filename_is_a_template)
+    {
+      for (gint i = 0; i < AFFILE_DD_WRITER_SHARDS; i++)
+        {
+          if (driver->writer_shards[i].writers)
+            g_hash_table_foreach(driver->writer_shards[i].writers, affile_dw_reopen_writer, NULL);
+        }
+    }
 }
 
 static void
@@ -390,7 +527,39 @@ affile_dd_set_fsync(LogDriver *s, gboolean use_fsync)
 {
   AFFileDestDriver *self = (AFFileDestDriver *) s;
 
-  self->use_fsync = use_fsync;
+  self->file_writer_options.fsync = use_fsync;
+}
+
+void
+affile_dd_set_write_behind_size(LogDriver *s, gsize write_behind_size)
+{
+  AFFileDestDriver *self = (AFFileDestDriver *) s;
+
+  self->file_writer_options.write_behind_size = write_behind_size;
+}
+
+void
+affile_dd_set_preallocate_size(LogDriver *s, gsize preallocate_size)
+{
+  AFFileDestDriver *self = (AFFileDestDriver *) s;
+
+  self->file_writer_options.preallocate_size = preallocate_size;
+}
+
+void
+affile_dd_set_sync_bytes(LogDriver *s, gsize sync_bytes)
+{
+  AFFileDestDriver *self = (AFFileDestDriver *) s;
+
+  self->file_writer_options.sync_bytes = sync_bytes;
+}
+
+void
+affile_dd_set_sync_interval(LogDriver *s, gint sync_interval)
+{
+  AFFileDestDriver *self = (AFFileDestDriver *) s;
+
+  self->file_writer_options.sync_interval = sync_interval;
 }
 
 void
@@ -401,6 +570,14 @@ affile_dd_set_time_reap(LogDriver *s, gint time_reap)
   log_proto_client_options_set_timeout(&self->writer_options.proto_options.super, time_reap);
 }
 
+void
+affile_dd_set_max_open_files(LogDriver *s, gint max_open_files)
+{
+  AFFileDestDriver *self = (AFFileDestDriver *) s;
+
+  self->max_open_files = max_open_files;
+}
+
 static gint
 affile_dd_get_time_reap(AFFileDestDriver *self)
 {
@@ -422,7 +599,7 @@ affile_dd_format_persist_name(const LogPipe *s)
   return persist_name;
 }
 
-/* DestDriver lock must be held before calling this function */
+/* the lock returned by affile_dw_get_owner_lock() must be held before calling this function */
 static void
 affile_dd_reap_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
 {
@@ -433,7 +610,8 @@ affile_dd_reap_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
   if (self->filename_is_a_template)
     {
       /* remove from hash table */
-      g_hash_table_remove(self->writer_hash, dw->filename);
+      g_hash_table_remove(affile_dd_get_shard(self, dw->filename_hash)->writers, dw->filename);
+      self->open_writers--;
     }
   else
     {
@@ -447,14 +625,88 @@ affile_dd_reap_writer(AFFileDestDriver *self, AFFileDestWriter *dw)
   log_pipe_unref(&dw->super);
 }
 
+static void
+affile_dd_collect_idle_writer(gpointer key, gpointer value, gpointer user_data)
+{
+  AFFileDestWriter *dw = (AFFileDestWriter *) value;
+  GPtrArray *idle_writers = (GPtrArray *) user_data;
+
+  if (affile_dw_is_idle(dw))
+    g_ptr_array_add(idle_writers, dw);
+}
+
+static gint
+affile_dw_compare_last_msg_stamp(gconstpointer a, gconstpointer b)
+{
+  const AFFileDestWriter *dw_a = *(const AFFileDestWriter **) a;
+  const AFFileDestWriter *dw_b = *(const AFFileDestWriter **) b;
+
+  if (dw_a->last_msg_stamp < dw_b->last_msg_stamp)
+    return -1;
+  if (dw_a->last_msg_stamp > dw_b->last_msg_stamp)
+    return 1;
+  return 0;
+}
+
+/*
+ * Called in the main thread before a new writer is opened.  If
+ * max-open-files() is reached, the least recently used idle writers are
+ * closed to make room for the new one.  Writers that still have pending
+ * writes or are in use by a source thread are never closed here, if there
+ * are not enough idle ones, the limit is exceeded temporarily.
+ */
+static void
+affile_dd_close_lru_writers(AFFileDestDriver *self)
+{
+  main_loop_assert_main_thread();
+
+  if (self->max_open_files <= 0 || self->open_writers < self->max_open_files)
+    return;
+
+  /* shard tables are only modified in the main thread, so collecting the
+   * candidates is possible without taking the shard locks */
+  GPtrArray *idle_writers = g_ptr_array_new();
+  for (gint i = 0; i < AFFILE_DD_WRITER_SHARDS; i++)
+    g_hash_table_foreach(self->writer_shards[i].writers, affile_dd_collect_idle_writer, idle_writers);
+  g_ptr_array_sort(idle_writers, affile_dw_compare_last_msg_stamp);
+
+  gint to_close = self->open_writers - self->max_open_files + 1;
+  for (guint i = 0; i < idle_writers->len && to_close > 0; i++)
+    {
+      AFFileDestWriter *dw = (AFFileDestWriter *) g_ptr_array_index(idle_writers, i);
+      AFFileDestWriterShard *shard = affile_dd_get_shard(self, dw->filename_hash);
+
+      g_static_mutex_lock(&shard->lock);
+      /* a source thread may have picked it up since it was collected */
+      if (affile_dw_is_idle(dw))
+        {
+          msg_verbose("Destination reached max-open-files(), closing least recently used file",
+                      evt_tag_str("template", self->filename_template->template),
+                      evt_tag_str("filename", dw->filename),
+                      evt_tag_int("max_open_files", self->max_open_files));
+          affile_dd_reap_writer(self, dw);
+          to_close--;
+        }
+      g_static_mutex_unlock(&shard->lock);
+    }
+
+  if (to_close > 0)
+    msg_debug("Not enough idle files to close, max-open-files() exceeded temporarily",
+              evt_tag_str("template", self->filename_template->template),
+              evt_tag_int("open_files", self->open_writers),
+              evt_tag_int("max_open_files", self->max_open_files));
+
+  g_ptr_array_free(idle_writers, TRUE);
+}
+
 
 /**
  * affile_dd_reuse_writer:
  *
  * This function is called as a g_hash_table_foreach() callback to set the
  * owner of each writer, previously connected to an AFileDestDriver instance
- * in an earlier configuration. This way AFFileDestWriter instances are
- * remembered across reloads.
+ * in an earlier configuration, and to put it into its shard. This way
+ * AFFileDestWriter instances are remembered across reloads.
  *
  **/
 static void
@@ -462,14 +714,21 @@ affile_dd_reuse_writer(gpointer key, gpointer value, gpointer user_data)
 {
   AFFileDestDriver *self = (AFFileDestDriver *) user_data;
   AFFileDestWriter *writer = (AFFileDestWriter *) value;
+  AFFileDestWriterShard *shard;
 
   affile_dw_set_owner(writer, self);
   if (!log_pipe_init(&writer->super))
     {
       affile_dw_set_owner(writer, NULL);
       log_pipe_unref(&writer->super);
-      g_hash_table_remove(self->writer_hash, key);
+      return;
     }
+
+  shard = affile_dd_get_shard(self, writer->filename_hash);
+  g_static_mutex_lock(&shard->lock);
+  g_hash_table_insert(shard->writers, writer->filename, writer);
+  g_static_mutex_unlock(&shard->lock);
+  self->open_writers++;
 }
 
 
@@ -491,9 +750,17 @@ affile_dd_init(LogPipe *s)
 
   if (self->filename_is_a_template)
     {
-      self->writer_hash = cfg_persist_config_fetch(cfg, affile_dd_format_persist_name(s));
-      if (self->writer_hash)
-        g_hash_table_foreach(self->writer_hash, affile_dd_reuse_writer, self);
+      GHashTable *writer_hash = cfg_persist_config_fetch(cfg, affile_dd_format_persist_name(s));
+
+      for (gint i = 0; i < AFFILE_DD_WRITER_SHARDS; i++)
+        self->writer_shards[i].writers = g_hash_table_new(g_str_hash, g_str_equal);
+      self->open_writers = 0;
+
+      if (writer_hash)
+        {
+          g_hash_table_foreach(writer_hash, affile_dd_reuse_writer, self);
+          g_hash_table_destroy(writer_hash);
+        }
     }
   else
     {
@@ -553,10 +820,18 @@ affile_dd_destroy_writer_hash(gpointer value)
   g_hash_table_destroy(writer_hash);
 }
 
+/*
+ * This function is called as a g_hash_table_foreach() callback to deinit
+ * the writers of a shard and to collect them into a single hashtable, which
+ * is then kept across reloads.
+ */
 static void
 affile_dd_deinit_writer(gpointer key, gpointer value, gpointer user_data)
 {
+  GHashTable *writer_hash = (GHashTable *) user_data;
+
   log_pipe_deinit((LogPipe *) value);
+  g_hash_table_insert(writer_hash, key, value);
 }
 
 static gboolean
@@ -568,21 +843,28 @@ affile_dd_deinit(LogPipe *s)
    * have circular references between AFFileDestDriver and file writers */
   if (self->single_writer)
     {
-      g_assert(self->writer_hash == NULL);
+      g_assert(!self->filename_is_a_template);
 
       log_pipe_deinit(&self->single_writer->super);
       cfg_persist_config_add(cfg, affile_dd_format_persist_name(s), self->single_writer,
                              affile_dd_destroy_writer, FALSE);
       self->single_writer = NULL;
     }
-  else if (self->writer_hash)
+  else if (self->filename_is_a_template && self->writer_shards[0].writers)
     {
-      g_assert(self->single_writer == NULL);
+      GHashTable *writer_hash = g_hash_table_new(g_str_hash, g_str_equal);
 
-      g_hash_table_foreach(self->writer_hash, affile_dd_deinit_writer, NULL);
-      cfg_persist_config_add(cfg, affile_dd_format_persist_name(s), self->writer_hash,
+      for (gint i = 0; i < AFFILE_DD_WRITER_SHARDS; i++)
+        {
+          AFFileDestWriterShard *shard = &self->writer_shards[i];
+
+          g_hash_table_foreach(shard->writers, affile_dd_deinit_writer, writer_hash);
+          g_hash_table_destroy(shard->writers);
+          shard->writers = NULL;
+        }
+      self->open_writers = 0;
+      cfg_persist_config_add(cfg, affile_dd_format_persist_name(s), writer_hash,
                              affile_dd_destroy_writer_hash, FALSE);
-      self->writer_hash = NULL;
     }
 
   if (!log_dest_driver_deinit_method(s))
@@ -632,19 +914,17 @@ affile_dd_open_writer(gpointer args[])
   else
     {
       GString *filename = args[1];
-
-      /* hash table construction is serialized, as we only do that in the main thread. */
-      if (!self->writer_hash)
-        self->writer_hash = g_hash_table_new(g_str_hash, g_str_equal);
+      AFFileDestWriterShard *shard = affile_dd_get_shard(self, g_str_hash(filename->str));
 
       /* we don't need to lock the hashtable as it is only written in
        * the main thread, which we're running right now.  lookups in
        * other threads must be locked. writers must be locked even in
        * this thread to exclude lookups in other threads.  */
 
-      next = g_hash_table_lookup(self->writer_hash, filename->str);
+      next = g_hash_table_lookup(shard->writers, filename->str);
       if (!next)
         {
+          affile_dd_close_lru_writers(self);
           next = affile_dw_new(filename->str, log_pipe_get_config(&self->super.super.super));
           affile_dw_set_owner(next, self);
           if (!log_pipe_init(&next->super))
@@ -655,9 +935,10 @@ affile_dd_open_writer(gpointer args[])
           else
             {
               log_pipe_ref(&next->super);
-              g_static_mutex_lock(&self->lock);
-              g_hash_table_insert(self->writer_hash, next->filename, next);
-              g_static_mutex_unlock(&self->lock);
+              g_static_mutex_lock(&shard->lock);
+              g_hash_table_insert(shard->writers, next->filename, next);
+              g_static_mutex_unlock(&shard->lock);
+              self->open_writers++;
             }
         }
       else
@@ -668,18 +949,38 @@ affile_dd_open_writer(gpointer args[])
 
   if (next)
     {
-      next->queue_pending = TRUE;
+      g_atomic_int_inc(&next->queue_pending);
       /* we're returning a reference */
       return &next->super;
     }
   return NULL;
 }
 
+/*
+ * Looks up the writer for @filename in its shard, returns a pinned
+ * reference or NULL if the file is not opened yet.
+ */
+static AFFileDestWriter *
+affile_dd_lookup_writer(AFFileDestDriver *self, const gchar *filename, guint filename_hash)
+{
+  AFFileDestWriterShard *shard = affile_dd_get_shard(self, filename_hash);
+  AFFileDestWriter *next;
+
+  g_static_mutex_lock(&shard->lock);
+  next = g_hash_table_lookup(shard->writers, filename);
+  if (next)
+    affile_dw_pin(next);
+  g_static_mutex_unlock(&shard->lock);
+
+  return next;
+}
+
 static void
 affile_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
 {
   AFFileDestDriver *self = (AFFileDestDriver *) s;
   AFFileDestWriter *next;
+  gboolean cached = FALSE;
   gpointer args[2] = { self, NULL };
 
   if (!self->filename_is_a_template)
@@ -697,36 +998,35 @@ affile_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
       else
         {
           next = self->single_writer;
-          next->queue_pending = TRUE;
-          log_pipe_ref(&next->super);
+          affile_dw_pin(next);
           g_static_mutex_unlock(&self->lock);
         }
     }
   else
     {
       GString *filename;
+      guint filename_hash;
 
       filename = g_string_sized_new(32);
       LogTemplateEvalOptions options = {&self->writer_options.template_options, LTZ_LOCAL, 0, NULL};
       log_template_format(self->filename_template, msg, &options, filename);
+      filename_hash = g_str_hash(filename->str);
 
-      g_static_mutex_lock(&self->lock);
-      if (self->writer_hash)
-        next = g_hash_table_lookup(self->writer_hash, filename->str);
-      else
-        next = NULL;
-
+      next = affile_dw_cache_lookup(self, filename->str, filename_hash);
       if (next)
         {
-          log_pipe_ref(&next->super);
-          next->queue_pending = TRUE;
-          g_static_mutex_unlock(&self->lock);
+          cached = TRUE;
         }
       else
         {
-          g_static_mutex_unlock(&self->lock);
-          args[1] = filename;
-          next = main_loop_call((void *(*)(void *)) affile_dd_open_writer, args, TRUE);
+          next = affile_dd_lookup_writer(self, filename->str, filename_hash);
+          if (!next)
+            {
+              args[1] = filename;
+              next = main_loop_call((void *(*)(void *)) affile_dd_open_writer, args, TRUE);
+            }
+          if (next)
+            cached = affile_dw_cache_store(next);
         }
       g_string_free(filename, TRUE);
     }
@@ -734,8 +1034,8 @@ affile_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
     {
       log_msg_add_ack(msg, path_options);
       log_pipe_queue(&next->super, log_msg_ref(msg), path_options);
-      next->queue_pending = FALSE;
-      log_pipe_unref(&next->super);
+      if (!cached)
+        affile_dw_unpin(next);
     }
 
   log_dest_driver_queue_method(s, msg, path_options);
@@ -747,10 +1047,15 @@ affile_dd_free(LogPipe *s)
   AFFileDestDriver *self = (AFFileDestDriver *) s;
 
   g_static_mutex_free(&self->lock);
+  for (gint i = 0; i < AFFILE_DD_WRITER_SHARDS; i++)
+    {
+      /* NOTE: this must be NULL as deinit has freed it, otherwise we'd have circular references */
+      g_assert(self->writer_shards[i].writers == NULL);
+      g_static_mutex_free(&self->writer_shards[i].lock);
+    }
   affile_dest_drivers = g_list_remove(affile_dest_drivers, self);
 
-  /* NOTE: this must be NULL as deinit has freed it, otherwise we'd have circular references */
-  g_assert(self->single_writer == NULL && self->writer_hash == NULL);
+  g_assert(self->single_writer == NULL);
 
   log_template_unref(self->filename_template);
   log_writer_options_destroy(&self->writer_options);
@@ -772,6 +1077,7 @@ affile_dd_new_instance(LogTemplate *filename_template, GlobalConfig *cfg)
   self->super.super.super.generate_persist_name = affile_dd_format_persist_name;
   self->filename_template = filename_template;
   log_writer_options_defaults(&self->writer_options);
+  log_proto_file_writer_options_defaults(&self->file_writer_options);
   self->writer_options.mark_mode = MM_NONE;
   self->writer_options.stats_level = STATS_LEVEL1;
   self->writer_flags = LW_FORMAT_FILE;
@@ -784,6 +1090,8 @@ affile_dd_new_instance(LogTemplate *filename_template, GlobalConfig *cfg)
 
   affile_dd_set_time_reap(&self->super.super, self->filename_is_a_template ? -1 : 0);
   g_static_mutex_init(&self->lock);
+  for (gint i = 0; i < AFFILE_DD_WRITER_SHARDS; i++)
+    g_static_mutex_init(&self->writer_shards[i].lock);
 
   affile_dest_drivers = g_list_append(affile_dest_drivers, self);
 
@@ -797,18 +1105,28 @@ affile_dd_new(LogTemplate *filename_template, GlobalConfig *cfg)
 
   self->writer_flags |= LW_SOFT_FLOW_CONTROL;
   self->writer_options.stats_source = stats_register_type("file");
-  self->file_opener = file_opener_for_regular_dest_files_new(&self->writer_options, &self->use_fsync);
+  self->file_opener = file_opener_for_regular_dest_files_new(&self->writer_options, &self->file_writer_options);
   return &self->super.super;
 }
 
+static gboolean affile_dd_global_initialized = FALSE;
+
+/* the hooks are dropped by app_shutdown(), they are registered again by the next init */
+static void
+affile_dd_global_deinit(gint hook_type, gpointer user_data)
+{
+  log_proto_file_writer_global_deinit();
+  affile_dd_global_initialized = FALSE;
+}
+
 void
 affile_dd_global_init(void)
 {
-  static gboolean initialized = FALSE;
-
-  if (!initialized)
+  if (!affile_dd_global_initialized)
     {
       register_application_hook(AH_REOPEN_FILES, affile_dd_register_reopen_hook, NULL, AHM_RUN_REPEAT);
-      initialized = TRUE;
+      log_proto_file_writer_global_init();
+      register_application_hook(AH_SHUTDOWN, affile_dd_global_deinit, NULL, AHM_RUN_ONCE);
+      affile_dd_global_initialized = TRUE;
     }
 }
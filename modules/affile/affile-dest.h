@@ -26,10 +26,19 @@
 
 #include "driver.h"
 #include "logwriter.h"
+#include "logproto-file-writer.h"
 #include "file-opener.h"
 
 typedef struct _AFFileDestWriter AFFileDestWriter;
 
+#define AFFILE_DD_WRITER_SHARDS 16
+
+typedef struct _AFFileDestWriterShard
+{
+  GStaticMutex lock;
+  GHashTable *writers;
+} AFFileDestWriterShard;
+
 typedef struct _AFFileDestDriver
 {
   LogDestDriver super;
@@ -38,13 +47,15 @@ typedef struct _AFFileDestDriver
   AFFileDestWriter *single_writer;
   gboolean filename_is_a_template;
   gboolean template_escape;
-  gboolean use_fsync;
+  LogProtoFileWriterOptions file_writer_options;
   FileOpenerOptions file_opener_options;
   FileOpener *file_opener;
   TimeZoneInfo *local_time_zone_info;
   LogWriterOptions writer_options;
   guint32 writer_flags;
-  GHashTable *writer_hash;
+  AFFileDestWriterShard writer_shards[AFFILE_DD_WRITER_SHARDS];
+  gint open_writers;
+  gint max_open_files;
 
   gint overwrite_if_older;
   gboolean use_time_recvd;
@@ -55,9 +66,14 @@ LogDriver *affile_dd_new(LogTemplate *filename_template, GlobalConfig *cfg);
 
 void affile_dd_set_create_dirs(LogDriver *s, gboolean create_dirs);
 void affile_dd_set_fsync(LogDriver *s, gboolean enable);
+void affile_dd_set_write_behind_size(LogDriver *s, gsize write_behind_size);
+void affile_dd_set_preallocate_size(LogDriver *s, gsize preallocate_size);
+void affile_dd_set_sync_bytes(LogDriver *s, gsize sync_bytes);
+void affile_dd_set_sync_interval(LogDriver *s, gint sync_interval);
 void affile_dd_set_overwrite_if_older(LogDriver *s, gint overwrite_if_older);
 void affile_dd_set_local_time_zone(LogDriver *s, const gchar *local_time_zone);
 void affile_dd_set_time_reap(LogDriver *s, gint time_reap);
+void affile_dd_set_max_open_files(LogDriver *s, gint max_open_files);
 void affile_dd_global_init(void);
 
 #endif
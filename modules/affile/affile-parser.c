@@ -45,6 +45,10 @@ static CfgLexerKeyword affile_keywords[] =
   { "force_directory_polling", KW_FORCE_DIRECTORY_POLLING, KWS_OBSOLETE, "Use wildcard-file(monitor-method())" },
 
   { "fsync",              KW_FSYNC },
+  { "write_behind_size",  KW_WRITE_BEHIND_SIZE },
+  { "preallocate_size",   KW_PREALLOCATE_SIZE },
+  { "sync_bytes",         KW_SYNC_BYTES },
+  { "sync_interval",      KW_SYNC_INTERVAL },
   { "remove_if_older",    KW_OVERWRITE_IF_OLDER, KWS_OBSOLETE, "overwrite_if_older" },
   { "overwrite_if_older", KW_OVERWRITE_IF_OLDER },
   { "follow_freq",        KW_FOLLOW_FREQ },
@@ -54,6 +58,7 @@ static CfgLexerKeyword affile_keywords[] =
   { "multi_line_suffix",  KW_MULTI_LINE_GARBAGE },
   { "multi_line_timeout", KW_MULTI_LINE_TIMEOUT },
   { "time_reap",          KW_TIME_REAP },
+  { "max_open_files",     KW_MAX_OPEN_FILES },
   { NULL }
 };
 
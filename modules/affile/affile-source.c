@@ -138,6 +138,7 @@ affile_sd_new_instance(gchar *filename, GlobalConfig *cfg)
   log_src_driver_init_instance(&self->super, cfg);
   self->super.super.super.init = affile_sd_init;
   self->super.super.super.queue = affile_sd_queue;
+  self->super.super.super.queue_batch = NULL;
   self->super.super.super.deinit = affile_sd_deinit;
   self->super.super.super.free_fn = affile_sd_free;
   self->super.super.super.generate_persist_name = affile_sd_format_persist_name;
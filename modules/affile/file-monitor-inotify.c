@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "file-monitor-inotify.h"
+#include "messages.h"
+
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#include <errno.h>
+#include <iv.h>
+
+#define FILE_MONITOR_INOTIFY_MASK (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+
+/* filesystems where inotify_add_watch() succeeds, but changes made by
+ * other hosts are never reported */
+static const glong remote_filesystem_magics[] =
+{
+  0x6969,       /* NFS */
+  0x517B,       /* SMB */
+  0xFF534D42,   /* CIFS */
+  0xFE534D42,   /* SMB2 */
+  0x73757245,   /* CODA */
+  0x5346414F,   /* AFS */
+  0x65735546,   /* FUSE */
+  0x00C36400,   /* CEPH */
+  0x01161970,   /* GFS2 */
+  0x7461636F,   /* OCFS2 */
+  0x01021997,   /* 9P */
+};
+
+struct _FileMonitorInotify
+{
+  gint wd;
+  FileMonitorInotifyCallback callback;
+  gpointer cookie;
+};
+
+typedef struct _FileMonitorInotifyDispatcher
+{
+  gint ref_cnt;
+  struct iv_fd inotify_fd;
+  /* wd -> GList of FileMonitorInotify, the kernel hands out the same wd
+   * when the same inode is watched more than once */
+  GHashTable *monitors;
+} FileMonitorInotifyDispatcher;
+
+static FileMonitorInotifyDispatcher dispatcher;
+
+static void
+_invoke_callbacks(GList *monitors, guint32 mask)
+{
+  for (GList *l = monitors; l; l = l->next)
+    {
+      FileMonitorInotify *monitor = (FileMonitorInotify *) l->data;
+
+      monitor->callback(monitor->cookie, mask);
+    }
+}
+
+static void
+_invoke_all_callbacks(gpointer key, gpointer value, gpointer user_data)
+{
+  _invoke_callbacks((GList *) value, GPOINTER_TO_UINT(user_data));
+}
+
+static void
+_dispatch_event(struct inotify_event *event)
+{
+  if (event->wd < 0)
+    {
+      /* IN_Q_OVERFLOW: events were lost, anything might have changed */
+      g_hash_table_foreach(dispatcher.monitors, _invoke_all_callbacks, GUINT_TO_POINTER(event->mask));
+      return;
+    }
+
+  GList *monitors = g_hash_table_lookup(dispatcher.monitors, GINT_TO_POINTER(event->wd));
+  if (!monitors)
+    return;
+
+  if (event->mask & IN_IGNORED)
+    {
+      for (GList *l = monitors; l; l = l->next)
+        ((FileMonitorInotify *) l->data)->wd = -1;
+      g_hash_table_steal(dispatcher.monitors, GINT_TO_POINTER(event->wd));
+    }
+
+  _invoke_callbacks(monitors, event->mask);
+
+  if (event->mask & IN_IGNORED)
+    g_list_free(monitors);
+}
+
+static void
+_handle_inotify_events(gpointer s)
+{
+  gchar buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  while (TRUE)
+    {
+      gssize len = read(dispatcher.inotify_fd.fd, buf, sizeof(buf));
+
+      if (len < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          if (errno != EAGAIN)
+            msg_error("file-monitor-inotify: error reading inotify events",
+                      evt_tag_error("error"));
+          return;
+        }
+      if (len == 0)
+        return;
+
+      for (gchar *p = buf; p < buf + len; )
+        {
+          struct inotify_event *event = (struct inotify_event *) p;
+
+          _dispatch_event(event);
+          p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+static gboolean
+_dispatcher_ref(void)
+{
+  if (dispatcher.ref_cnt++ > 0)
+    return TRUE;
+
+  gint fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    {
+      msg_error("file-monitor-inotify: could not create inotify object, falling back to follow-freq() polling",
+                evt_tag_error("error"));
+      dispatcher.ref_cnt--;
+      return FALSE;
+    }
+
+  IV_FD_INIT(&dispatcher.inotify_fd);
+  dispatcher.inotify_fd.fd = fd;
+  dispatcher.inotify_fd.handler_in = _handle_inotify_events;
+  iv_fd_register(&dispatcher.inotify_fd);
+
+  dispatcher.monitors = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) g_list_free);
+  return TRUE;
+}
+
+static void
+_dispatcher_unref(void)
+{
+  g_assert(dispatcher.ref_cnt > 0);
+
+  if (--dispatcher.ref_cnt > 0)
+    return;
+
+  iv_fd_unregister(&dispatcher.inotify_fd);
+  close(dispatcher.inotify_fd.fd);
+  g_hash_table_destroy(dispatcher.monitors);
+  dispatcher.monitors = NULL;
+}
+
+static void
+_replace_monitors_of_wd(gint wd, GList *monitors)
+{
+  g_hash_table_steal(dispatcher.monitors, GINT_TO_POINTER(wd));
+  if (monitors)
+    g_hash_table_insert(dispatcher.monitors, GINT_TO_POINTER(wd), monitors);
+}
+
+gboolean
+file_monitor_inotify_is_supported(gint fd)
+{
+  struct statfs sfs;
+
+  if (fstatfs(fd, &sfs) < 0)
+    return FALSE;
+
+  for (gsize i = 0; i < G_N_ELEMENTS(remote_filesystem_magics); i++)
+    {
+      if ((glong) sfs.f_type == remote_filesystem_magics[i])
+        return FALSE;
+    }
+  return TRUE;
+}
+
+FileMonitorInotify *
+file_monitor_inotify_new(gint fd, const gchar *filename, FileMonitorInotifyCallback callback, gpointer cookie)
+{
+  if (!file_monitor_inotify_is_supported(fd))
+    {
+      msg_debug("file-monitor-inotify: filesystem does not support inotify, using follow-freq() polling",
+                evt_tag_str("filename", filename));
+      return NULL;
+    }
+
+  if (!_dispatcher_ref())
+    return NULL;
+
+  /* watch the inode we have opened, not the one currently at filename */
+  gchar fd_path[64];
+  g_snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", fd);
+
+  gint wd = inotify_add_watch(dispatcher.inotify_fd.fd, fd_path, FILE_MONITOR_INOTIFY_MASK);
+  if (wd < 0)
+    {
+      msg_debug("file-monitor-inotify: unable to add inotify watch, using follow-freq() polling",
+                evt_tag_str("filename", filename),
+                evt_tag_error("error"));
+      _dispatcher_unref();
+      return NULL;
+    }
+
+  FileMonitorInotify *self = g_new0(FileMonitorInotify, 1);
+  self->wd = wd;
+  self->callback = callback;
+  self->cookie = cookie;
+
+  GList *monitors = g_hash_table_lookup(dispatcher.monitors, GINT_TO_POINTER(wd));
+  _replace_monitors_of_wd(wd, g_list_prepend(monitors, self));
+
+  msg_trace("file-monitor-inotify: watching file",
+            evt_tag_str("filename", filename),
+            evt_tag_int("wd", wd));
+  return self;
+}
+
+gboolean
+file_monitor_inotify_is_active(FileMonitorInotify *self)
+{
+  return self->wd >= 0;
+}
+
+void
+file_monitor_inotify_free(FileMonitorInotify *self)
+{
+  if (self->wd >= 0)
+    {
+      GList *monitors = g_hash_table_lookup(dispatcher.monitors, GINT_TO_POINTER(self->wd));
+
+      monitors = g_list_remove(monitors, self);
+      if (!monitors)
+        inotify_rm_watch(dispatcher.inotify_fd.fd, self->wd);
+      _replace_monitors_of_wd(self->wd, monitors);
+    }
+
+  _dispatcher_unref();
+  g_free(self);
+}
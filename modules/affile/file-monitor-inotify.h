@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef MODULES_AFFILE_FILE_MONITOR_INOTIFY_H_
+#define MODULES_AFFILE_FILE_MONITOR_INOTIFY_H_
+
+#include "syslog-ng.h"
+
+/*
+ * Change notification for an opened file.  All instances share a single
+ * inotify fd, registered in the main loop, the callback is invoked with the
+ * inotify event mask whenever the file is modified, moved or deleted.
+ *
+ * The callback must not free the FileMonitorInotify instance.
+ */
+typedef struct _FileMonitorInotify FileMonitorInotify;
+typedef void (*FileMonitorInotifyCallback)(gpointer cookie, guint32 mask);
+
+gboolean file_monitor_inotify_is_supported(gint fd);
+FileMonitorInotify *file_monitor_inotify_new(gint fd, const gchar *filename,
+                                             FileMonitorInotifyCallback callback, gpointer cookie);
+gboolean file_monitor_inotify_is_active(FileMonitorInotify *self);
+void file_monitor_inotify_free(FileMonitorInotify *self);
+
+#endif
@@ -216,6 +216,7 @@ file_opener_options_defaults(FileOpenerOptions *options)
   file_perm_options_defaults(&options->file_perm_options);
   options->create_dirs = -1;
   options->needs_privileges = FALSE;
+  options->use_io_uring = FALSE;
 }
 
 void
@@ -231,6 +232,7 @@ file_opener_options_init(FileOpenerOptions *options, GlobalConfig *cfg)
   file_perm_options_inherit_from(&options->file_perm_options, &cfg->file_perm_options);
   if (options->create_dirs == -1)
     options->create_dirs = cfg->create_dirs;
+  options->use_io_uring = cfg->use_io_uring;
 }
 
 void
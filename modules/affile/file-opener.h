@@ -45,6 +45,7 @@ typedef struct _FileOpenerOptions
   FilePermOptions file_perm_options;
   gboolean needs_privileges:1;
   gint create_dirs;
+  gboolean use_io_uring;
 } FileOpenerOptions;
 
 typedef enum
@@ -23,15 +23,20 @@
 
 #include "logproto-file-writer.h"
 #include "messages.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-histogram.h"
 
 #include <string.h>
 #include <errno.h>
 #include <sys/uio.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 typedef struct _LogProtoFileWriter
 {
   LogProtoClient super;
+  LogProtoFileWriterOptions file_options;
   guchar *partial;
   gsize partial_len, partial_pos;
   gint partial_messages;
@@ -39,22 +44,167 @@ typedef struct _LogProtoFileWriter
   gint buf_count;
   gint fd;
   gint sum_len;
-  gboolean fsync;
+
+  /* write-behind mode: messages are copied here and written with a single write() */
+  guchar *wb_buffer;
+  gsize wb_size, wb_len, wb_pos;
+
+  /* our idea of the file size and the end of the space reserved by fallocate() */
+  gboolean preallocate;
+  off_t file_size;
+  off_t reserved_until;
+
+  gsize unsynced_bytes;
+  gint64 last_sync;
   struct iovec buffer[0];
 } LogProtoFileWriter;
 
+static StatsHistogram *file_writer_sync_latency;
+
+void
+log_proto_file_writer_options_defaults(LogProtoFileWriterOptions *options)
+{
+  options->fsync = FALSE;
+  options->write_behind_size = 0;
+  options->preallocate_size = 0;
+  options->sync_bytes = 0;
+  options->sync_interval = 0;
+}
+
+static inline gboolean
+log_proto_file_writer_has_sync_policy(LogProtoFileWriter *self)
+{
+  return self->file_options.sync_bytes > 0 || self->file_options.sync_interval > 0;
+}
+
+static void
+log_proto_file_writer_sync(LogProtoFileWriter *self, gboolean data_only)
+{
+  gint64 start = g_get_monotonic_time();
+  gint rc;
+
+#ifdef SYSLOG_NG_HAVE_FDATASYNC
+  rc = data_only ? fdatasync(self->fd) : fsync(self->fd);
+#else
+  rc = fsync(self->fd);
+#endif
+
+  self->last_sync = g_get_monotonic_time();
+  stats_histogram_record(file_writer_sync_latency, self->last_sync - start);
+  self->unsynced_bytes = 0;
+
+  if (rc < 0)
+    msg_error("Error syncing file to disk",
+              evt_tag_int("fd", self->fd),
+              evt_tag_error(EVT_TAG_OSERROR));
+}
+
+/* make sure that the next @len bytes fall into space reserved by fallocate() */
+static void
+log_proto_file_writer_reserve_space(LogProtoFileWriter *self, gsize len)
+{
+#if defined(SYSLOG_NG_HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+  if (!self->preallocate || self->file_size + (off_t) len <= self->reserved_until)
+    return;
+
+  off_t chunk = MAX((off_t) self->file_options.preallocate_size, (off_t) len);
+
+  /* KEEP_SIZE leaves st_size alone, so O_APPEND writes still land right
+   * after the real data.  The reserved tail is not released on close:
+   * anything cutting or punching it would race with other appenders of
+   * the same file (another destination, copytruncate), it is reused when
+   * the file is reopened and freed once the file is rotated or removed. */
+  if (fallocate(self->fd, FALLOC_FL_KEEP_SIZE, self->file_size, chunk) < 0)
+    {
+      msg_debug("Preallocating file space failed, disabling preallocation for this file",
+                evt_tag_int("fd", self->fd),
+                evt_tag_error(EVT_TAG_OSERROR));
+      self->preallocate = FALSE;
+      return;
+    }
+  self->reserved_until = self->file_size + chunk;
+#endif
+}
+
+static void
+log_proto_file_writer_written(LogProtoFileWriter *self, gsize len)
+{
+  self->file_size += len;
+  self->unsynced_bytes += len;
+
+  if (!log_proto_file_writer_has_sync_policy(self))
+    {
+      if (self->file_options.fsync)
+        log_proto_file_writer_sync(self, FALSE);
+    }
+  else if (self->file_options.sync_bytes > 0 && self->unsynced_bytes >= self->file_options.sync_bytes)
+    {
+      log_proto_file_writer_sync(self, TRUE);
+    }
+}
+
+static void
+log_proto_file_writer_sync_if_due(LogProtoFileWriter *self)
+{
+  if (self->file_options.sync_interval <= 0 || self->unsynced_bytes == 0)
+    return;
+
+  if (g_get_monotonic_time() - self->last_sync >= self->file_options.sync_interval * G_TIME_SPAN_MILLISECOND)
+    log_proto_file_writer_sync(self, TRUE);
+}
+
+static LogProtoStatus
+log_proto_file_writer_write_error(LogProtoFileWriter *self)
+{
+  if (errno != EINTR && errno != EAGAIN)
+    {
+      log_proto_client_msg_rewind(&self->super);
+      msg_error("I/O error occurred while writing",
+                evt_tag_int("fd", self->super.transport->fd),
+                evt_tag_error(EVT_TAG_OSERROR));
+      return LPS_ERROR;
+    }
+
+  return LPS_SUCCESS;
+}
+
 /*
- * log_proto_file_writer_flush:
- *
- * this function flushes the file output buffer
- * it is called either form log_proto_file_writer_post (normal mode: the buffer is full)
- * or from log_proto_flush (foced flush: flush time, exit, etc)
- *
+ * Write-behind mode: the buffered messages are written with a single
+ * write() call and acknowledged together once all of it made it to the
+ * file.  A partial write leaves the rest in place, just like the partial
+ * buffer of the writev() based path.
  */
 static LogProtoStatus
-log_proto_file_writer_flush(LogProtoClient *s)
+log_proto_file_writer_flush_write_behind(LogProtoFileWriter *self)
+{
+  if (self->wb_len == 0)
+    return LPS_SUCCESS;
+
+  gsize len = self->wb_len - self->wb_pos;
+
+  log_proto_file_writer_reserve_space(self, len);
+  gssize rc = log_transport_write(self->super.transport, self->wb_buffer + self->wb_pos, len);
+  if (rc < 0)
+    return log_proto_file_writer_write_error(self);
+
+  if (rc > 0)
+    log_proto_file_writer_written(self, rc);
+  if ((gsize) rc != len)
+    {
+      self->wb_pos += rc;
+      return LPS_PARTIAL;
+    }
+
+  log_proto_client_msg_ack(&self->super, self->buf_count);
+  self->buf_count = 0;
+  self->wb_len = 0;
+  self->wb_pos = 0;
+  return LPS_SUCCESS;
+}
+
+static LogProtoStatus
+log_proto_file_writer_flush_buffers(LogProtoFileWriter *self)
 {
-  LogProtoFileWriter *self = (LogProtoFileWriter *)s;
   gint rc, i, i0, sum, ofs, pos;
 
   if (self->partial)
@@ -62,9 +212,10 @@ log_proto_file_writer_flush(LogProtoClient *s)
       /* there is still some data from the previous file writing process */
       gint len = self->partial_len - self->partial_pos;
 
+      log_proto_file_writer_reserve_space(self, len);
       rc = log_transport_write(self->super.transport, self->partial + self->partial_pos, len);
-      if (rc > 0 && self->fsync)
-        fsync(self->fd);
+      if (rc > 0)
+        log_proto_file_writer_written(self, rc);
       if (rc < 0)
         {
           goto write_error;
@@ -86,9 +237,10 @@ log_proto_file_writer_flush(LogProtoClient *s)
   if (self->buf_count == 0)
     return LPS_SUCCESS;
 
+  log_proto_file_writer_reserve_space(self, self->sum_len);
   rc = log_transport_writev(self->super.transport, self->buffer, self->buf_count);
-  if (rc > 0 && self->fsync)
-    fsync(self->fd);
+  if (rc > 0)
+    log_proto_file_writer_written(self, rc);
 
   if (rc < 0)
     {
@@ -137,17 +289,64 @@ log_proto_file_writer_flush(LogProtoClient *s)
   return LPS_SUCCESS;
 
 write_error:
-  if (errno != EINTR && errno != EAGAIN)
+  return log_proto_file_writer_write_error(self);
+}
+
+/*
+ * log_proto_file_writer_flush:
+ *
+ * this function flushes the file output buffer
+ * it is called either form log_proto_file_writer_post (normal mode: the buffer is full)
+ * or from log_proto_flush (foced flush: flush time, exit, etc)
+ *
+ */
+static LogProtoStatus
+log_proto_file_writer_flush(LogProtoClient *s)
+{
+  LogProtoFileWriter *self = (LogProtoFileWriter *)s;
+  LogProtoStatus result;
+
+  if (self->wb_buffer)
+    result = log_proto_file_writer_flush_write_behind(self);
+  else
+    result = log_proto_file_writer_flush_buffers(self);
+
+  if (result != LPS_ERROR)
+    log_proto_file_writer_sync_if_due(self);
+  return result;
+}
+
+static LogProtoStatus
+log_proto_file_writer_post_write_behind(LogProtoFileWriter *self, guchar *msg, gsize msg_len, gboolean *consumed)
+{
+  LogProtoStatus result;
+
+  *consumed = FALSE;
+  if (self->wb_pos > 0 || (self->wb_len > 0 && self->wb_len + msg_len > self->wb_size))
     {
-      log_proto_client_msg_rewind(&self->super);
-      msg_error("I/O error occurred while writing",
-                evt_tag_int("fd", self->super.transport->fd),
-                evt_tag_error(EVT_TAG_OSERROR));
-      return LPS_ERROR;
+      result = log_proto_file_writer_flush_write_behind(self);
+      if (result != LPS_SUCCESS || self->wb_len > 0)
+        return result;
     }
 
-  return LPS_SUCCESS;
+  if (msg_len > self->wb_size)
+    {
+      /* a single message larger than the budget, grow the buffer for it */
+      self->wb_size = msg_len;
+      self->wb_buffer = g_realloc(self->wb_buffer, self->wb_size);
+    }
+
+  memcpy(self->wb_buffer + self->wb_len, msg, msg_len);
+  self->wb_len += msg_len;
+  ++self->buf_count;
+  g_free(msg);
 
+  *consumed = TRUE;
+
+  if (self->wb_len == self->wb_size)
+    return log_proto_file_writer_flush_write_behind(self);
+
+  return LPS_SUCCESS;
 }
 
 /*
@@ -167,6 +366,9 @@ log_proto_file_writer_post(LogProtoClient *s, LogMessage *logmsg, guchar *msg, g
   LogProtoFileWriter *self = (LogProtoFileWriter *)s;
   LogProtoStatus result;
 
+  if (self->wb_buffer)
+    return log_proto_file_writer_post_write_behind(self, msg, msg_len, consumed);
+
   *consumed = FALSE;
   if (self->buf_count >= self->buf_size || self->partial)
     {
@@ -209,7 +411,7 @@ log_proto_file_writer_prepare(LogProtoClient *s, gint *fd, GIOCondition *cond, g
   /* if there's no pending I/O in the transport layer, then we want to do a write */
   if (*cond == 0)
     *cond = G_IO_OUT;
-  const gboolean pending_write = self->buf_count > 0 || self->partial;
+  const gboolean pending_write = self->buf_count > 0 || self->partial || self->wb_len > 0;
 
   if (!pending_write && s->options->timeout > 0)
     *timeout = s->options->timeout;
@@ -217,8 +419,46 @@ log_proto_file_writer_prepare(LogProtoClient *s, gint *fd, GIOCondition *cond, g
   return pending_write;
 }
 
+static void
+log_proto_file_writer_free(LogProtoClient *s)
+{
+  LogProtoFileWriter *self = (LogProtoFileWriter *) s;
+
+  if (self->unsynced_bytes > 0 && log_proto_file_writer_has_sync_policy(self))
+    log_proto_file_writer_sync(self, TRUE);
+
+  /* whatever is still buffered has not been acknowledged and is going to be resent */
+  if (!self->wb_buffer)
+    {
+      for (gint i = 0; i < self->buf_count; ++i)
+        g_free(self->buffer[i].iov_base);
+    }
+  g_free(self->wb_buffer);
+  g_free(self->partial);
+  log_proto_client_free_method(s);
+}
+
+static void
+log_proto_file_writer_init_preallocation(LogProtoFileWriter *self)
+{
+#if defined(SYSLOG_NG_HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+  struct stat st;
+
+  if (self->file_options.preallocate_size == 0)
+    return;
+
+  if (fstat(self->fd, &st) < 0 || !S_ISREG(st.st_mode))
+    return;
+
+  self->preallocate = TRUE;
+  self->file_size = st.st_size;
+  self->reserved_until = st.st_size;
+#endif
+}
+
 LogProtoClient *
-log_proto_file_writer_new(LogTransport *transport, const LogProtoClientOptions *options, gint flush_lines, gint fsync_)
+log_proto_file_writer_new_with_options(LogTransport *transport, const LogProtoClientOptions *options,
+                                       gint flush_lines, const LogProtoFileWriterOptions *file_writer_options)
 {
   if (flush_lines == 0)
     /* the flush-lines option has not been specified, use a default value */
@@ -236,9 +476,49 @@ log_proto_file_writer_new(LogTransport *transport, const LogProtoClientOptions *
   log_proto_client_init(&self->super, transport, options);
   self->fd = transport->fd;
   self->buf_size = flush_lines;
-  self->fsync = fsync_;
+  self->file_options = *file_writer_options;
+  if (self->file_options.write_behind_size > 0)
+    {
+      self->wb_size = self->file_options.write_behind_size;
+      self->wb_buffer = g_malloc(self->wb_size);
+    }
+  self->last_sync = g_get_monotonic_time();
+  log_proto_file_writer_init_preallocation(self);
   self->super.prepare = log_proto_file_writer_prepare;
   self->super.post = log_proto_file_writer_post;
   self->super.flush = log_proto_file_writer_flush;
+  self->super.free_fn = log_proto_file_writer_free;
   return &self->super;
 }
+
+LogProtoClient *
+log_proto_file_writer_new(LogTransport *transport, const LogProtoClientOptions *options, gint flush_lines, gint fsync_)
+{
+  LogProtoFileWriterOptions file_writer_options;
+
+  log_proto_file_writer_options_defaults(&file_writer_options);
+  file_writer_options.fsync = fsync_;
+  return log_proto_file_writer_new_with_options(transport, options, flush_lines, &file_writer_options);
+}
+
+void
+log_proto_file_writer_global_init(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_histogram_key_set(&sc_key, SCS_GLOBAL, "file_writer", NULL, "sync_usec");
+  stats_register_histogram(0, &sc_key, &file_writer_sync_latency);
+  stats_unlock();
+}
+
+void
+log_proto_file_writer_global_deinit(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_histogram_key_set(&sc_key, SCS_GLOBAL, "file_writer", NULL, "sync_usec");
+  stats_unregister_histogram(&sc_key, &file_writer_sync_latency);
+  stats_unlock();
+}
@@ -26,7 +26,28 @@
 
 #include "logproto/logproto-client.h"
 
+typedef struct _LogProtoFileWriterOptions
+{
+  gboolean fsync;
+  /* accumulate up to this many bytes before calling write(), 0 disables */
+  gsize write_behind_size;
+  /* reserve disk space with fallocate() in chunks of this size, 0 disables */
+  gsize preallocate_size;
+  /* fdatasync() once this many bytes were written since the last sync */
+  gsize sync_bytes;
+  /* fdatasync() if this many milliseconds elapsed since the last sync */
+  gint sync_interval;
+} LogProtoFileWriterOptions;
+
+void log_proto_file_writer_options_defaults(LogProtoFileWriterOptions *options);
+
 LogProtoClient *log_proto_file_writer_new(LogTransport *transport, const LogProtoClientOptions *options,
                                           gint flush_lines, gboolean fsync);
+LogProtoClient *log_proto_file_writer_new_with_options(LogTransport *transport, const LogProtoClientOptions *options,
+                                                       gint flush_lines,
+                                                       const LogProtoFileWriterOptions *file_writer_options);
+
+void log_proto_file_writer_global_init(void);
+void log_proto_file_writer_global_deinit(void);
 
 #endif
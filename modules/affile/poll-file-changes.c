@@ -37,6 +37,10 @@
 #include <iv.h>
 #include <iv_work.h>
 
+#if SYSLOG_NG_HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
 
 static inline void
 poll_file_changes_on_read(PollFileChanges *self)
@@ -74,6 +78,7 @@ poll_file_changes_check_file(gpointer s)
   off_t pos = -1;
   gint fd = self->fd;
 
+  self->file_changed = FALSE;
   msg_trace("Checking if the followed file has new lines",
             evt_tag_str("follow_filename", self->follow_filename));
   if (fd >= 0)
@@ -160,8 +165,81 @@ poll_file_changes_stop_watches(PollEvents *s)
 
   if (iv_timer_registered(&self->follow_timer))
     iv_timer_unregister(&self->follow_timer);
+  if (iv_task_registered(&self->check_task))
+    iv_task_unregister(&self->check_task);
+  self->watching = FALSE;
+}
+
+static gboolean
+poll_file_changes_is_file_monitor_usable(PollFileChanges *self)
+{
+#if SYSLOG_NG_HAVE_INOTIFY
+  return self->file_monitor && file_monitor_inotify_is_active(self->file_monitor) && !self->file_replaced;
+#else
+  return FALSE;
+#endif
+}
+
+static void
+poll_file_changes_schedule_check(PollFileChanges *self)
+{
+  if (!iv_task_registered(&self->check_task))
+    iv_task_register(&self->check_task);
+}
+
+#if SYSLOG_NG_HAVE_INOTIFY
+
+static gboolean
+_is_file_unlinked(PollFileChanges *self)
+{
+  struct stat st;
+
+  return fstat(self->fd, &st) == 0 && st.st_nlink == 0;
+}
+
+/* runs whenever the inode changes, even while the reader is busy reading
+ * it: only remember the change unless we are waiting for one */
+static void
+poll_file_changes_on_file_monitor_event(gpointer s, guint32 mask)
+{
+  PollFileChanges *self = (PollFileChanges *) s;
+
+  /* once the file is moved away or removed, the name has to be polled
+   * anyway until a new file shows up, the reader is reopened then */
+  if ((mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) ||
+      ((mask & IN_ATTRIB) && _is_file_unlinked(self)))
+    {
+      msg_trace("poll-file-changes: followed file moved or deleted, polling its name",
+                evt_tag_str("follow_filename", self->follow_filename));
+      self->file_replaced = TRUE;
+    }
+
+  self->file_changed = TRUE;
+
+  if (self->watching)
+    poll_file_changes_schedule_check(self);
+}
+
+static void
+poll_file_changes_start_file_monitor(PollFileChanges *self)
+{
+  if (self->fd < 0)
+    return;
+
+  self->file_monitor = file_monitor_inotify_new(self->fd, self->follow_filename,
+                                                poll_file_changes_on_file_monitor_event, self);
+}
+
+static void
+poll_file_changes_stop_file_monitor(PollFileChanges *self)
+{
+  if (self->file_monitor)
+    file_monitor_inotify_free(self->file_monitor);
+  self->file_monitor = NULL;
 }
 
+#endif
+
 static void
 poll_file_changes_rearm_timer(PollFileChanges *self)
 {
@@ -197,21 +275,36 @@ poll_file_changes_update_watches(PollEvents *s, GIOCondition cond)
 {
   PollFileChanges *self = (PollFileChanges *) s;
   gboolean check_again = TRUE;
+  gboolean end_of_file;
 
   /* we can only provide input events */
   g_assert((cond & ~G_IO_IN) == 0);
 
   poll_file_changes_stop_watches(s);
 
-  if (poll_file_changes_check_eof(self))
+  end_of_file = poll_file_changes_check_eof(self);
+  if (end_of_file)
     {
       msg_trace("End of file, following file",
                 evt_tag_str("follow_filename", self->follow_filename));
       check_again = poll_file_changes_on_eof(self);
     }
 
-  if (check_again)
-    poll_file_changes_rearm_timer(self);
+  if (!check_again)
+    return;
+
+  self->watching = TRUE;
+  if (poll_file_changes_is_file_monitor_usable(self))
+    {
+      if (!end_of_file || self->file_changed)
+        poll_file_changes_schedule_check(self);
+
+      /* on_eof() implementations (multi-line-timeout) rely on periodic checks */
+      if (!self->on_eof)
+        return;
+    }
+
+  poll_file_changes_rearm_timer(self);
 }
 
 void
@@ -219,6 +312,9 @@ poll_file_changes_free(PollEvents *s)
 {
   PollFileChanges *self = (PollFileChanges *) s;
 
+#if SYSLOG_NG_HAVE_INOTIFY
+  poll_file_changes_stop_file_monitor(self);
+#endif
   log_pipe_unref(self->control);
   g_free(self->follow_filename);
 }
@@ -239,6 +335,16 @@ poll_file_changes_init_instance(PollFileChanges *self, gint fd, const gchar *fol
   IV_TIMER_INIT(&self->follow_timer);
   self->follow_timer.cookie = self;
   self->follow_timer.handler = poll_file_changes_check_file;
+
+  IV_TASK_INIT(&self->check_task);
+  self->check_task.cookie = self;
+  self->check_task.handler = poll_file_changes_check_file;
+
+  /* make sure content written before the watch was added gets noticed */
+  self->file_changed = TRUE;
+#if SYSLOG_NG_HAVE_INOTIFY
+  poll_file_changes_start_file_monitor(self);
+#endif
 }
 
 PollEvents *
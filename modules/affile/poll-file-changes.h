@@ -25,6 +25,7 @@
 
 #include "poll-events.h"
 #include "logpipe.h"
+#include "file-monitor-inotify.h"
 
 #include <iv.h>
 
@@ -39,6 +40,14 @@ struct _PollFileChanges
   struct iv_timer follow_timer;
   LogPipe *control;
 
+  /* when available, changes are reported by inotify and follow_freq is
+   * only used to notice a file being recreated after rotation */
+  FileMonitorInotify *file_monitor;
+  struct iv_task check_task;
+  gboolean watching;
+  gboolean file_changed;
+  gboolean file_replaced;
+
   void (*on_read)(PollFileChanges *);
   gboolean (*on_eof)(PollFileChanges *);
   void (*on_file_moved)(PollFileChanges *);
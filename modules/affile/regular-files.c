@@ -22,6 +22,7 @@
  */
 #include "file-specializations.h"
 #include "transport/transport-file.h"
+#include "transport/transport-uring.h"
 #include "logproto-file-writer.h"
 #include "messages.h"
 #include "ack-tracker/ack_tracker_factory.h"
@@ -52,6 +53,9 @@ _prepare_open(FileOpener *self, const gchar *name)
 static LogTransport *
 _construct_src_transport(FileOpener *self, gint fd)
 {
+  if (self->options->use_io_uring)
+    return log_transport_uring_new(fd, LTU_IGNORE_EOF);
+
   LogTransport *transport = log_transport_file_new(fd);
 
   transport->read = log_transport_file_read_and_ignore_eof_method;
@@ -81,27 +85,47 @@ typedef struct _FileOpenerRegularDestFiles
 {
   FileOpener super;
   const LogWriterOptions *writer_options;
-  gboolean *use_fsync;
+  const LogProtoFileWriterOptions *file_writer_options;
 } FileOpenerRegularDestFiles;
 
 static LogProtoClient *
 _construct_dst_proto(FileOpener *s, LogTransport *transport, LogProtoClientOptions *proto_options)
 {
   FileOpenerRegularDestFiles *self = (FileOpenerRegularDestFiles *) s;
+  LogProtoFileWriterOptions file_writer_options = *self->file_writer_options;
+
+  /* the sync is already linked to each write by the transport */
+  if (log_transport_uring_syncs_writes(transport))
+    file_writer_options.fsync = FALSE;
+
+  return log_proto_file_writer_new_with_options(transport, proto_options,
+                                                self->writer_options->flush_lines,
+                                                &file_writer_options);
+}
 
-  return log_proto_file_writer_new(transport, proto_options,
-                                   self->writer_options->flush_lines,
-                                   *self->use_fsync);
+static gboolean
+_sync_after_each_write(const LogProtoFileWriterOptions *options)
+{
+  return options->fsync && options->sync_bytes == 0 && options->sync_interval == 0;
 }
 
 static LogTransport *
 _construct_transport(FileOpener *s, gint fd)
 {
+  FileOpenerRegularDestFiles *self = (FileOpenerRegularDestFiles *) s;
+
+  if (s->options->use_io_uring)
+    {
+      guint32 flags = _sync_after_each_write(self->file_writer_options) ? LTU_SYNC_AFTER_WRITE : 0;
+      return log_transport_uring_new(fd, flags);
+    }
+
   return log_transport_file_new(fd);
 }
 
 FileOpener *
-file_opener_for_regular_dest_files_new(const LogWriterOptions *writer_options, gboolean *use_fsync)
+file_opener_for_regular_dest_files_new(const LogWriterOptions *writer_options,
+                                       const LogProtoFileWriterOptions *file_writer_options)
 {
   FileOpenerRegularDestFiles *self = g_new0(FileOpenerRegularDestFiles, 1);
 
@@ -109,6 +133,6 @@ file_opener_for_regular_dest_files_new(const LogWriterOptions *writer_options, g
   self->super.construct_transport = _construct_transport;
   self->super.construct_dst_proto = _construct_dst_proto;
   self->writer_options = writer_options;
-  self->use_fsync = use_fsync;
+  self->file_writer_options = file_writer_options;
   return &self->super;
 }
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "affile-dest.c"
+#include "apphook.h"
+#include "plugin.h"
+#include "libtest/persist_lib.h"
+
+#include <criterion/criterion.h>
+#include <glib/gstdio.h>
+
+MainLoop *main_loop;
+MainLoopOptions main_loop_options = {0};
+GlobalConfig *cfg;
+gchar *test_dir;
+
+static AFFileDestDriver *
+_create_driver(gint max_open_files)
+{
+  LogTemplate *filename_template = log_template_new(cfg, NULL);
+  gchar *filename = g_strdup_printf("%s/${HOST}.log", test_dir);
+
+  cr_assert(log_template_compile(filename_template, filename, NULL));
+  g_free(filename);
+
+  AFFileDestDriver *self = (AFFileDestDriver *) affile_dd_new(filename_template, cfg);
+
+  self->super.super.id = g_strdup("d_file");
+  affile_dd_set_max_open_files(&self->super.super, max_open_files);
+  cr_assert(log_pipe_init(&self->super.super.super));
+  return self;
+}
+
+static void
+_free_driver(AFFileDestDriver *self)
+{
+  log_pipe_deinit(&self->super.super.super);
+  log_pipe_unref(&self->super.super.super);
+}
+
+static void
+_send_message(AFFileDestDriver *self, const gchar *host)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value(msg, LM_V_HOST, host, -1);
+  log_pipe_queue(&self->super.super.super, msg, &path_options);
+}
+
+static AFFileDestWriter *
+_find_writer(AFFileDestDriver *self, const gchar *host)
+{
+  gchar *filename = g_strdup_printf("%s/%s.log", test_dir, host);
+  AFFileDestWriterShard *shard = affile_dd_get_shard(self, g_str_hash(filename));
+  AFFileDestWriter *dw = g_hash_table_lookup(shard->writers, filename);
+
+  g_free(filename);
+  return dw;
+}
+
+/* takes the queued messages, as if they were written, so that the writer becomes idle */
+static void
+_drain_writer(AFFileDestWriter *dw)
+{
+  LogQueue *queue = log_writer_get_queue(dw->writer);
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+
+  while ((msg = log_queue_pop_head_ignore_throttle(queue, &path_options)))
+    {
+      log_queue_ack_backlog(queue, 1);
+      log_msg_unref(msg);
+    }
+  log_queue_unref(queue);
+}
+
+static void
+_send_and_drain(AFFileDestDriver *self, const gchar *host, time_t last_msg_stamp)
+{
+  _send_message(self, host);
+
+  AFFileDestWriter *dw = _find_writer(self, host);
+  cr_assert_not_null(dw);
+  _drain_writer(dw);
+  dw->last_msg_stamp = last_msg_stamp;
+}
+
+/* a source thread, which keeps the writers it used cached until its batch is finished */
+typedef struct _TestWorker
+{
+  GThread *thread;
+  AFFileDestDriver *driver;
+  const gchar *host;
+  GMutex lock;
+  GCond cond;
+  gboolean queued, finish_batch;
+} TestWorker;
+
+static gpointer
+_test_worker_thread(gpointer user_data)
+{
+  TestWorker *self = (TestWorker *) user_data;
+
+  main_loop_worker_thread_start(NULL);
+  _send_message(self->driver, self->host);
+
+  g_mutex_lock(&self->lock);
+  self->queued = TRUE;
+  g_cond_signal(&self->cond);
+  while (!self->finish_batch)
+    g_cond_wait(&self->cond, &self->lock);
+  g_mutex_unlock(&self->lock);
+
+  main_loop_worker_invoke_batch_callbacks();
+  main_loop_worker_thread_stop();
+  return NULL;
+}
+
+static void
+_test_worker_start_batch(TestWorker *self, AFFileDestDriver *driver, const gchar *host)
+{
+  g_mutex_init(&self->lock);
+  g_cond_init(&self->cond);
+  self->driver = driver;
+  self->host = host;
+  self->queued = self->finish_batch = FALSE;
+  self->thread = g_thread_new("test-worker", _test_worker_thread, self);
+
+  g_mutex_lock(&self->lock);
+  while (!self->queued)
+    g_cond_wait(&self->cond, &self->lock);
+  g_mutex_unlock(&self->lock);
+}
+
+static void
+_test_worker_finish_batch(TestWorker *self)
+{
+  g_mutex_lock(&self->lock);
+  self->finish_batch = TRUE;
+  g_cond_signal(&self->cond);
+  g_mutex_unlock(&self->lock);
+
+  g_thread_join(self->thread);
+  g_mutex_clear(&self->lock);
+  g_cond_clear(&self->cond);
+}
+
+Test(affile_dest_writers, writers_cached_by_a_source_thread_are_not_reaped)
+{
+  AFFileDestDriver *driver = _create_driver(0);
+  TestWorker worker;
+
+  _send_and_drain(driver, "alpha", 0);
+  AFFileDestWriter *dw = _find_writer(driver, "alpha");
+
+  _test_worker_start_batch(&worker, driver, "alpha");
+  cr_assert_eq(g_atomic_int_get(&dw->queue_pending), 1, "the writer is pinned by the cache of the source thread");
+
+  /* the source thread is still in its batch, even if the writer was drained meanwhile */
+  _drain_writer(dw);
+  log_pipe_notify(&dw->super, NC_CLOSE, NULL);
+  cr_assert_eq(_find_writer(driver, "alpha"), dw);
+  cr_assert_eq(driver->open_writers, 1);
+
+  _test_worker_finish_batch(&worker);
+  cr_assert_eq(g_atomic_int_get(&dw->queue_pending), 0, "the pin is dropped at the end of the batch");
+
+  _drain_writer(dw);
+  log_pipe_notify(&dw->super, NC_CLOSE, NULL);
+  cr_assert_null(_find_writer(driver, "alpha"));
+  cr_assert_eq(driver->open_writers, 0);
+
+  _free_driver(driver);
+}
+
+Test(affile_dest_writers, least_recently_used_writers_are_closed_at_max_open_files)
+{
+  AFFileDestDriver *driver = _create_driver(3);
+
+  _send_and_drain(driver, "alpha", 100);
+  _send_and_drain(driver, "beta", 300);
+  _send_and_drain(driver, "gamma", 200);
+  cr_assert_eq(driver->open_writers, 3);
+
+  _send_message(driver, "delta");
+
+  cr_assert_eq(driver->open_writers, 3);
+  cr_assert_null(_find_writer(driver, "alpha"), "the least recently used writer is closed");
+  cr_assert_not_null(_find_writer(driver, "beta"));
+  cr_assert_not_null(_find_writer(driver, "gamma"));
+  cr_assert_not_null(_find_writer(driver, "delta"));
+
+  _free_driver(driver);
+}
+
+Test(affile_dest_writers, max_open_files_is_exceeded_temporarily_without_idle_writers)
+{
+  AFFileDestDriver *driver = _create_driver(2);
+
+  /* the messages stay in the queues, so none of the writers is idle */
+  _send_message(driver, "alpha");
+  _send_message(driver, "beta");
+  _send_message(driver, "gamma");
+
+  cr_assert_eq(driver->open_writers, 3);
+  cr_assert_not_null(_find_writer(driver, "alpha"));
+  cr_assert_not_null(_find_writer(driver, "beta"));
+  cr_assert_not_null(_find_writer(driver, "gamma"));
+
+  /* once they become idle, the next new file brings it back below the limit */
+  _drain_writer(_find_writer(driver, "alpha"));
+  _drain_writer(_find_writer(driver, "beta"));
+  _drain_writer(_find_writer(driver, "gamma"));
+  _find_writer(driver, "alpha")->last_msg_stamp = 100;
+  _find_writer(driver, "beta")->last_msg_stamp = 200;
+  _find_writer(driver, "gamma")->last_msg_stamp = 300;
+
+  _send_message(driver, "delta");
+
+  cr_assert_eq(driver->open_writers, 2);
+  cr_assert_null(_find_writer(driver, "alpha"));
+  cr_assert_null(_find_writer(driver, "beta"));
+  cr_assert_not_null(_find_writer(driver, "gamma"));
+  cr_assert_not_null(_find_writer(driver, "delta"));
+
+  _free_driver(driver);
+}
+
+Test(affile_dest_writers, persisted_writers_are_moved_back_into_shards_on_reload)
+{
+  const gchar *hosts[] = { "alpha", "beta", "gamma", "delta", "epsilon", "zeta" };
+  AFFileDestWriter *writers[G_N_ELEMENTS(hosts)];
+  AFFileDestDriver *driver = _create_driver(0);
+
+  for (gint i = 0; i < G_N_ELEMENTS(hosts); i++)
+    {
+      _send_and_drain(driver, hosts[i], 0);
+      writers[i] = _find_writer(driver, hosts[i]);
+    }
+
+  _free_driver(driver);
+  driver = _create_driver(0);
+
+  cr_assert_eq(driver->open_writers, G_N_ELEMENTS(hosts));
+  for (gint i = 0; i < G_N_ELEMENTS(hosts); i++)
+    {
+      cr_assert_eq(_find_writer(driver, hosts[i]), writers[i], "writer of %s is not in its shard", hosts[i]);
+      cr_assert_eq(writers[i]->owner, driver);
+      cr_assert(writers[i]->super.flags & PIF_INITIALIZED);
+    }
+
+  _free_driver(driver);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+
+  main_loop = main_loop_get_instance();
+  main_loop_init(main_loop, &main_loop_options);
+
+  cfg = cfg_new_snippet();
+  cr_assert(cfg_load_module(cfg, "affile"));
+  cfg->state = clean_and_create_persist_state_for_test("test_affile_dest_writers.persist");
+  cfg->persist = persist_config_new();
+
+  test_dir = g_dir_make_tmp("test_affile_dest_writers_XXXXXX", NULL);
+  cr_assert_not_null(test_dir);
+}
+
+static void
+_remove_test_dir(void)
+{
+  GDir *dir = g_dir_open(test_dir, 0, NULL);
+  const gchar *name;
+
+  while ((name = g_dir_read_name(dir)))
+    {
+      gchar *path = g_build_filename(test_dir, name, NULL);
+
+      g_unlink(path);
+      g_free(path);
+    }
+  g_dir_close(dir);
+  g_rmdir(test_dir);
+  g_free(test_dir);
+}
+
+static void
+teardown(void)
+{
+  persist_config_free(cfg->persist);
+  cfg->persist = NULL;
+  cancel_and_destroy_persist_state(cfg->state);
+  cfg->state = NULL;
+  cfg_free(cfg);
+  _remove_test_dir();
+  main_loop_deinit(main_loop);
+  app_shutdown();
+}
+
+TestSuite(affile_dest_writers, .init = setup, .fini = teardown);
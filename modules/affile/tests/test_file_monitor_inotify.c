@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "file-monitor-inotify.h"
+#include "apphook.h"
+#include "timeutils/misc.h"
+
+#include <criterion/criterion.h>
+#include <glib/gstdio.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iv.h>
+
+typedef struct _TestMonitorEvents
+{
+  guint32 mask;
+  gint count;
+} TestMonitorEvents;
+
+static void
+_record_event(gpointer cookie, guint32 mask)
+{
+  TestMonitorEvents *events = (TestMonitorEvents *) cookie;
+
+  events->mask |= mask;
+  events->count++;
+  iv_quit();
+}
+
+static void
+_stop_timer_expired(gpointer user_data)
+{
+  iv_quit();
+}
+
+static void
+_run_main_loop_until_event(void)
+{
+  struct iv_timer stop_timer;
+
+  IV_TIMER_INIT(&stop_timer);
+  iv_validate_now();
+  stop_timer.expires = iv_now;
+  timespec_add_msec(&stop_timer.expires, 1000);
+  stop_timer.handler = _stop_timer_expired;
+  iv_timer_register(&stop_timer);
+
+  iv_main();
+
+  if (iv_timer_registered(&stop_timer))
+    iv_timer_unregister(&stop_timer);
+}
+
+static gchar *
+_create_test_file(void)
+{
+  gchar *filename = g_strdup("test_file_monitor_inotify_XXXXXX");
+  gint fd = g_mkstemp(filename);
+
+  cr_assert(fd >= 0);
+  close(fd);
+  return filename;
+}
+
+static void
+_append_to_file(const gchar *filename)
+{
+  gint fd = open(filename, O_WRONLY | O_APPEND);
+
+  cr_assert(fd >= 0);
+  cr_assert_eq(write(fd, "foo\n", 4), 4);
+  close(fd);
+}
+
+TestSuite(file_monitor_inotify, .init = app_startup, .fini = app_shutdown);
+
+Test(file_monitor_inotify, modification_is_reported)
+{
+  gchar *filename = _create_test_file();
+  gint fd = open(filename, O_RDONLY);
+  TestMonitorEvents events = { 0 };
+
+  FileMonitorInotify *monitor = file_monitor_inotify_new(fd, filename, _record_event, &events);
+  cr_assert_not_null(monitor);
+  cr_assert(file_monitor_inotify_is_active(monitor));
+
+  _append_to_file(filename);
+  _run_main_loop_until_event();
+
+  cr_assert(events.mask & IN_MODIFY);
+
+  file_monitor_inotify_free(monitor);
+  close(fd);
+  g_unlink(filename);
+  g_free(filename);
+}
+
+Test(file_monitor_inotify, rename_of_the_opened_file_is_reported)
+{
+  gchar *filename = _create_test_file();
+  gchar *rotated_filename = g_strdup_printf("%s.1", filename);
+  gint fd = open(filename, O_RDONLY);
+  TestMonitorEvents events = { 0 };
+
+  FileMonitorInotify *monitor = file_monitor_inotify_new(fd, filename, _record_event, &events);
+  cr_assert_not_null(monitor);
+
+  cr_assert_eq(g_rename(filename, rotated_filename), 0);
+  _run_main_loop_until_event();
+
+  cr_assert(events.mask & IN_MOVE_SELF);
+
+  file_monitor_inotify_free(monitor);
+  close(fd);
+  g_unlink(rotated_filename);
+  g_free(rotated_filename);
+  g_free(filename);
+}
+
+Test(file_monitor_inotify, monitors_of_the_same_file_share_the_watch)
+{
+  gchar *filename = _create_test_file();
+  gint fd1 = open(filename, O_RDONLY);
+  gint fd2 = open(filename, O_RDONLY);
+  TestMonitorEvents events1 = { 0 }, events2 = { 0 };
+
+  FileMonitorInotify *monitor1 = file_monitor_inotify_new(fd1, filename, _record_event, &events1);
+  FileMonitorInotify *monitor2 = file_monitor_inotify_new(fd2, filename, _record_event, &events2);
+  cr_assert_not_null(monitor1);
+  cr_assert_not_null(monitor2);
+
+  _append_to_file(filename);
+  _run_main_loop_until_event();
+
+  cr_assert_eq(events1.count, events2.count);
+  cr_assert(events1.mask & IN_MODIFY);
+
+  file_monitor_inotify_free(monitor1);
+
+  events2.mask = 0;
+  _append_to_file(filename);
+  _run_main_loop_until_event();
+  cr_assert(events2.mask & IN_MODIFY, "remaining monitor should still receive events");
+
+  file_monitor_inotify_free(monitor2);
+  close(fd1);
+  close(fd2);
+  g_unlink(filename);
+  g_free(filename);
+}
@@ -161,6 +161,75 @@ Test(file_writer, batches_of_messages_are_flushed_even_if_the_underlying_transpo
   log_proto_client_free(fw);
 }
 
+Test(file_writer, write_behind_buffer_is_written_once_the_byte_budget_is_reached)
+{
+  const gint MESSAGE_COUNT = 3;
+  LogProtoFileWriterOptions file_writer_options;
+
+  log_proto_file_writer_options_defaults(&file_writer_options);
+  file_writer_options.write_behind_size = MESSAGE_COUNT * (strlen(payload) + 1);
+  LogProtoClient *fw = log_proto_file_writer_new_with_options(transport, &options, 1, &file_writer_options);
+
+  log_proto_client_set_client_flow_control(fw, &flow_control_funcs);
+  for (gint i = 0; i < MESSAGE_COUNT - 1; i++)
+    {
+      status = log_proto_client_post(fw, msg, (guchar *) g_strdup(payload), strlen(payload) + 1, &consumed);
+      cr_assert(status == LPS_SUCCESS);
+      cr_assert(consumed == TRUE);
+    }
+
+  /* flush-lines(1) is ignored, everything stays buffered until the budget is used up */
+  count = log_transport_mock_read_from_write_buffer((LogTransportMock *) transport, output_buffer, sizeof(output_buffer));
+  cr_assert_eq(count, 0);
+  cr_assert_eq(messages_acked, 0);
+
+  status = log_proto_client_post(fw, msg, (guchar *) g_strdup(payload), strlen(payload) + 1, &consumed);
+  cr_assert(status == LPS_SUCCESS);
+  cr_assert(consumed == TRUE);
+
+  count = log_transport_mock_read_from_write_buffer((LogTransportMock *) transport, output_buffer, sizeof(output_buffer));
+  cr_assert_eq(count, MESSAGE_COUNT * (strlen(payload) + 1));
+  cr_assert_eq(messages_acked, MESSAGE_COUNT);
+
+  log_proto_client_free(fw);
+}
+
+Test(file_writer, write_behind_buffer_is_acked_only_after_a_series_of_partial_writes_completes)
+{
+  const gint MESSAGE_COUNT = 10;
+  LogProtoFileWriterOptions file_writer_options;
+
+  log_proto_file_writer_options_defaults(&file_writer_options);
+  file_writer_options.write_behind_size = 1024 * 1024;
+  LogProtoClient *fw = log_proto_file_writer_new_with_options(transport, &options, 1, &file_writer_options);
+
+  log_transport_mock_set_write_chunk_limit((LogTransportMock *) transport, 2);
+  log_proto_client_set_client_flow_control(fw, &flow_control_funcs);
+  for (gint i = 0; i < MESSAGE_COUNT; i++)
+    {
+      status = log_proto_client_post(fw, msg, (guchar *) g_strdup(payload), strlen(payload) + 1, &consumed);
+      cr_assert(status == LPS_SUCCESS, "status=%d", status);
+      cr_assert(consumed == TRUE);
+    }
+
+  while ((status = log_proto_client_flush(fw)) == LPS_PARTIAL)
+    cr_assert_eq(messages_acked, 0);
+
+  cr_assert(status == LPS_SUCCESS);
+
+  count = log_transport_mock_read_from_write_buffer((LogTransportMock *) transport, output_buffer, sizeof(output_buffer));
+  cr_assert_eq(count, MESSAGE_COUNT * (strlen(payload) + 1));
+
+  for (gint i = 0; i < MESSAGE_COUNT; i++)
+    {
+      const gchar *output_element = output_buffer + i * (strlen(payload) + 1);
+      cr_assert_str_eq(output_element, "PAYLOAD");
+    }
+  cr_assert_eq(messages_acked, MESSAGE_COUNT);
+
+  log_proto_client_free(fw);
+}
+
 static void
 startup(void)
 {
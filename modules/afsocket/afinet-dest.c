@@ -26,6 +26,7 @@
 #include "socket-options-inet.h"
 #include "messages.h"
 #include "gprocess.h"
+#include "stats/stats-registry.h"
 #include "compat/openssl_support.h"
 
 #include <sys/types.h>
@@ -389,11 +390,43 @@ _libnet_destroy_when_spoof_source_enabled(AFInetDestDriver *self)
 #endif
 }
 
+static const gchar *
+_format_tls_stats_instance(AFInetDestDriver *self)
+{
+  static gchar buf[256];
+
+  g_snprintf(buf, sizeof(buf), "%s,%s", self->super.transport_mapper->transport, self->primary);
+  return buf;
+}
+
+static void
+_register_tls_stats(AFInetDestDriver *self)
+{
+  TransportMapperInet *transport_mapper_inet = (TransportMapperInet *) self->super.transport_mapper;
+
+  tls_context_register_stats(transport_mapper_inet->tls_context,
+                             self->super.transport_mapper->stats_source | SCS_DESTINATION,
+                             self->super.super.super.id, _format_tls_stats_instance(self));
+}
+
+static void
+_unregister_tls_stats(AFInetDestDriver *self)
+{
+  TransportMapperInet *transport_mapper_inet = (TransportMapperInet *) self->super.transport_mapper;
+
+  tls_context_unregister_stats(transport_mapper_inet->tls_context,
+                               self->super.transport_mapper->stats_source | SCS_DESTINATION,
+                               self->super.super.super.id, _format_tls_stats_instance(self));
+}
+
 static gboolean
 afinet_dd_deinit(LogPipe *s)
 {
   AFInetDestDriver *self = (AFInetDestDriver *) s;
 
+  if (_is_tls_used(self))
+    _unregister_tls_stats(self);
+
   if (_is_failover_used(self))
     afinet_dd_failover_deinit(self->failover);
 
@@ -415,6 +448,9 @@ afinet_dd_init(LogPipe *s)
   if (!afsocket_dd_init(s))
     return FALSE;
 
+  if (_is_tls_used(self))
+    _register_tls_stats(self);
+
 #if SYSLOG_NG_ENABLE_SPOOF_SOURCE
   if (self->super.transport_mapper->sock_type == SOCK_DGRAM)
     {
@@ -596,7 +632,7 @@ afinet_dd_spoof_write_message(AFInetDestDriver *self, LogMessage *msg, const Log
   if (!self->lnet_buffer)
     self->lnet_buffer = g_string_sized_new(self->spoof_source_max_msglen);
 
-  log_writer_format_log(self->super.writer, msg, self->lnet_buffer);
+  log_writer_format_log(self->super.connections[0].writer, msg, self->lnet_buffer);
 
   if (self->lnet_buffer->len > self->spoof_source_max_msglen)
     g_string_truncate(self->lnet_buffer, self->spoof_source_max_msglen);
@@ -646,13 +682,14 @@ afinet_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
   /* NOTE: This code should probably be moved to the LogProto layer so that
    * spoofed packets are also going through the LogWriter queue */
 
-  if (_is_spoof_source_enabled(self) && _is_message_spoofable(msg) && log_writer_opened(self->super.writer))
+  if (_is_spoof_source_enabled(self) && _is_message_spoofable(msg)
+      && log_writer_opened(self->super.connections[0].writer))
     {
       if (afinet_dd_spoof_write_message(self, msg, path_options))
         return;
     }
 #endif
-  log_dest_driver_queue_method(s, msg, path_options);
+  afsocket_dd_queue(s, msg, path_options);
 }
 
 void
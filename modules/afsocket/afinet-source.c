@@ -23,6 +23,7 @@
 
 #include "afinet-source.h"
 #include "messages.h"
+#include "stats/stats-registry.h"
 #include "transport-mapper-inet.h"
 #include "socket-options-inet.h"
 
@@ -95,6 +96,22 @@ afinet_sd_setup_addresses(AFSocketSourceDriver *s)
   return TRUE;
 }
 
+static const gchar *
+_format_tls_stats_instance(AFInetSourceDriver *self)
+{
+  static gchar buf[256];
+
+  g_snprintf(buf, sizeof(buf), "%s,%s:%s", self->super.transport_mapper->transport,
+             self->bind_ip ? : "", self->bind_port ? : "");
+  return buf;
+}
+
+static TLSContext *
+_get_tls_context(AFInetSourceDriver *self)
+{
+  return ((TransportMapperInet *) self->super.transport_mapper)->tls_context;
+}
+
 gboolean
 afinet_sd_init(LogPipe *s)
 {
@@ -103,9 +120,27 @@ afinet_sd_init(LogPipe *s)
   if (!afsocket_sd_init_method(&self->super.super.super.super))
     return FALSE;
 
+  if (_get_tls_context(self))
+    tls_context_register_stats(_get_tls_context(self),
+                               self->super.transport_mapper->stats_source | SCS_SOURCE,
+                               self->super.super.super.id, _format_tls_stats_instance(self));
+
   return TRUE;
 }
 
+static gboolean
+afinet_sd_deinit(LogPipe *s)
+{
+  AFInetSourceDriver *self = (AFInetSourceDriver *) s;
+
+  if (_get_tls_context(self))
+    tls_context_unregister_stats(_get_tls_context(self),
+                                 self->super.transport_mapper->stats_source | SCS_SOURCE,
+                                 self->super.super.super.id, _format_tls_stats_instance(self));
+
+  return afsocket_sd_deinit_method(s);
+}
+
 void
 afinet_sd_free(LogPipe *s)
 {
@@ -126,6 +161,7 @@ afinet_sd_new_instance(TransportMapper *transport_mapper, GlobalConfig *cfg)
                             transport_mapper,
                             cfg);
   self->super.super.super.super.init = afinet_sd_init;
+  self->super.super.super.super.deinit = afinet_sd_deinit;
   self->super.super.super.super.free_fn = afinet_sd_free;
   self->super.setup_addresses = afinet_sd_setup_addresses;
   return self;
@@ -30,6 +30,7 @@
 #include "timeutils/misc.h"
 #include "hostname.h"
 #include "persist-state.h"
+#include "scratch-buffers.h"
 
 #include <string.h>
 #include <sys/types.h>
@@ -42,11 +43,11 @@ typedef struct _ReloadStoreItem
 } ReloadStoreItem;
 
 static ReloadStoreItem *
-_reload_store_item_new(AFSocketDestDriver *afsocket_dd)
+_reload_store_item_new(AFSocketDestDriver *afsocket_dd, AFSocketDestConnection *connection)
 {
   ReloadStoreItem *item = g_new(ReloadStoreItem, 1);
   item->proto_factory = afsocket_dd->proto_factory;
-  item->writer = afsocket_dd->writer;
+  item->writer = connection->writer;
   return item;
 }
 
@@ -93,6 +94,23 @@ afsocket_dd_set_close_on_input(LogDriver *s, gboolean close_on_input)
   self->close_on_input = close_on_input;
 }
 
+void
+afsocket_dd_set_connections(LogDriver *s, gint num_connections)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+
+  self->num_connections = num_connections;
+}
+
+void
+afsocket_dd_set_partition_key(LogDriver *s, LogTemplate *partition_key)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+
+  log_template_unref(self->partition_key);
+  self->partition_key = partition_key;
+}
+
 static const gchar *_module_name = "afsocket_dd";
 
 static const gchar *
@@ -133,21 +151,43 @@ afsocket_dd_format_name(const LogPipe *s)
   return persist_name;
 }
 
+/* the first connection keeps the persist names used before connections() existed */
 static const gchar *
-afsocket_dd_format_qfile_name(const AFSocketDestDriver *self)
+afsocket_dd_format_qfile_name(const AFSocketDestDriver *self, gint index)
 {
   static gchar persist_name[1024];
-  g_snprintf(persist_name, sizeof(persist_name), "%s_qfile(%s)", _module_name,
-             _get_module_identifier(self));
+
+  if (index == 0)
+    g_snprintf(persist_name, sizeof(persist_name), "%s_qfile(%s)", _module_name,
+               _get_module_identifier(self));
+  else
+    g_snprintf(persist_name, sizeof(persist_name), "%s_qfile(%s).%d", _module_name,
+               _get_module_identifier(self), index);
 
   return persist_name;
 }
 
 static const gchar *
-afsocket_dd_format_connections_name(const AFSocketDestDriver *self)
+afsocket_dd_format_connections_name(const AFSocketDestDriver *self, gint index)
 {
   static gchar persist_name[1024];
-  g_snprintf(persist_name, sizeof(persist_name), "%s_connections(%s)", _module_name,
+
+  if (index == 0)
+    g_snprintf(persist_name, sizeof(persist_name), "%s_connections(%s)", _module_name,
+               _get_module_identifier(self));
+  else
+    g_snprintf(persist_name, sizeof(persist_name), "%s_connections(%s).%d", _module_name,
+               _get_module_identifier(self), index);
+
+  return persist_name;
+}
+
+static const gchar *
+afsocket_dd_format_num_connections_name(const AFSocketDestDriver *self)
+{
+  static gchar persist_name[1024];
+
+  g_snprintf(persist_name, sizeof(persist_name), "%s_num_connections(%s)", _module_name,
              _get_module_identifier(self));
 
   return persist_name;
@@ -164,80 +204,98 @@ afsocket_dd_format_legacy_connection_name(const AFSocketDestDriver *self)
 }
 
 static gchar *
-afsocket_dd_stats_instance(AFSocketDestDriver *self)
+afsocket_dd_stats_instance(AFSocketDestDriver *self, gint index)
 {
   static gchar buf[256];
 
-  g_snprintf(buf, sizeof(buf), "%s,%s", self->transport_mapper->transport, afsocket_dd_get_dest_name(self));
+  if (index == 0)
+    g_snprintf(buf, sizeof(buf), "%s,%s", self->transport_mapper->transport, afsocket_dd_get_dest_name(self));
+  else
+    g_snprintf(buf, sizeof(buf), "%s,%s#%d", self->transport_mapper->transport, afsocket_dd_get_dest_name(self),
+               index);
   return buf;
 }
 
-static void _afsocket_dd_connection_in_progress(AFSocketDestDriver *self);
-static void afsocket_dd_try_connect(AFSocketDestDriver *self);
-static gboolean afsocket_dd_setup_connection(AFSocketDestDriver *self);
+static void _afsocket_dd_connection_in_progress(AFSocketDestConnection *connection);
+static void _connection_try_connect(AFSocketDestConnection *connection);
+static gboolean afsocket_dd_setup_connection(AFSocketDestConnection *connection);
 
 static void
-afsocket_dd_init_watches(AFSocketDestDriver *self)
+afsocket_dd_init_watches(AFSocketDestConnection *connection)
 {
-  IV_FD_INIT(&self->connect_fd);
-  self->connect_fd.cookie = self;
-  self->connect_fd.handler_out = (void (*)(void *)) _afsocket_dd_connection_in_progress;
+  IV_FD_INIT(&connection->connect_fd);
+  connection->connect_fd.cookie = connection;
+  connection->connect_fd.handler_out = (void (*)(void *)) _afsocket_dd_connection_in_progress;
 
-  IV_TIMER_INIT(&self->reconnect_timer);
-  self->reconnect_timer.cookie = self;
+  IV_TIMER_INIT(&connection->reconnect_timer);
+  connection->reconnect_timer.cookie = connection;
   /* Using reinit as a handler before establishing the first successful connection.
-   * We'll change this to afsocket_dd_reconnect when the initialization of the
+   * We'll change this to _connection_reconnect when the initialization of the
    * connection succeeds.*/
-  self->reconnect_timer.handler = (void (*)(void *)) afsocket_dd_try_connect;
+  connection->reconnect_timer.handler = (void (*)(void *)) _connection_try_connect;
 }
 
 static void
-afsocket_dd_start_watches(AFSocketDestDriver *self)
+afsocket_dd_start_watches(AFSocketDestConnection *connection)
 {
   main_loop_assert_main_thread();
 
-  self->connect_fd.fd = self->fd;
-  iv_fd_register(&self->connect_fd);
+  connection->connect_fd.fd = connection->fd;
+  iv_fd_register(&connection->connect_fd);
 }
 
-void
-afsocket_dd_stop_watches(AFSocketDestDriver *self)
+static void
+afsocket_dd_stop_connection_watches(AFSocketDestConnection *connection)
 {
   main_loop_assert_main_thread();
 
-  if (iv_fd_registered(&self->connect_fd))
+  if (iv_fd_registered(&connection->connect_fd))
     {
-      iv_fd_unregister(&self->connect_fd);
+      iv_fd_unregister(&connection->connect_fd);
 
       /* need to close the fd in this case as it wasn't established yet */
       msg_verbose("Closing connecting fd",
-                  evt_tag_int("fd", self->fd));
-      close(self->fd);
-      self->fd = -1;
+                  evt_tag_int("fd", connection->fd));
+      close(connection->fd);
+      connection->fd = -1;
     }
-  if (iv_timer_registered(&self->reconnect_timer))
-    iv_timer_unregister(&self->reconnect_timer);
+  if (iv_timer_registered(&connection->reconnect_timer))
+    iv_timer_unregister(&connection->reconnect_timer);
+}
+
+void
+afsocket_dd_stop_watches(AFSocketDestDriver *self)
+{
+  for (gint i = 0; self->connections && i < self->num_connections; i++)
+    afsocket_dd_stop_connection_watches(&self->connections[i]);
 }
 
 static void
-afsocket_dd_start_reconnect_timer(AFSocketDestDriver *self)
+afsocket_dd_start_reconnect_timer(AFSocketDestConnection *connection)
 {
   main_loop_assert_main_thread();
 
-  if (iv_timer_registered(&self->reconnect_timer))
-    iv_timer_unregister(&self->reconnect_timer);
+  if (iv_timer_registered(&connection->reconnect_timer))
+    iv_timer_unregister(&connection->reconnect_timer);
   iv_validate_now();
 
-  self->reconnect_timer.expires = iv_now;
-  timespec_add_msec(&self->reconnect_timer.expires, self->writer_options.time_reopen * 1000L);
-  iv_timer_register(&self->reconnect_timer);
+  connection->reconnect_timer.expires = iv_now;
+  timespec_add_msec(&connection->reconnect_timer.expires, connection->owner->writer_options.time_reopen * 1000L);
+  iv_timer_register(&connection->reconnect_timer);
+}
+
+static void
+_connection_set_dest_addr(AFSocketDestConnection *connection, GSockAddr *dest_addr)
+{
+  g_sockaddr_unref(connection->dest_addr);
+  connection->dest_addr = g_sockaddr_ref(dest_addr);
 }
 
 static gboolean
 _update_legacy_connection_persist_name(AFSocketDestDriver *self)
 {
   GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
-  const gchar *current_persist_name = afsocket_dd_format_connections_name(self);
+  const gchar *current_persist_name = afsocket_dd_format_connections_name(self, 0);
   const gchar *legacy_persist_name = afsocket_dd_format_legacy_connection_name(self);
 
   if (persist_state_entry_exists(cfg->state, current_persist_name))
@@ -256,8 +314,9 @@ afsocket_dd_construct_transport(AFSocketDestDriver *self, gint fd)
 }
 
 static gboolean
-afsocket_dd_connected(AFSocketDestDriver *self)
+afsocket_dd_connected(AFSocketDestConnection *connection)
 {
+  AFSocketDestDriver *self = connection->owner;
   GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
   LogTransport *transport;
   LogProtoClient *proto;
@@ -266,54 +325,59 @@ afsocket_dd_connected(AFSocketDestDriver *self)
   main_loop_assert_main_thread();
 
   msg_notice("Syslog connection established",
-             evt_tag_int("fd", self->fd),
-             evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf2, sizeof(buf2), GSA_FULL)),
+             evt_tag_int("fd", connection->fd),
+             evt_tag_str("server", g_sockaddr_format(connection->dest_addr, buf2, sizeof(buf2), GSA_FULL)),
              evt_tag_str("local", g_sockaddr_format(self->bind_addr, buf1, sizeof(buf1), GSA_FULL)));
 
-  transport = afsocket_dd_construct_transport(self, self->fd);
+  transport = afsocket_dd_construct_transport(self, connection->fd);
   if (!transport)
     return FALSE;
 
   proto = log_proto_client_factory_construct(self->proto_factory, transport, &self->writer_options.proto_options.super);
 
-  log_proto_client_restart_with_state(proto, cfg->state, afsocket_dd_format_connections_name(self));
-  log_writer_reopen(self->writer, proto);
+  log_proto_client_restart_with_state(proto, cfg->state, afsocket_dd_format_connections_name(self, connection->index));
+  log_writer_reopen(connection->writer, proto);
   return TRUE;
 }
 
+/* failback to the primary server, the other connections follow it when they reconnect */
 void
 afsocket_dd_connected_with_fd(gpointer s, gint fd, GSockAddr *saddr)
 {
   AFSocketDestDriver *self = (AFSocketDestDriver *)s;
-  afsocket_dd_stop_watches(self);
+  AFSocketDestConnection *connection = &self->connections[0];
+
+  afsocket_dd_stop_connection_watches(connection);
   g_sockaddr_unref(self->dest_addr);
   self->dest_addr = saddr;
-  self->fd = fd;
-  if (!afsocket_dd_connected(self))
+  _connection_set_dest_addr(connection, saddr);
+  connection->fd = fd;
+  if (!afsocket_dd_connected(connection))
     {
-      close(self->fd);
-      self->fd = -1;
-      afsocket_dd_start_reconnect_timer(self);
+      close(connection->fd);
+      connection->fd = -1;
+      afsocket_dd_start_reconnect_timer(connection);
     }
 }
 
 static void
-_afsocket_dd_connection_in_progress(AFSocketDestDriver *self)
+_afsocket_dd_connection_in_progress(AFSocketDestConnection *connection)
 {
+  AFSocketDestDriver *self = connection->owner;
   gchar buf[256];
   int error = 0;
   socklen_t errorlen = sizeof(error);
 
-  if (iv_fd_registered(&self->connect_fd))
-    iv_fd_unregister(&self->connect_fd);
+  if (iv_fd_registered(&connection->connect_fd))
+    iv_fd_unregister(&connection->connect_fd);
 
   if (self->transport_mapper->sock_type == SOCK_STREAM)
     {
-      if (getsockopt(self->fd, SOL_SOCKET, SO_ERROR, &error, &errorlen) == -1)
+      if (getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error, &errorlen) == -1)
         {
           msg_error("getsockopt(SOL_SOCKET, SO_ERROR) failed for connecting socket",
-                    evt_tag_int("fd", self->fd),
-                    evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf, sizeof(buf), GSA_FULL)),
+                    evt_tag_int("fd", connection->fd),
+                    evt_tag_str("server", g_sockaddr_format(connection->dest_addr, buf, sizeof(buf), GSA_FULL)),
                     evt_tag_error(EVT_TAG_OSERROR),
                     evt_tag_int("time_reopen", self->writer_options.time_reopen));
           goto error_reconnect;
@@ -321,26 +385,27 @@ _afsocket_dd_connection_in_progress(AFSocketDestDriver *self)
       if (error)
         {
           msg_error("Syslog connection failed",
-                    evt_tag_int("fd", self->fd),
-                    evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf, sizeof(buf), GSA_FULL)),
+                    evt_tag_int("fd", connection->fd),
+                    evt_tag_str("server", g_sockaddr_format(connection->dest_addr, buf, sizeof(buf), GSA_FULL)),
                     evt_tag_errno(EVT_TAG_OSERROR, error),
                     evt_tag_int("time_reopen", self->writer_options.time_reopen));
           goto error_reconnect;
         }
     }
 
-  if (afsocket_dd_connected(self))
+  if (afsocket_dd_connected(connection))
     return;
 
 error_reconnect:
-  close(self->fd);
-  self->fd = -1;
-  afsocket_dd_start_reconnect_timer(self);
+  close(connection->fd);
+  connection->fd = -1;
+  afsocket_dd_start_reconnect_timer(connection);
 }
 
 static gboolean
-afsocket_dd_start_connect(AFSocketDestDriver *self)
+afsocket_dd_start_connect(AFSocketDestConnection *connection)
 {
+  AFSocketDestDriver *self = connection->owner;
   int sock, rc;
   gchar buf1[MAX_SOCKADDR_STRING], buf2[MAX_SOCKADDR_STRING];
 
@@ -356,15 +421,16 @@ afsocket_dd_start_connect(AFSocketDestDriver *self)
     }
 
   g_assert(self->dest_addr);
+  _connection_set_dest_addr(connection, self->dest_addr);
 
-  rc = g_connect(sock, self->dest_addr);
+  rc = g_connect(sock, connection->dest_addr);
   if (rc == G_IO_STATUS_NORMAL)
     {
-      self->fd = sock;
-      if (!afsocket_dd_connected(self))
+      connection->fd = sock;
+      if (!afsocket_dd_connected(connection))
         {
-          close(self->fd);
-          self->fd = -1;
+          close(connection->fd);
+          connection->fd = -1;
           return FALSE;
         }
     }
@@ -372,15 +438,15 @@ afsocket_dd_start_connect(AFSocketDestDriver *self)
     {
       /* we must wait until connect succeeds */
 
-      self->fd = sock;
-      afsocket_dd_start_watches(self);
+      connection->fd = sock;
+      afsocket_dd_start_watches(connection);
     }
   else
     {
       /* error establishing connection */
       msg_error("Connection failed",
                 evt_tag_int("fd", sock),
-                evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf2, sizeof(buf2), GSA_FULL)),
+                evt_tag_str("server", g_sockaddr_format(connection->dest_addr, buf2, sizeof(buf2), GSA_FULL)),
                 evt_tag_str("local", g_sockaddr_format(self->bind_addr, buf1, sizeof(buf1), GSA_FULL)),
                 evt_tag_error(EVT_TAG_OSERROR));
       close(sock);
@@ -391,45 +457,84 @@ afsocket_dd_start_connect(AFSocketDestDriver *self)
 }
 
 static void
-_dd_reconnect(AFSocketDestDriver *self, gboolean request_setup_addr)
+_dd_reconnect(AFSocketDestConnection *connection, gboolean request_setup_addr)
 {
-  if ((request_setup_addr && !afsocket_dd_setup_addresses(self)) || !afsocket_dd_start_connect(self))
+  AFSocketDestDriver *self = connection->owner;
+
+  if ((request_setup_addr && !afsocket_dd_setup_addresses(self)) || !afsocket_dd_start_connect(connection))
     {
       msg_error("Initiating connection failed, reconnecting",
                 evt_tag_int("time_reopen", self->writer_options.time_reopen));
-      afsocket_dd_start_reconnect_timer(self);
+      afsocket_dd_start_reconnect_timer(connection);
     }
 }
 
 static void
-_dd_reconnect_with_setup_addresses(AFSocketDestDriver *self)
+_dd_reconnect_with_setup_addresses(AFSocketDestConnection *connection)
 {
-  _dd_reconnect(self, TRUE);
+  _dd_reconnect(connection, TRUE);
 }
 
 static void
-_dd_reconnect_with_current_addresses(AFSocketDestDriver *self)
+_dd_reconnect_with_current_addresses(AFSocketDestConnection *connection)
 {
-  _dd_reconnect(self, FALSE);
+  _dd_reconnect(connection, FALSE);
+}
+
+/*
+ * Only the first connection re-resolves the destination (and steps to the
+ * next failover server), the others follow it to its current address, so
+ * all connections share the server (and TLS peer verification) in use.
+ */
+static void
+_connection_reconnect(AFSocketDestConnection *connection)
+{
+  stats_counter_inc(connection->reconnects);
+
+  if (connection->index == 0 || !connection->owner->dest_addr)
+    _dd_reconnect_with_setup_addresses(connection);
+  else
+    _dd_reconnect_with_current_addresses(connection);
 }
 
 void
 afsocket_dd_reconnect(AFSocketDestDriver *self)
 {
-  _dd_reconnect_with_setup_addresses(self);
+  _dd_reconnect_with_setup_addresses(&self->connections[0]);
+}
+
+static gboolean
+afsocket_dd_setup_connections(AFSocketDestDriver *self)
+{
+  for (gint i = 0; i < self->num_connections; i++)
+    {
+      if (!afsocket_dd_setup_connection(&self->connections[i]))
+        return FALSE;
+    }
+
+  self->connection_initialized = TRUE;
+  return TRUE;
 }
 
 static void
 afsocket_dd_try_connect(AFSocketDestDriver *self)
 {
-  if ((!afsocket_dd_setup_addresses(self)) || !afsocket_dd_setup_connection(self))
+  if ((!afsocket_dd_setup_addresses(self)) || !afsocket_dd_setup_connections(self))
     {
       msg_error("Initiating connection failed, reconnecting",
                 evt_tag_int("time_reopen", self->writer_options.time_reopen));
-      afsocket_dd_start_reconnect_timer(self);
+      afsocket_dd_start_reconnect_timer(&self->connections[0]);
       return;
     }
-  self->reconnect_timer.handler = (void (*)(void *)) afsocket_dd_reconnect;
+
+  for (gint i = 0; i < self->num_connections; i++)
+    self->connections[i].reconnect_timer.handler = (void (*)(void *)) _connection_reconnect;
+}
+
+static void
+_connection_try_connect(AFSocketDestConnection *connection)
+{
+  afsocket_dd_try_connect(connection->owner);
 }
 
 static gboolean
@@ -484,15 +589,15 @@ afsocket_dd_setup_addresses_method(AFSocketDestDriver *self)
 }
 
 static void
-_afsocket_dd_try_to_restore_writer(AFSocketDestDriver *self)
+_afsocket_dd_try_to_restore_writer(AFSocketDestDriver *self, AFSocketDestConnection *connection)
 {
   /* If we are reinitializing an old config, an existing writer may be present */
-  if (self->writer)
+  if (connection->writer)
     return;
 
   ReloadStoreItem *item = cfg_persist_config_fetch(
                             log_pipe_get_config(&self->super.super.super),
-                            afsocket_dd_format_connections_name(self));
+                            afsocket_dd_format_connections_name(self, connection->index));
 
   /* We don't have an item stored in the reload cache, which means */
   /* it is the first time when we try to initialize the writer */
@@ -500,7 +605,7 @@ _afsocket_dd_try_to_restore_writer(AFSocketDestDriver *self)
     return;
 
   if (_is_protocol_compatible_with_writer_after_reload(self, item))
-    self->writer = _reload_store_item_release_writer(item);
+    connection->writer = _reload_store_item_release_writer(item);
 
   _reload_store_item_free(item);
 }
@@ -518,42 +623,189 @@ afsocket_dd_construct_writer_method(AFSocketDestDriver *self)
 }
 
 static gboolean
-afsocket_dd_setup_writer(AFSocketDestDriver *self)
+afsocket_dd_setup_writer(AFSocketDestDriver *self, AFSocketDestConnection *connection)
 {
-  _afsocket_dd_try_to_restore_writer(self);
+  _afsocket_dd_try_to_restore_writer(self, connection);
 
-  if (!self->writer)
+  if (!connection->writer)
     {
       /* NOTE: we open our writer with no fd, so we can send messages down there
        * even while the connection is not established */
 
-      self->writer = afsocket_dd_construct_writer(self);
+      connection->writer = afsocket_dd_construct_writer(self);
     }
-  log_pipe_set_config((LogPipe *)self->writer, log_pipe_get_config(&self->super.super.super));
-  log_writer_set_options(self->writer, &self->super.super.super,
+  log_pipe_set_config((LogPipe *)connection->writer, log_pipe_get_config(&self->super.super.super));
+  log_writer_set_options(connection->writer, &self->super.super.super,
                          &self->writer_options,
                          self->super.super.id,
-                         afsocket_dd_stats_instance(self));
-  log_writer_set_queue(self->writer, log_dest_driver_acquire_queue(
-                         &self->super, afsocket_dd_format_qfile_name(self)));
+                         afsocket_dd_stats_instance(self, connection->index));
+  log_writer_set_queue(connection->writer, log_dest_driver_acquire_queue(
+                         &self->super, afsocket_dd_format_qfile_name(self, connection->index)));
 
-  if (!log_pipe_init((LogPipe *) self->writer))
+  if (!log_pipe_init((LogPipe *) connection->writer))
     {
-      log_pipe_unref((LogPipe *) self->writer);
+      log_pipe_unref((LogPipe *) connection->writer);
+      connection->writer = NULL;
       return FALSE;
     }
 
-  log_pipe_append(&self->super.super.super, (LogPipe *) self->writer);
+  return TRUE;
+}
+
+static void
+_init_connection_stats_key(AFSocketDestDriver *self, AFSocketDestConnection *connection, StatsClusterKey *sc_key)
+{
+  stats_cluster_single_key_set_with_name(sc_key, self->transport_mapper->stats_source | SCS_DESTINATION,
+                                         self->super.super.id, connection->stats_instance, "reconnects");
+}
+
+static void
+_register_connection_stats(AFSocketDestDriver *self)
+{
+  if (self->num_connections <= 1)
+    return;
+
+  stats_lock();
+  for (gint i = 0; i < self->num_connections; i++)
+    {
+      StatsClusterKey sc_key;
+
+      /* the destination name changes with failover, keep the instance we registered with */
+      g_free(self->connections[i].stats_instance);
+      self->connections[i].stats_instance = g_strdup(afsocket_dd_stats_instance(self, i));
+      _init_connection_stats_key(self, &self->connections[i], &sc_key);
+      stats_register_counter(self->writer_options.stats_level, &sc_key, SC_TYPE_SINGLE_VALUE,
+                             &self->connections[i].reconnects);
+    }
+  stats_unlock();
+}
+
+static void
+_unregister_connection_stats(AFSocketDestDriver *self)
+{
+  if (self->num_connections <= 1 || !self->connections)
+    return;
+
+  stats_lock();
+  for (gint i = 0; i < self->num_connections; i++)
+    {
+      StatsClusterKey sc_key;
+
+      _init_connection_stats_key(self, &self->connections[i], &sc_key);
+      stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &self->connections[i].reconnects);
+    }
+  stats_unlock();
+}
+
+static void
+_init_connections(AFSocketDestDriver *self)
+{
+  /* a reinitialized driver keeps its connections, along with their writers */
+  if (self->connections)
+    return;
+
+  self->connections = g_new0(AFSocketDestConnection, self->num_connections);
+  for (gint i = 0; i < self->num_connections; i++)
+    {
+      AFSocketDestConnection *connection = &self->connections[i];
+
+      connection->owner = self;
+      connection->index = i;
+      connection->fd = -1;
+      afsocket_dd_init_watches(connection);
+    }
+}
+
+static AFSocketDestConnection *_lookup_connection(AFSocketDestDriver *self, LogMessage *msg);
+
+/*
+ * connections() was lowered since the last reload: the connection at
+ * @index no longer exists, move the messages in its queue to the remaining
+ * connections instead of losing them along with the queue.
+ */
+static void
+_drain_removed_connection(AFSocketDestDriver *self, gint index)
+{
+  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  gint drained = 0;
+
+  /* closes the connection if it was kept alive, the queue is persisted on its own */
+  _reload_store_item_free(cfg_persist_config_fetch(cfg, afsocket_dd_format_connections_name(self, index)));
+
+  LogQueue *queue = log_dest_driver_acquire_queue(&self->super, afsocket_dd_format_qfile_name(self, index));
+  log_queue_rewind_backlog_all(queue);
+  log_queue_set_use_backlog(queue, FALSE);
+
+  while ((msg = log_queue_pop_head_ignore_throttle(queue, &path_options)))
+    {
+      /* these were already accepted, don't let log_fifo_size drop them */
+      path_options.flow_control_requested = TRUE;
+      log_pipe_queue((LogPipe *) _lookup_connection(self, msg)->writer, msg, &path_options);
+      path_options = (LogPathOptions) LOG_PATH_OPTIONS_INIT;
+      drained++;
+    }
+  log_dest_driver_release_queue(&self->super, queue);
+
+  if (drained > 0)
+    msg_notice("Moving messages of a removed connection to the remaining ones",
+               evt_tag_str("driver", self->super.super.id),
+               evt_tag_int("connection", index),
+               evt_tag_int("messages", drained));
+}
+
+static void
+_drain_removed_connections(AFSocketDestDriver *self)
+{
+  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  gint old_num_connections = GPOINTER_TO_INT(cfg_persist_config_fetch(cfg,
+                                             afsocket_dd_format_num_connections_name(self)));
+
+  for (gint i = self->num_connections; i < old_num_connections; i++)
+    _drain_removed_connection(self, i);
+}
+
+static void
+afsocket_dd_save_num_connections(AFSocketDestDriver *self)
+{
+  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+
+  if (self->num_connections > 1)
+    cfg_persist_config_add(cfg, afsocket_dd_format_num_connections_name(self),
+                           GINT_TO_POINTER(self->num_connections), NULL, FALSE);
+}
+
+static gboolean
+afsocket_dd_setup_writers(AFSocketDestDriver *self)
+{
+  _init_connections(self);
+
+  for (gint i = 0; i < self->num_connections; i++)
+    {
+      if (!afsocket_dd_setup_writer(self, &self->connections[i]))
+        {
+          while (--i >= 0)
+            log_pipe_deinit((LogPipe *) self->connections[i].writer);
+          return FALSE;
+        }
+    }
+
+  /* with a single connection, messages are simply forwarded to its writer */
+  log_pipe_append(&self->super.super.super, (LogPipe *) self->connections[0].writer);
+  _register_connection_stats(self);
+  _drain_removed_connections(self);
   return TRUE;
 }
 
 static gboolean
-afsocket_dd_setup_connection(AFSocketDestDriver *self)
+afsocket_dd_setup_connection(AFSocketDestConnection *connection)
 {
-  if (!log_writer_opened(self->writer))
-    _dd_reconnect_with_current_addresses(self);
+  if (!log_writer_opened(connection->writer))
+    _dd_reconnect_with_current_addresses(connection);
+  else
+    _connection_set_dest_addr(connection, connection->owner->dest_addr);
 
-  self->connection_initialized = TRUE;
   return TRUE;
 }
 
@@ -568,7 +820,7 @@ _finalize_init(gpointer arg)
 static gboolean
 _dd_init_stream(AFSocketDestDriver *self)
 {
-  if (!afsocket_dd_setup_writer(self))
+  if (!afsocket_dd_setup_writers(self))
     return FALSE;
 
   return transport_mapper_async_init(self->transport_mapper, _finalize_init, self);
@@ -582,7 +834,7 @@ _dd_init_dgram(AFSocketDestDriver *self)
       return FALSE;
     }
 
-  if (!afsocket_dd_setup_writer(self))
+  if (!afsocket_dd_setup_writers(self))
     {
       return FALSE;
     }
@@ -595,7 +847,8 @@ _dd_rewind_stateless_proto_backlog(AFSocketDestDriver *self)
 {
   if (!log_proto_client_factory_is_proto_stateful(self->proto_factory))
     {
-      log_writer_msg_rewind(self->writer);
+      for (gint i = 0; i < self->num_connections; i++)
+        log_writer_msg_rewind(self->connections[i].writer);
     }
 }
 
@@ -640,8 +893,11 @@ afsocket_dd_init(LogPipe *s)
 static void
 afsocket_dd_stop_writer(AFSocketDestDriver *self)
 {
-  if (self->writer)
-    log_pipe_deinit((LogPipe *) self->writer);
+  for (gint i = 0; self->connections && i < self->num_connections; i++)
+    {
+      if (self->connections[i].writer)
+        log_pipe_deinit((LogPipe *) self->connections[i].writer);
+    }
 }
 
 static void
@@ -651,10 +907,15 @@ afsocket_dd_save_connection(AFSocketDestDriver *self)
 
   if (self->connections_kept_alive_across_reloads)
     {
-      ReloadStoreItem *item = _reload_store_item_new(self);
-      cfg_persist_config_add(cfg, afsocket_dd_format_connections_name(self), item,
-                             (GDestroyNotify)_reload_store_item_free, FALSE);
-      self->writer = NULL;
+      for (gint i = 0; i < self->num_connections; i++)
+        {
+          AFSocketDestConnection *connection = &self->connections[i];
+          ReloadStoreItem *item = _reload_store_item_new(self, connection);
+
+          cfg_persist_config_add(cfg, afsocket_dd_format_connections_name(self, i), item,
+                                 (GDestroyNotify)_reload_store_item_free, FALSE);
+          connection->writer = NULL;
+        }
     }
 }
 
@@ -665,32 +926,92 @@ afsocket_dd_deinit(LogPipe *s)
 
   afsocket_dd_stop_watches(self);
   afsocket_dd_stop_writer(self);
+  _unregister_connection_stats(self);
 
   if (self->connection_initialized)
     {
       afsocket_dd_save_connection(self);
     }
+  afsocket_dd_save_num_connections(self);
 
   return log_dest_driver_deinit_method(s);
 }
 
+static AFSocketDestConnection *
+_lookup_connection(AFSocketDestDriver *self, LogMessage *msg)
+{
+  guint slot;
+
+  if (self->partition_key)
+    {
+      ScratchBuffersMarker marker;
+      GString *key = scratch_buffers_alloc_and_mark(&marker);
+      LogTemplateEvalOptions options = {&self->writer_options.template_options, LTZ_LOCAL, 0, NULL};
+
+      log_template_format(self->partition_key, msg, &options, key);
+      slot = g_str_hash(key->str);
+      scratch_buffers_reclaim_marked(marker);
+    }
+  else
+    {
+      slot = (guint) g_atomic_int_add(&self->last_connection, 1);
+    }
+
+  return &self->connections[slot % self->num_connections];
+}
+
+void
+afsocket_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+
+  if (self->num_connections <= 1)
+    {
+      log_dest_driver_queue_method(s, msg, path_options);
+      return;
+    }
+
+  /* messages with the same partition-key() are kept in order on the same connection */
+  AFSocketDestConnection *connection = _lookup_connection(self, msg);
+
+  stats_counter_inc(self->super.super.processed_group_messages);
+  stats_counter_inc(self->super.queued_global_messages);
+  log_pipe_queue((LogPipe *) connection->writer, msg, path_options);
+}
+
+static AFSocketDestConnection *
+_lookup_connection_by_writer(AFSocketDestDriver *self, LogWriter *writer)
+{
+  for (gint i = 0; i < self->num_connections; i++)
+    {
+      if (self->connections[i].writer == writer)
+        return &self->connections[i];
+    }
+  return NULL;
+}
+
 static void
 afsocket_dd_notify(LogPipe *s, gint notify_code, gpointer user_data)
 {
   AFSocketDestDriver *self = (AFSocketDestDriver *) s;
+  AFSocketDestConnection *connection;
   gchar buf[MAX_SOCKADDR_STRING];
 
   switch (notify_code)
     {
     case NC_CLOSE:
     case NC_WRITE_ERROR:
-      log_writer_reopen(self->writer, NULL);
+      connection = _lookup_connection_by_writer(self, (LogWriter *) user_data);
+      if (!connection)
+        break;
+
+      log_writer_reopen(connection->writer, NULL);
 
       msg_notice((notify_code == NC_CLOSE) ? "Syslog connection closed" : "Syslog connection broken",
-                 evt_tag_int("fd", self->fd),
-                 evt_tag_str("server", g_sockaddr_format(self->dest_addr, buf, sizeof(buf), GSA_FULL)),
+                 evt_tag_int("fd", connection->fd),
+                 evt_tag_str("server", g_sockaddr_format(connection->dest_addr, buf, sizeof(buf), GSA_FULL)),
                  evt_tag_int("time_reopen", self->writer_options.time_reopen));
-      afsocket_dd_start_reconnect_timer(self);
+      afsocket_dd_start_reconnect_timer(connection);
       break;
     default:
       break;
@@ -705,7 +1026,14 @@ afsocket_dd_free(LogPipe *s)
   log_writer_options_destroy(&self->writer_options);
   g_sockaddr_unref(self->bind_addr);
   g_sockaddr_unref(self->dest_addr);
-  log_pipe_unref((LogPipe *) self->writer);
+  for (gint i = 0; self->connections && i < self->num_connections; i++)
+    {
+      g_sockaddr_unref(self->connections[i].dest_addr);
+      g_free(self->connections[i].stats_instance);
+      log_pipe_unref((LogPipe *) self->connections[i].writer);
+    }
+  g_free(self->connections);
+  log_template_unref(self->partition_key);
   transport_mapper_free(self->transport_mapper);
   socket_options_free(self->socket_options);
   log_dest_driver_free(s);
@@ -722,6 +1050,7 @@ afsocket_dd_init_instance(AFSocketDestDriver *self,
   log_writer_options_defaults(&self->writer_options);
   self->super.super.super.init = afsocket_dd_init;
   self->super.super.super.deinit = afsocket_dd_deinit;
+  self->super.super.super.queue = afsocket_dd_queue;
   self->super.super.super.free_fn = afsocket_dd_free;
   self->super.super.super.notify = afsocket_dd_notify;
   self->super.super.super.generate_persist_name = afsocket_dd_format_name;
@@ -732,10 +1061,10 @@ afsocket_dd_init_instance(AFSocketDestDriver *self,
   self->connections_kept_alive_across_reloads = TRUE;
   self->close_on_input = TRUE;
   self->connection_initialized = FALSE;
+  self->num_connections = 1;
 
 
   self->writer_options.mark_mode = MM_GLOBAL;
   self->writer_options.stats_level = STATS_LEVEL0;
   self->writer_options.stats_source = self->transport_mapper->stats_source;
-  afsocket_dd_init_watches(self);
 }
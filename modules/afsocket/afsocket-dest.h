@@ -34,6 +34,20 @@
 
 typedef struct _AFSocketDestDriver AFSocketDestDriver;
 
+/* one of the connections() parallel connections, each with its own writer and queue */
+typedef struct _AFSocketDestConnection
+{
+  AFSocketDestDriver *owner;
+  gint index;
+  gint fd;
+  LogWriter *writer;
+  GSockAddr *dest_addr;
+  struct iv_fd connect_fd;
+  struct iv_timer reconnect_timer;
+  StatsCounterItem *reconnects;
+  gchar *stats_instance;
+} AFSocketDestConnection;
+
 struct _AFSocketDestDriver
 {
   LogDestDriver super;
@@ -41,8 +55,10 @@ struct _AFSocketDestDriver
   gboolean
   connections_kept_alive_across_reloads:1;
   gboolean close_on_input;
-  gint fd;
-  LogWriter *writer;
+  AFSocketDestConnection *connections;
+  gint num_connections;
+  gint last_connection;
+  LogTemplate *partition_key;
   LogWriterOptions writer_options;
   LogProtoClientFactory *proto_factory;
 
@@ -50,8 +66,6 @@ struct _AFSocketDestDriver
   GSockAddr *dest_addr;
   gint time_reopen;
   gboolean connection_initialized;
-  struct iv_fd connect_fd;
-  struct iv_timer reconnect_timer;
   SocketOptions *socket_options;
   TransportMapper *transport_mapper;
 
@@ -82,6 +96,8 @@ LogWriter *afsocket_dd_construct_writer_method(AFSocketDestDriver *self);
 gboolean afsocket_dd_setup_addresses_method(AFSocketDestDriver *self);
 void afsocket_dd_set_keep_alive(LogDriver *self, gint enable);
 void afsocket_dd_set_close_on_input(LogDriver *self, gboolean close_on_input);
+void afsocket_dd_set_connections(LogDriver *self, gint num_connections);
+void afsocket_dd_set_partition_key(LogDriver *self, LogTemplate *partition_key);
 void afsocket_dd_init_instance(AFSocketDestDriver *self, SocketOptions *socket_options,
                                TransportMapper *transport_mapper, GlobalConfig *cfg);
 void afsocket_dd_reconnect(AFSocketDestDriver *self);
@@ -89,6 +105,7 @@ void afsocket_dd_stop_watches(AFSocketDestDriver *self);
 
 gboolean afsocket_dd_init(LogPipe *s);
 gboolean afsocket_dd_deinit(LogPipe *s);
+void afsocket_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options);
 void afsocket_dd_free(LogPipe *s);
 void afsocket_dd_connected_with_fd(gpointer self, gint fd, GSockAddr *saddr);
 
@@ -60,6 +60,10 @@ static CfgLexerKeyword afsocket_keywords[] =
   { "ssl_options",        KW_SSL_OPTIONS },
   { "sni",                KW_SNI },
   { "allow_compress",     KW_ALLOW_COMPRESS },
+  { "session_cache_size", KW_SESSION_CACHE_SIZE },
+  { "session_timeout",    KW_SESSION_TIMEOUT },
+  { "session_tickets",    KW_SESSION_TICKETS },
+  { "session_ticket_key_file", KW_SESSION_TICKET_KEY_FILE },
 
   { "localip",            KW_LOCALIP },
   { "ip",                 KW_IP },
@@ -86,8 +90,12 @@ static CfgLexerKeyword afsocket_keywords[] =
   { "ip_protocol",        KW_IP_PROTOCOL },
   { "max_connections",    KW_MAX_CONNECTIONS },
   { "listen_backlog",     KW_LISTEN_BACKLOG },
+  { "listen_sockets",     KW_LISTEN_SOCKETS },
+  { "reuseport_steering", KW_REUSEPORT_STEERING },
   { "keep_alive",         KW_KEEP_ALIVE },
   { "close_on_input",     KW_CLOSE_ON_INPUT },
+  { "connections",        KW_CONNECTIONS },
+  { "partition_key",      KW_PARTITION_KEY },
   { "systemd_syslog",     KW_SYSTEMD_SYSLOG  },
   { "failover_servers",   KW_FAILOVER_SERVERS, KWS_OBSOLETE, "failover-servers has been deprecated, try failover() and use servers() option inside it." },
   { "failover",           KW_FAILOVER },
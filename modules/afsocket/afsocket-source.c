@@ -35,6 +35,10 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+#include <linux/filter.h>
+#endif
+
 #if SYSLOG_NG_ENABLE_TCP_WRAPPER
 #include <tcpd.h>
 int allow_severity = 0;
@@ -50,6 +54,8 @@ typedef struct _AFSocketSourceConnection
   struct _AFSocketSourceDriver *owner;
   LogReader *reader;
   int sock;
+  /* index among the listen-sockets() dgram sockets, -1 for accepted connections */
+  gint socket_index;
   GSockAddr *peer_addr;
   GSockAddr *local_addr;
 } AFSocketSourceConnection;
@@ -92,6 +98,11 @@ _format_sc_name(AFSocketSourceConnection *self, gint format_type)
       if (self->owner->bind_addr)
         {
           g_sockaddr_format(self->owner->bind_addr, buf, sizeof(buf), format_type);
+          if (self->owner->listen_sockets > 1 && self->socket_index >= 0)
+            {
+              gsize len = strlen(buf);
+              g_snprintf(buf + len, sizeof(buf) - len, "#%d", self->socket_index);
+            }
           return buf;
         }
       else
@@ -237,7 +248,7 @@ afsocket_sc_free(LogPipe *s)
 }
 
 AFSocketSourceConnection *
-afsocket_sc_new(GSockAddr *peer_addr, GSockAddr *local_addr, int fd, GlobalConfig *cfg)
+afsocket_sc_new(GSockAddr *peer_addr, GSockAddr *local_addr, int fd, gint socket_index, GlobalConfig *cfg)
 {
   AFSocketSourceConnection *self = g_new0(AFSocketSourceConnection, 1);
 
@@ -249,6 +260,7 @@ afsocket_sc_new(GSockAddr *peer_addr, GSockAddr *local_addr, int fd, GlobalConfi
   self->peer_addr = g_sockaddr_ref(peer_addr);
   self->local_addr = g_sockaddr_ref(local_addr);
   self->sock = fd;
+  self->socket_index = socket_index;
   return self;
 }
 
@@ -319,6 +331,22 @@ afsocket_sd_set_listen_backlog(LogDriver *s, gint listen_backlog)
   self->listen_backlog = listen_backlog;
 }
 
+void
+afsocket_sd_set_listen_sockets(LogDriver *s, gint listen_sockets)
+{
+  AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
+
+  self->listen_sockets = listen_sockets;
+}
+
+void
+afsocket_sd_set_reuseport_steering(LogDriver *s, gboolean enable)
+{
+  AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
+
+  self->reuseport_steering = enable;
+}
+
 void
 afsocket_sd_set_dynamic_window_size(LogDriver *s, gint dynamic_window_size)
 {
@@ -367,16 +395,32 @@ afsocket_sd_format_name(const LogPipe *s)
 }
 
 static const gchar *
-afsocket_sd_format_listener_name(const AFSocketSourceDriver *self)
+afsocket_sd_format_listener_name(const AFSocketSourceDriver *self, gint index)
 {
   static gchar persist_name[1024];
 
-  g_snprintf(persist_name, sizeof(persist_name), "%s.listen_fd",
-             afsocket_sd_format_name((const LogPipe *)self));
+  /* the first socket keeps the name used before listen-sockets() existed */
+  if (index == 0)
+    g_snprintf(persist_name, sizeof(persist_name), "%s.listen_fd",
+               afsocket_sd_format_name((const LogPipe *)self));
+  else
+    g_snprintf(persist_name, sizeof(persist_name), "%s.listen_fd.%d",
+               afsocket_sd_format_name((const LogPipe *)self), index);
 
   return persist_name;
 }
 
+static const gchar *
+afsocket_sd_format_listener_stats_instance(const AFSocketSourceDriver *self, gint index)
+{
+  static gchar stats_instance[1024];
+
+  g_snprintf(stats_instance, sizeof(stats_instance), "%s#%d",
+             afsocket_sd_format_name((const LogPipe *)self), index);
+
+  return stats_instance;
+}
+
 static const gchar *
 afsocket_sd_format_connections_name(const AFSocketSourceDriver *self)
 {
@@ -400,7 +444,8 @@ afsocket_sd_format_dynamic_window_pool_name(const AFSocketSourceDriver *self)
 }
 
 static gboolean
-afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_addr, GSockAddr *local_addr, gint fd)
+afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_addr, GSockAddr *local_addr, gint fd,
+                               gint socket_index)
 {
   gchar buf[MAX_SOCKADDR_STRING], buf2[MAX_SOCKADDR_STRING];
 #if SYSLOG_NG_ENABLE_TCP_WRAPPER
@@ -426,7 +471,8 @@ afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_add
 
 #endif
 
-  if (_connections_count_get(self) >= self->max_connections)
+  /* max-connections() only limits accepted connections, dgram sockets are limited by listen-sockets() */
+  if (self->transport_mapper->sock_type == SOCK_STREAM && _connections_count_get(self) >= self->max_connections)
     {
       msg_error("Number of allowed concurrent connections reached, rejecting connection",
                 evt_tag_str("client", g_sockaddr_format(client_addr, buf, sizeof(buf), GSA_FULL)),
@@ -440,7 +486,7 @@ afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_add
     {
       AFSocketSourceConnection *conn;
 
-      conn = afsocket_sc_new(client_addr, local_addr, fd, self->super.super.super.cfg);
+      conn = afsocket_sc_new(client_addr, local_addr, fd, socket_index, self->super.super.super.cfg);
       afsocket_sc_set_owner(conn, self);
       if (log_pipe_init(&conn->super))
         {
@@ -462,7 +508,8 @@ afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_add
 static void
 afsocket_sd_accept(gpointer s)
 {
-  AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
+  AFSocketSourceListener *listener = (AFSocketSourceListener *) s;
+  AFSocketSourceDriver *self = listener->owner;
   GSockAddr *peer_addr;
   GSockAddr *local_addr;
   gchar buf1[256], buf2[256];
@@ -474,7 +521,7 @@ afsocket_sd_accept(gpointer s)
     {
       GIOStatus status;
 
-      status = g_accept(self->fd, &new_fd, &peer_addr);
+      status = g_accept(listener->listen_fd.fd, &new_fd, &peer_addr);
       if (status == G_IO_STATUS_AGAIN)
         {
           /* no more connections to accept */
@@ -491,11 +538,12 @@ afsocket_sd_accept(gpointer s)
       g_fd_set_cloexec(new_fd, TRUE);
 
       local_addr = g_socket_get_local_name(new_fd);
-      res = afsocket_sd_process_connection(self, peer_addr, local_addr, new_fd);
+      res = afsocket_sd_process_connection(self, peer_addr, local_addr, new_fd, -1);
       g_sockaddr_unref(local_addr);
 
       if (res)
         {
+          stats_counter_inc(listener->accepted_connections);
           if (peer_addr->sa.sa_family != AF_UNIX)
             msg_notice("Syslog connection accepted",
                        evt_tag_int("fd", new_fd),
@@ -542,18 +590,21 @@ afsocket_sd_close_connection(AFSocketSourceDriver *self, AFSocketSourceConnectio
 }
 
 static void
-_listen_fd_init(AFSocketSourceDriver *self)
+_listen_fd_init(AFSocketSourceListener *listener, AFSocketSourceDriver *owner, gint index, gint fd)
 {
-  IV_FD_INIT(&self->listen_fd);
-  self->listen_fd.fd = self->fd;
-  self->listen_fd.cookie = self;
-  self->listen_fd.handler_in = afsocket_sd_accept;
+  listener->owner = owner;
+  listener->index = index;
+  IV_FD_INIT(&listener->listen_fd);
+  listener->listen_fd.fd = fd;
+  listener->listen_fd.cookie = listener;
+  listener->listen_fd.handler_in = afsocket_sd_accept;
 }
 
 static void
 _listen_fd_start(AFSocketSourceDriver *self)
 {
-  iv_fd_register(&self->listen_fd);
+  for (gint i = 0; i < self->num_listeners; i++)
+    iv_fd_register(&self->listeners[i].listen_fd);
 }
 
 static void
@@ -659,8 +710,11 @@ _dynamic_window_timer_stop(AFSocketSourceDriver *self)
 static void
 _listen_fd_stop(AFSocketSourceDriver *self)
 {
-  if (iv_fd_registered (&self->listen_fd))
-    iv_fd_unregister(&self->listen_fd);
+  for (gint i = 0; i < self->num_listeners; i++)
+    {
+      if (iv_fd_registered (&self->listeners[i].listen_fd))
+        iv_fd_unregister(&self->listeners[i].listen_fd);
+    }
 }
 
 static void
@@ -814,21 +868,122 @@ afsocket_sd_restore_kept_alive_connections(AFSocketSourceDriver *self)
   return TRUE;
 }
 
+/*
+ * SO_REUSEPORT spreads packets and connections by a hash of the 4-tuple,
+ * this program selects the socket by the source address instead, so a
+ * sender keeps using the same socket (and reader) even if its source
+ * port changes.
+ */
+static void
+afsocket_sd_attach_reuseport_steering(AFSocketSourceDriver *self, gint fd, gint num_sockets)
+{
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+  struct sock_filter code[] =
+  {
+    /* A = IP version */
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 2),
+    /* IPv6: the last 32 bits of the source address */
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 20),
+    BPF_STMT(BPF_JMP | BPF_JA, 1),
+    /* IPv4: the source address */
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, num_sockets),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+  struct sock_fprog prog =
+  {
+    .len = G_N_ELEMENTS(code),
+    .filter = code,
+  };
+
+  if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+    msg_warning("Error attaching the reuseport-steering() program, senders are distributed by the kernel's hash",
+                evt_tag_error(EVT_TAG_OSERROR),
+                log_pipe_location_tag(&self->super.super.super));
+#else
+  msg_warning("reuseport-steering() is not supported on this platform, senders are distributed by the kernel's hash",
+              log_pipe_location_tag(&self->super.super.super));
+#endif
+}
+
+static void
+_register_listener_stats(AFSocketSourceDriver *self)
+{
+  if (self->listen_sockets <= 1)
+    return;
+
+  stats_lock();
+  for (gint i = 0; i < self->num_listeners; i++)
+    {
+      StatsClusterKey sc_key;
+      stats_cluster_single_key_set_with_name(&sc_key,
+                                             self->transport_mapper->stats_source | SCS_SOURCE,
+                                             self->super.super.group,
+                                             afsocket_sd_format_listener_stats_instance(self, i),
+                                             "accepted_connections");
+      stats_register_counter(self->reader_options.super.stats_level, &sc_key, SC_TYPE_SINGLE_VALUE,
+                             &self->listeners[i].accepted_connections);
+    }
+  stats_unlock();
+}
+
+static void
+_unregister_listener_stats(AFSocketSourceDriver *self)
+{
+  if (self->listen_sockets <= 1)
+    return;
+
+  stats_lock();
+  for (gint i = 0; i < self->num_listeners; i++)
+    {
+      StatsClusterKey sc_key;
+      stats_cluster_single_key_set_with_name(&sc_key,
+                                             self->transport_mapper->stats_source | SCS_SOURCE,
+                                             self->super.super.group,
+                                             afsocket_sd_format_listener_stats_instance(self, i),
+                                             "accepted_connections");
+      stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &self->listeners[i].accepted_connections);
+    }
+  stats_unlock();
+}
+
+static void
+_close_listeners(AFSocketSourceDriver *self)
+{
+  for (gint i = 0; i < self->num_listeners; i++)
+    {
+      msg_verbose("Closing listener fd",
+                  evt_tag_int("fd", self->listeners[i].listen_fd.fd));
+      close(self->listeners[i].listen_fd.fd);
+    }
+  g_free(self->listeners);
+  self->listeners = NULL;
+  self->num_listeners = 0;
+}
+
 static gboolean
 _finalize_init(gpointer arg)
 {
   AFSocketSourceDriver *self = (AFSocketSourceDriver *)arg;
   /* set up listening source */
-  if (listen(self->fd, self->listen_backlog) < 0)
+  for (gint i = 0; i < self->num_listeners; i++)
     {
-      msg_error("Error during listen()",
-                evt_tag_error(EVT_TAG_OSERROR));
-      close(self->fd);
-      self->fd = -1;
-      return FALSE;
+      if (listen(self->listeners[i].listen_fd.fd, self->listen_backlog) < 0)
+        {
+          msg_error("Error during listen()",
+                    evt_tag_error(EVT_TAG_OSERROR));
+          _close_listeners(self);
+          return FALSE;
+        }
     }
 
-  _listen_fd_init(self);
+  /* the reuseport group only exists once the sockets are listening */
+  if (self->reuseport_steering && self->num_listeners > 1)
+    afsocket_sd_attach_reuseport_steering(self, self->listeners[0].listen_fd.fd, self->num_listeners);
+
+  _register_listener_stats(self);
   afsocket_sd_start_watches(self);
   char buf[256];
   msg_info("Accepting connections",
@@ -836,52 +991,115 @@ _finalize_init(gpointer arg)
   return TRUE;
 }
 
+/*
+ * Opens the @index-th of the listen-sockets() sockets.  The first one may
+ * come from the runtime environment (e.g. systemd), in which case
+ * *acquired is set and no further sockets should be opened.
+ */
 static gboolean
-_sd_open_stream(AFSocketSourceDriver *self)
+_sd_open_socket(AFSocketSourceDriver *self, gint index, gint *sock, gboolean *acquired)
 {
-  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
-  gint sock = -1;
-  if (self->connections_kept_alive_across_reloads)
+  *sock = -1;
+  *acquired = FALSE;
+
+  if (index == 0)
     {
-      /* NOTE: this assumes that fd 0 will never be used for listening fds,
-       * main.c opens fd 0 so this assumption can hold */
-      sock = GPOINTER_TO_UINT(
-               cfg_persist_config_fetch(cfg, afsocket_sd_format_listener_name(self))) -
-             1;
+      if (!afsocket_sd_acquire_socket(self, sock))
+        return FALSE;
+
+      if (*sock != -1)
+        {
+          *acquired = TRUE;
+          if (self->listen_sockets > 1)
+            msg_warning("WARNING: listen-sockets() is ignored for sockets passed by the service manager",
+                        log_pipe_location_tag(&self->super.super.super));
+          return TRUE;
+        }
     }
 
-  if (sock == -1)
+  if (!transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr,
+                                    self->bind_addr, AFSOCKET_DIR_RECV, sock))
     {
-      if (!afsocket_sd_acquire_socket(self, &sock))
-        return self->super.super.optional;
-      if (sock == -1
-          && !transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr,
-                                           self->bind_addr, AFSOCKET_DIR_RECV, &sock))
-        return self->super.super.optional;
+      if (index > 0)
+        msg_warning("Error opening additional listen-sockets() socket, continuing with fewer sockets",
+                    evt_tag_int("listen_sockets", self->listen_sockets),
+                    evt_tag_int("opened", index),
+                    log_pipe_location_tag(&self->super.super.super));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+_sd_open_stream(AFSocketSourceDriver *self)
+{
+  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  gboolean acquired = FALSE;
+
+  self->listeners = g_new0(AFSocketSourceListener, self->listen_sockets);
+  self->num_listeners = 0;
+  for (gint i = 0; i < self->listen_sockets && !acquired; i++)
+    {
+      gint sock = -1;
+      if (self->connections_kept_alive_across_reloads)
+        {
+          /* NOTE: this assumes that fd 0 will never be used for listening fds,
+           * main.c opens fd 0 so this assumption can hold */
+          sock = GPOINTER_TO_UINT(
+                   cfg_persist_config_fetch(cfg, afsocket_sd_format_listener_name(self, i))) -
+                 1;
+        }
+
+      if (sock == -1 && !_sd_open_socket(self, i, &sock, &acquired))
+        {
+          if (i == 0)
+            {
+              g_free(self->listeners);
+              self->listeners = NULL;
+              return self->super.super.optional;
+            }
+          break;
+        }
+      _listen_fd_init(&self->listeners[i], self, i, sock);
+      self->num_listeners++;
     }
-  self->fd = sock;
   return transport_mapper_async_init(self->transport_mapper, _finalize_init, self);
 }
 
 static gboolean
 _sd_open_dgram(AFSocketSourceDriver *self)
 {
-  gint sock = -1;
-  if (!self->connections)
+  gboolean acquired = FALSE;
+
+  /* kept-alive sockets were already restored to self->connections, only open the missing ones */
+  for (gint i = g_list_length(self->connections); i < self->listen_sockets && !acquired; i++)
     {
-      if (!afsocket_sd_acquire_socket(self, &sock))
-        return self->super.super.optional;
-      if (sock == -1
-          && !transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr,
-                                           self->bind_addr, AFSOCKET_DIR_RECV, &sock))
-        return self->super.super.optional;
+      gint sock = -1;
+
+      if (!_sd_open_socket(self, i, &sock, &acquired))
+        {
+          if (i == 0)
+            return self->super.super.optional;
+          break;
+        }
+
+      if (!afsocket_sd_process_connection(self, NULL, self->bind_addr, sock, i))
+        return FALSE;
     }
-  self->fd = -1;
 
-  /* we either have self->connections != NULL, or sock contains a new fd */
-  if (self->connections || afsocket_sd_process_connection(self, NULL, self->bind_addr, sock))
-    return transport_mapper_init(self->transport_mapper);
-  return FALSE;
+  /* the program belongs to the reuseport group, so it can be attached
+   * through any of its sockets, restored or new.  It is attached again
+   * after a reload even if all sockets were kept alive, as the option or
+   * the number of sockets may have changed. */
+  gint num_sockets = g_list_length(self->connections);
+  if (self->reuseport_steering && num_sockets > 1 && !acquired)
+    {
+      AFSocketSourceConnection *sc = (AFSocketSourceConnection *) self->connections->data;
+
+      afsocket_sd_attach_reuseport_steering(self, sc->sock, num_sockets);
+    }
+
+  return transport_mapper_init(self->transport_mapper);
 }
 
 static gboolean
@@ -938,19 +1156,22 @@ afsocket_sd_save_listener(AFSocketSourceDriver *self)
   if (self->transport_mapper->sock_type == SOCK_STREAM)
     {
       afsocket_sd_stop_watches(self);
+      _unregister_listener_stats(self);
       if (!self->connections_kept_alive_across_reloads)
         {
-          msg_verbose("Closing listener fd",
-                      evt_tag_int("fd", self->fd));
-          close(self->fd);
+          _close_listeners(self);
         }
       else
         {
           /* NOTE: the fd is incremented by one when added to persistent config
            * as persist config cannot store NULL */
 
-          cfg_persist_config_add(cfg, afsocket_sd_format_listener_name(self),
-                                 GUINT_TO_POINTER(self->fd + 1), afsocket_sd_close_fd, FALSE);
+          for (gint i = 0; i < self->num_listeners; i++)
+            cfg_persist_config_add(cfg, afsocket_sd_format_listener_name(self, i),
+                                   GUINT_TO_POINTER(self->listeners[i].listen_fd.fd + 1), afsocket_sd_close_fd, FALSE);
+          g_free(self->listeners);
+          self->listeners = NULL;
+          self->num_listeners = 0;
         }
     }
 }
@@ -1055,6 +1276,10 @@ afsocket_sd_init_method(LogPipe *s)
         }
     }
 
+  /* the additional listen-sockets() can only bind to the same address with SO_REUSEPORT */
+  if (self->listen_sockets > 1)
+    self->socket_options->so_reuseport = TRUE;
+
   gboolean success = afsocket_sd_restore_kept_alive_connections(self) && afsocket_sd_open_listener(self);
   if (success)
     _make_connection_conter_stats_queryable(self);
@@ -1125,6 +1350,7 @@ afsocket_sd_init_instance(AFSocketSourceDriver *self,
   self->transport_mapper = transport_mapper;
   self->max_connections = 10;
   self->listen_backlog = 255;
+  self->listen_sockets = 1;
   self->dynamic_window_stats_freq = DYNAMIC_WINDOW_TIMER_MSECS;
   self->dynamic_window_realloc_ticks = DYNAMIC_WINDOW_REALLOC_TICKS;
   self->connections_kept_alive_across_reloads = TRUE;
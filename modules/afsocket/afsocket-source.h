@@ -36,18 +36,29 @@
 
 typedef struct _AFSocketSourceDriver AFSocketSourceDriver;
 
+/* one of the listen-sockets() stream sockets bound to the same address */
+typedef struct _AFSocketSourceListener
+{
+  AFSocketSourceDriver *owner;
+  gint index;
+  struct iv_fd listen_fd;
+  StatsCounterItem *accepted_connections;
+} AFSocketSourceListener;
+
 struct _AFSocketSourceDriver
 {
   LogSrcDriver super;
   guint32 connections_kept_alive_across_reloads:1,
-          window_size_initialized:1;
-  struct iv_fd listen_fd;
+          window_size_initialized:1,
+          reuseport_steering:1;
+  AFSocketSourceListener *listeners;
+  gint num_listeners;
+  gint listen_sockets;
   struct iv_timer dynamic_window_timer;
   gsize dynamic_window_size;
   gsize dynamic_window_timer_tick;
   glong dynamic_window_stats_freq;
   gint dynamic_window_realloc_ticks;
-  gint fd;
   LogReaderOptions reader_options;
   DynamicWindowPool *dynamic_window_pool;
   LogProtoServerFactory *proto_factory;
@@ -78,6 +89,8 @@ struct _AFSocketSourceDriver
 void afsocket_sd_set_keep_alive(LogDriver *self, gint enable);
 void afsocket_sd_set_max_connections(LogDriver *self, gint max_connections);
 void afsocket_sd_set_listen_backlog(LogDriver *self, gint listen_backlog);
+void afsocket_sd_set_listen_sockets(LogDriver *self, gint listen_sockets);
+void afsocket_sd_set_reuseport_steering(LogDriver *self, gboolean enable);
 void afsocket_sd_set_dynamic_window_size(LogDriver *self, gint dynamic_window_size);
 void afsocket_sd_set_dynamic_window_stats_freq(LogDriver *self, gdouble stats_freq);
 void afsocket_sd_set_dynamic_window_realloc_ticks(LogDriver *self, gint realloc_ticks);
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "afunix-dest.h"
+#include "afsocket-dest.h"
+#include "apphook.h"
+#include "mainloop.h"
+#include "logqueue.h"
+#include "logwriter.h"
+#include "template/templates.h"
+#include "stats/stats-registry.h"
+#include "libtest/persist_lib.h"
+
+#include <criterion/criterion.h>
+#include <iv.h>
+
+/* nothing listens here, so every connection stays in the reconnecting state
+ * and the messages stay in the queues of the writers */
+#define TEST_SOCKET "/nonexistent/test-afsocket-dest-connections.sock"
+
+MainLoop *main_loop;
+MainLoopOptions main_loop_options = {0};
+GlobalConfig *cfg;
+
+static AFSocketDestDriver *
+_create_driver(gint num_connections, const gchar *partition_key)
+{
+  AFSocketDestDriver *self = (AFSocketDestDriver *) afunix_dd_new_stream(TEST_SOCKET, cfg);
+
+  self->super.super.id = g_strdup("d_connections");
+  afsocket_dd_set_connections(&self->super.super, num_connections);
+
+  if (partition_key)
+    {
+      LogTemplate *template = log_template_new(cfg, NULL);
+
+      cr_assert(log_template_compile(template, partition_key, NULL));
+      afsocket_dd_set_partition_key(&self->super.super, template);
+    }
+
+  cr_assert(log_pipe_init(&self->super.super.super));
+  return self;
+}
+
+static void
+_free_driver(AFSocketDestDriver *self)
+{
+  log_pipe_deinit(&self->super.super.super);
+  log_pipe_unref(&self->super.super.super);
+}
+
+static void
+_send_message(AFSocketDestDriver *self, const gchar *host)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value(msg, LM_V_HOST, host, -1);
+  log_pipe_queue(&self->super.super.super, msg, &path_options);
+}
+
+static gint64
+_get_queued_messages(AFSocketDestConnection *connection)
+{
+  LogQueue *queue = log_writer_get_queue(connection->writer);
+  gint64 length = log_queue_get_length(queue);
+
+  log_queue_unref(queue);
+  return length;
+}
+
+/* pops the messages of the connection and checks that no host was seen on another one */
+static gint
+_pop_and_check_hosts(AFSocketDestConnection *connection, GHashTable *host_connections)
+{
+  LogQueue *queue = log_writer_get_queue(connection->writer);
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  gint count = 0;
+
+  while ((msg = log_queue_pop_head_ignore_throttle(queue, &path_options)))
+    {
+      const gchar *host = log_msg_get_value(msg, LM_V_HOST, NULL);
+      gpointer seen_on;
+
+      if (g_hash_table_lookup_extended(host_connections, host, NULL, &seen_on))
+        cr_assert_eq(GPOINTER_TO_INT(seen_on), connection->index,
+                     "messages of the same partition are split across connections, host=%s", host);
+      else
+        g_hash_table_insert(host_connections, g_strdup(host), GINT_TO_POINTER(connection->index));
+
+      log_queue_ack_backlog(queue, 1);
+      log_msg_unref(msg);
+      count++;
+    }
+  log_queue_unref(queue);
+  return count;
+}
+
+Test(afsocket_dest_connections, messages_are_distributed_round_robin)
+{
+  AFSocketDestDriver *driver = _create_driver(3, NULL);
+
+  for (gint i = 0; i < 7; i++)
+    _send_message(driver, "host");
+
+  cr_assert_eq(_get_queued_messages(&driver->connections[0]), 3);
+  cr_assert_eq(_get_queued_messages(&driver->connections[1]), 2);
+  cr_assert_eq(_get_queued_messages(&driver->connections[2]), 2);
+
+  _free_driver(driver);
+}
+
+Test(afsocket_dest_connections, partition_key_keeps_messages_on_the_same_connection)
+{
+  const gchar *hosts[] = { "alpha", "beta", "gamma", "delta" };
+  AFSocketDestDriver *driver = _create_driver(4, "$HOST");
+
+  for (gint round = 0; round < 5; round++)
+    {
+      for (gint i = 0; i < G_N_ELEMENTS(hosts); i++)
+        _send_message(driver, hosts[i]);
+    }
+
+  GHashTable *host_connections = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  gint total = 0;
+
+  for (gint i = 0; i < driver->num_connections; i++)
+    total += _pop_and_check_hosts(&driver->connections[i], host_connections);
+
+  cr_assert_eq(total, 5 * G_N_ELEMENTS(hosts));
+  cr_assert_eq(g_hash_table_size(host_connections), G_N_ELEMENTS(hosts));
+  g_hash_table_destroy(host_connections);
+
+  _free_driver(driver);
+}
+
+Test(afsocket_dest_connections, connections_reconnect_independently)
+{
+  AFSocketDestDriver *driver = _create_driver(3, NULL);
+  AFSocketDestConnection *broken = &driver->connections[1];
+
+  afsocket_dd_stop_watches(driver);
+  log_pipe_notify(&driver->super.super.super, NC_CLOSE, broken->writer);
+
+  cr_assert_not(iv_timer_registered(&driver->connections[0].reconnect_timer));
+  cr_assert(iv_timer_registered(&broken->reconnect_timer));
+  cr_assert_not(iv_timer_registered(&driver->connections[2].reconnect_timer));
+
+  iv_timer_unregister(&broken->reconnect_timer);
+  broken->reconnect_timer.handler(broken->reconnect_timer.cookie);
+
+  cr_assert_eq(stats_counter_get(driver->connections[0].reconnects), 0);
+  cr_assert_eq(stats_counter_get(broken->reconnects), 1);
+  cr_assert_eq(stats_counter_get(driver->connections[2].reconnects), 0);
+
+  _free_driver(driver);
+}
+
+Test(afsocket_dest_connections, messages_of_removed_connections_are_moved_on_reload)
+{
+  AFSocketDestDriver *driver = _create_driver(4, NULL);
+
+  for (gint i = 0; i < 8; i++)
+    _send_message(driver, "host");
+  _free_driver(driver);
+
+  driver = _create_driver(2, NULL);
+
+  cr_assert_eq(_get_queued_messages(&driver->connections[0]) + _get_queued_messages(&driver->connections[1]), 8);
+  cr_assert_null(cfg_persist_config_fetch(cfg, "afsocket_dd_qfile(stream,localhost.afunix:" TEST_SOCKET ").2"));
+  cr_assert_null(cfg_persist_config_fetch(cfg, "afsocket_dd_qfile(stream,localhost.afunix:" TEST_SOCKET ").3"));
+
+  _free_driver(driver);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+
+  main_loop = main_loop_get_instance();
+  main_loop_init(main_loop, &main_loop_options);
+
+  cfg = cfg_new_snippet();
+  cfg->state = clean_and_create_persist_state_for_test("test-afsocket-dest-connections.persist");
+  cfg->persist = persist_config_new();
+}
+
+static void
+teardown(void)
+{
+  persist_config_free(cfg->persist);
+  cfg->persist = NULL;
+  cancel_and_destroy_persist_state(cfg->state);
+  cfg->state = NULL;
+  cfg_free(cfg);
+  main_loop_deinit(main_loop);
+  app_shutdown();
+}
+
+TestSuite(afsocket_dest_connections, .init = setup, .fini = teardown);
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "afinet-source.h"
+#include "afsocket-source.h"
+#include "apphook.h"
+#include "mainloop.h"
+#include "plugin.h"
+#include "libtest/persist_lib.h"
+
+#include <criterion/criterion.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#define NUM_LISTEN_SOCKETS 2
+#define NUM_SENDERS 32
+
+MainLoop *main_loop;
+MainLoopOptions main_loop_options = {0};
+GlobalConfig *cfg;
+guint16 test_port;
+
+static guint16
+_find_free_udp_port(void)
+{
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  socklen_t addr_len = sizeof(addr);
+  gint sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+  cr_assert(bind(sock, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+  cr_assert(getsockname(sock, (struct sockaddr *) &addr, &addr_len) == 0);
+  close(sock);
+  return ntohs(addr.sin_port);
+}
+
+static AFSocketSourceDriver *
+_create_driver(gboolean reuseport_steering)
+{
+  AFInetSourceDriver *self = afinet_sd_new_udp(cfg);
+  LogDriver *driver = &self->super.super.super;
+  gchar *port = g_strdup_printf("%d", test_port);
+
+  driver->id = g_strdup("s_reuseport");
+  afinet_sd_set_localip(driver, "127.0.0.1");
+  afinet_sd_set_localport(driver, port);
+  afsocket_sd_set_keep_alive(driver, TRUE);
+  afsocket_sd_set_listen_sockets(driver, NUM_LISTEN_SOCKETS);
+  afsocket_sd_set_reuseport_steering(driver, reuseport_steering);
+  g_free(port);
+
+  cr_assert(log_pipe_init(&driver->super));
+  return &self->super;
+}
+
+static void
+_free_driver(AFSocketSourceDriver *self)
+{
+  log_pipe_deinit(&self->super.super.super);
+  log_pipe_unref(&self->super.super.super);
+}
+
+/* the sockets of the reuseport group, whether they are owned by a driver or kept in the persist config */
+static gint
+_find_listen_sockets(gint *socks, gint max_socks)
+{
+  gint num_socks = 0;
+
+  for (gint fd = 0; fd < 1024 && num_socks < max_socks; fd++)
+    {
+      struct sockaddr_in addr;
+      socklen_t addr_len = sizeof(addr);
+      gint type;
+      socklen_t type_len = sizeof(type);
+
+      if (getsockname(fd, (struct sockaddr *) &addr, &addr_len) < 0 || addr.sin_family != AF_INET)
+        continue;
+      if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_len) < 0 || type != SOCK_DGRAM)
+        continue;
+      if (ntohs(addr.sin_port) == test_port)
+        socks[num_socks++] = fd;
+    }
+  return num_socks;
+}
+
+/* every datagram comes from a new source port, the kernel's hash would spread them among the sockets */
+static void
+_send_from_different_ports(gint num_senders)
+{
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+
+  addr.sin_port = htons(test_port);
+  for (gint i = 0; i < num_senders; i++)
+    {
+      gint sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+      cr_assert(sendto(sock, "message", 7, 0, (struct sockaddr *) &addr, sizeof(addr)) == 7);
+      close(sock);
+    }
+}
+
+static gint
+_count_received(gint sock)
+{
+  gchar buf[64];
+  gint count = 0;
+
+  while (recv(sock, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+    count++;
+  return count;
+}
+
+static void
+_assert_all_received_by_one_socket(void)
+{
+  gint socks[NUM_LISTEN_SOCKETS];
+  gint counts[NUM_LISTEN_SOCKETS];
+
+  cr_assert_eq(_find_listen_sockets(socks, NUM_LISTEN_SOCKETS), NUM_LISTEN_SOCKETS);
+  _send_from_different_ports(NUM_SENDERS);
+
+  for (gint i = 0; i < NUM_LISTEN_SOCKETS; i++)
+    counts[i] = _count_received(socks[i]);
+
+  cr_assert_eq(counts[0] + counts[1], NUM_SENDERS);
+  cr_assert(counts[0] == NUM_SENDERS || counts[1] == NUM_SENDERS,
+            "datagrams of one sender address were spread among the sockets: %d/%d", counts[0], counts[1]);
+}
+
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+
+Test(afsocket_source_reuseport, steering_program_is_attached_to_new_sockets)
+{
+  AFSocketSourceDriver *driver = _create_driver(TRUE);
+
+  _assert_all_received_by_one_socket();
+
+  _free_driver(driver);
+}
+
+Test(afsocket_source_reuseport, steering_program_is_attached_to_sockets_kept_alive_across_reload)
+{
+  gint socks_before[NUM_LISTEN_SOCKETS], socks_after[NUM_LISTEN_SOCKETS];
+  AFSocketSourceDriver *driver = _create_driver(FALSE);
+
+  cr_assert_eq(_find_listen_sockets(socks_before, NUM_LISTEN_SOCKETS), NUM_LISTEN_SOCKETS);
+  _free_driver(driver);
+
+  driver = _create_driver(TRUE);
+
+  cr_assert_eq(_find_listen_sockets(socks_after, NUM_LISTEN_SOCKETS), NUM_LISTEN_SOCKETS);
+  cr_assert_arr_eq(socks_before, socks_after, sizeof(socks_before), "the sockets were not kept alive");
+  _assert_all_received_by_one_socket();
+
+  _free_driver(driver);
+}
+
+#endif
+
+static void
+setup(void)
+{
+  app_startup();
+
+  main_loop = main_loop_get_instance();
+  main_loop_init(main_loop, &main_loop_options);
+
+  cfg = cfg_new_snippet();
+  cr_assert(cfg_load_module(cfg, "syslogformat"));
+  cfg->state = clean_and_create_persist_state_for_test("test-afsocket-source-reuseport.persist");
+  cfg->persist = persist_config_new();
+
+  test_port = _find_free_udp_port();
+}
+
+static void
+teardown(void)
+{
+  persist_config_free(cfg->persist);
+  cfg->persist = NULL;
+  cancel_and_destroy_persist_state(cfg->state);
+  cfg->state = NULL;
+  cfg_free(cfg);
+  main_loop_deinit(main_loop);
+  app_shutdown();
+}
+
+TestSuite(afsocket_source_reuseport, .init = setup, .fini = teardown);
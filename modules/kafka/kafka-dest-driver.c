@@ -112,6 +112,14 @@ kafka_dd_set_poll_timeout(LogDriver *d, gint poll_timeout)
   self->poll_timeout = poll_timeout;
 }
 
+void
+kafka_dd_set_batch_produce(LogDriver *d, gboolean batch_produce)
+{
+  KafkaDestDriver *self = (KafkaDestDriver *)d;
+
+  self->batch_produce = batch_produce;
+}
+
 LogTemplateOptions *
 kafka_dd_get_template_options(LogDriver *d)
 {
@@ -26,6 +26,7 @@
 #include "kafka-dest-driver.h"
 #include "str-utils.h"
 #include "timeutils/misc.h"
+#include "stats/stats-cluster-logpipe.h"
 #include <zlib.h>
 
 static gboolean
@@ -70,15 +71,98 @@ kafka_dest_worker_resolve_template_topic_name(KafkaDestWorker *self, LogMessage
   return owner->fallback_topic_name;
 }
 
-rd_kafka_topic_t *
-kafka_dest_worker_calculate_topic_from_template(KafkaDestWorker *self, LogMessage *msg)
+static KafkaWorkerTopic *
+_worker_topic_new(KafkaDestWorker *self, rd_kafka_topic_t *topic)
+{
+  KafkaDestDriver *owner = (KafkaDestDriver *) self->super.owner;
+  KafkaWorkerTopic *worker_topic = g_new0(KafkaWorkerTopic, 1);
+  StatsClusterKey sc_key;
+
+  worker_topic->topic = topic;
+  worker_topic->batch = g_array_new(FALSE, TRUE, sizeof(rd_kafka_message_t));
+
+  /* the counter is shared by all workers producing to the same topic */
+  stats_lock();
+  stats_cluster_logpipe_key_set(&sc_key, owner->super.stats_source | SCS_DESTINATION, owner->super.super.super.id,
+                                rd_kafka_topic_name(topic));
+  worker_topic->stats_cluster = stats_register_dynamic_counter(STATS_LEVEL2, &sc_key, SC_TYPE_PROCESSED,
+                                &worker_topic->produced_messages);
+  stats_unlock();
+
+  return worker_topic;
+}
+
+static void
+_worker_topic_discard_batch(KafkaWorkerTopic *self)
+{
+  for (guint i = 0; i < self->batch->len; i++)
+    {
+      rd_kafka_message_t *rkmessage = &g_array_index(self->batch, rd_kafka_message_t, i);
+
+      g_free(rkmessage->payload);
+      g_free(rkmessage->key);
+      log_msg_unref((LogMessage *) rkmessage->_private);
+    }
+  g_array_set_size(self->batch, 0);
+}
+
+static void
+_worker_topic_free(KafkaWorkerTopic *self)
+{
+  /* messages not flushed yet are still in the backlog of the worker */
+  _worker_topic_discard_batch(self);
+  g_array_free(self->batch, TRUE);
+
+  stats_lock();
+  stats_unregister_dynamic_counter(self->stats_cluster, SC_TYPE_PROCESSED, &self->produced_messages);
+  stats_unlock();
+  g_free(self);
+}
+
+static KafkaWorkerTopic *
+_lookup_template_topic(KafkaDestWorker *self, LogMessage *msg)
 {
   KafkaDestDriver *owner = (KafkaDestDriver *) self->super.owner;
-  rd_kafka_topic_t *topic = kafka_dd_query_insert_topic(owner, kafka_dest_worker_resolve_template_topic_name(self, msg));
+  const gchar *name = kafka_dest_worker_resolve_template_topic_name(self, msg);
+  KafkaWorkerTopic *worker_topic = g_hash_table_lookup(self->topics, name);
 
+  if (worker_topic)
+    return worker_topic;
+
+  rd_kafka_topic_t *topic = kafka_dd_query_insert_topic(owner, name);
   g_assert(topic);
 
-  return topic;
+  worker_topic = _worker_topic_new(self, topic);
+  g_hash_table_insert(self->topics, g_strdup(name), worker_topic);
+  return worker_topic;
+}
+
+static KafkaWorkerTopic *
+_lookup_literal_topic(KafkaDestWorker *self)
+{
+  KafkaDestDriver *owner = (KafkaDestDriver *) self->super.owner;
+
+  if (!self->literal_topic)
+    self->literal_topic = _worker_topic_new(self, owner->topic);
+
+  return self->literal_topic;
+}
+
+static KafkaWorkerTopic *
+_lookup_topic(KafkaDestWorker *self, LogMessage *msg)
+{
+  KafkaDestDriver *owner = (KafkaDestDriver *) self->super.owner;
+
+  if (kafka_dd_is_topic_name_a_template(owner))
+    return _lookup_template_topic(self, msg);
+
+  return _lookup_literal_topic(self);
+}
+
+rd_kafka_topic_t *
+kafka_dest_worker_calculate_topic_from_template(KafkaDestWorker *self, LogMessage *msg)
+{
+  return _lookup_template_topic(self, msg)->topic;
 }
 
 rd_kafka_topic_t *
@@ -92,22 +176,15 @@ kafka_dest_worker_get_literal_topic(KafkaDestWorker *self)
 rd_kafka_topic_t *
 kafka_dest_worker_calculate_topic(KafkaDestWorker *self, LogMessage *msg)
 {
-  KafkaDestDriver *owner = (KafkaDestDriver *) self->super.owner;
-
-  if (kafka_dd_is_topic_name_a_template(owner))
-    {
-      return kafka_dest_worker_calculate_topic_from_template(self, msg);
-    }
-
-  return kafka_dest_worker_get_literal_topic(self);
+  return _lookup_topic(self, msg)->topic;
 }
 
 static gboolean
-_publish_message(KafkaDestWorker *self, LogMessage *msg)
+_publish_message(KafkaDestWorker *self, KafkaWorkerTopic *worker_topic, LogMessage *msg)
 {
   KafkaDestDriver *owner = (KafkaDestDriver *) self->super.owner;
   int block_flag = _is_poller_thread(self) ? 0 : RD_KAFKA_MSG_F_BLOCK;
-  rd_kafka_topic_t *topic = kafka_dest_worker_calculate_topic(self, msg);
+  rd_kafka_topic_t *topic = worker_topic->topic;
 
   if (rd_kafka_produce(topic,
                        RD_KAFKA_PARTITION_UA,
@@ -135,9 +212,107 @@ _publish_message(KafkaDestWorker *self, LogMessage *msg)
 
   /* we passed the allocated buffers to rdkafka, which will eventually free them */
   g_string_steal(self->message);
+  stats_counter_inc(worker_topic->produced_messages);
   return TRUE;
 }
 
+static void
+_queue_message(KafkaDestWorker *self, KafkaWorkerTopic *worker_topic, LogMessage *msg)
+{
+  rd_kafka_message_t rkmessage = { 0 };
+
+  rkmessage.partition = RD_KAFKA_PARTITION_UA;
+  rkmessage.payload = self->message->str;
+  rkmessage.len = self->message->len;
+  if (self->key->len)
+    {
+      rkmessage.key = g_strndup(self->key->str, self->key->len);
+      rkmessage.key_len = self->key->len;
+    }
+  rkmessage._private = log_msg_ref(msg);
+  g_array_append_val(worker_topic->batch, rkmessage);
+
+  /* the payload is passed to rdkafka at flush time */
+  g_string_steal(self->message);
+}
+
+static gboolean
+_republish_batch_member(KafkaDestWorker *self, KafkaWorkerTopic *worker_topic, rd_kafka_message_t *rkmessage)
+{
+  KafkaDestDriver *owner = (KafkaDestDriver *) self->super.owner;
+  int block_flag = _is_poller_thread(self) ? 0 : RD_KAFKA_MSG_F_BLOCK;
+
+  /* this is usually a full rdkafka queue, retry the message the same way
+   * as rd_kafka_produce() would be called without batching, which blocks
+   * all but the poller thread */
+  if (rd_kafka_produce(worker_topic->topic,
+                       RD_KAFKA_PARTITION_UA,
+                       RD_KAFKA_MSG_F_FREE | block_flag,
+                       rkmessage->payload, rkmessage->len,
+                       rkmessage->key, rkmessage->key_len,
+                       rkmessage->_private) == 0)
+    {
+      stats_counter_inc(worker_topic->produced_messages);
+      return TRUE;
+    }
+
+  msg_error("kafka: failed to publish message, putting it back to our queue",
+            evt_tag_str("topic", rd_kafka_topic_name(worker_topic->topic)),
+            evt_tag_str("error", rd_kafka_err2str(rd_kafka_last_error())),
+            evt_tag_str("driver", owner->super.super.super.id),
+            log_pipe_location_tag(&owner->super.super.super.super));
+
+  g_free(rkmessage->payload);
+  return FALSE;
+}
+
+static void
+_produce_batch(KafkaDestWorker *self, KafkaWorkerTopic *worker_topic)
+{
+  KafkaDestDriver *owner = (KafkaDestDriver *) self->super.owner;
+  rd_kafka_message_t *rkmessages = (rd_kafka_message_t *) worker_topic->batch->data;
+  gint count = worker_topic->batch->len;
+  gint failed = 0;
+
+  /* the partitioner is run for each message, as the partition is RD_KAFKA_PARTITION_UA */
+  gint produced = rd_kafka_produce_batch(worker_topic->topic, RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_FREE,
+                                         rkmessages, count);
+  stats_counter_add(worker_topic->produced_messages, produced);
+
+  msg_debug("kafka: message batch published",
+            evt_tag_str("topic", rd_kafka_topic_name(worker_topic->topic)),
+            evt_tag_int("batch_size", count),
+            evt_tag_int("produced", produced),
+            evt_tag_str("driver", owner->super.super.super.id),
+            log_pipe_location_tag(&owner->super.super.super.super));
+
+  for (gint i = 0; i < count; i++)
+    {
+      rd_kafka_message_t *rkmessage = &rkmessages[i];
+
+      /* rdkafka took the payload of the successful ones, and copied the
+       * keys; the messages failed again are collected at the front of the
+       * batch */
+      if (rkmessage->err != RD_KAFKA_RESP_ERR_NO_ERROR && !_republish_batch_member(self, worker_topic, rkmessage))
+        rkmessages[failed++]._private = rkmessage->_private;
+      g_free(rkmessage->key);
+    }
+
+  /* push_head() prepends, go backwards to keep their original order */
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT_NOACK;
+  for (gint i = failed - 1; i >= 0; i--)
+    log_queue_push_head(self->super.queue, (LogMessage *) rkmessages[i]._private, &path_options);
+
+  g_array_set_size(worker_topic->batch, 0);
+}
+
+static void
+_produce_batch_if_not_empty(KafkaDestWorker *self, KafkaWorkerTopic *worker_topic)
+{
+  if (worker_topic && worker_topic->batch->len > 0)
+    _produce_batch(self, worker_topic);
+}
+
 static void
 _update_drain_timer(KafkaDestWorker *self)
 {
@@ -187,21 +362,51 @@ static LogThreadedResult
 kafka_dest_worker_insert(LogThreadedDestWorker *s, LogMessage *msg)
 {
   KafkaDestWorker *self = (KafkaDestWorker *)s;
+  KafkaDestDriver *owner = (KafkaDestDriver *) self->super.owner;
 
   _drain_responses(self);
 
   _format_message_and_key(self, msg);
-  if (!_publish_message(self, msg))
+  KafkaWorkerTopic *worker_topic = _lookup_topic(self, msg);
+
+  if (owner->batch_produce)
+    {
+      _queue_message(self, worker_topic, msg);
+      return LTR_QUEUED;
+    }
+
+  if (!_publish_message(self, worker_topic, msg))
     return LTR_RETRY;
 
   _drain_responses(self);
   return LTR_SUCCESS;
 }
 
+static LogThreadedResult
+kafka_dest_worker_flush(LogThreadedDestWorker *s, LogThreadedFlushMode mode)
+{
+  KafkaDestWorker *self = (KafkaDestWorker *)s;
+  GHashTableIter iter;
+  gpointer value;
+
+  _produce_batch_if_not_empty(self, self->literal_topic);
+
+  g_hash_table_iter_init(&iter, self->topics);
+  while (g_hash_table_iter_next(&iter, NULL, &value))
+    _produce_batch_if_not_empty(self, (KafkaWorkerTopic *) value);
+
+  _drain_responses(self);
+  return LTR_SUCCESS;
+}
+
 static void
 kafka_dest_worker_free(LogThreadedDestWorker *s)
 {
   KafkaDestWorker *self = (KafkaDestWorker *)s;
+
+  g_hash_table_destroy(self->topics);
+  if (self->literal_topic)
+    _worker_topic_free(self->literal_topic);
   g_string_free(self->key, TRUE);
   g_string_free(self->message, TRUE);
   g_string_free(self->topic_name_buffer, TRUE);
@@ -225,10 +430,13 @@ LogThreadedDestWorker *
 kafka_dest_worker_new(LogThreadedDestDriver *o, gint worker_index)
 {
   KafkaDestWorker *self = g_new0(KafkaDestWorker, 1);
+  KafkaDestDriver *owner = (KafkaDestDriver *) o;
 
   log_threaded_dest_worker_init_instance(&self->super, o, worker_index);
   self->super.thread_init = _thread_init;
   self->super.insert = kafka_dest_worker_insert;
+  if (owner->batch_produce)
+    self->super.flush = kafka_dest_worker_flush;
   self->super.free_fn = kafka_dest_worker_free;
 
   IV_TIMER_INIT(&self->poll_timer);
@@ -238,6 +446,7 @@ kafka_dest_worker_new(LogThreadedDestDriver *o, gint worker_index)
   self->key = g_string_sized_new(0);
   self->message = g_string_sized_new(1024);
   self->topic_name_buffer = g_string_sized_new(256);
+  self->topics = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) _worker_topic_free);
 
   return &self->super;
 }
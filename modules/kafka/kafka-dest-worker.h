@@ -26,6 +26,19 @@
 #define KAFKA_DEST_WORKER_H_INCLUDED
 
 #include "logthrdest/logthrdestdrv.h"
+#include "stats/stats-registry.h"
+#include <librdkafka/rdkafka.h>
+
+/* a topic as seen by a single worker */
+typedef struct _KafkaWorkerTopic
+{
+  /* owned by KafkaDestDriver */
+  rd_kafka_topic_t *topic;
+  StatsCluster *stats_cluster;
+  StatsCounterItem *produced_messages;
+  /* rd_kafka_message_t entries waiting for rd_kafka_produce_batch() */
+  GArray *batch;
+} KafkaWorkerTopic;
 
 typedef struct _KafkaDestWorker
 {
@@ -34,6 +47,10 @@ typedef struct _KafkaDestWorker
   GString *key;
   GString *message;
   GString *topic_name_buffer;
+  /* topic name -> KafkaWorkerTopic, only accessed by this worker, so
+   * the shared topic table of the driver is only locked on a miss */
+  GHashTable *topics;
+  KafkaWorkerTopic *literal_topic;
 } KafkaDestWorker;
 
 LogThreadedDestWorker *kafka_dest_worker_new(LogThreadedDestDriver *owner, gint worker_index);
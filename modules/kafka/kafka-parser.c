@@ -50,6 +50,7 @@ static CfgLexerKeyword kafka_keywords[] =
   { "kafka_bootstrap_servers", KW_BOOTSTRAP_SERVERS, KWS_OBSOLETE, "Please use bootstrap-servers option" },
   { "workers",        KW_WORKERS },
   { "poll_timeout",   KW_POLL_TIMEOUT },
+  { "batch_produce",  KW_BATCH_PRODUCE },
   { "kafka_c",        KW_KAFKA },   /* compatibility with incubator naming */
   { NULL }
 };
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include <syslog-ng.h>
+#include <apphook.h>
+#include "logthrdest/logthrdestdrv.h"
+#include "logqueue.h"
+#include <librdkafka/rdkafka.h>
+#include "kafka-dest-worker.h"
+#include "kafka-dest-driver.h"
+#include "kafka-props.h"
+
+#include <criterion/criterion.h>
+
+static void
+setup(void)
+{
+  app_startup();
+  configuration = cfg_new_snippet();
+}
+
+static void
+teardown(void)
+{
+  cfg_free(configuration);
+  app_shutdown();
+}
+
+TestSuite(kafka_batch_produce, .init = setup, .fini = teardown);
+
+/* no brokers are configured, so the produced messages stay in the rdkafka
+ * queue and the ones beyond its limit fail with RD_KAFKA_RESP_ERR__QUEUE_FULL */
+static LogDriver *
+_init_batching_driver(gint rdkafka_queue_limit)
+{
+  LogDriver *driver = kafka_dd_new(configuration);
+  LogTemplate *topic_name = log_template_new(configuration, NULL);
+  gchar *limit = g_strdup_printf("%d", rdkafka_queue_limit);
+
+  cr_assert(log_template_compile(topic_name, "topicname", NULL));
+  kafka_dd_set_topic(driver, topic_name);
+  kafka_dd_set_batch_produce(driver, TRUE);
+  kafka_dd_set_flush_timeout_on_reload(driver, 0);
+  kafka_dd_merge_config(driver, g_list_append(NULL, kafka_property_new("queue.buffering.max.messages", limit)));
+  g_free(limit);
+
+  cr_assert(log_pipe_init(&driver->super));
+  return driver;
+}
+
+static void
+_deinit_driver(LogDriver *driver)
+{
+  KafkaDestWorker *worker = (KafkaDestWorker *) ((KafkaDestDriver *) driver)->super.workers[0];
+
+  /* registered by flush(), as worker 0 is the poller */
+  if (iv_timer_registered(&worker->poll_timer))
+    iv_timer_unregister(&worker->poll_timer);
+
+  log_pipe_deinit(&driver->super);
+  log_pipe_unref(&driver->super);
+}
+
+/* pops the messages from the queue and inserts them the same way the worker thread would */
+static void
+_insert_messages(KafkaDestWorker *worker, gint num_messages)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT_NOACK;
+
+  for (gint i = 0; i < num_messages; i++)
+    {
+      LogMessage *msg = log_msg_new_empty();
+      gchar *text = g_strdup_printf("m%d", i);
+
+      log_msg_set_value(msg, LM_V_MESSAGE, text, -1);
+      log_queue_push_tail(worker->super.queue, msg, &path_options);
+      g_free(text);
+    }
+
+  for (gint i = 0; i < num_messages; i++)
+    {
+      LogMessage *msg = log_queue_pop_head(worker->super.queue, &path_options);
+
+      cr_assert_not_null(msg);
+      cr_assert_eq(worker->super.insert(&worker->super, msg), LTR_QUEUED);
+      log_msg_unref(msg);
+    }
+}
+
+static void
+_assert_requeued_messages(LogQueue *queue, gint first, gint last)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT_NOACK;
+
+  cr_assert_eq(log_queue_get_length(queue), last - first + 1);
+  for (gint i = first; i <= last; i++)
+    {
+      LogMessage *msg = log_queue_pop_head(queue, &path_options);
+      gchar *expected = g_strdup_printf("m%d", i);
+
+      cr_assert_not_null(msg);
+      cr_assert_str_eq(log_msg_get_value(msg, LM_V_MESSAGE, NULL), expected);
+      g_free(expected);
+      log_msg_unref(msg);
+    }
+}
+
+Test(kafka_batch_produce, failed_members_of_the_batch_are_requeued_in_their_original_order)
+{
+  LogDriver *driver = _init_batching_driver(2);
+  KafkaDestWorker *worker = (KafkaDestWorker *) ((KafkaDestDriver *) driver)->super.workers[0];
+
+  _insert_messages(worker, 5);
+  cr_assert_eq(log_queue_get_length(worker->super.queue), 0);
+
+  cr_assert_eq(worker->super.flush(&worker->super, LTF_FLUSH_NORMAL), LTR_SUCCESS);
+  _assert_requeued_messages(worker->super.queue, 2, 4);
+  cr_assert_eq(worker->literal_topic->batch->len, 0);
+
+  _deinit_driver(driver);
+}
+
+Test(kafka_batch_produce, nothing_is_requeued_when_the_whole_batch_is_produced)
+{
+  LogDriver *driver = _init_batching_driver(5);
+  KafkaDestWorker *worker = (KafkaDestWorker *) ((KafkaDestDriver *) driver)->super.workers[0];
+
+  _insert_messages(worker, 5);
+
+  cr_assert_eq(worker->super.flush(&worker->super, LTF_FLUSH_NORMAL), LTR_SUCCESS);
+  cr_assert_eq(log_queue_get_length(worker->super.queue), 0);
+  cr_assert_eq(worker->literal_topic->batch->len, 0);
+
+  _deinit_driver(driver);
+}
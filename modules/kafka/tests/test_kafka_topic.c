@@ -257,3 +257,37 @@ Test(kafka_topic, test_calculate_topic)
   log_pipe_unref(&driver->super);
   cfg_free(configuration);
 }
+
+Test(kafka_topic, test_topics_are_cached_per_worker)
+{
+  configuration = cfg_new_snippet();
+  LogDriver *driver = kafka_dd_new(configuration);
+
+  _init_topic_names(driver, "$kafka_topic", "fallbackhere");
+
+  cr_assert(kafka_dd_init((LogPipe *) driver));
+
+  KafkaDestDriver *kafka_driver = (KafkaDestDriver *) driver;
+
+  KafkaDestWorker *worker = (KafkaDestWorker *) kafka_dest_worker_new(&kafka_driver->super, 0);
+
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value_by_name(msg, "kafka_topic", "cachedtopic", -1);
+  rd_kafka_topic_t *topic = kafka_dest_worker_calculate_topic(worker, msg);
+
+  cr_assert_eq(kafka_dest_worker_calculate_topic(worker, msg), topic);
+  cr_assert_eq(kafka_dd_query_insert_topic(kafka_driver, "cachedtopic"), topic);
+  cr_assert_eq(g_hash_table_size(worker->topics), 1);
+
+  log_msg_set_value_by_name(msg, "kafka_topic", "invalid name", -1);
+  cr_assert_str_eq(rd_kafka_topic_name(kafka_dest_worker_calculate_topic(worker, msg)), "fallbackhere");
+  cr_assert_eq(g_hash_table_size(worker->topics), 2);
+
+  log_msg_unref(msg);
+
+  log_threaded_dest_worker_free(&worker->super);
+  log_pipe_deinit(&driver->super);
+  log_pipe_unref(&driver->super);
+  cfg_free(configuration);
+}
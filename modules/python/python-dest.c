@@ -47,6 +47,9 @@ typedef struct
   GHashTable *options;
   ValuePairs *vp;
 
+  /* messages queued for send_batch(), along with their seqnum */
+  GArray *batch;
+
   struct
   {
     PyObject *class;
@@ -54,6 +57,7 @@ typedef struct
     PyObject *is_opened;
     PyObject *open;
     PyObject *send;
+    PyObject *send_batch;
     PyObject *flush;
     PyObject *generate_persist_name;
     GPtrArray *_refs_to_clean;
@@ -290,6 +294,20 @@ _py_invoke_send(PythonDestDriver *self, PyObject *dict)
   return result;
 }
 
+static LogThreadedResult
+_py_invoke_send_batch(PythonDestDriver *self, PyObject *list)
+{
+  PyObject *ret;
+  ret = _py_invoke_function(self->py.send_batch, list, self->class, self->super.super.super.id);
+
+  if (!ret)
+    return LTR_ERROR;
+
+  LogThreadedResult result = pyobject_to_worker_insert_result(ret);
+  Py_XDECREF(ret);
+  return result;
+}
+
 static gboolean
 _py_invoke_init(PythonDestDriver *self)
 {
@@ -385,10 +403,11 @@ _py_init_bindings(PythonDestDriver *self)
   self->py.open = _py_get_attr_or_null(self->py.instance, "open");
   self->py.flush = _py_get_attr_or_null(self->py.instance, "flush");
   self->py.send = _py_get_attr_or_null(self->py.instance, "send");
+  self->py.send_batch = _py_get_attr_or_null(self->py.instance, "send_batch");
   self->py.generate_persist_name = _py_get_attr_or_null(self->py.instance, "generate_persist_name");
-  if (!self->py.send)
+  if (!self->py.send && !self->py.send_batch)
     {
-      msg_error("Error initializing Python destination, class does not have a send() method",
+      msg_error("Error initializing Python destination, class does not have a send() or send_batch() method",
                 evt_tag_str("driver", self->super.super.super.id),
                 evt_tag_str("class", self->class));
       return FALSE;
@@ -404,6 +423,7 @@ _py_init_bindings(PythonDestDriver *self)
   g_ptr_array_add(self->py._refs_to_clean, self->py.open);
   g_ptr_array_add(self->py._refs_to_clean, self->py.flush);
   g_ptr_array_add(self->py._refs_to_clean, self->py.send);
+  g_ptr_array_add(self->py._refs_to_clean, self->py.send_batch);
   g_ptr_array_add(self->py._refs_to_clean, self->py.generate_persist_name);
 
   return TRUE;
@@ -437,14 +457,14 @@ _py_init_object(PythonDestDriver *self)
 }
 
 static gboolean
-_py_construct_message(PythonDestDriver *self, LogMessage *msg, PyObject **msg_object)
+_py_construct_message(PythonDestDriver *self, LogMessage *msg, gint32 seq_num, PyObject **msg_object)
 {
   gboolean success;
   *msg_object = NULL;
 
   if (self->vp)
     {
-      LogTemplateEvalOptions options = {&self->template_options, LTZ_LOCAL, self->super.worker.instance.seq_num, NULL};
+      LogTemplateEvalOptions options = {&self->template_options, LTZ_LOCAL, seq_num, NULL};
       success = py_value_pairs_apply(self->vp, &options, msg, msg_object);
       if (!success && (self->template_options.on_error & ON_ERROR_DROP_MESSAGE))
         return FALSE;
@@ -457,6 +477,76 @@ _py_construct_message(PythonDestDriver *self, LogMessage *msg, PyObject **msg_ob
   return TRUE;
 }
 
+typedef struct
+{
+  LogMessage *msg;
+  gint32 seq_num;
+} PythonDestBatchEntry;
+
+static void
+_clear_batch(PythonDestDriver *self)
+{
+  for (guint i = 0; i < self->batch->len; i++)
+    log_msg_unref(g_array_index(self->batch, PythonDestBatchEntry, i).msg);
+  g_array_set_size(self->batch, 0);
+}
+
+static PyObject *
+_py_construct_batch(PythonDestDriver *self)
+{
+  PyObject *list = PyList_New(0);
+
+  for (guint i = 0; i < self->batch->len; i++)
+    {
+      PythonDestBatchEntry *entry = &g_array_index(self->batch, PythonDestBatchEntry, i);
+      PyObject *msg_object;
+
+      /* a message failing value-pairs() is left out of the batch, but acked
+       * along with the rest of it, just as send() would not see it either */
+      if (!_py_construct_message(self, entry->msg, entry->seq_num, &msg_object))
+        continue;
+
+      PyList_Append(list, msg_object);
+      Py_DECREF(msg_object);
+    }
+  return list;
+}
+
+/* NOTE: runs with the GIL held */
+static LogThreadedResult
+_py_send_batch(PythonDestDriver *self)
+{
+  LogThreadedResult result;
+
+  if (self->py.is_opened && !_py_invoke_is_opened(self))
+    {
+      if (!_py_invoke_open(self))
+        return LTR_NOT_CONNECTED;
+    }
+
+  PyObject *list = _py_construct_batch(self);
+  result = _py_invoke_send_batch(self, list);
+  Py_DECREF(list);
+
+  if (result == LTR_SUCCESS)
+    result = _py_invoke_flush(self);
+  return result;
+}
+
+/* send_batch() fast path: messages are only collected here and the
+ * Python code is invoked from flush(), once per batch, with the GIL
+ * acquired only once. */
+static LogThreadedResult
+_queue_for_batch(PythonDestDriver *self, LogMessage *msg)
+{
+  PythonDestBatchEntry entry = { log_msg_ref(msg), self->super.worker.instance.seq_num };
+
+  g_array_append_val(self->batch, entry);
+
+  if (self->super.batch_lines <= 1)
+    return log_threaded_dest_driver_flush(&self->super);
+  return LTR_QUEUED;
+}
 
 static LogThreadedResult
 python_dd_insert(LogThreadedDestDriver *d, LogMessage *msg)
@@ -466,6 +556,9 @@ python_dd_insert(LogThreadedDestDriver *d, LogMessage *msg)
   PyObject *msg_object;
   PyGILState_STATE gstate;
 
+  if (self->py.send_batch)
+    return _queue_for_batch(self, msg);
+
   gstate = PyGILState_Ensure();
   if (self->py.is_opened && !_py_invoke_is_opened(self))
     {
@@ -476,7 +569,7 @@ python_dd_insert(LogThreadedDestDriver *d, LogMessage *msg)
         }
     }
 
-  if (!_py_construct_message(self, msg, &msg_object))
+  if (!_py_construct_message(self, msg, self->super.worker.instance.seq_num, &msg_object))
     goto exit;
 
   result =_py_invoke_send(self, msg_object);
@@ -505,9 +598,18 @@ python_dd_flush(LogThreadedDestDriver *s)
   PythonDestDriver *self = (PythonDestDriver *)s;
   PyGILState_STATE gstate;
 
+  LogThreadedResult result;
+
   gstate = PyGILState_Ensure();
-  LogThreadedResult result = _py_invoke_flush(self);
+  if (self->batch->len > 0)
+    result = _py_send_batch(self);
+  else
+    result = _py_invoke_flush(self);
   PyGILState_Release(gstate);
+
+  /* the batch is either acked or rewound as a whole, rewound messages are
+   * going to be inserted again */
+  _clear_batch(self);
   return result;
 };
 
@@ -597,6 +699,7 @@ python_dd_deinit(LogPipe *d)
   _py_invoke_deinit(self);
   PyGILState_Release(gstate);
 
+  _clear_batch(self);
   return log_threaded_dest_driver_deinit_method(d);
 }
 
@@ -621,6 +724,9 @@ python_dd_free(LogPipe *d)
 
   string_list_free(self->loaders);
 
+  _clear_batch(self);
+  g_array_free(self->batch, TRUE);
+
   log_threaded_dest_driver_free(d);
 }
 
@@ -646,6 +752,7 @@ python_dd_new(GlobalConfig *cfg)
   self->super.stats_source = stats_register_type("python");
 
   self->options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  self->batch = g_array_new(FALSE, FALSE, sizeof(PythonDestBatchEntry));
 
   return (LogDriver *)self;
 }
@@ -27,7 +27,6 @@
 #include "logmsg/logmsg.h"
 #include "messages.h"
 #include "timeutils/cache.h"
-#include "str-utils.h"
 #include "timeutils/unixtime.h"
 #include "timeutils/misc.h"
 
@@ -71,36 +70,174 @@ _is_key_blacklisted(const gchar *key)
   return (bsearch(&key, blacklist, n, sizeof(gchar *), _str_cmp) != NULL);
 }
 
-static PyObject *
-_py_log_message_subscript(PyObject *o, PyObject *key)
+/* Maps the key objects used from Python code to NVHandles.  Keys are
+ * usually string literals, so the same objects are looked up over and over
+ * again: this way the NVRegistry lock is only taken once per name.  Only
+ * accessed with the GIL held. */
+static PyObject *nv_handle_cache;
+
+static NVHandle
+_lookup_value_handle(PyObject *key)
 {
-  if (!_py_is_string(key))
+  PyObject *py_handle = PyDict_GetItem(nv_handle_cache, key);
+
+  if (py_handle)
+    return (NVHandle) pyobject_as_int(py_handle);
+
+  const gchar *name = _py_get_string_as_string(key);
+  NVHandle handle = log_msg_get_value_handle(name);
+
+  /* blacklisted and invalid names are never cached, so a cache hit also
+   * means that the name can be queried */
+  if (handle && !_is_key_blacklisted(name))
     {
-      PyErr_SetString(PyExc_TypeError, "key is not a string object");
-      return NULL;
+      py_handle = int_as_pyobject(handle);
+      PyDict_SetItem(nv_handle_cache, key, py_handle);
+      Py_DECREF(py_handle);
     }
+  return handle;
+}
+
+static NVHandle
+_lookup_queryable_value_handle(PyObject *key)
+{
+  PyObject *py_handle = PyDict_GetItem(nv_handle_cache, key);
+
+  if (py_handle)
+    return (NVHandle) pyobject_as_int(py_handle);
 
   const gchar *name = _py_get_string_as_string(key);
 
   if (_is_key_blacklisted(name))
     {
       PyErr_Format(PyExc_KeyError, "Blacklisted attribute %s was requested", name);
+      return 0;
+    }
+
+  NVHandle handle = _lookup_value_handle(key);
+  if (!handle)
+    PyErr_Format(PyExc_KeyError, "Invalid name-value pair name was requested: '%s'", name);
+  return handle;
+}
+
+static const gchar *
+_get_value_by_key(PyLogMessage *self, PyObject *key, gssize *value_len)
+{
+  if (!_py_is_string(key))
+    {
+      PyErr_SetString(PyExc_TypeError, "key is not a string object");
       return NULL;
     }
-  NVHandle handle = log_msg_get_value_handle(name);
-  PyLogMessage *py_msg = (PyLogMessage *)o;
-  gssize value_len = 0;
-  const gchar *value = log_msg_get_value(py_msg->msg, handle, &value_len);
 
+  NVHandle handle = _lookup_queryable_value_handle(key);
+  if (!handle)
+    return NULL;
+
+  const gchar *value = log_msg_get_value(self->msg, handle, value_len);
   if (!value)
     {
-      PyErr_Format(PyExc_KeyError, "No such name-value pair %s", name);
+      PyErr_Format(PyExc_KeyError, "No such name-value pair %s", _py_get_string_as_string(key));
       return NULL;
     }
+  return value;
+}
+
+static PyObject *
+_py_log_message_subscript(PyObject *o, PyObject *key)
+{
+  gssize value_len = 0;
+  const gchar *value = _get_value_by_key((PyLogMessage *) o, key, &value_len);
+
+  if (!value)
+    return NULL;
+
+  return PyBytes_FromStringAndSize(value, value_len);
+}
+
+/* Exports a value of a LogMessage through the buffer protocol, while
+ * keeping a reference to the message itself, so that a memoryview can refer
+ * to the payload directly. */
+typedef struct _PyLogMessageValue
+{
+  PyObject_HEAD
+  LogMessage *msg;
+  const gchar *value;
+  gssize value_len;
+} PyLogMessageValue;
+
+static int
+_py_log_message_value_get_buffer(PyLogMessageValue *self, Py_buffer *view, int flags)
+{
+  return PyBuffer_FillInfo(view, (PyObject *) self, (void *) self->value, self->value_len, TRUE, flags);
+}
+
+static void
+py_log_message_value_free(PyLogMessageValue *self)
+{
+  log_msg_unref(self->msg);
+  PyObject_Del(self);
+}
+
+static PyBufferProcs py_log_message_value_buffer =
+{
+  .bf_getbuffer = (getbufferproc) _py_log_message_value_get_buffer,
+};
+
+static PyTypeObject py_log_message_value_type =
+{
+  PyVarObject_HEAD_INIT(&PyType_Type, 0)
+  .tp_name = "LogMessageValue",
+  .tp_basicsize = sizeof(PyLogMessageValue),
+  .tp_dealloc = (destructor) py_log_message_value_free,
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+  .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER,
+#else
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+#endif
+  .tp_doc = "Read-only buffer referring to a value of a LogMessage",
+  .tp_as_buffer = &py_log_message_value_buffer,
+  0,
+};
+
+/* Returns a read-only memoryview of a value without copying it.  This is
+ * only possible for write protected messages (e.g. in destinations): values
+ * of a writable message may be overwritten or relocated when another value
+ * is set, so in that case the view refers to a private copy, which costs
+ * the same as a subscript. */
+static PyObject *
+py_log_message_get_view(PyLogMessage *self, PyObject *args, PyObject *kwrds)
+{
+  PyObject *key;
+
+  static const gchar *kwlist[] = {"name", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwrds, "O", (gchar **) kwlist, &key))
+    return NULL;
+
+  gssize value_len = 0;
+  const gchar *value = _get_value_by_key(self, key, &value_len);
+
+  if (!value)
+    return NULL;
+
+  if (!log_msg_is_write_protected(self->msg))
+    {
+      PyObject *copy = PyBytes_FromStringAndSize(value, value_len);
+      PyObject *view = PyMemoryView_FromObject(copy);
+      Py_XDECREF(copy);
+      return view;
+    }
 
-  APPEND_ZERO(value, value, value_len);
+  PyLogMessageValue *exporter = PyObject_New(PyLogMessageValue, &py_log_message_value_type);
+  if (!exporter)
+    return NULL;
 
-  return PyBytes_FromString(value);
+  exporter->msg = log_msg_ref(self->msg);
+  exporter->value = value;
+  exporter->value_len = value_len;
+
+  PyObject *view = PyMemoryView_FromObject((PyObject *) exporter);
+  Py_DECREF(exporter);
+  return view;
 }
 
 static int
@@ -125,10 +262,11 @@ _py_log_message_ass_subscript(PyObject *o, PyObject *key, PyObject *value)
       return -1;
     }
 
-  NVHandle handle = log_msg_get_value_handle(name);
+  NVHandle handle = _lookup_value_handle(key);
 
   if (value && _py_is_string(value))
     {
+      Py_CLEAR(py_msg->values);
       log_msg_set_value(py_msg->msg, handle, _py_get_string_as_string(value), -1);
     }
   else
@@ -149,6 +287,7 @@ py_log_message_free(PyLogMessage *self)
 {
   log_msg_unref(self->msg);
   Py_CLEAR(self->bookmark_data);
+  Py_CLEAR(self->values);
   Py_TYPE(self)->tp_free((PyObject *) self);
 }
 
@@ -163,6 +302,7 @@ py_log_message_new(LogMessage *msg)
 
   self->msg = log_msg_ref(msg);
   self->bookmark_data = NULL;
+  self->values = NULL;
   return (PyObject *) self;
 }
 
@@ -183,6 +323,7 @@ py_log_message_new_empty(PyTypeObject *subtype, PyObject *args, PyObject *kwds)
 
   self->msg = log_msg_new_empty();
   self->bookmark_data = NULL;
+  self->values = NULL;
   invalidate_cached_time();
 
   if (message)
@@ -194,13 +335,6 @@ py_log_message_new_empty(PyTypeObject *subtype, PyObject *args, PyObject *kwds)
   return (PyObject *) self;
 }
 
-static PyMappingMethods py_log_message_mapping =
-{
-  .mp_length = NULL,
-  .mp_subscript = (binaryfunc) _py_log_message_subscript,
-  .mp_ass_subscript = (objobjargproc) _py_log_message_ass_subscript
-};
-
 static gboolean
 _collect_nvpair_names_from_logmsg(NVHandle handle, const gchar *name, const gchar *value, gssize value_len,
                                   gpointer user_data)
@@ -247,6 +381,59 @@ _logmessage_get_keys_method(PyLogMessage *self)
   return keys;
 }
 
+/* The name-value dict of the message is only built when the whole message
+ * is needed (iteration, len() or items()), plain subscripts go directly to
+ * the LogMessage.  The dict is dropped whenever a value is set. */
+static PyObject *
+_materialize_values(PyLogMessage *self)
+{
+  if (self->values)
+    return self->values;
+
+  PyObject *keys = _logmessage_get_keys_method(self);
+  PyObject *values = PyDict_New();
+
+  for (Py_ssize_t i = 0; i < PyList_Size(keys); i++)
+    {
+      PyObject *key = PyList_GetItem(keys, i);
+      gssize value_len = 0;
+      const gchar *value = log_msg_get_value(self->msg, _lookup_value_handle(key), &value_len);
+      PyObject *py_value = PyBytes_FromStringAndSize(value ? value : "", value_len);
+
+      PyDict_SetItem(values, key, py_value);
+      Py_DECREF(py_value);
+    }
+  Py_DECREF(keys);
+
+  self->values = values;
+  return self->values;
+}
+
+static Py_ssize_t
+_py_log_message_length(PyLogMessage *self)
+{
+  return PyDict_Size(_materialize_values(self));
+}
+
+static PyObject *
+_py_log_message_iter(PyLogMessage *self)
+{
+  return PyObject_GetIter(_materialize_values(self));
+}
+
+static PyObject *
+_logmessage_get_items_method(PyLogMessage *self)
+{
+  return PyDict_Items(_materialize_values(self));
+}
+
+static PyMappingMethods py_log_message_mapping =
+{
+  .mp_length = (lenfunc) _py_log_message_length,
+  .mp_subscript = (binaryfunc) _py_log_message_subscript,
+  .mp_ass_subscript = (objobjargproc) _py_log_message_ass_subscript
+};
+
 static PyObject *
 py_log_message_set_pri(PyLogMessage *self, PyObject *args, PyObject *kwrds)
 {
@@ -410,6 +597,7 @@ py_log_message_parse(PyObject *_none, PyObject *args, PyObject *kwrds)
 
   py_msg->msg = log_msg_new(raw_msg, raw_msg_length, parse_options);
   py_msg->bookmark_data = NULL;
+  py_msg->values = NULL;
 
   return (PyObject *) py_msg;
 }
@@ -417,6 +605,8 @@ py_log_message_parse(PyObject *_none, PyObject *args, PyObject *kwrds)
 static PyMethodDef py_log_message_methods[] =
 {
   { "keys", (PyCFunction)_logmessage_get_keys_method, METH_NOARGS, "Return keys." },
+  { "items", (PyCFunction)_logmessage_get_items_method, METH_NOARGS, "Return name-value pairs." },
+  { "get_view", (PyCFunction)py_log_message_get_view, METH_VARARGS | METH_KEYWORDS, "Return value as a read-only memoryview, without copying it unless the message is writable" },
   { "set_pri", (PyCFunction)py_log_message_set_pri, METH_VARARGS | METH_KEYWORDS, "Set priority" },
   { "set_timestamp", (PyCFunction)py_log_message_set_timestamp, METH_VARARGS | METH_KEYWORDS, "Set timestamp" },
   { "set_bookmark", (PyCFunction)py_log_message_set_bookmark, METH_VARARGS | METH_KEYWORDS, "Set bookmark" },
@@ -434,6 +624,7 @@ PyTypeObject py_log_message_type =
   .tp_doc = "LogMessage class encapsulating a syslog-ng log message",
   .tp_new = py_log_message_new_empty,
   .tp_as_mapping = &py_log_message_mapping,
+  .tp_iter = (getiterfunc) _py_log_message_iter,
   .tp_methods = py_log_message_methods,
   0,
 };
@@ -442,6 +633,9 @@ void
 py_log_message_init(void)
 {
   PyDateTime_IMPORT;
+  Py_CLEAR(nv_handle_cache);
+  nv_handle_cache = PyDict_New();
+  PyType_Ready(&py_log_message_value_type);
   PyType_Ready(&py_log_message_type);
   PyModule_AddObject(PyImport_AddModule("_syslogng"), "LogMessage", (PyObject *) &py_log_message_type);
 }
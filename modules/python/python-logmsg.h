@@ -32,6 +32,7 @@ typedef struct _PyLogMessage
   PyObject_HEAD
   LogMessage *msg;
   PyObject *bookmark_data;
+  PyObject *values;
 } PyLogMessage;
 
 extern PyTypeObject py_log_message_type;
@@ -57,7 +57,17 @@ class LogDestination(object):
         self.DROP: message cannot be sent, it should be dropped immediately.
         self.QUEUED: message is not sent immediately, it will be sent with the flush method.
         self.NOT_CONNECTED: message is put back to the queue, open method will be called until success.
-        self.RETRY: message is put back to the queue, try to send again until 3 times, then fallback to self.NOT_CONNECTED."""
+        self.RETRY: message is put back to the queue, try to send again until 3 times, then fallback to self.NOT_CONNECTED.
+
+        A send_batch(self, msgs) method can be defined instead of send(), it
+        is then used for sending. It is called with up to batch-lines()
+        messages at once, so the cost of entering Python is paid once per
+        batch instead of once per message. Its return value is interpreted
+        the same way as the one of send(), but it applies to the whole batch:
+        either all messages are acknowledged, or all of them are put back to
+        the queue. flush() is still called after a successful send_batch().
+        It is not defined here, as it would take precedence over the send()
+        of subclasses."""
 
         pass
 
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2020 One Identity
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "python-helpers.h"
+#include "apphook.h"
+#include "python-dest.h"
+#include "python-main.h"
+#include "logthrdest/logthrdestdrv.h"
+#include "logmsg/logmsg.h"
+#include "mainloop.h"
+
+#include <criterion/criterion.h>
+
+#define PERF_NUM_MESSAGES 100000
+#define PERF_BATCH_LINES 100
+
+MainLoop *main_loop;
+MainLoopOptions main_loop_options = {0};
+
+CFG_LTYPE yyltype;
+GlobalConfig *empty_cfg;
+
+static void
+_py_init_interpreter(void)
+{
+  Py_Initialize();
+  py_init_argv();
+  py_init_threads();
+  PyEval_SaveThread();
+}
+
+const gchar *python_dest_code = "\n\
+calls = []\n\
+\n\
+def pop_calls():\n\
+    result = ' '.join(calls)\n\
+    del calls[:]\n\
+    return result\n\
+\n\
+def _text(msg):\n\
+    value = msg['MESSAGE']\n\
+    return value.decode() if isinstance(value, bytes) else value\n\
+\n\
+class RecordingDest(object):\n\
+    def send(self, msg):\n\
+        calls.append('send(%s)' % _text(msg))\n\
+        return True\n\
+\n\
+class RecordingBatchDest(RecordingDest):\n\
+    def send_batch(self, msgs):\n\
+        calls.append('send_batch(%s)' % ','.join(_text(msg) for msg in msgs))\n\
+        return True\n\
+\n\
+class FailingBatchDest(object):\n\
+    def send_batch(self, msgs):\n\
+        calls.append('send_batch(%s)' % ','.join(_text(msg) for msg in msgs))\n\
+        return False\n\
+\n\
+class CountingDest(object):\n\
+    def init(self, options):\n\
+        self.count = 0\n\
+        return True\n\
+    def send(self, msg):\n\
+        self.count += 1\n\
+        return True\n\
+    def deinit(self):\n\
+        calls.append(str(self.count))\n\
+\n\
+class CountingBatchDest(object):\n\
+    def init(self, options):\n\
+        self.count = 0\n\
+        return True\n\
+    def send_batch(self, msgs):\n\
+        self.count += len(msgs)\n\
+        return True\n\
+    def deinit(self):\n\
+        calls.append(str(self.count))\n";
+
+void setup(void)
+{
+  app_startup();
+
+  main_loop = main_loop_get_instance();
+  main_loop_init(main_loop, &main_loop_options);
+
+  _py_init_interpreter();
+
+  empty_cfg = cfg_new_snippet();
+
+  PyGILState_STATE gstate = PyGILState_Ensure();
+  cr_assert(python_evaluate_global_code(empty_cfg, python_dest_code, &yyltype));
+  PyGILState_Release(gstate);
+}
+
+void teardown(void)
+{
+  cfg_free(empty_cfg);
+  main_loop_deinit(main_loop);
+  app_shutdown();
+}
+
+TestSuite(python_dest, .init = setup, .fini = teardown);
+
+/* returns the calls recorded by the Python classes above since the last call */
+static gchar *
+_pop_recorded_calls(void)
+{
+  PyGILState_STATE gstate = PyGILState_Ensure();
+  PyObject *calls = PyObject_CallMethod(_py_get_current_main_module(), "pop_calls", NULL);
+
+  cr_assert_not_null(calls);
+  gchar *result = g_strdup(_py_get_string_as_string(calls));
+  Py_DECREF(calls);
+  PyGILState_Release(gstate);
+  return result;
+}
+
+static void
+_assert_recorded_calls(const gchar *expected)
+{
+  gchar *calls = _pop_recorded_calls();
+
+  cr_assert_str_eq(calls, expected);
+  g_free(calls);
+}
+
+static LogThreadedDestDriver *
+_construct_dest(const gchar *class_name, gint batch_lines)
+{
+  LogDriver *d = python_dd_new(empty_cfg);
+
+  python_dd_set_class(d, (gchar *) class_name);
+  log_threaded_dest_driver_set_batch_lines(d, batch_lines);
+  cr_assert(log_pipe_init((LogPipe *) d));
+  return (LogThreadedDestDriver *) d;
+}
+
+static void
+_destroy_dest(LogThreadedDestDriver *dd)
+{
+  main_loop_sync_worker_startup_and_teardown();
+  log_pipe_deinit((LogPipe *) dd);
+  log_pipe_unref((LogPipe *) dd);
+}
+
+/* drives insert() the same way the worker thread would, without the queue in between */
+static LogThreadedResult
+_insert(LogThreadedDestDriver *dd, const gchar *message)
+{
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value(msg, LM_V_MESSAGE, message, -1);
+  LogThreadedResult result = dd->worker.insert(dd, msg);
+  log_msg_unref(msg);
+  return result;
+}
+
+Test(python_dest, test_send_batch_receives_the_queued_messages_in_order)
+{
+  LogThreadedDestDriver *dd = _construct_dest("RecordingBatchDest", 5);
+
+  cr_assert_eq(_insert(dd, "m0"), LTR_QUEUED);
+  cr_assert_eq(_insert(dd, "m1"), LTR_QUEUED);
+  cr_assert_eq(_insert(dd, "m2"), LTR_QUEUED);
+  _assert_recorded_calls("");
+
+  cr_assert_eq(log_threaded_dest_driver_flush(dd), LTR_SUCCESS);
+  _assert_recorded_calls("send_batch(m0,m1,m2)");
+
+  /* the batch is not sent again */
+  cr_assert_eq(log_threaded_dest_driver_flush(dd), LTR_SUCCESS);
+  _assert_recorded_calls("");
+
+  _destroy_dest(dd);
+}
+
+Test(python_dest, test_send_batch_is_invoked_for_each_message_without_batching)
+{
+  LogThreadedDestDriver *dd = _construct_dest("RecordingBatchDest", 1);
+
+  cr_assert_eq(_insert(dd, "m0"), LTR_SUCCESS);
+  cr_assert_eq(_insert(dd, "m1"), LTR_SUCCESS);
+  _assert_recorded_calls("send_batch(m0) send_batch(m1)");
+
+  _destroy_dest(dd);
+}
+
+Test(python_dest, test_send_is_used_when_send_batch_is_not_defined)
+{
+  LogThreadedDestDriver *dd = _construct_dest("RecordingDest", 5);
+
+  cr_assert_eq(_insert(dd, "m0"), LTR_SUCCESS);
+  cr_assert_eq(_insert(dd, "m1"), LTR_SUCCESS);
+  _assert_recorded_calls("send(m0) send(m1)");
+
+  cr_assert_eq(log_threaded_dest_driver_flush(dd), LTR_SUCCESS);
+  _assert_recorded_calls("");
+
+  _destroy_dest(dd);
+}
+
+Test(python_dest, test_failed_send_batch_fails_the_whole_batch)
+{
+  LogThreadedDestDriver *dd = _construct_dest("FailingBatchDest", 5);
+
+  cr_assert_eq(_insert(dd, "m0"), LTR_QUEUED);
+  cr_assert_eq(_insert(dd, "m1"), LTR_QUEUED);
+  cr_assert_eq(log_threaded_dest_driver_flush(dd), LTR_ERROR);
+  _assert_recorded_calls("send_batch(m0,m1)");
+
+  /* the rewound messages are inserted again by the worker, not kept in the batch */
+  cr_assert_eq(log_threaded_dest_driver_flush(dd), LTR_SUCCESS);
+  _assert_recorded_calls("");
+
+  _destroy_dest(dd);
+}
+
+/* not run by "make check", see CRITERION_TEST_PATTERN */
+static void
+_perftest_dest(const gchar *class_name, gint batch_lines)
+{
+  LogThreadedDestDriver *dd = _construct_dest(class_name, batch_lines);
+  LogMessage *msg = log_msg_new_empty();
+  GTimeVal start, end;
+  gint i;
+
+  log_msg_set_value(msg, LM_V_MESSAGE, "message text", -1);
+
+  g_get_current_time(&start);
+  for (i = 0; i < PERF_NUM_MESSAGES; i++)
+    {
+      LogThreadedResult result = dd->worker.insert(dd, msg);
+
+      if (result == LTR_QUEUED && (i + 1) % batch_lines == 0)
+        result = log_threaded_dest_driver_flush(dd);
+      cr_assert_eq(result, LTR_SUCCESS);
+    }
+  g_get_current_time(&end);
+
+  printf("      %-20s batch-lines(%3d) speed: %12.3f msg/sec\n",
+         class_name, batch_lines, i * 1e6 / g_time_val_diff(&end, &start));
+
+  log_msg_unref(msg);
+  _destroy_dest(dd);
+
+  gchar *expected = g_strdup_printf("%d", PERF_NUM_MESSAGES);
+  _assert_recorded_calls(expected);
+  g_free(expected);
+}
+
+Test(python_dest, test_per_message_and_batched_send_performance)
+{
+  _perftest_dest("CountingDest", 1);
+  _perftest_dest("CountingDest", PERF_BATCH_LINES);
+  _perftest_dest("CountingBatchDest", 1);
+  _perftest_dest("CountingBatchDest", PERF_BATCH_LINES);
+}
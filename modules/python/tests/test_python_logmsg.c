@@ -314,3 +314,99 @@ Test(python_log_message, test_python_logmessage_keys)
   Py_XDECREF(py_msg);
   PyGILState_Release(gstate);
 }
+
+Test(python_log_message, test_python_logmessage_iteration_materializes_values)
+{
+  LogMessage *msg = log_msg_new_internal(LOG_INFO | LOG_SYSLOG, "test");
+  log_msg_set_value_by_name(msg, "test_key", "value", -1);
+
+  PyGILState_STATE gstate = PyGILState_Ensure();
+  {
+    PyObject *msg_object = py_log_message_new(msg);
+
+    PyDict_SetItemString(_python_main_dict, "test_msg", msg_object);
+    const gchar *iterate = "\
+names = [name for name in test_msg]\n\
+items = dict(test_msg.items())\n\
+test_msg['test_key'] = 'changed'\n\
+changed = dict(test_msg.items())[b'test_key']\n\
+result = str(names == list(items.keys()) and items[b'test_key'] == b'value' and changed == b'changed')";
+    PyRun_String(iterate, Py_file_input, _python_main_dict, _python_main_dict);
+
+    gchar *res = _dict_clone_value(_python_main_dict, "result");
+    cr_assert_str_eq(res, "True");
+    g_free(res);
+
+    Py_XDECREF(msg_object);
+  }
+  PyGILState_Release(gstate);
+  log_msg_unref(msg);
+}
+
+Test(python_log_message, test_python_logmessage_get_view)
+{
+  LogMessage *msg = log_msg_new_internal(LOG_INFO | LOG_SYSLOG, "test");
+  log_msg_set_value_by_name(msg, "test_key", "value", -1);
+
+  PyGILState_STATE gstate = PyGILState_Ensure();
+  {
+    PyObject *msg_object = py_log_message_new(msg);
+
+    PyDict_SetItemString(_python_main_dict, "test_msg", msg_object);
+    const gchar *writable = "\
+view = test_msg.get_view('test_key')\n\
+test_msg['test_key'] = 'changed'\n\
+result = str(view == b'value' and test_msg.get_view('test_key') == b'changed')";
+    PyRun_String(writable, Py_file_input, _python_main_dict, _python_main_dict);
+
+    gchar *res = _dict_clone_value(_python_main_dict, "result");
+    cr_assert_str_eq(res, "True");
+    g_free(res);
+
+    log_msg_write_protect(msg);
+    const gchar *read_only = "\
+view = test_msg.get_view('test_key')\n\
+result = str(isinstance(view, memoryview) and view.readonly and view.tobytes() == b'value')";
+    PyRun_String(read_only, Py_file_input, _python_main_dict, _python_main_dict);
+
+    res = _dict_clone_value(_python_main_dict, "result");
+    cr_assert_str_eq(res, "True");
+    g_free(res);
+
+    PyDict_DelItemString(_python_main_dict, "view");
+    Py_XDECREF(msg_object);
+  }
+  PyGILState_Release(gstate);
+  log_msg_unref(msg);
+}
+
+Test(python_log_message, test_python_logmessage_invalid_name_raises_key_error)
+{
+  LogMessage *msg = log_msg_new_internal(LOG_INFO | LOG_SYSLOG, "test");
+
+  PyGILState_STATE gstate = PyGILState_Ensure();
+  {
+    PyObject *msg_object = py_log_message_new(msg);
+
+    PyDict_SetItemString(_python_main_dict, "test_msg", msg_object);
+    const gchar *invalid_name = "\
+def raises_key_error(lookup):\n\
+    try:\n\
+        lookup()\n\
+    except KeyError:\n\
+        return True\n\
+    return False\n\
+first = raises_key_error(lambda: test_msg[''])\n\
+cached = raises_key_error(lambda: test_msg[''])\n\
+result = str(first and cached and raises_key_error(lambda: test_msg.get_view('')))";
+    PyRun_String(invalid_name, Py_file_input, _python_main_dict, _python_main_dict);
+
+    gchar *res = _dict_clone_value(_python_main_dict, "result");
+    cr_assert_str_eq(res, "True");
+    g_free(res);
+
+    Py_XDECREF(msg_object);
+  }
+  PyGILState_Release(gstate);
+  log_msg_unref(msg);
+}
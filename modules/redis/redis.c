@@ -54,6 +54,7 @@ typedef struct
   gint argc;
   gchar **argv;
   size_t *argvlen;
+  gint pending_replies;
   struct timeval timeout;
 } RedisDriver;
 
@@ -272,6 +273,7 @@ redis_dd_disconnect(LogThreadedDestDriver *s)
   if (self->c)
     redisFree(self->c);
   self->c = NULL;
+  self->pending_replies = 0;
 }
 
 static inline void _fill_template(RedisDriver *self, LogMessage *msg, LogTemplate *template, gchar **str, gsize *size)
@@ -323,19 +325,131 @@ _argv_to_string(RedisDriver *self)
  * Worker thread
  */
 
+/* These errors are reported by the server when it is temporarily unable to
+ * execute commands (e.g. it is still loading its dataset or a failover is in
+ * progress), retrying the same command later is expected to succeed. */
+static gboolean
+_is_transient_error_reply(redisReply *reply)
+{
+  static const gchar *transient_prefixes[] =
+  {
+    "LOADING", "BUSY", "TRYAGAIN", "MASTERDOWN", "CLUSTERDOWN", NULL
+  };
+
+  for (gint i = 0; transient_prefixes[i]; i++)
+    {
+      if (g_str_has_prefix(reply->str, transient_prefixes[i]))
+        return TRUE;
+    }
+  return FALSE;
+}
+
+static LogThreadedResult
+_map_reply_to_result(RedisDriver *self, redisReply *reply)
+{
+  _trace_reply_message(reply);
+
+  if (reply->type != REDIS_REPLY_ERROR)
+    return LTR_SUCCESS;
+
+  if (_is_transient_error_reply(reply))
+    {
+      msg_error("REDIS server is temporarily unable to execute command, retrying",
+                evt_tag_str("driver", self->super.super.super.id),
+                evt_tag_str("error", reply->str));
+      return LTR_RETRY;
+    }
+
+  msg_error("REDIS server rejected command, dropping message",
+            evt_tag_str("driver", self->super.super.super.id),
+            evt_tag_str("error", reply->str));
+  return LTR_DROP;
+}
+
+static void
+_ack_replied_messages(RedisDriver *self, gint *num_succeeded)
+{
+  if (*num_succeeded == 0)
+    return;
+
+  log_threaded_dest_worker_ack_messages(&self->super.worker.instance, *num_succeeded);
+  *num_succeeded = 0;
+}
+
+/* Reads the replies of all commands appended since the last flush.  Replies
+ * arrive in command order, which is also the order of messages in the
+ * current batch, so successful commands are acked and rejected ones are
+ * dropped one by one.  Once a transient error is seen, the rest of the
+ * replies are only drained to keep the connection in sync, and the batch is
+ * rewound from that point on. */
+static LogThreadedResult
+redis_worker_flush(LogThreadedDestDriver *s)
+{
+  RedisDriver *self = (RedisDriver *)s;
+  gint num_succeeded = 0;
+  gboolean retry = FALSE;
+
+  while (self->pending_replies > 0)
+    {
+      redisReply *reply = NULL;
+
+      if (redisGetReply(self->c, (void **) &reply) != REDIS_OK)
+        {
+          msg_error("REDIS server error, suspending",
+                    evt_tag_str("driver", self->super.super.super.id),
+                    evt_tag_str("error", self->c->errstr),
+                    evt_tag_int("pending_replies", self->pending_replies),
+                    evt_tag_int("time_reopen", self->super.time_reopen));
+          self->pending_replies = 0;
+          if (!retry)
+            _ack_replied_messages(self, &num_succeeded);
+          return LTR_ERROR;
+        }
+      self->pending_replies--;
+
+      LogThreadedResult result = _map_reply_to_result(self, reply);
+      freeReplyObject(reply);
+
+      if (retry)
+        continue;
+
+      switch (result)
+        {
+        case LTR_SUCCESS:
+          num_succeeded++;
+          break;
+        case LTR_DROP:
+          _ack_replied_messages(self, &num_succeeded);
+          log_threaded_dest_worker_drop_messages(&self->super.worker.instance, 1);
+          break;
+        default:
+          _ack_replied_messages(self, &num_succeeded);
+          retry = TRUE;
+          break;
+        }
+    }
+
+  if (retry)
+    return LTR_RETRY;
+
+  _ack_replied_messages(self, &num_succeeded);
+  return LTR_EXPLICIT_ACK_MGMT;
+}
+
 static LogThreadedResult
 redis_worker_insert(LogThreadedDestDriver *s, LogMessage *msg)
 {
   RedisDriver *self = (RedisDriver *)s;
 
+  if (self->c->err)
+    return LTR_NOT_CONNECTED;
+
   ScratchBuffersMarker marker;
   scratch_buffers_mark(&marker);
 
   _fill_argv_from_template_list(self, msg);
 
-  redisReply *reply = redisCommandArgv(self->c, self->argc, (const gchar **)self->argv, self->argvlen);
-
-  if (!reply)
+  if (redisAppendCommandArgv(self->c, self->argc, (const gchar **)self->argv, self->argvlen) != REDIS_OK)
     {
       msg_error("REDIS server error, suspending",
                 evt_tag_str("driver", self->super.super.super.id),
@@ -345,14 +459,18 @@ redis_worker_insert(LogThreadedDestDriver *s, LogMessage *msg)
       scratch_buffers_reclaim_marked(marker);
       return LTR_ERROR;
     }
+  self->pending_replies++;
 
-  msg_debug("REDIS command sent",
+  msg_debug("REDIS command queued",
             evt_tag_str("driver", self->super.super.super.id),
             evt_tag_str("command", _argv_to_string(self)));
 
-  freeReplyObject(reply);
   scratch_buffers_reclaim_marked(marker);
-  return LTR_SUCCESS;
+
+  if (self->super.batch_lines <= 1)
+    return log_threaded_dest_driver_flush(&self->super);
+
+  return LTR_QUEUED;
 }
 
 static void
@@ -446,6 +564,7 @@ redis_dd_new(GlobalConfig *cfg)
   self->super.worker.connect = redis_dd_connect;
   self->super.worker.disconnect = redis_dd_disconnect;
   self->super.worker.insert = redis_worker_insert;
+  self->super.worker.flush = redis_worker_flush;
 
   self->super.format_stats_instance = redis_dd_format_stats_instance;
   self->super.stats_source = stats_register_type("redis");
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "bench.h"
+#include "cfg.h"
+#include "messages.h"
+#include "gsockaddr.h"
+#include "logmsg/logmsg.h"
+#include "filter/filter-expr.h"
+#include "filter/filter-re.h"
+#include "filter/filter-netmask.h"
+#include "filter/filter-in-list.h"
+
+#include <glib/gstdio.h>
+
+#define FILTER_MESSAGE "<34>Oct 11 22:14:15 mymachine su[1234]: 'su root' failed for lonvick on /dev/pts/8"
+#define IN_LIST_ENTRIES 1000
+
+typedef struct _FilterState
+{
+  FilterExprNode *filter;
+  LogMessage *msg;
+  gchar *list_file;
+} FilterState;
+
+static FilterState *
+_filter_state_new(FilterExprNode *filter, gchar *list_file)
+{
+  FilterState *self = g_new0(FilterState, 1);
+
+  self->filter = filter;
+  self->list_file = list_file;
+  self->msg = bench_construct_message(FILTER_MESSAGE);
+  log_msg_set_saddr_ref(self->msg, g_sockaddr_inet_new("10.10.0.1", 5000));
+
+  if (!self->filter || !filter_expr_init(self->filter, configuration))
+    {
+      msg_error("Error initializing benchmark filter");
+      if (self->filter)
+        filter_expr_unref(self->filter);
+      log_msg_unref(self->msg);
+      if (self->list_file)
+        g_unlink(self->list_file);
+      g_free(self->list_file);
+      g_free(self);
+      return NULL;
+    }
+  return self;
+}
+
+static gpointer
+_setup_match(void)
+{
+  FilterExprNode *filter = filter_match_new();
+  LogMatcherOptions *matcher_options = filter_re_get_matcher_options(filter);
+
+  log_matcher_options_defaults(matcher_options);
+  log_matcher_options_set_type(matcher_options, "pcre");
+  filter_match_set_value_handle(filter, LM_V_MESSAGE);
+  if (!filter_re_compile_pattern(filter, "(failed|denied) for [a-z]+", NULL))
+    {
+      filter_expr_unref(filter);
+      return NULL;
+    }
+  return _filter_state_new(filter, NULL);
+}
+
+static gpointer
+_setup_netmask(void)
+{
+  return _filter_state_new(filter_netmask_new("10.10.0.0/16"), NULL);
+}
+
+static gpointer
+_setup_in_list(void)
+{
+  GString *contents = g_string_new("");
+
+  /* the program of the message is the last entry of the list */
+  for (gint i = 0; i < IN_LIST_ENTRIES - 1; i++)
+    g_string_append_printf(contents, "program%d\n", i);
+  g_string_append(contents, "su\n");
+
+  gchar *list_file = bench_write_temp_file("bench-in-list", contents->str);
+  g_string_free(contents, TRUE);
+  if (!list_file)
+    return NULL;
+
+  return _filter_state_new(filter_in_list_new(list_file, "PROGRAM"), list_file);
+}
+
+static void
+_run_filter(gpointer s, gint64 iterations)
+{
+  FilterState *self = (FilterState *) s;
+  gint matches = 0;
+
+  for (gint64 i = 0; i < iterations; i++)
+    matches += filter_expr_eval(self->filter, self->msg);
+  bench_consume(GINT_TO_POINTER(matches));
+}
+
+static void
+_teardown_filter(gpointer s)
+{
+  FilterState *self = (FilterState *) s;
+
+  filter_expr_unref(self->filter);
+  log_msg_unref(self->msg);
+  if (self->list_file)
+    g_unlink(self->list_file);
+  g_free(self->list_file);
+  g_free(self);
+}
+
+static const Benchmark filter_benchmarks[] =
+{
+  { "filter/match_pcre", _setup_match, _run_filter, _teardown_filter },
+  { "filter/netmask", _setup_netmask, _run_filter, _teardown_filter },
+  { "filter/in_list", _setup_in_list, _run_filter, _teardown_filter },
+};
+
+void
+bench_register_filter_benchmarks(void)
+{
+  bench_register_all(filter_benchmarks, G_N_ELEMENTS(filter_benchmarks));
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "bench.h"
+#include "cfg.h"
+#include "msg-format.h"
+#include "logmsg/logmsg.h"
+
+#include <string.h>
+
+#define RFC3164_MESSAGE "<34>Oct 11 22:14:15 mymachine su[1234]: 'su root' failed for lonvick on /dev/pts/8"
+#define RFC5424_MESSAGE "<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog 1234 ID47 " \
+  "[exampleSDID@32473 iut=\"3\" eventSource=\"Application\" eventID=\"1011\"] An application event log entry"
+
+typedef struct _MsgParseState
+{
+  MsgFormatOptions parse_options;
+  const gchar *raw_message;
+  gsize raw_message_len;
+} MsgParseState;
+
+static MsgParseState *
+_msg_parse_state_new(const gchar *raw_message, guint32 flags)
+{
+  MsgParseState *self = g_new0(MsgParseState, 1);
+
+  msg_format_options_defaults(&self->parse_options);
+  self->parse_options.flags |= flags;
+  msg_format_options_init(&self->parse_options, configuration);
+  self->raw_message = raw_message;
+  self->raw_message_len = strlen(raw_message);
+  return self;
+}
+
+static gpointer
+_setup_rfc3164(void)
+{
+  return _msg_parse_state_new(RFC3164_MESSAGE, 0);
+}
+
+static gpointer
+_setup_rfc5424(void)
+{
+  return _msg_parse_state_new(RFC5424_MESSAGE, LP_SYSLOG_PROTOCOL);
+}
+
+static void
+_run_msg_parse(gpointer s, gint64 iterations)
+{
+  MsgParseState *self = (MsgParseState *) s;
+
+  for (gint64 i = 0; i < iterations; i++)
+    {
+      LogMessage *msg = log_msg_new(self->raw_message, self->raw_message_len, &self->parse_options);
+      log_msg_unref(msg);
+    }
+}
+
+static void
+_teardown_msg_parse(gpointer s)
+{
+  MsgParseState *self = (MsgParseState *) s;
+
+  msg_format_options_destroy(&self->parse_options);
+  g_free(self);
+}
+
+static void
+_run_msg_new_empty(gpointer s, gint64 iterations)
+{
+  for (gint64 i = 0; i < iterations; i++)
+    {
+      LogMessage *msg = log_msg_new_empty();
+      log_msg_unref(msg);
+    }
+}
+
+/* NVTable: set and get N dynamic (name-value pair) keys on a fresh message */
+
+typedef struct _NVTableState
+{
+  gint num_keys;
+  NVHandle *handles;
+  gchar **values;
+} NVTableState;
+
+static NVTableState *
+_nvtable_state_new(gint num_keys)
+{
+  NVTableState *self = g_new0(NVTableState, 1);
+
+  self->num_keys = num_keys;
+  self->handles = g_new(NVHandle, num_keys);
+  self->values = g_new0(gchar *, num_keys + 1);
+  for (gint i = 0; i < num_keys; i++)
+    {
+      gchar name[32];
+
+      g_snprintf(name, sizeof(name), ".bench.key%d", i);
+      self->handles[i] = log_msg_get_value_handle(name);
+      self->values[i] = g_strdup_printf("value-of-key-%d", i);
+    }
+  return self;
+}
+
+static gpointer
+_setup_nvtable_8(void)
+{
+  return _nvtable_state_new(8);
+}
+
+static gpointer
+_setup_nvtable_64(void)
+{
+  return _nvtable_state_new(64);
+}
+
+static void
+_run_nvtable_set_get(gpointer s, gint64 iterations)
+{
+  NVTableState *self = (NVTableState *) s;
+
+  for (gint64 i = 0; i < iterations; i++)
+    {
+      LogMessage *msg = log_msg_new_empty();
+
+      for (gint k = 0; k < self->num_keys; k++)
+        log_msg_set_value(msg, self->handles[k], self->values[k], -1);
+
+      for (gint k = 0; k < self->num_keys; k++)
+        {
+          gssize len;
+          bench_consume(log_msg_get_value(msg, self->handles[k], &len));
+        }
+      log_msg_unref(msg);
+    }
+}
+
+static void
+_teardown_nvtable(gpointer s)
+{
+  NVTableState *self = (NVTableState *) s;
+
+  g_strfreev(self->values);
+  g_free(self->handles);
+  g_free(self);
+}
+
+static const Benchmark msg_benchmarks[] =
+{
+  { "logmsg/new_empty", NULL, _run_msg_new_empty, NULL },
+  { "logmsg/parse_rfc3164", _setup_rfc3164, _run_msg_parse, _teardown_msg_parse },
+  { "logmsg/parse_rfc5424", _setup_rfc5424, _run_msg_parse, _teardown_msg_parse },
+  { "nvtable/set_get_8_keys", _setup_nvtable_8, _run_nvtable_set_get, _teardown_nvtable },
+  { "nvtable/set_get_64_keys", _setup_nvtable_64, _run_nvtable_set_get, _teardown_nvtable },
+};
+
+void
+bench_register_msg_benchmarks(void)
+{
+  bench_register_all(msg_benchmarks, G_N_ELEMENTS(msg_benchmarks));
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "bench.h"
+#include "cfg.h"
+#include "cfg-grammar.h"
+#include "messages.h"
+#include "logmsg/logmsg.h"
+#include "parser/parser-expr.h"
+#include "scratch-buffers.h"
+#include "patterndb.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define PATTERNDB_RULES 256
+
+typedef struct _ParserState
+{
+  LogParser *parser;
+  LogMessage *msg;
+  const gchar *input;
+  gsize input_len;
+} ParserState;
+
+static ParserState *
+_parser_state_new(const gchar *parser_config, const gchar *input)
+{
+  LogParser *parser = bench_parse_config(parser_config, LL_CONTEXT_PARSER);
+
+  if (!parser)
+    return NULL;
+
+  if (!log_pipe_init(&parser->super))
+    {
+      msg_error("Error initializing benchmark parser",
+                evt_tag_str("parser", parser_config));
+      log_pipe_unref(&parser->super);
+      return NULL;
+    }
+
+  ParserState *self = g_new0(ParserState, 1);
+  self->parser = parser;
+  self->msg = log_msg_new_empty();
+  self->input = input;
+  self->input_len = strlen(input);
+  return self;
+}
+
+static gpointer
+_setup_csv(void)
+{
+  return _parser_state_new("csv-parser(columns(date, host, program, pid, severity, user, action, result) "
+                           "delimiters(','))",
+                           "2021-10-11T22:14:15,mymachine,su,1234,err,lonvick,\"su root\",failed");
+}
+
+static gpointer
+_setup_kv(void)
+{
+  return _parser_state_new("kv-parser(prefix('.kv.'))",
+                           "host=mymachine program=su pid=1234 severity=err user=lonvick "
+                           "action=\"su root\" result=failed tty=/dev/pts/8");
+}
+
+static gpointer
+_setup_json(void)
+{
+  return _parser_state_new("json-parser(prefix('.json.'))",
+                           "{\"host\": \"mymachine\", \"program\": \"su\", \"pid\": 1234, \"severity\": \"err\", "
+                           "\"user\": \"lonvick\", \"action\": \"su root\", \"result\": \"failed\", "
+                           "\"session\": {\"tty\": \"/dev/pts/8\", \"uid\": 0}}");
+}
+
+static void
+_run_parser(gpointer s, gint64 iterations)
+{
+  ParserState *self = (ParserState *) s;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+
+  for (gint64 i = 0; i < iterations; i++)
+    {
+      ScratchBuffersMarker marker;
+
+      scratch_buffers_mark(&marker);
+      log_parser_process(self->parser, &self->msg, &path_options, self->input, self->input_len);
+      scratch_buffers_reclaim_marked(marker);
+    }
+}
+
+static void
+_teardown_parser(gpointer s)
+{
+  ParserState *self = (ParserState *) s;
+
+  log_msg_unref(self->msg);
+  log_pipe_deinit(&self->parser->super);
+  log_pipe_unref(&self->parser->super);
+  g_free(self);
+}
+
+/* patterndb: lookup in a ruleset of PATTERNDB_RULES rules, the message
+ * matches one of them */
+
+typedef struct _PatternDBState
+{
+  PatternDB *patterndb;
+  LogMessage *msg;
+  gchar *filename;
+} PatternDBState;
+
+static gchar *
+_generate_ruleset(void)
+{
+  GString *pdb = g_string_new("<patterndb version='4' pub_date='2021-01-01'>\n"
+                              " <ruleset name='bench' id='bench-ruleset'>\n"
+                              "  <patterns>\n"
+                              "   <pattern>su</pattern>\n"
+                              "  </patterns>\n"
+                              "  <rules>\n");
+
+  for (gint i = 0; i < PATTERNDB_RULES; i++)
+    {
+      g_string_append_printf(pdb,
+                             "   <rule provider='bench' id='rule-%d' class='system'>\n"
+                             "    <patterns>\n"
+                             "     <pattern>'su root' @ESTRING:result: @for user%d on @ANYSTRING:tty@</pattern>\n"
+                             "    </patterns>\n"
+                             "   </rule>\n", i, i);
+    }
+  /* the one that matches the benchmark message */
+  g_string_append(pdb,
+                  "   <rule provider='bench' id='rule-match' class='system'>\n"
+                  "    <patterns>\n"
+                  "     <pattern>'su root' @ESTRING:result: @for @ESTRING:user: @on @ANYSTRING:tty@</pattern>\n"
+                  "    </patterns>\n"
+                  "   </rule>\n"
+                  "  </rules>\n"
+                  " </ruleset>\n"
+                  "</patterndb>\n");
+  return g_string_free(pdb, FALSE);
+}
+
+static gpointer
+_setup_patterndb(void)
+{
+  static gboolean patterndb_initialized = FALSE;
+
+  if (!patterndb_initialized)
+    {
+      pattern_db_global_init();
+      patterndb_initialized = TRUE;
+    }
+
+  gchar *pdb = _generate_ruleset();
+  gchar *filename = bench_write_temp_file("bench-patterndb", pdb);
+
+  g_free(pdb);
+  if (!filename)
+    return NULL;
+
+  PatternDB *patterndb = pattern_db_new();
+  if (!pattern_db_reload_ruleset(patterndb, configuration, filename))
+    {
+      pattern_db_free(patterndb);
+      g_unlink(filename);
+      g_free(filename);
+      return NULL;
+    }
+
+  PatternDBState *self = g_new0(PatternDBState, 1);
+  self->patterndb = patterndb;
+  self->filename = filename;
+  self->msg = log_msg_new_empty();
+  log_msg_set_value(self->msg, LM_V_PROGRAM, "su", -1);
+  log_msg_set_value(self->msg, LM_V_MESSAGE, "'su root' failed for lonvick on /dev/pts/8", -1);
+  return self;
+}
+
+static void
+_run_patterndb(gpointer s, gint64 iterations)
+{
+  PatternDBState *self = (PatternDBState *) s;
+  gint matches = 0;
+
+  for (gint64 i = 0; i < iterations; i++)
+    matches += pattern_db_process(self->patterndb, self->msg);
+  bench_consume(GINT_TO_POINTER(matches));
+}
+
+static void
+_teardown_patterndb(gpointer s)
+{
+  PatternDBState *self = (PatternDBState *) s;
+
+  log_msg_unref(self->msg);
+  pattern_db_free(self->patterndb);
+  g_unlink(self->filename);
+  g_free(self->filename);
+  g_free(self);
+}
+
+static const Benchmark parser_benchmarks[] =
+{
+  { "parser/csv", _setup_csv, _run_parser, _teardown_parser },
+  { "parser/kv", _setup_kv, _run_parser, _teardown_parser },
+  { "parser/json", _setup_json, _run_parser, _teardown_parser },
+  { "parser/patterndb_lookup", _setup_patterndb, _run_patterndb, _teardown_patterndb },
+};
+
+void
+bench_register_parser_benchmarks(void)
+{
+  bench_register_all(parser_benchmarks, G_N_ELEMENTS(parser_benchmarks));
+}
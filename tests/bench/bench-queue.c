@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "bench.h"
+#include "logqueue.h"
+#include "logqueue-fifo.h"
+#include "logmsg/logmsg.h"
+#include "mainloop-worker.h"
+#include "diskq-options.h"
+#include "logqueue-disk.h"
+#include "logqueue-disk-reliable.h"
+#include "logqueue-disk-non-reliable.h"
+
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include <iv.h>
+
+#define QUEUE_MESSAGE "<34>Oct 11 22:14:15 mymachine su[1234]: 'su root' failed for lonvick on /dev/pts/8"
+#define FIFO_FEEDERS 4
+#define FIFO_SIZE 10000
+#define DISKQ_BATCH 64
+
+/* LogQueueFifo: FIFO_FEEDERS worker threads push, the calling thread pops */
+
+typedef struct _FifoFeeder
+{
+  LogQueue *queue;
+  LogMessage *msg;
+  gint64 count;
+} FifoFeeder;
+
+static gpointer
+_setup_fifo(void)
+{
+  log_queue_set_max_threads(FIFO_FEEDERS);
+  return bench_construct_message(QUEUE_MESSAGE);
+}
+
+static gpointer
+_fifo_feed(gpointer s)
+{
+  FifoFeeder *feeder = (FifoFeeder *) s;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT_NOACK;
+
+  /* flow-controlled messages are never dropped, even if the queue is full */
+  path_options.flow_control_requested = TRUE;
+
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+
+  for (gint64 i = 0; i < feeder->count; i++)
+    {
+      log_queue_push_tail(feeder->queue, log_msg_ref(feeder->msg), &path_options);
+
+      if ((i & 0xFF) == 0)
+        main_loop_worker_invoke_batch_callbacks();
+    }
+  main_loop_worker_invoke_batch_callbacks();
+
+  main_loop_worker_thread_stop();
+  iv_deinit();
+  return NULL;
+}
+
+static void
+_run_fifo(gpointer s, gint64 iterations)
+{
+  LogMessage *msg = (LogMessage *) s;
+  LogQueue *q = log_queue_fifo_new(FIFO_SIZE, NULL);
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT_NOACK;
+  FifoFeeder feeders[FIFO_FEEDERS];
+  GThread *threads[FIFO_FEEDERS];
+
+  for (gint i = 0; i < FIFO_FEEDERS; i++)
+    {
+      feeders[i].queue = q;
+      feeders[i].msg = msg;
+      feeders[i].count = iterations / FIFO_FEEDERS + (i < iterations % FIFO_FEEDERS ? 1 : 0);
+      threads[i] = g_thread_create(_fifo_feed, &feeders[i], TRUE, NULL);
+    }
+
+  for (gint64 popped = 0; popped < iterations; )
+    {
+      LogMessage *popped_msg = log_queue_pop_head(q, &path_options);
+
+      if (!popped_msg)
+        {
+          g_thread_yield();
+          continue;
+        }
+      log_msg_unref(popped_msg);
+      popped++;
+    }
+
+  for (gint i = 0; i < FIFO_FEEDERS; i++)
+    g_thread_join(threads[i]);
+  log_queue_unref(q);
+}
+
+static void
+_teardown_fifo(gpointer s)
+{
+  log_msg_unref((LogMessage *) s);
+}
+
+/* disk-buffer: push and pop a message through the disk based queue, in
+ * batches of DISKQ_BATCH, acknowledging the backlog for the reliable one */
+
+typedef struct _DiskQueueState
+{
+  DiskQueueOptions options;
+  LogQueue *queue;
+  LogMessage *msg;
+  gchar *filename;
+} DiskQueueState;
+
+static DiskQueueState *
+_diskq_state_new(gboolean reliable)
+{
+  DiskQueueState *self = g_new0(DiskQueueState, 1);
+  gchar *basename = g_strdup_printf("syslog-ng-bench-%d-%s.qf", (gint) getpid(), reliable ? "reliable" : "non-reliable");
+
+  self->filename = g_build_filename(g_get_tmp_dir(), basename, NULL);
+  g_free(basename);
+
+  self->options.disk_buf_size = 100 * 1024 * 1024;
+  self->options.mem_buf_length = DISKQ_BATCH;
+  self->options.mem_buf_size = 1024 * 1024;
+  self->options.qout_size = 0;
+  self->options.reliable = reliable;
+
+  if (reliable)
+    self->queue = log_queue_disk_reliable_new(&self->options, NULL);
+  else
+    self->queue = log_queue_disk_non_reliable_new(&self->options, NULL);
+  log_queue_set_use_backlog(self->queue, reliable);
+
+  g_unlink(self->filename);
+  if (!log_queue_disk_load_queue(self->queue, self->filename))
+    {
+      log_queue_unref(self->queue);
+      disk_queue_options_destroy(&self->options);
+      g_free(self->filename);
+      g_free(self);
+      return NULL;
+    }
+
+  self->msg = bench_construct_message(QUEUE_MESSAGE);
+  return self;
+}
+
+static gpointer
+_setup_diskq_reliable(void)
+{
+  return _diskq_state_new(TRUE);
+}
+
+static gpointer
+_setup_diskq_non_reliable(void)
+{
+  return _diskq_state_new(FALSE);
+}
+
+static void
+_diskq_drain(DiskQueueState *self, gint count)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT_NOACK;
+
+  for (gint i = 0; i < count; i++)
+    {
+      LogMessage *msg = log_queue_pop_head(self->queue, &path_options);
+
+      if (msg)
+        log_msg_unref(msg);
+    }
+  if (self->queue->use_backlog)
+    log_queue_ack_backlog(self->queue, count);
+}
+
+static void
+_run_diskq(gpointer s, gint64 iterations)
+{
+  DiskQueueState *self = (DiskQueueState *) s;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT_NOACK;
+  gint pending = 0;
+
+  for (gint64 i = 0; i < iterations; i++)
+    {
+      log_queue_push_tail(self->queue, log_msg_ref(self->msg), &path_options);
+
+      if (++pending == DISKQ_BATCH)
+        {
+          _diskq_drain(self, pending);
+          pending = 0;
+        }
+    }
+  _diskq_drain(self, pending);
+}
+
+static void
+_teardown_diskq(gpointer s)
+{
+  DiskQueueState *self = (DiskQueueState *) s;
+
+  log_msg_unref(self->msg);
+  log_queue_unref(self->queue);
+  g_unlink(self->filename);
+  g_free(self->filename);
+  disk_queue_options_destroy(&self->options);
+  g_free(self);
+}
+
+static const Benchmark queue_benchmarks[] =
+{
+  { "logqueue/fifo_push_pop_threaded", _setup_fifo, _run_fifo, _teardown_fifo },
+  { "logqueue/diskq_reliable_push_pop", _setup_diskq_reliable, _run_diskq, _teardown_diskq },
+  { "logqueue/diskq_non_reliable_push_pop", _setup_diskq_non_reliable, _run_diskq, _teardown_diskq },
+};
+
+void
+bench_register_queue_benchmarks(void)
+{
+  bench_register_all(queue_benchmarks, G_N_ELEMENTS(queue_benchmarks));
+}
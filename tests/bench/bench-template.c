@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "bench.h"
+#include "cfg.h"
+#include "messages.h"
+#include "template/templates.h"
+#include "logmsg/logmsg.h"
+#include "scratch-buffers.h"
+
+#define TEMPLATE_MESSAGE "<34>Oct 11 22:14:15 mymachine su[1234]: 'su root' failed for lonvick on /dev/pts/8"
+
+typedef struct _TemplateState
+{
+  LogTemplate *template;
+  LogMessage *msg;
+  GString *result;
+} TemplateState;
+
+static TemplateState *
+_template_state_new(const gchar *template_code)
+{
+  TemplateState *self = g_new0(TemplateState, 1);
+  GError *error = NULL;
+
+  self->template = log_template_new(configuration, NULL);
+  if (!log_template_compile(self->template, template_code, &error))
+    {
+      msg_error("Error compiling benchmark template",
+                evt_tag_str("template", template_code),
+                evt_tag_str("error", error->message));
+      g_clear_error(&error);
+      log_template_unref(self->template);
+      g_free(self);
+      return NULL;
+    }
+
+  self->msg = bench_construct_message(TEMPLATE_MESSAGE);
+  log_msg_set_value_by_name(self->msg, ".bench.user", "lonvick", -1);
+  log_msg_set_value_by_name(self->msg, ".bench.tty", "/dev/pts/8", -1);
+  log_msg_set_value_by_name(self->msg, ".bench.action", "su", -1);
+  self->result = g_string_sized_new(256);
+  return self;
+}
+
+static gpointer
+_setup_isodate_host_msg(void)
+{
+  return _template_state_new("$ISODATE $HOST $MSG");
+}
+
+static gpointer
+_setup_format_json(void)
+{
+  return _template_state_new("$(format-json --scope rfc5424 --key .bench.*)");
+}
+
+static void
+_run_template_format(gpointer s, gint64 iterations)
+{
+  TemplateState *self = (TemplateState *) s;
+  LogTemplateEvalOptions options = DEFAULT_TEMPLATE_EVAL_OPTIONS;
+
+  for (gint64 i = 0; i < iterations; i++)
+    {
+      ScratchBuffersMarker marker;
+
+      scratch_buffers_mark(&marker);
+      log_template_format(self->template, self->msg, &options, self->result);
+      scratch_buffers_reclaim_marked(marker);
+    }
+  bench_consume(self->result->str);
+}
+
+static void
+_teardown_template(gpointer s)
+{
+  TemplateState *self = (TemplateState *) s;
+
+  g_string_free(self->result, TRUE);
+  log_msg_unref(self->msg);
+  log_template_unref(self->template);
+  g_free(self);
+}
+
+static const Benchmark template_benchmarks[] =
+{
+  { "template/isodate_host_msg", _setup_isodate_host_msg, _run_template_format, _teardown_template },
+  { "template/format_json", _setup_format_json, _run_template_format, _teardown_template },
+};
+
+void
+bench_register_template_benchmarks(void)
+{
+  bench_register_all(template_benchmarks, G_N_ELEMENTS(template_benchmarks));
+}
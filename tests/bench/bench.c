@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "bench.h"
+#include "apphook.h"
+#include "cfg.h"
+#include "messages.h"
+#include "msg-format.h"
+#include "logmsg/logmsg.h"
+#include "scratch-buffers.h"
+#include "timeutils/misc.h"
+#include "libtest/config_parse_lib.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+
+#define BENCH_MAX_CALIBRATED_ITERATIONS (G_GINT64_CONSTANT(1) << 30)
+
+static gchar *filter_pattern = NULL;
+static gint rounds = 10;
+static gint warmup_rounds = 2;
+static gint64 fixed_iterations = 0;
+static gint min_round_time_msec = 50;
+static gchar *output_file = NULL;
+static gboolean list_only = FALSE;
+
+static GOptionEntry bench_options[] =
+{
+  { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter_pattern, "Only run benchmarks matching the glob pattern", "<pattern>" },
+  { "rounds", 'r', 0, G_OPTION_ARG_INT, &rounds, "Number of measured rounds per benchmark", "<n>" },
+  { "warmup", 'w', 0, G_OPTION_ARG_INT, &warmup_rounds, "Number of unmeasured warmup rounds per benchmark", "<n>" },
+  { "iterations", 'i', 0, G_OPTION_ARG_INT64, &fixed_iterations, "Operations per round, calibrated automatically if not set", "<n>" },
+  { "min-time", 't', 0, G_OPTION_ARG_INT, &min_round_time_msec, "Minimum duration of a calibrated round", "<msec>" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file, "Write the JSON report to this file instead of stdout", "<file>" },
+  { "list", 'l', 0, G_OPTION_ARG_NONE, &list_only, "List the available benchmarks and exit", NULL },
+  { NULL }
+};
+
+typedef struct _BenchmarkResult
+{
+  const Benchmark *benchmark;
+  gint64 iterations;
+  gdouble mean;
+  gdouble median;
+  gdouble stddev;
+  gdouble min;
+  gdouble max;
+} BenchmarkResult;
+
+static GPtrArray *benchmarks;
+static MsgFormatOptions parse_options;
+
+void
+bench_register(const Benchmark *benchmark)
+{
+  g_ptr_array_add(benchmarks, (gpointer) benchmark);
+}
+
+void
+bench_register_all(const Benchmark *benchmark_array, gsize count)
+{
+  for (gsize i = 0; i < count; i++)
+    bench_register(&benchmark_array[i]);
+}
+
+gpointer
+bench_parse_config(const gchar *config, gint context)
+{
+  gpointer result = NULL;
+
+  if (!parse_config(config, context, NULL, &result))
+    return NULL;
+  return result;
+}
+
+gchar *
+bench_write_temp_file(const gchar *prefix, const gchar *contents)
+{
+  gchar *template = g_strdup_printf("%s-XXXXXX", prefix);
+  gchar *filename = NULL;
+  gint fd = g_file_open_tmp(template, &filename, NULL);
+
+  g_free(template);
+  if (fd < 0)
+    return NULL;
+  close(fd);
+
+  if (!g_file_set_contents(filename, contents, -1, NULL))
+    {
+      g_unlink(filename);
+      g_free(filename);
+      return NULL;
+    }
+  return filename;
+}
+
+LogMessage *
+bench_construct_message(const gchar *raw_message)
+{
+  return log_msg_new(raw_message, strlen(raw_message), &parse_options);
+}
+
+static gint64
+_run_timed(const Benchmark *benchmark, gpointer state, gint64 iterations)
+{
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  benchmark->run(state, iterations);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  /* whatever the benchmark left in the scratch buffers of this thread */
+  scratch_buffers_explicit_gc();
+  return timespec_diff_nsec(&end, &start);
+}
+
+/* find an iteration count where a single round takes at least
+ * min_round_time_msec, so the clock resolution does not matter */
+static gint64
+_calibrate_iterations(const Benchmark *benchmark, gpointer state)
+{
+  gint64 min_round_time = (gint64) min_round_time_msec * 1000000;
+  gint64 iterations = 1;
+
+  while (iterations < BENCH_MAX_CALIBRATED_ITERATIONS)
+    {
+      gint64 elapsed = _run_timed(benchmark, state, iterations);
+
+      if (elapsed >= min_round_time)
+        break;
+
+      if (elapsed < min_round_time / 100)
+        iterations *= 10;
+      else
+        iterations = MAX(iterations + 1, iterations * min_round_time / MAX(elapsed, 1) * 11 / 10);
+    }
+  return MIN(iterations, BENCH_MAX_CALIBRATED_ITERATIONS);
+}
+
+static gint
+_compare_doubles(gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble *) a;
+  gdouble y = *(const gdouble *) b;
+
+  return (x > y) - (x < y);
+}
+
+static void
+_calculate_statistics(BenchmarkResult *result, gdouble *samples, gint num_samples)
+{
+  gdouble sum = 0, sum_of_squares = 0;
+
+  qsort(samples, num_samples, sizeof(samples[0]), _compare_doubles);
+
+  for (gint i = 0; i < num_samples; i++)
+    sum += samples[i];
+  result->mean = sum / num_samples;
+
+  for (gint i = 0; i < num_samples; i++)
+    sum_of_squares += (samples[i] - result->mean) * (samples[i] - result->mean);
+  result->stddev = num_samples > 1 ? sqrt(sum_of_squares / (num_samples - 1)) : 0;
+
+  result->min = samples[0];
+  result->max = samples[num_samples - 1];
+  if (num_samples % 2)
+    result->median = samples[num_samples / 2];
+  else
+    result->median = (samples[num_samples / 2 - 1] + samples[num_samples / 2]) / 2;
+}
+
+static gboolean
+_run_benchmark(const Benchmark *benchmark, BenchmarkResult *result)
+{
+  gpointer state = benchmark->setup ? benchmark->setup() : NULL;
+
+  if (benchmark->setup && !state)
+    {
+      fprintf(stderr, "%-40s skipped, setup failed\n", benchmark->name);
+      return FALSE;
+    }
+
+  result->benchmark = benchmark;
+  result->iterations = fixed_iterations > 0 ? fixed_iterations : _calibrate_iterations(benchmark, state);
+
+  for (gint i = 0; i < warmup_rounds; i++)
+    _run_timed(benchmark, state, result->iterations);
+
+  gdouble *samples = g_new(gdouble, rounds);
+  for (gint i = 0; i < rounds; i++)
+    samples[i] = (gdouble) _run_timed(benchmark, state, result->iterations) / result->iterations;
+  _calculate_statistics(result, samples, rounds);
+  g_free(samples);
+
+  if (benchmark->teardown)
+    benchmark->teardown(state);
+
+  fprintf(stderr, "%-40s %12.1f ns/op  (median %.1f, stddev %.1f, min %.1f, max %.1f, %d x %" G_GINT64_FORMAT ")\n",
+          benchmark->name, result->mean, result->median, result->stddev, result->min, result->max,
+          rounds, result->iterations);
+  return TRUE;
+}
+
+static void
+_append_result_json(GString *json, const BenchmarkResult *result)
+{
+  g_string_append_printf(json,
+                         "    {\"name\": \"%s\", \"iterations\": %" G_GINT64_FORMAT ", \"rounds\": %d, "
+                         "\"ns_per_op\": {\"mean\": %.3f, \"median\": %.3f, \"stddev\": %.3f, \"min\": %.3f, \"max\": %.3f}, "
+                         "\"ops_per_sec\": %.1f}",
+                         result->benchmark->name, result->iterations, rounds,
+                         result->mean, result->median, result->stddev, result->min, result->max,
+                         result->mean > 0 ? 1e9 / result->mean : 0);
+}
+
+static gboolean
+_write_report(GArray *results)
+{
+  GString *json = g_string_new("{\n  \"benchmarks\": [\n");
+
+  for (guint i = 0; i < results->len; i++)
+    {
+      _append_result_json(json, &g_array_index(results, BenchmarkResult, i));
+      g_string_append(json, i + 1 < results->len ? ",\n" : "\n");
+    }
+  g_string_append(json, "  ]\n}\n");
+
+  gboolean success = TRUE;
+  if (output_file)
+    {
+      GError *error = NULL;
+
+      success = g_file_set_contents(output_file, json->str, json->len, &error);
+      if (!success)
+        {
+          fprintf(stderr, "Error writing benchmark report: %s\n", error->message);
+          g_clear_error(&error);
+        }
+    }
+  else
+    {
+      fputs(json->str, stdout);
+    }
+
+  g_string_free(json, TRUE);
+  return success;
+}
+
+static gboolean
+_is_selected(const Benchmark *benchmark)
+{
+  return !filter_pattern || g_pattern_match_simple(filter_pattern, benchmark->name);
+}
+
+static void
+_setup_configuration(void)
+{
+  configuration = cfg_new_snippet();
+
+  cfg_load_module(configuration, "syslogformat");
+  cfg_load_module(configuration, "basicfuncs");
+  cfg_load_module(configuration, "csvparser");
+  cfg_load_module(configuration, "kvformat");
+  cfg_load_module(configuration, "json-plugin");
+
+  msg_format_options_defaults(&parse_options);
+  msg_format_options_init(&parse_options, configuration);
+}
+
+static void
+_register_benchmarks(void)
+{
+  benchmarks = g_ptr_array_new();
+
+  bench_register_msg_benchmarks();
+  bench_register_template_benchmarks();
+  bench_register_filter_benchmarks();
+  bench_register_parser_benchmarks();
+  bench_register_queue_benchmarks();
+}
+
+int
+main(int argc, char *argv[])
+{
+  GOptionContext *ctx = g_option_context_new("- syslog-ng microbenchmarks");
+  GError *error = NULL;
+
+  g_option_context_add_main_entries(ctx, bench_options, NULL);
+  if (!g_option_context_parse(ctx, &argc, &argv, &error))
+    {
+      fprintf(stderr, "Error parsing command line arguments: %s\n", error->message);
+      g_clear_error(&error);
+      g_option_context_free(ctx);
+      return 1;
+    }
+  g_option_context_free(ctx);
+
+  if (rounds <= 0 || warmup_rounds < 0 || min_round_time_msec <= 0)
+    {
+      fprintf(stderr, "Error: --rounds and --min-time must be positive, --warmup must not be negative\n");
+      return 1;
+    }
+
+  _register_benchmarks();
+
+  if (list_only)
+    {
+      for (guint i = 0; i < benchmarks->len; i++)
+        printf("%s\n", ((const Benchmark *) g_ptr_array_index(benchmarks, i))->name);
+      g_ptr_array_free(benchmarks, TRUE);
+      return 0;
+    }
+
+  app_startup();
+  msg_init(TRUE);
+  _setup_configuration();
+
+  GArray *results = g_array_new(FALSE, TRUE, sizeof(BenchmarkResult));
+  for (guint i = 0; i < benchmarks->len; i++)
+    {
+      const Benchmark *benchmark = g_ptr_array_index(benchmarks, i);
+      BenchmarkResult result = { 0 };
+
+      if (_is_selected(benchmark) && _run_benchmark(benchmark, &result))
+        g_array_append_val(results, result);
+    }
+
+  gboolean success = _write_report(results);
+
+  g_array_free(results, TRUE);
+  g_ptr_array_free(benchmarks, TRUE);
+  msg_format_options_destroy(&parse_options);
+  cfg_free(configuration);
+  configuration = NULL;
+  app_shutdown();
+  return success ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef TESTS_BENCH_BENCH_H_INCLUDED
+#define TESTS_BENCH_BENCH_H_INCLUDED
+
+#include "syslog-ng.h"
+
+/*
+ * A single microbenchmark.  setup() creates the state the benchmark runs
+ * on (returning NULL skips the benchmark, e.g. when a module is not
+ * available), run() performs the operation under test @iterations times,
+ * the harness divides the elapsed time by @iterations to get ns/op.
+ *
+ * run() is called several times with the same state (warmup, calibration
+ * and the measured rounds), so it must leave the state reusable.
+ */
+typedef struct _Benchmark
+{
+  const gchar *name;
+  gpointer (*setup)(void);
+  void (*run)(gpointer state, gint64 iterations);
+  void (*teardown)(gpointer state);
+} Benchmark;
+
+void bench_register(const Benchmark *benchmark);
+void bench_register_all(const Benchmark *benchmarks, gsize count);
+
+gpointer bench_parse_config(const gchar *config, gint context);
+gchar *bench_write_temp_file(const gchar *prefix, const gchar *contents);
+
+LogMessage *bench_construct_message(const gchar *raw_message);
+
+/* keep the compiler from optimizing away results nobody looks at */
+static inline void
+bench_consume(gconstpointer value)
+{
+  __asm__ __volatile__("" : : "r"(value) : "memory");
+}
+
+void bench_register_msg_benchmarks(void);
+void bench_register_template_benchmarks(void);
+void bench_register_filter_benchmarks(void);
+void bench_register_parser_benchmarks(void);
+void bench_register_queue_benchmarks(void);
+
+#endif
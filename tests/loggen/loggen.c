@@ -63,6 +63,7 @@ static PluginOption global_plugin_option =
 static char *sdata_value = NULL;
 static int noframing = 0;
 static int syslog_proto = 0;
+static int send_stamp = 0;
 static int quiet = 0;
 static int csv = 0;
 static int debug = 0;
@@ -99,6 +100,7 @@ static GOptionEntry loggen_options[] =
   { "csv", 'C', 0, G_OPTION_ARG_NONE, &csv, "Produce CSV output", NULL },
   { "number", 'n', 0, G_OPTION_ARG_INT, &global_plugin_option.number_of_messages, "Number of messages to generate", "<number>" },
   { "quiet", 'Q', 0, G_OPTION_ARG_NONE, &quiet, "Don't print the msg/sec data", NULL },
+  { "send-stamp", 0, 0, G_OPTION_ARG_NONE, &send_stamp, "Stamp the send time (usec since the epoch) into the messages, for measuring end-to-end latency; with --read-file, it replaces the " SEND_STAMP_PLACEHOLDER " placeholder", NULL },
   { "debug", 0, 0, G_OPTION_ARG_NONE, &debug, "Enable loggen debug messages", NULL },
   { "reconnect", 0, 0, G_OPTION_ARG_NONE, &global_plugin_option.reconnect, "Attempt to reconnect when destination connections are lost", NULL},
   { NULL }
@@ -128,6 +130,19 @@ generate_message(char *buffer, int buffer_size, ThreadData *thread_context, unsi
   if (str_len < 0)
     return -1;
 
+  if (send_stamp && read_from_file)
+    {
+      char *placeholder = g_strstr_len(buffer, str_len, SEND_STAMP_PLACEHOLDER);
+
+      if (placeholder)
+        {
+          struct timeval now;
+
+          gettimeofday(&now, NULL);
+          stamp_send_time(placeholder, &now);
+        }
+    }
+
   g_mutex_lock(message_counter_lock);
   sent_messages_num++;
   raw_message_length += str_len;
@@ -303,7 +318,8 @@ init_logline_generator(GPtrArray *plugin_array)
     syslog_proto,
     framing,
     global_plugin_option.message_length,
-    sdata_value);
+    sdata_value,
+    send_stamp);
 }
 
 static void
@@ -37,9 +37,20 @@ static int pos_timestamp1 = 0;
 static int pos_timestamp2 = 0;
 static int pos_seq = 0;
 static int pos_thread_id = 0;
+static int pos_send_stamp = 0;
+
+void
+stamp_send_time(char *dst, const struct timeval *now)
+{
+  char stamp[SEND_STAMP_LENGTH + 1];
+
+  snprintf(stamp, sizeof(stamp), "%0*" G_GINT64_FORMAT, (int) SEND_STAMP_LENGTH,
+           (gint64) now->tv_sec * G_USEC_PER_SEC + now->tv_usec);
+  memcpy(dst, stamp, SEND_STAMP_LENGTH);
+}
 
 int
-prepare_log_line_template(int syslog_proto, int framing, int message_length, char *sdata_value)
+prepare_log_line_template(int syslog_proto, int framing, int message_length, char *sdata_value, int send_stamp)
 {
   int linelen = 0;
   char padding[] = "PADD";
@@ -79,6 +90,19 @@ prepare_log_line_template(int syslog_proto, int framing, int message_length, cha
       pos_timestamp2 = 107 + hdr_len;
     }
 
+  if (send_stamp)
+    {
+      int stamplen = snprintf(line_buf_template + hdr_len + linelen, buffer_length - hdr_len - linelen,
+                              "sent: %s ", SEND_STAMP_PLACEHOLDER);
+
+      pos_send_stamp = hdr_len + linelen + 6;
+      linelen += stamplen;
+    }
+  else
+    {
+      pos_send_stamp = 0;
+    }
+
   if (linelen > message_length)
     {
       ERROR("warning: message length is too small, the minimum is %d bytes\n", linelen);
@@ -132,6 +156,9 @@ generate_log_line(char *buffer, int buffer_length, int syslog_proto, int thread_
   snprintf(thread_id_buff, sizeof(thread_id_buff), "%04d", thread_id);
   memcpy(&buffer[pos_thread_id], thread_id_buff, 4);
 
+  if (pos_send_stamp)
+    stamp_send_time(&buffer[pos_send_stamp], &now);
+
   return strlen(buffer);
 }
 
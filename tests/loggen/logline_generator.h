@@ -24,7 +24,17 @@
 #ifndef LOGLINE_GENERATOR_H_INCLUDED
 #define LOGLINE_GENERATOR_H_INCLUDED
 
+#include <sys/time.h>
+
+/* With --send-stamp, this placeholder is replaced by the time the message
+ * was generated, as microseconds since the epoch, on exactly as many
+ * digits as the placeholder is long.  Generated messages contain it as
+ * "sent: <usec>", files read with --read-file may contain it anywhere. */
+#define SEND_STAMP_PLACEHOLDER "@SENT_TIMESTAMP@"
+#define SEND_STAMP_LENGTH (sizeof(SEND_STAMP_PLACEHOLDER) - 1)
+
 int generate_log_line(char *buffer, int buffer_length, int syslog_proto, int thread_id, unsigned long seq);
-int prepare_log_line_template(int syslog_proto, int framing, int message_length, char *sdata_value);
+int prepare_log_line_template(int syslog_proto, int framing, int message_length, char *sdata_value, int send_stamp);
+void stamp_send_time(char *dst, const struct timeval *now);
 
 #endif
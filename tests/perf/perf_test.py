@@ -0,0 +1,621 @@
+#!/usr/bin/env python3
+#############################################################################
+# Copyright (c) 2021 Balabit
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 as published
+# by the Free Software Foundation, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# As an additional exemption you are allowed to compile & link against the
+# OpenSSL libraries as published by the OpenSSL project. See the file
+# COPYING for details.
+#
+#############################################################################
+#
+# End-to-end throughput and latency harness: starts syslog-ng with the
+# reference configurations in configs/, drives them with loggen over
+# loopback and measures the delivered rate, the end-to-end latency
+# percentiles, the CPU time per 100k messages and the memory usage.
+#
+# The latency is measured using the send time that loggen stamps into the
+# messages (loggen --send-stamp), against the time syslog-ng formatted the
+# message for a file destination (${C_UNIXTIME}) or the time the harness
+# received it for a network destination.
+#
+# See perf.md for details.
+import argparse
+import json
+import os
+import platform
+import re
+import selectors
+import shutil
+import signal
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+SRCDIR = os.path.dirname(os.path.abspath(__file__))
+TOP_SRCDIR = os.path.abspath(os.path.join(SRCDIR, "..", ".."))
+
+STAMP_RE = re.compile(rb"sent: (\d{16})")
+FILE_OUTPUT_RE = re.compile(rb"^(\d+\.\d+) .*?sent: (\d{16})", re.MULTILINE)
+
+INPUT_LINE_TEMPLATE = "<38>2021-10-19T12:00:00 localhost prg00000[1234]: seq: {:010d}, sent: {:016d} "
+
+JSON_INPUT_LINES = 1000
+
+
+class Scenario(object):
+    def __init__(self, name, config, loggen_args=(), uses_sink=False, file_source=False, json_input=False):
+        self.name = name
+        self.config = config
+        self.loggen_args = list(loggen_args)
+        self.uses_sink = uses_sink
+        self.file_source = file_source
+        self.json_input = json_input
+
+
+SCENARIOS = [
+    Scenario("udp-file", "udp-file.conf", loggen_args=["--inet", "--dgram"]),
+    Scenario("tcp-file", "tcp-file.conf", loggen_args=["--inet", "--stream"]),
+    Scenario("tls-tcp", "tls-tcp.conf", loggen_args=["--inet", "--stream", "--use-ssl"], uses_sink=True),
+    Scenario("file-diskq-tcp", "file-diskq-tcp.conf", uses_sink=True, file_source=True),
+    Scenario("tcp-json-file", "tcp-json-file.conf", loggen_args=["--inet", "--stream"], json_input=True),
+]
+
+
+def log(message):
+    sys.stderr.write("{} {}\n".format(time.strftime("%H:%M:%S"), message))
+    sys.stderr.flush()
+
+
+def find_free_port(sock_type=socket.SOCK_STREAM):
+    with socket.socket(socket.AF_INET, sock_type) as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return None
+    rank = int(round(p / 100.0 * len(sorted_values) + 0.5)) - 1
+    return sorted_values[min(max(rank, 0), len(sorted_values) - 1)]
+
+
+class Sink(object):
+    """TCP server receiving the output of network destinations. Every
+    received chunk is timestamped once, the send stamps found in it are
+    recorded as (received, sent) pairs."""
+
+    def __init__(self):
+        self.port = find_free_port()
+        self.samples = []
+        self.lock = threading.Lock()
+        self.running = True
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(("127.0.0.1", self.port))
+        self.listener.listen(16)
+        self.listener.setblocking(False)
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    def _run(self):
+        selector = selectors.DefaultSelector()
+        selector.register(self.listener, selectors.EVENT_READ)
+        partial_lines = {}
+
+        while self.running:
+            for key, _ in selector.select(timeout=0.1):
+                if key.fileobj is self.listener:
+                    conn, _ = self.listener.accept()
+                    conn.setblocking(False)
+                    selector.register(conn, selectors.EVENT_READ)
+                    partial_lines[conn] = b""
+                    continue
+
+                conn = key.fileobj
+                try:
+                    data = conn.recv(1 << 20)
+                except (BlockingIOError, InterruptedError):
+                    continue
+                except ConnectionError:
+                    data = b""
+
+                if not data:
+                    selector.unregister(conn)
+                    conn.close()
+                    del partial_lines[conn]
+                    continue
+
+                received = time.time()
+                data = partial_lines[conn] + data
+                complete, _, partial_lines[conn] = data.rpartition(b"\n")
+                stamps = [(received, int(m)) for m in STAMP_RE.findall(complete)]
+                with self.lock:
+                    self.samples.extend(stamps)
+
+        selector.close()
+
+    def pending(self):
+        with self.lock:
+            return len(self.samples)
+
+    def take_samples(self):
+        with self.lock:
+            samples, self.samples = self.samples, []
+        return samples
+
+    def stop(self):
+        self.running = False
+        self.thread.join()
+        self.listener.close()
+
+
+class FileOutput(object):
+    """Output of file destinations, every line starts with ${C_UNIXTIME}."""
+
+    def __init__(self, path):
+        self.path = path
+        self.offset = 0
+
+    def pending(self):
+        try:
+            with open(self.path, "rb") as f:
+                f.seek(self.offset)
+                return f.read().count(b"\n")
+        except FileNotFoundError:
+            return 0
+
+    def take_samples(self):
+        try:
+            with open(self.path, "rb") as f:
+                f.seek(self.offset)
+                data = f.read()
+        except FileNotFoundError:
+            return []
+        data = data[:data.rfind(b"\n") + 1]
+        self.offset += len(data)
+        return [(float(written), int(sent)) for written, sent in FILE_OUTPUT_RE.findall(data)]
+
+
+class ProcessMonitor(object):
+    """Samples the CPU time and the RSS of a process from /proc."""
+
+    def __init__(self, pid):
+        self.pid = pid
+        self.clock_ticks = os.sysconf("SC_CLK_TCK")
+        self.max_rss_kb = 0
+        self.running = True
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    def cpu_seconds(self):
+        with open("/proc/{}/stat".format(self.pid)) as f:
+            fields = f.read().rsplit(")", 1)[1].split()
+        # utime and stime are the 14th and 15th fields, counting the pid and comm
+        return (int(fields[11]) + int(fields[12])) / float(self.clock_ticks)
+
+    def rss_kb(self):
+        with open("/proc/{}/status".format(self.pid)) as f:
+            for line in f:
+                if line.startswith("VmRSS:"):
+                    return int(line.split()[1])
+        return 0
+
+    def reset_max_rss(self):
+        self.max_rss_kb = self.rss_kb()
+
+    def _run(self):
+        while self.running:
+            try:
+                self.max_rss_kb = max(self.max_rss_kb, self.rss_kb())
+            except (FileNotFoundError, ProcessLookupError):
+                return
+            time.sleep(0.1)
+
+    def stop(self):
+        self.running = False
+        self.thread.join()
+
+
+class FileFeeder(object):
+    """Appends stamped messages to the input file of file sources at a
+    fixed rate, in place of loggen."""
+
+    def __init__(self, path, rate, duration, size):
+        self.path = path
+        self.rate = rate
+        self.duration = duration
+        self.size = size
+        self.sent = 0
+
+    def run(self):
+        tick = 0.01
+        start = time.time()
+        next_tick = start
+        seq = 0
+        with open(self.path, "ab", buffering=0) as f:
+            while time.time() - start < self.duration:
+                expected = int((time.time() - start) * self.rate)
+                lines = []
+                now_usec = int(time.time() * 1000000)
+                while seq < expected:
+                    line = INPUT_LINE_TEMPLATE.format(seq, now_usec)
+                    lines.append(line.ljust(self.size - 1, "P") + "\n")
+                    seq += 1
+                if lines:
+                    f.write("".join(lines).encode())
+                next_tick += tick
+                time.sleep(max(0, next_tick - time.time()))
+        self.sent = seq
+        return self.sent
+
+
+class SyslogNg(object):
+    def __init__(self, args, scenario, workdir, sink_port):
+        self.args = args
+        self.scenario = scenario
+        self.workdir = workdir
+        self.port = find_free_port(socket.SOCK_DGRAM if "--dgram" in scenario.loggen_args else socket.SOCK_STREAM)
+        self.sink_port = sink_port
+        self.process = None
+
+    def _render_config(self):
+        with open(os.path.join(SRCDIR, "configs", self.scenario.config)) as f:
+            config = f.read()
+        replacements = {
+            "@VERSION@": self.args.config_version,
+            "@PORT@": str(self.port),
+            "@SINK_PORT@": str(self.sink_port or 0),
+            "@WORKDIR@": self.workdir,
+            "@TLS_KEY@": os.path.join(TOP_SRCDIR, "tests", "functional", "ssl.key"),
+            "@TLS_CERT@": os.path.join(TOP_SRCDIR, "tests", "functional", "ssl.crt"),
+        }
+        for placeholder, value in replacements.items():
+            config = config.replace(placeholder, value)
+        path = os.path.join(self.workdir, "syslog-ng.conf")
+        with open(path, "w") as f:
+            f.write(config)
+        return path
+
+    def start(self):
+        config_path = self._render_config()
+        command = [
+            self.args.syslog_ng, "-F", "--no-caps", "--enable-core",
+            "-f", config_path,
+            "-R", os.path.join(self.workdir, "syslog-ng.persist"),
+            "-p", os.path.join(self.workdir, "syslog-ng.pid"),
+            "-c", os.path.join(self.workdir, "syslog-ng.ctl"),
+        ]
+        if self.args.module_path:
+            command += ["--module-path", self.args.module_path]
+
+        stderr = open(os.path.join(self.workdir, "syslog-ng.stderr"), "w")
+        self.process = subprocess.Popen(command, stdout=stderr, stderr=stderr)
+        stderr.close()
+
+        control_socket = os.path.join(self.workdir, "syslog-ng.ctl")
+        deadline = time.time() + 10
+        while not os.path.exists(control_socket):
+            if self.process.poll() is not None or time.time() > deadline:
+                raise RuntimeError("syslog-ng failed to start, see {}".format(os.path.join(self.workdir, "syslog-ng.stderr")))
+            time.sleep(0.1)
+        # the control socket is opened before the sources, give them some time
+        time.sleep(1)
+
+    def stop(self):
+        if not self.process:
+            return
+        self.process.send_signal(signal.SIGTERM)
+        try:
+            self.process.wait(timeout=30)
+        except subprocess.TimeoutExpired:
+            self.process.kill()
+            self.process.wait()
+        self.process = None
+
+
+def generate_json_input(path):
+    with open(path, "w") as f:
+        for i in range(JSON_INPUT_LINES):
+            payload = json.dumps({
+                "sent": "@SENT_TIMESTAMP@", "seq": i, "host": "localhost", "program": "prg00000",
+                "user": "user{}".format(i % 100), "action": "login", "result": "success",
+            })
+            line = "<38>2021-10-19T12:00:00 localhost prg00000[1234]: {}".format(payload)
+            f.write(line + "\n")
+
+
+def run_loggen(args, scenario, syslog_ng, rate, workdir):
+    command = [args.loggen, "--quiet", "--send-stamp", "--rate", str(rate), "--interval", str(args.duration),
+               "--size", str(args.size), "--active-connections", "1"]
+    command += scenario.loggen_args
+    if scenario.json_input:
+        input_path = os.path.join(workdir, "input.json-lines")
+        generate_json_input(input_path)
+        command += ["--read-file", input_path, "--dont-parse", "--loop-reading"]
+    command += ["127.0.0.1", str(syslog_ng.port)]
+
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    match = re.search(r"average rate = [0-9.]+ msg/sec, count=(\d+)", result.stdout)
+    if not match:
+        raise RuntimeError("Unexpected loggen output: {}".format(result.stdout))
+    return int(match.group(1))
+
+
+def wait_for_delivery(output, expected):
+    """Wait until everything sent in this step is delivered, or nothing
+    arrived for 2 seconds (e.g. UDP drops)."""
+    last_count, last_change = -1, time.time()
+    deadline = time.time() + 60
+    while time.time() < deadline:
+        count = output.pending()
+        if count >= expected:
+            return
+        if count != last_count:
+            last_count, last_change = count, time.time()
+        elif time.time() - last_change > 2:
+            return
+        time.sleep(0.1)
+
+
+def measure(args, scenario, syslog_ng, monitor, output, rate, workdir):
+    monitor.reset_max_rss()
+    cpu_before = monitor.cpu_seconds()
+
+    if scenario.file_source:
+        sent = FileFeeder(os.path.join(workdir, "input.log"), rate, args.duration, args.size).run()
+    else:
+        sent = run_loggen(args, scenario, syslog_ng, rate, workdir)
+
+    wait_for_delivery(output, sent)
+    cpu_used = monitor.cpu_seconds() - cpu_before
+
+    samples = output.take_samples()
+    delivered = len(samples)
+
+    result = {
+        "scenario": scenario.name,
+        "offered_rate": rate,
+        "duration": args.duration,
+        "sent": sent,
+        "delivered": delivered,
+        "lost": max(sent - delivered, 0),
+        "sustained_rate": None,
+        "latency_usec": {"p50": None, "p99": None, "p999": None, "max": None},
+        "cpu_sec_per_100k": cpu_used / delivered * 100000 if delivered else None,
+        "max_rss_kb": monitor.max_rss_kb,
+        "rss_kb": monitor.rss_kb(),
+    }
+    if samples:
+        first_sent = min(sent_usec for _, sent_usec in samples) / 1e6
+        last_delivered = max(delivered_at for delivered_at, _ in samples)
+        if last_delivered > first_sent:
+            result["sustained_rate"] = delivered / (last_delivered - first_sent)
+
+        latencies = sorted(max(0, int(delivered_at * 1e6) - sent_usec) for delivered_at, sent_usec in samples)
+        result["latency_usec"] = {
+            "p50": percentile(latencies, 50),
+            "p99": percentile(latencies, 99),
+            "p999": percentile(latencies, 99.9),
+            "max": latencies[-1],
+        }
+    return result
+
+
+def format_result(result):
+    latency = result["latency_usec"]
+
+    def fmt(value, spec):
+        return format(value, spec) if value is not None else "-"
+
+    return "{:<16} {:>9} {:>12} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}".format(
+        result["scenario"] + (" (ramp)" if result.get("ramp") else ""), result["offered_rate"],
+        fmt(result["sustained_rate"], ".0f"), result["lost"],
+        fmt(latency["p50"], "d"), fmt(latency["p99"], "d"), fmt(latency["p999"], "d"),
+        fmt(result["cpu_sec_per_100k"], ".3f"), result["max_rss_kb"],
+    )
+
+
+RESULT_HEADER = "{:<16} {:>9} {:>12} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}".format(
+    "scenario", "rate", "sustained", "lost", "p50 usec", "p99 usec", "p999 usec", "cpu/100k", "rss kB",
+)
+
+
+def run_scenario(args, scenario, rates, ramp=False):
+    """Run the given rates on a single syslog-ng instance, one after the other."""
+    workdir = tempfile.mkdtemp(prefix="syslog-ng-perf-{}-".format(scenario.name), dir=args.workdir)
+    sink = Sink() if scenario.uses_sink else None
+    syslog_ng = SyslogNg(args, scenario, workdir, sink.port if sink else None)
+    results = []
+    try:
+        syslog_ng.start()
+        monitor = ProcessMonitor(syslog_ng.process.pid)
+        output = sink if sink else FileOutput(os.path.join(workdir, "output.log"))
+        try:
+            for rate in rates:
+                log("{}: running at {} msg/sec for {} sec".format(scenario.name, rate, args.duration))
+                result = measure(args, scenario, syslog_ng, monitor, output, rate, workdir)
+                result["ramp"] = ramp
+                log(format_result(result))
+                results.append(result)
+        finally:
+            monitor.stop()
+    finally:
+        syslog_ng.stop()
+        if sink:
+            sink.stop()
+        if not args.keep_workdir:
+            shutil.rmtree(workdir, ignore_errors=True)
+    return results
+
+
+def median_of(results, key_func):
+    values = [key_func(r) for r in results if key_func(r) is not None]
+    return statistics.median(values) if values else None
+
+
+def summarize(results):
+    """Median of the repeated runs of the same scenario and rate."""
+    groups = {}
+    for result in results:
+        groups.setdefault((result["scenario"], result["offered_rate"], result["ramp"]), []).append(result)
+
+    summary = []
+    for (scenario, rate, ramp), runs in groups.items():
+        summary.append({
+            "scenario": scenario,
+            "offered_rate": rate,
+            "ramp": ramp,
+            "runs": len(runs),
+            "sustained_rate": median_of(runs, lambda r: r["sustained_rate"]),
+            "lost": median_of(runs, lambda r: r["lost"]),
+            "latency_usec": {
+                p: median_of(runs, lambda r, p=p: r["latency_usec"][p]) for p in ("p50", "p99", "p999", "max")
+            },
+            "cpu_sec_per_100k": median_of(runs, lambda r: r["cpu_sec_per_100k"]),
+            "max_rss_kb": median_of(runs, lambda r: r["max_rss_kb"]),
+        })
+    return summary
+
+
+def compare(summary, baseline_path):
+    with open(baseline_path) as f:
+        baseline = {(s["scenario"], s["offered_rate"], s["ramp"]): s for s in json.load(f)["summary"]}
+
+    print("\nChange compared to {}:".format(baseline_path))
+    print("{:<16} {:>9} {:>12} {:>10} {:>10} {:>10}".format("scenario", "rate", "sustained", "p99", "cpu/100k", "rss"))
+
+    def change(new, old):
+        if new is None or not old:
+            return "-"
+        return "{:+.1f}%".format((new - old) * 100.0 / old)
+
+    for s in summary:
+        old = baseline.get((s["scenario"], s["offered_rate"], s["ramp"]))
+        if not old:
+            continue
+        print("{:<16} {:>9} {:>12} {:>10} {:>10} {:>10}".format(
+            s["scenario"] + (" (ramp)" if s["ramp"] else ""), s["offered_rate"],
+            change(s["sustained_rate"], old["sustained_rate"]),
+            change(s["latency_usec"]["p99"], old["latency_usec"]["p99"]),
+            change(s["cpu_sec_per_100k"], old["cpu_sec_per_100k"]),
+            change(s["max_rss_kb"], old["max_rss_kb"]),
+        ))
+
+
+def parse_ramp(value):
+    try:
+        start, stop, step = (int(v) for v in value.split(":"))
+    except ValueError:
+        raise argparse.ArgumentTypeError("ramp must be START:STOP:STEP")
+    if start <= 0 or step <= 0 or stop < start:
+        raise argparse.ArgumentTypeError("ramp must be START:STOP:STEP with positive values and STOP >= START")
+    return list(range(start, stop + 1, step))
+
+
+def get_config_version(syslog_ng):
+    output = subprocess.run([syslog_ng, "--version"], stdout=subprocess.PIPE, universal_newlines=True).stdout
+    match = re.search(r"Config version: *([0-9.]+)", output)
+    if not match:
+        raise RuntimeError("Unable to determine the config version of {}".format(syslog_ng))
+    return match.group(1), output
+
+
+def intree_module_path(top_builddir):
+    modules_dir = os.path.join(top_builddir, "modules")
+    paths = []
+    for name in sorted(os.listdir(modules_dir)):
+        paths += [os.path.join(modules_dir, name, ".libs"), os.path.join(modules_dir, name)]
+    return ":".join(paths)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="syslog-ng end-to-end throughput and latency harness")
+    parser.add_argument("--syslog-ng", default=shutil.which("syslog-ng") or "syslog-ng", help="syslog-ng binary")
+    parser.add_argument("--loggen", default=shutil.which("loggen") or "loggen", help="loggen binary")
+    parser.add_argument("--builddir", help="use the syslog-ng, loggen and modules of this build tree")
+    parser.add_argument("--module-path", help="module path passed to syslog-ng")
+    parser.add_argument("--scenario", action="append", choices=[s.name for s in SCENARIOS],
+                        help="scenario to run, can be repeated (default: all)")
+    parser.add_argument("--rate", action="append", type=int,
+                        help="fixed rate (msg/sec) to run, syslog-ng is restarted for each, can be repeated")
+    parser.add_argument("--ramp", type=parse_ramp, help="START:STOP:STEP rates run back-to-back on the same syslog-ng")
+    parser.add_argument("--duration", type=int, default=10, help="seconds to send messages at each rate")
+    parser.add_argument("--size", type=int, default=256, help="message size")
+    parser.add_argument("--repeat", type=int, default=1, help="repeat every fixed rate run this many times")
+    parser.add_argument("--output", help="write the JSON report to this file")
+    parser.add_argument("--compare", help="compare the results with a previous JSON report")
+    parser.add_argument("--workdir", help="directory for the temporary files (default: $TMPDIR)")
+    parser.add_argument("--keep-workdir", action="store_true", help="keep the configs, logs and outputs")
+    args = parser.parse_args()
+
+    if args.builddir:
+        args.syslog_ng = os.path.join(args.builddir, "syslog-ng", "syslog-ng")
+        args.loggen = os.path.join(args.builddir, "tests", "loggen", "loggen")
+        if not args.module_path:
+            args.module_path = intree_module_path(args.builddir)
+    if not args.rate and not args.ramp:
+        args.rate = [10000]
+    return args
+
+
+def main():
+    args = parse_args()
+    args.config_version, version_output = get_config_version(args.syslog_ng)
+    scenarios = [s for s in SCENARIOS if not args.scenario or s.name in args.scenario]
+
+    results = []
+    for scenario in scenarios:
+        for rate in args.rate or []:
+            for _ in range(args.repeat):
+                results += run_scenario(args, scenario, [rate])
+        if args.ramp:
+            results += run_scenario(args, scenario, args.ramp, ramp=True)
+
+    summary = summarize(results)
+    report = {
+        "environment": {
+            "hostname": platform.node(),
+            "kernel": platform.release(),
+            "machine": platform.machine(),
+            "cpus": os.cpu_count(),
+            "syslog_ng_version": version_output.splitlines()[0] if version_output else None,
+        },
+        "parameters": {
+            "duration": args.duration,
+            "size": args.size,
+            "repeat": args.repeat,
+        },
+        "results": results,
+        "summary": summary,
+    }
+
+    print(RESULT_HEADER)
+    for s in summary:
+        print(format_result(s))
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2)
+    if args.compare:
+        compare(summary, args.compare)
+
+
+if __name__ == "__main__":
+    main()
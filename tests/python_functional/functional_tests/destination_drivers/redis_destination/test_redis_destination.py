@@ -0,0 +1,58 @@
+#!/usr/bin/env python
+#############################################################################
+# Copyright (c) 2020 One Identity
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 as published
+# by the Free Software Foundation, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# As an additional exemption you are allowed to compile & link against the
+# OpenSSL libraries as published by the OpenSSL project. See the file
+# COPYING for details.
+#
+#############################################################################
+from src.helpers.redis.conftest import *  # noqa:F403, F401
+
+
+def _create_redis_destination(config, redis_server, **options):
+    return config.create_redis_destination(
+        host='"127.0.0.1"',
+        port=redis_server.get_port(),
+        command='"LPUSH", "syslog-ng", "$MSG"',
+        **options
+    )
+
+
+def test_redis_destination_pipelined_batch(config, syslog_ng, redis_server):
+    counter = 100
+    generator_source = config.create_example_msg_generator_source(num=counter, freq=0.0001, template=config.stringify("message text"))
+    redis_destination = _create_redis_destination(config, redis_server, batch_lines=10, batch_timeout=100)
+    config.create_logpath(statements=[generator_source, redis_destination])
+
+    syslog_ng.start(config)
+
+    commands = redis_server.get_commands(counter)
+    assert commands == [["LPUSH", "syslog-ng", "message text"]] * counter
+
+
+def test_redis_destination_rejected_command_is_dropped(config, syslog_ng, redis_server):
+    redis_server.reply_error_for("rejected", "WRONGTYPE Operation against a key holding the wrong kind of value")
+    generator_source = config.create_example_msg_generator_source(num=1, template=config.stringify("rejected"))
+    accepted_source = config.create_example_msg_generator_source(num=1, template=config.stringify("accepted"))
+    redis_destination = _create_redis_destination(config, redis_server, batch_lines=10, batch_timeout=100)
+    config.create_logpath(statements=[generator_source, accepted_source, redis_destination])
+
+    syslog_ng.start(config)
+
+    commands = redis_server.get_commands(2)
+    assert sorted(command[-1] for command in commands) == ["accepted", "rejected"]
+    assert redis_destination.get_stats()["dropped"] == 1
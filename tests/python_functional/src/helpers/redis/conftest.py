@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+#############################################################################
+# Copyright (c) 2020 One Identity
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 as published
+# by the Free Software Foundation, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# As an additional exemption you are allowed to compile & link against the
+# OpenSSL libraries as published by the OpenSSL project. See the file
+# COPYING for details.
+#
+#############################################################################
+import socket
+import threading
+
+import pytest
+
+from src.common.blocking import wait_until_true
+
+
+class FakeRedisServer(object):
+    """Minimal stand-in for redis-server, speaking just enough of RESP to
+    accept pipelined commands and record them in arrival order."""
+
+    def __init__(self, port):
+        self.port = port
+        self.commands = []
+        self.error_replies = {}
+        self.lock = threading.Lock()
+        self.listener = None
+        self.thread = None
+        self.running = False
+
+    def start(self):
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(("127.0.0.1", self.port))
+        self.listener.listen(5)
+        self.listener.settimeout(0.1)
+        self.running = True
+        self.thread = threading.Thread(target=self.__serve)
+        self.thread.start()
+
+    def stop(self):
+        self.running = False
+        self.thread.join()
+        self.listener.close()
+
+    def get_port(self):
+        return self.port
+
+    def reply_error_for(self, value, error):
+        self.error_replies[value] = error
+
+    def get_commands(self, counter):
+        def enough_commands():
+            with self.lock:
+                return len(self.commands) >= counter
+
+        assert wait_until_true(enough_commands)
+        with self.lock:
+            return list(self.commands)
+
+    def __serve(self):
+        while self.running:
+            try:
+                conn, _ = self.listener.accept()
+            except socket.timeout:
+                continue
+            conn.settimeout(0.1)
+            self.__handle_connection(conn)
+            conn.close()
+
+    @staticmethod
+    def __parse_command(buf):
+        lines = buf.split(b"\r\n")
+        if len(lines) < 2:
+            return None, buf
+        argc = int(lines[0][1:])
+        if len(lines) < 2 * argc + 2:
+            return None, buf
+        argv = [arg.decode() for arg in lines[2:2 * argc + 1:2]]
+        return argv, b"\r\n".join(lines[2 * argc + 1:])
+
+    def __reply(self, argv):
+        if argv[0].upper() == "PING":
+            return b"+PONG\r\n"
+        if argv[0].upper() == "AUTH":
+            return b"+OK\r\n"
+
+        with self.lock:
+            self.commands.append(argv)
+        error = self.error_replies.get(argv[-1])
+        if error:
+            return "-{}\r\n".format(error).encode()
+        return b":1\r\n"
+
+    def __handle_connection(self, conn):
+        buf = b""
+        while self.running:
+            try:
+                data = conn.recv(65536)
+            except socket.timeout:
+                continue
+            if not data:
+                return
+            buf += data
+            replies = b""
+            argv, buf = self.__parse_command(buf)
+            while argv is not None:
+                replies += self.__reply(argv)
+                argv, buf = self.__parse_command(buf)
+            conn.sendall(replies)
+
+
+@pytest.fixture
+def redis_server(port_allocator):
+    server = FakeRedisServer(port_allocator())
+    server.start()
+    yield server
+    server.stop()